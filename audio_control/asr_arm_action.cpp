@@ -3,9 +3,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
-#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -19,31 +19,55 @@
 #include <rnnoise.h>
 #include <whisper.h>
 
+#include "log_mel.hpp"
+#include "mic_capture.hpp"
+#include "spectral_denoiser.hpp"
+#include "speech_endpointer.hpp"
+#include "utterance_filter.hpp"
+#include "wav_writer.hpp"
+
 namespace {
-constexpr int kMicCaptureRate = 48000;
 constexpr int kMicWhisperRate = 16000;
-constexpr int kMicChannels = 1;
-constexpr int kMicBitsPerSample = 16;
-constexpr int kMicChunkSeconds = 1;
+// The mic is read in short chunks so the endpointer reacts within one.
+constexpr int kMicChunkMs = 100;
 constexpr int kMicMaxRecordSeconds = 2;
 constexpr int kMicSilenceStopMs = 300;
-constexpr float kMicVadThresholdStart = 0.0f;
-constexpr float kMicVadThresholdContinue = 0.0f;
-constexpr int kMicRmsThreshold = 1200;
+// Minimum denoiser speech probability for a frame to count as speech
+// (0 = level only).
+constexpr float kMicVadThreshold = 0.0f;
+// Endpointer stats (ASR calls per hour, noise floor) every N utterances.
+constexpr uint64_t kEndpointerStatsEvery = 20;
+// Shared log-mel frames kept for the utterance filter and Whisper; more
+// than the longest utterance plus preroll.
+constexpr size_t kMelRingFrames = 500;
 #ifndef WHISPER_MODEL_PATH
 #define WHISPER_MODEL_PATH "thirdparty/whisper.cpp/models/ggml-tiny.en.bin"
 #endif
 constexpr const char* kDefaultModelPath = WHISPER_MODEL_PATH;
-constexpr const char* kLocalMicChunkPcm = "/tmp/whisper_mic_chunk.pcm";
 constexpr const char* kAlsaDevice = "plughw:0,0";
 
+// Mic backend and denoiser chosen by MIC_SOURCE / MIC_DENOISE.
+g1_common::MicPipeline g_mic_pipeline;
+g1_common::CaptureSource* g_mic = nullptr;
+g1_common::SpectralDenoiser* g_spectral_denoiser = nullptr;
+g1_common::SpeechEndpointer* g_endpointer = nullptr;
+// Log-mel frames of the denoised 16 kHz stream; capture thread only.
+g1_common::MelStream* g_mel = nullptr;
+g1_common::UtteranceFilter* g_utterance_filter = nullptr;
 unitree::robot::g1::G1ArmActionClient* g_client = nullptr;
 unitree::robot::g1::AudioClient* g_audio_client = nullptr;
 whisper_context* g_whisper_ctx = nullptr;
 DenoiseState* g_rnnoise_state = nullptr;
 std::mutex g_queue_mutex;
 std::condition_variable g_queue_cv;
-std::deque<std::vector<int16_t>> g_pcm_queue;
+// An utterance at 16 kHz with its log-mel frames (empty if the ring
+// had already dropped them).
+struct QueuedUtterance {
+  std::vector<int16_t> pcm;
+  std::vector<float> mel;
+  bool marginal = true;  // SpeechVerdict::marginal
+};
+std::deque<QueuedUtterance> g_utterance_queue;
 std::atomic<bool> g_capture_running(true);
 
 std::string Normalize(const std::string& input) {
@@ -250,16 +274,14 @@ void MaybeProcessCommand(const std::string& transcript, bool is_test) {
   ProcessCommandText(transcript);
 }
 
-std::string TranscribeWithWhisper(const std::vector<int16_t>& pcm_data) {
-  if (g_whisper_ctx == nullptr || pcm_data.empty()) {
+// Transcribes from the capture thread's log-mel frames when there are
+// some and the model takes that many bands, so Whisper doesn't redo the
+// STFT (plus 30 s of padding) per call; otherwise from the audio.
+std::string TranscribeWithWhisper(const QueuedUtterance& utterance) {
+  if (g_whisper_ctx == nullptr || utterance.pcm.empty()) {
     return "";
   }
 
-  std::vector<float> samples(pcm_data.size());
-  for (size_t i = 0; i < pcm_data.size(); ++i) {
-    samples[i] = static_cast<float>(pcm_data[i]) / 32768.0f;
-  }
-
   whisper_full_params params =
       whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
   params.print_progress = false;
@@ -268,8 +290,28 @@ std::string TranscribeWithWhisper(const std::vector<int16_t>& pcm_data) {
   params.translate = false;
   params.language = "en";
 
-  int ret = whisper_full(g_whisper_ctx, params, samples.data(),
-                         static_cast<int>(samples.size()));
+  const int n_mels = whisper_model_n_mels(g_whisper_ctx);
+  int ret = 0;
+  if (!utterance.mel.empty() && n_mels > 0 &&
+      utterance.mel.size() % n_mels == 0 &&
+      static_cast<size_t>(n_mels) == g1_common::LogMelOptions().n_mels) {
+    const size_t frames = utterance.mel.size() / n_mels;
+    int n_len = 0;
+    const std::vector<float> mel =
+        g1_common::ToWhisperMel(utterance.mel, n_mels, &n_len);
+    params.duration_ms = static_cast<int>(frames * 10);
+    ret = whisper_set_mel(g_whisper_ctx, mel.data(), n_len, n_mels);
+    if (ret == 0) {
+      ret = whisper_full(g_whisper_ctx, params, nullptr, 0);
+    }
+  } else {
+    std::vector<float> samples(utterance.pcm.size());
+    for (size_t i = 0; i < utterance.pcm.size(); ++i) {
+      samples[i] = static_cast<float>(utterance.pcm[i]) / 32768.0f;
+    }
+    ret = whisper_full(g_whisper_ctx, params, samples.data(),
+                       static_cast<int>(samples.size()));
+  }
   if (ret != 0) {
     std::cout << "Whisper transcribe error: " << ret << std::endl;
     return "";
@@ -310,19 +352,21 @@ RnnoiseChunkResult DenoiseChunk48k(const std::vector<int16_t>& pcm_data) {
     size_t frame_count =
         remaining < static_cast<size_t>(kFrameSize) ? remaining : kFrameSize;
     for (size_t i = 0; i < frame_count; ++i) {
-      in_frame[i] = static_cast<float>(pcm_data[offset + i]) / 32768.0f;
+      // RNNoise works on int16-range floats; at +-1 it hears silence and
+      // its VAD stays near 0.
+      in_frame[i] = static_cast<float>(pcm_data[offset + i]);
     }
     float vad = rnnoise_process_frame(g_rnnoise_state, out_frame, in_frame);
     vad_sum += vad;
     vad_frames++;
     for (size_t i = 0; i < frame_count; ++i) {
       float v = out_frame[i];
-      if (v > 1.0f) {
-        v = 1.0f;
-      } else if (v < -1.0f) {
-        v = -1.0f;
+      if (v > 32767.0f) {
+        v = 32767.0f;
+      } else if (v < -32768.0f) {
+        v = -32768.0f;
       }
-      result.denoised.push_back(static_cast<int16_t>(v * 32767.0f));
+      result.denoised.push_back(static_cast<int16_t>(v));
     }
     offset += frame_count;
   }
@@ -333,6 +377,26 @@ RnnoiseChunkResult DenoiseChunk48k(const std::vector<int16_t>& pcm_data) {
   return result;
 }
 
+// Denoises a captured chunk with the configured stage. Without one there
+// is no VAD (avg_vad < 0), so the endpointer goes on level alone.
+RnnoiseChunkResult PrepareChunk(std::vector<int16_t> chunk) {
+  RnnoiseChunkResult result;
+  switch (g_mic_pipeline.denoise) {
+    case g1_common::MicDenoise::kRnnoise:
+      return DenoiseChunk48k(chunk);
+    case g1_common::MicDenoise::kSpectral:
+      result.denoised.reserve(chunk.size());
+      result.avg_vad = g_spectral_denoiser->Process(
+          chunk.data(), chunk.size(), &result.denoised);
+      return result;
+    case g1_common::MicDenoise::kOff:
+      break;
+  }
+  result.denoised = std::move(chunk);
+  result.avg_vad = -1.0f;
+  return result;
+}
+
 std::vector<int16_t> DownsampleTo16k(const std::vector<int16_t>& pcm_data) {
   if (pcm_data.empty()) {
     return {};
@@ -345,75 +409,6 @@ std::vector<int16_t> DownsampleTo16k(const std::vector<int16_t>& pcm_data) {
   return out;
 }
 
-void WriteWav(const std::string& path,
-              const std::vector<int16_t>& pcm_data,
-              int sample_rate_hz) {
-  std::ofstream out(path, std::ios::binary);
-  if (!out) {
-    std::cout << "Failed to open " << path << " for writing." << std::endl;
-    return;
-  }
-
-  uint32_t data_size = static_cast<uint32_t>(pcm_data.size() * sizeof(int16_t));
-  uint32_t riff_size = 36 + data_size;
-  uint16_t audio_format = 1;
-  uint16_t num_channels = kMicChannels;
-  uint32_t sample_rate = static_cast<uint32_t>(sample_rate_hz);
-  uint16_t bits_per_sample = kMicBitsPerSample;
-  uint32_t byte_rate = sample_rate * num_channels * bits_per_sample / 8;
-  uint16_t block_align = num_channels * bits_per_sample / 8;
-
-  out.write("RIFF", 4);
-  out.write(reinterpret_cast<char*>(&riff_size), sizeof(riff_size));
-  out.write("WAVE", 4);
-  out.write("fmt ", 4);
-  uint32_t fmt_chunk_size = 16;
-  out.write(reinterpret_cast<char*>(&fmt_chunk_size), sizeof(fmt_chunk_size));
-  out.write(reinterpret_cast<char*>(&audio_format), sizeof(audio_format));
-  out.write(reinterpret_cast<char*>(&num_channels), sizeof(num_channels));
-  out.write(reinterpret_cast<char*>(&sample_rate), sizeof(sample_rate));
-  out.write(reinterpret_cast<char*>(&byte_rate), sizeof(byte_rate));
-  out.write(reinterpret_cast<char*>(&block_align), sizeof(block_align));
-  out.write(reinterpret_cast<char*>(&bits_per_sample), sizeof(bits_per_sample));
-  out.write("data", 4);
-  out.write(reinterpret_cast<char*>(&data_size), sizeof(data_size));
-  out.write(reinterpret_cast<const char*>(pcm_data.data()), data_size);
-}
-
-std::vector<int16_t> ReadRawPcm(const std::string& path) {
-  std::ifstream in(path, std::ios::binary);
-  if (!in) {
-    std::cout << "Failed to open PCM file: " << path << std::endl;
-    return {};
-  }
-  in.seekg(0, std::ios::end);
-  std::streamsize size = in.tellg();
-  in.seekg(0, std::ios::beg);
-  if (size <= 0 || size % static_cast<std::streamsize>(sizeof(int16_t)) != 0) {
-    std::cout << "Invalid PCM size: " << size << std::endl;
-    return {};
-  }
-  std::vector<int16_t> data(static_cast<size_t>(size / sizeof(int16_t)));
-  if (!in.read(reinterpret_cast<char*>(data.data()), size)) {
-    std::cout << "Failed to read PCM data." << std::endl;
-    return {};
-  }
-  return data;
-}
-
-int ComputeRms(const std::vector<int16_t>& pcm) {
-  if (pcm.empty()) {
-    return 0;
-  }
-  double sum_sq = 0.0;
-  for (int16_t sample : pcm) {
-    double v = static_cast<double>(sample);
-    sum_sq += v * v;
-  }
-  double rms = std::sqrt(sum_sq / pcm.size());
-  return static_cast<int>(rms);
-}
-
 std::string RunCommand(const std::string& cmd) {
   std::string output;
   FILE* pipe = popen(cmd.c_str(), "r");
@@ -428,77 +423,82 @@ std::string RunCommand(const std::string& cmd) {
   return output;
 }
 
-std::vector<int16_t> RecordLocalMicPcmDynamic() {
-  std::cout << "Local mic: using arecord default device." << std::endl;
+// Reads the mic in short chunks and feeds them, denoised, to the shared
+// log-mel stream and the endpointer until the latter completes an
+// utterance.
+g1_common::EndpointedUtterance RecordMicPcmDynamic() {
+  std::cout << "Listening on " << g_mic->name()
+            << " (denoise: " << g_mic_pipeline.denoise_name() << ")."
+            << std::endl;
   std::cout.flush();
-  std::vector<int16_t> result;
+  const size_t chunk_samples =
+      static_cast<size_t>(g_mic->sample_rate()) * kMicChunkMs / 1000;
+  std::vector<int16_t> chunk(chunk_samples);
   bool started = false;
-  int silence_ms = 0;
-  int captured_ms = 0;
-
-  while (captured_ms < kMicMaxRecordSeconds * 1000) {
-    std::string cmd =
-        std::string("arecord -q -D ") + kAlsaDevice + " -f S16_LE -r " +
-        std::to_string(kMicCaptureRate) + " -c 1 -d " +
-        std::to_string(kMicChunkSeconds) + " -t raw " + kLocalMicChunkPcm;
-    int ret = std::system(cmd.c_str());
-    if (ret != 0) {
-      std::cout << "arecord failed, ret=" << ret << std::endl;
-      break;
-    }
-    std::vector<int16_t> chunk = ReadRawPcm(kLocalMicChunkPcm);
-    std::remove(kLocalMicChunkPcm);
-    if (chunk.empty()) {
+  while (g_capture_running.load()) {
+    const size_t read =
+        g_mic->Read(chunk.data(), chunk.size(),
+                    std::chrono::milliseconds(kMicChunkMs + 1000));
+    if (read == 0) {
+      std::cout << "Mic stream stalled." << std::endl;
       break;
     }
 
-    RnnoiseChunkResult denoised = DenoiseChunk48k(chunk);
-    if (denoised.denoised.empty()) {
-      break;
+    RnnoiseChunkResult denoised = PrepareChunk(
+        std::vector<int16_t>(chunk.begin(), chunk.begin() + read));
+    const std::vector<int16_t> pcm16 =
+        g_mic->sample_rate() == kMicWhisperRate
+            ? denoised.denoised
+            : DownsampleTo16k(denoised.denoised);
+    g_mel->Push(pcm16.data(), pcm16.size());
+    if (g_endpointer->Push(denoised.denoised.data(), denoised.denoised.size(),
+                           denoised.avg_vad)) {
+      std::cout << "Speech end detected." << std::endl;
+      return g_endpointer->TakeUtterance();
     }
-    int rms = ComputeRms(denoised.denoised);
-    if (!started) {
-      if (denoised.avg_vad >= kMicVadThresholdStart &&
-          rms >= kMicRmsThreshold) {
-        started = true;
-        std::cout << "Speech start detected." << std::endl;
-        result.insert(result.end(), denoised.denoised.begin(),
-                      denoised.denoised.end());
-      }
-    } else {
-      result.insert(result.end(), denoised.denoised.begin(),
-                    denoised.denoised.end());
-      if (denoised.avg_vad < kMicVadThresholdContinue ||
-          rms < kMicRmsThreshold) {
-        silence_ms += kMicChunkSeconds * 1000;
-      } else {
-        silence_ms = 0;
-      }
-      if (silence_ms >= kMicSilenceStopMs) {
-        std::cout << "Speech end detected." << std::endl;
-        break;
-      }
+    if (g_endpointer->in_speech() != started) {
+      started = g_endpointer->in_speech();
+      std::cout << (started ? "Speech start detected."
+                            : "Speech too short, ignored.")
+                << std::endl;
     }
-    captured_ms += kMicChunkSeconds * 1000;
   }
-
-  if (!started) {
-    return {};
-  }
-
-  return result;
+  return {};
 }
 
 void CaptureThread() {
   while (g_capture_running.load()) {
-    std::vector<int16_t> pcm_data = RecordLocalMicPcmDynamic();
-    if (pcm_data.empty()) {
+    g1_common::EndpointedUtterance endpointed = RecordMicPcmDynamic();
+    if (endpointed.pcm.empty()) {
       unitree::common::Sleep(1);
       continue;
     }
+    // The endpointer is only touched on this thread.
+    if (g_endpointer->stats().utterances % kEndpointerStatsEvery == 0) {
+      g_endpointer->PrintStats();
+      g_utterance_filter->PrintStats();
+    }
+    QueuedUtterance utterance;
+    utterance.pcm = g_mic->sample_rate() == kMicWhisperRate
+                        ? std::move(endpointed.pcm)
+                        : DownsampleTo16k(endpointed.pcm);
+    // The frames were computed before the AGC gain; apply it in the log
+    // domain.
+    g_mel->ReadSpan(endpointed.start_sample * kMicWhisperRate /
+                        g_mic->sample_rate(),
+                    utterance.pcm.size(), endpointed.gain_db / 10.f,
+                    &utterance.mel);
+    const g1_common::SpeechVerdict verdict =
+        g_utterance_filter->CheckAudio(utterance.mel, endpointed.vad);
+    if (!verdict.speech) {
+      std::cout << "Not speech (" << verdict.reason << "), skipping Whisper."
+                << std::endl;
+      continue;
+    }
+    utterance.marginal = verdict.marginal;
     {
       std::lock_guard<std::mutex> lock(g_queue_mutex);
-      g_pcm_queue.push_back(std::move(pcm_data));
+      g_utterance_queue.push_back(std::move(utterance));
     }
     g_queue_cv.notify_one();
   }
@@ -510,6 +510,11 @@ int main(int argc, char const* argv[]) {
     std::cout
         << "Usage: g1_asr_arm_action [NetWorkInterface(eth0)|TEST] [model_path]"
         << std::endl;
+    std::cout << "Optional: MIC_SOURCE=alsa|multicast (default: alsa)"
+              << std::endl;
+    std::cout << "Optional: MIC_DENOISE=rnnoise|spectral|off (default: "
+                 "rnnoise for alsa, off for multicast)"
+              << std::endl;
     return 1;
   }
 
@@ -543,6 +548,36 @@ int main(int argc, char const* argv[]) {
     unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
   }
 
+  std::unique_ptr<g1_common::CaptureSource> mic;
+  if (g1_common::MicPipelineFromEnv(&g_mic_pipeline)) {
+    mic = g1_common::MakeCaptureSource(g_mic_pipeline, kAlsaDevice,
+                                       is_test ? "" : argv[1]);
+  }
+  g1_common::SpectralDenoiser spectral_denoiser;
+  g_spectral_denoiser = &spectral_denoiser;
+  if (!mic || !mic->Start()) {
+    std::cout << "Failed to start microphone capture." << std::endl;
+    return 1;
+  }
+  g_mic = mic.get();
+  g1_common::EndpointerOptions endpoint_options;
+  endpoint_options.end_silence_ms = kMicSilenceStopMs;
+  endpoint_options.max_utterance_ms = kMicMaxRecordSeconds * 1000;
+  endpoint_options.vad_threshold = kMicVadThreshold;
+  g1_common::SpeechEndpointer endpointer(mic->sample_rate(), endpoint_options);
+  g_endpointer = &endpointer;
+  g1_common::MelStream mel_stream(kMelRingFrames);
+  g_mel = &mel_stream;
+  g1_common::UtteranceFilterOptions filter_options;
+  if (g_mic_pipeline.denoise == g1_common::MicDenoise::kSpectral) {
+    // SpectralDenoiser's probability is a mean Wiener gain and runs lower
+    // than RNNoise's VAD on the same speech.
+    filter_options.vad_speech = 0.3f;
+  }
+  g1_common::UtteranceFilter utterance_filter(mel_stream.frontend().options(),
+                                              filter_options);
+  g_utterance_filter = &utterance_filter;
+
   std::unique_ptr<unitree::robot::g1::G1ArmActionClient> client;
   std::unique_ptr<unitree::robot::g1::AudioClient> audio_client;
   if (!is_test) {
@@ -563,28 +598,40 @@ int main(int argc, char const* argv[]) {
               << std::endl;
   }
 
+  // G1_CAPTURE_DIR=<dir> records every utterance Whisper sees, for ASR
+  // debugging.
+  std::unique_ptr<g1_common::WavWriter> capture_wav =
+      g1_common::OpenCaptureRecorder("asr_arm_action", kMicWhisperRate);
+
   std::thread capture_thread(CaptureThread);
   capture_thread.detach();
 
   while (true) {
-    std::vector<int16_t> pcm_data;
+    QueuedUtterance utterance;
     {
       std::unique_lock<std::mutex> lock(g_queue_mutex);
-      g_queue_cv.wait(lock, [] { return !g_pcm_queue.empty(); });
-      pcm_data = std::move(g_pcm_queue.front());
-      g_pcm_queue.pop_front();
+      g_queue_cv.wait(lock, [] { return !g_utterance_queue.empty(); });
+      utterance = std::move(g_utterance_queue.front());
+      g_utterance_queue.pop_front();
     }
-    std::vector<int16_t> whisper_pcm = DownsampleTo16k(pcm_data);
-    if (whisper_pcm.empty()) {
+    if (utterance.pcm.empty()) {
       continue;
     }
-    // Skip WAV writing for faster turnaround.
-    std::string transcript = TranscribeWithWhisper(whisper_pcm);
+    if (capture_wav) {
+      // Queued for the recorder's writer thread; doesn't delay Whisper.
+      capture_wav->Write(utterance.pcm.data(), utterance.pcm.size());
+    }
+    std::string transcript = TranscribeWithWhisper(utterance);
     if (transcript.empty()) {
       std::cout << "Whisper text: <empty>" << std::endl;
       continue;
     }
     std::cout << "Whisper text: " << transcript << std::endl;
+    if (!g_utterance_filter->CheckTranscript(transcript,
+                                             utterance.marginal)) {
+      std::cout << "Ignoring Whisper filler." << std::endl;
+      continue;
+    }
     MaybeProcessCommand(transcript, is_test);
   }
 }
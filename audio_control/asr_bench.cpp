@@ -0,0 +1,849 @@
+#include <time.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <rnnoise.h>
+#include <whisper.h>
+
+#include "keyword_spotter.hpp"
+#include "log_mel.hpp"
+#include "spectral_denoiser.hpp"
+#include "speech_endpointer.hpp"
+#include "utterance_filter.hpp"
+#include "wav_reader.hpp"
+
+// Offline comparison of the ASR front ends on recorded fixtures:
+//   rnnoise48   48 kHz capture, RNNoise, decimate to 16 kHz (the default)
+//   spectral16  16 kHz capture, SpectralDenoiser
+//   raw16       16 kHz capture, no denoising
+//   rnnoise+mel rnnoise48, with Whisper fed the shared log-mel frames
+//               (whisper_set_mel) instead of audio, as the live programs
+//               do; its front-end time includes the mels
+// For each it reports front-end CPU time per second of audio, Whisper time
+// and word error rate against the reference transcripts.
+//
+// Fixtures must be raw capture, as recorded by g1_audio_mic_test --raw
+// (ideally from ALSA at 48 kHz, which every path can be fed from).
+// G1_CAPTURE_DIR recordings won't do: they are utterances after the live
+// front end's denoising, decimation and AGC, so every path would be
+// compared on audio one of them has already processed.
+//
+// With --gate it instead counts how many utterances each speech gate would
+// send to Whisper (no model needed): the old fixed-RMS gate on 1 s chunks
+// versus SpeechEndpointer on 100 ms chunks, both after RNNoise, and how
+// many of the endpointer's utterances UtteranceFilter passes. Use
+// ambient recordings (empty reference) to measure false ASR calls per
+// hour, and speech recordings to check utterances are still caught.
+//
+// With --kws it runs the wake-word spotter (KWS_MODEL or the given model)
+// over every fixture: fixtures whose transcript contains "hey g1" should
+// trigger it (misses are false rejects), all others shouldn't (false
+// accepts per hour). Also reports the spotter's and the log-mel front
+// end's CPU time.
+//
+// --kws_selftest checks a KWS model file (kws_export.py's output, or a
+// small random one it generates) by comparing KeywordSpotter's posterior
+// on every window of a synthetic stream with a direct evaluation of the
+// documented file layout.
+
+namespace {
+
+#ifndef WHISPER_MODEL_PATH
+#define WHISPER_MODEL_PATH "thirdparty/whisper.cpp/models/ggml-tiny.en.bin"
+#endif
+constexpr const char* kDefaultModelPath = WHISPER_MODEL_PATH;
+constexpr int kWhisperRate = 16000;
+constexpr int kRnnoiseRate = 48000;
+// Fixtures are fed in capture-sized chunks, as the live programs do.
+constexpr int kChunkMs = 1000;
+constexpr int kGateChunkMs = 100;
+// The gate conv_main used before SpeechEndpointer.
+constexpr int kLegacyRmsThreshold = 1200;
+constexpr int kLegacyMaxRecordSeconds = 5;
+
+struct Fixture {
+  std::string path;
+  std::string reference;
+};
+
+struct PathTotals {
+  double audio_s = 0.0;
+  double frontend_cpu_ms = 0.0;
+  double whisper_ms = 0.0;
+  size_t ref_words = 0;
+  size_t word_errors = 0;
+};
+
+double ThreadCpuMs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+double WallMs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Lower case, punctuation dropped, split on whitespace.
+std::vector<std::string> Words(const std::string& text) {
+  std::vector<std::string> words;
+  std::string word;
+  for (unsigned char ch : text) {
+    if (std::isalnum(ch) || ch == '\'') {
+      word.push_back(static_cast<char>(std::tolower(ch)));
+    } else if (std::isspace(ch) && !word.empty()) {
+      words.push_back(word);
+      word.clear();
+    }
+  }
+  if (!word.empty()) {
+    words.push_back(word);
+  }
+  return words;
+}
+
+// Word-level Levenshtein distance.
+size_t WordErrors(const std::vector<std::string>& ref,
+                  const std::vector<std::string>& hyp) {
+  std::vector<size_t> prev(hyp.size() + 1);
+  std::vector<size_t> cur(hyp.size() + 1);
+  for (size_t j = 0; j <= hyp.size(); ++j) {
+    prev[j] = j;
+  }
+  for (size_t i = 1; i <= ref.size(); ++i) {
+    cur[0] = i;
+    for (size_t j = 1; j <= hyp.size(); ++j) {
+      const size_t sub = prev[j - 1] + (ref[i - 1] == hyp[j - 1] ? 0 : 1);
+      cur[j] = std::min({sub, prev[j] + 1, cur[j - 1] + 1});
+    }
+    std::swap(prev, cur);
+  }
+  return prev[hyp.size()];
+}
+
+std::vector<Fixture> ReadManifest(const std::string& path) {
+  std::vector<Fixture> fixtures;
+  std::ifstream in(path);
+  if (!in) {
+    std::cout << "Failed to open manifest: " << path << std::endl;
+    return fixtures;
+  }
+  const size_t slash = path.find_last_of('/');
+  const std::string dir =
+      slash == std::string::npos ? "" : path.substr(0, slash + 1);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    const size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      std::cout << "Skipping manifest line without a tab: " << line
+                << std::endl;
+      continue;
+    }
+    Fixture f;
+    f.path = line.substr(0, tab);
+    if (!f.path.empty() && f.path[0] != '/') {
+      f.path = dir + f.path;
+    }
+    f.reference = line.substr(tab + 1);
+    fixtures.push_back(f);
+  }
+  return fixtures;
+}
+
+std::vector<int16_t> LoadAt(const g1_common::WavFile& wav, uint32_t rate) {
+  g1_common::WavS16Stream stream(wav, rate);
+  std::vector<int16_t> pcm;
+  int16_t block[4096];
+  size_t n;
+  while ((n = stream.Read(block, 4096)) > 0) {
+    pcm.insert(pcm.end(), block, block + n);
+  }
+  return pcm;
+}
+
+// Same processing as DenoiseChunk48k in conv_main / asr_arm_action.
+// `vad`, if given, receives the mean speech probability.
+std::vector<int16_t> DenoiseRnnoise(DenoiseState* state, const int16_t* pcm,
+                                    size_t size, float* vad = nullptr) {
+  constexpr size_t kFrameSize = 480;
+  std::vector<int16_t> out;
+  out.reserve(size);
+  float vad_sum = 0.f;
+  int frames = 0;
+  for (size_t offset = 0; offset < size; offset += kFrameSize) {
+    float in_frame[kFrameSize] = {0.0f};
+    float out_frame[kFrameSize] = {0.0f};
+    const size_t count = std::min(kFrameSize, size - offset);
+    for (size_t i = 0; i < count; ++i) {
+      in_frame[i] = static_cast<float>(pcm[offset + i]);  // int16 range
+    }
+    vad_sum += rnnoise_process_frame(state, out_frame, in_frame);
+    ++frames;
+    for (size_t i = 0; i < count; ++i) {
+      const float v = std::clamp(out_frame[i], -32768.0f, 32767.0f);
+      out.push_back(static_cast<int16_t>(v));
+    }
+  }
+  if (vad != nullptr) {
+    *vad = frames ? vad_sum / frames : 0.f;
+  }
+  return out;
+}
+
+// Same decimation as DownsampleTo16k.
+std::vector<int16_t> Decimate3(const std::vector<int16_t>& pcm) {
+  std::vector<int16_t> out;
+  out.reserve(pcm.size() / 3);
+  for (size_t i = 0; i + 2 < pcm.size(); i += 3) {
+    out.push_back(pcm[i]);
+  }
+  return out;
+}
+
+// From `mel` (log10 frames, frame-major) when given, else from `pcm`.
+std::string Transcribe(whisper_context* ctx, const std::vector<int16_t>& pcm,
+                       const std::vector<float>* mel = nullptr) {
+  whisper_full_params params =
+      whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+  params.print_progress = false;
+  params.print_realtime = false;
+  params.print_timestamps = false;
+  params.translate = false;
+  params.language = "en";
+  int ret = 0;
+  if (mel != nullptr) {
+    const int n_mels = whisper_model_n_mels(ctx);
+    if (n_mels != static_cast<int>(g1_common::LogMelOptions().n_mels)) {
+      return "";
+    }
+    int n_len = 0;
+    const std::vector<float> input =
+        g1_common::ToWhisperMel(*mel, n_mels, &n_len);
+    params.duration_ms = static_cast<int>(mel->size() / n_mels * 10);
+    ret = whisper_set_mel(ctx, input.data(), n_len, n_mels);
+    if (ret == 0) {
+      ret = whisper_full(ctx, params, nullptr, 0);
+    }
+  } else {
+    std::vector<float> samples(pcm.size());
+    for (size_t i = 0; i < pcm.size(); ++i) {
+      samples[i] = static_cast<float>(pcm[i]) / 32768.0f;
+    }
+    ret = whisper_full(ctx, params, samples.data(),
+                       static_cast<int>(samples.size()));
+  }
+  if (ret != 0) {
+    return "";
+  }
+  std::string result;
+  const int segments = whisper_full_n_segments(ctx);
+  for (int i = 0; i < segments; ++i) {
+    const char* segment = whisper_full_get_segment_text(ctx, i);
+    if (segment != nullptr) {
+      result += segment;
+    }
+  }
+  return result;
+}
+
+// Runs one front end over `fixture` in chunks and transcribes the result,
+// from log-mel frames if `with_mel`.
+template <typename Frontend>
+void RunPath(const char* name, whisper_context* ctx, const Fixture& fixture,
+             const std::vector<int16_t>& input, int rate, Frontend frontend,
+             bool with_mel, PathTotals* totals) {
+  const size_t chunk = static_cast<size_t>(rate) * kChunkMs / 1000;
+  std::vector<int16_t> asr_pcm;
+  g1_common::MelStream mel_stream(input.size() / rate * 100 + 100);
+  const double cpu_start = ThreadCpuMs();
+  for (size_t offset = 0; offset < input.size(); offset += chunk) {
+    const size_t n = std::min(chunk, input.size() - offset);
+    const size_t before = asr_pcm.size();
+    frontend(input.data() + offset, n, &asr_pcm);
+    if (with_mel) {
+      mel_stream.Push(&asr_pcm[before], asr_pcm.size() - before);
+    }
+  }
+  const double cpu_ms = ThreadCpuMs() - cpu_start;
+  std::vector<float> mel;
+  mel_stream.ReadSpan(0, asr_pcm.size(), 0.f, &mel);
+
+  const double wall_start = WallMs();
+  const std::string text =
+      Transcribe(ctx, asr_pcm, with_mel ? &mel : nullptr);
+  const double whisper_ms = WallMs() - wall_start;
+
+  const std::vector<std::string> ref = Words(fixture.reference);
+  const size_t errors = WordErrors(ref, Words(text));
+  totals->audio_s += static_cast<double>(input.size()) / rate;
+  totals->frontend_cpu_ms += cpu_ms;
+  totals->whisper_ms += whisper_ms;
+  totals->ref_words += ref.size();
+  totals->word_errors += errors;
+  std::cout << "  " << std::left << std::setw(11) << name << std::right
+            << " errors=" << errors << "/" << ref.size()
+            << " frontend_cpu_ms=" << std::fixed << std::setprecision(1)
+            << cpu_ms << " whisper_ms=" << whisper_ms << " text=\"" << text
+            << "\"" << std::endl;
+}
+
+struct GateTotals {
+  double audio_s = 0.0;
+  size_t legacy_calls = 0;
+  size_t endpointer_calls = 0;
+  size_t filtered_calls = 0;
+};
+
+double Rms(const int16_t* pcm, size_t size) {
+  double sum_sq = 0.0;
+  for (size_t i = 0; i < size; ++i) {
+    sum_sq += static_cast<double>(pcm[i]) * pcm[i];
+  }
+  return size ? std::sqrt(sum_sq / size) : 0.0;
+}
+
+// The old gate: a 1 s chunk at or above the RMS threshold starts an
+// utterance, the first one below it ends it, 5 s at most.
+size_t LegacyGateCalls(const std::vector<int16_t>& pcm, int rate) {
+  const size_t chunk = static_cast<size_t>(rate);
+  size_t calls = 0;
+  size_t length = 0;
+  bool started = false;
+  for (size_t offset = 0; offset + chunk <= pcm.size(); offset += chunk) {
+    const bool loud = Rms(&pcm[offset], chunk) >= kLegacyRmsThreshold;
+    if (!started) {
+      started = loud;
+      length = loud ? 1 : 0;
+    } else if (!loud || ++length >= kLegacyMaxRecordSeconds) {
+      ++calls;
+      started = false;
+    }
+  }
+  return calls + (started ? 1 : 0);
+}
+
+void RunGate(const Fixture& fixture, const std::vector<int16_t>& pcm48,
+             GateTotals* totals) {
+  DenoiseState* rnnoise = rnnoise_create(nullptr);
+  const size_t chunk = static_cast<size_t>(kRnnoiseRate) * kGateChunkMs / 1000;
+  g1_common::EndpointerOptions options;
+  options.max_utterance_ms = kLegacyMaxRecordSeconds * 1000;
+  g1_common::SpeechEndpointer endpointer(kRnnoiseRate, options);
+  g1_common::MelStream mel_stream(1000);
+  g1_common::UtteranceFilter filter;
+  size_t filtered = 0;
+  std::vector<int16_t> denoised;
+  denoised.reserve(pcm48.size());
+  for (size_t offset = 0; offset < pcm48.size(); offset += chunk) {
+    const size_t n = std::min(chunk, pcm48.size() - offset);
+    float vad = 0.f;
+    const std::vector<int16_t> out =
+        DenoiseRnnoise(rnnoise, pcm48.data() + offset, n, &vad);
+    const std::vector<int16_t> pcm16 = Decimate3(out);
+    mel_stream.Push(pcm16.data(), pcm16.size());
+    if (endpointer.Push(out.data(), out.size(), vad)) {
+      const g1_common::EndpointedUtterance utterance =
+          endpointer.TakeUtterance();
+      std::vector<float> mel;
+      mel_stream.ReadSpan(utterance.start_sample / 3, utterance.pcm.size() / 3,
+                          utterance.gain_db / 10.f, &mel);
+      if (filter.CheckAudio(mel, utterance.vad).speech) {
+        ++filtered;
+      }
+    }
+    denoised.insert(denoised.end(), out.begin(), out.end());
+  }
+  rnnoise_destroy(rnnoise);
+
+  const size_t legacy = LegacyGateCalls(denoised, kRnnoiseRate);
+  const size_t adaptive = endpointer.stats().utterances;
+  totals->audio_s += static_cast<double>(pcm48.size()) / kRnnoiseRate;
+  totals->legacy_calls += legacy;
+  totals->endpointer_calls += adaptive;
+  totals->filtered_calls += filtered;
+  std::cout << "  " << (fixture.reference.empty() ? "ambient" : "speech ")
+            << " legacy=" << legacy << " endpointer=" << adaptive
+            << " filtered=" << filtered
+            << " rejected_short=" << endpointer.stats().rejected_short
+            << " noise_floor_db=" << std::fixed << std::setprecision(1)
+            << endpointer.noise_floor_db() << std::endl;
+}
+
+struct KwsTotals {
+  size_t positives = 0;
+  size_t false_rejects = 0;
+  double negative_s = 0.0;
+  size_t false_accepts = 0;
+  double mel_cpu_ms = 0.0;
+};
+
+bool HasWakePhrase(const std::string& reference) {
+  const std::vector<std::string> words = Words(reference);
+  for (size_t i = 0; i + 1 < words.size(); ++i) {
+    if (words[i] == "hey" && words[i + 1] == "g1") {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RunKws(const Fixture& fixture, const std::vector<int16_t>& pcm48,
+            g1_common::KeywordSpotter* kws, KwsTotals* totals) {
+  kws->Reset();
+  g1_common::MelStream mel_stream(1000);
+  DenoiseState* rnnoise = rnnoise_create(nullptr);
+  const size_t chunk = static_cast<size_t>(kRnnoiseRate) * kGateChunkMs / 1000;
+  size_t detections = 0;
+  for (size_t offset = 0; offset < pcm48.size(); offset += chunk) {
+    const size_t n = std::min(chunk, pcm48.size() - offset);
+    const std::vector<int16_t> pcm16 =
+        Decimate3(DenoiseRnnoise(rnnoise, pcm48.data() + offset, n));
+    mel_stream.Push(pcm16.data(), pcm16.size());
+    if (kws->Update(mel_stream)) {
+      ++detections;
+    }
+  }
+  rnnoise_destroy(rnnoise);
+  totals->mel_cpu_ms += mel_stream.cpu_ms();
+
+  const bool positive = HasWakePhrase(fixture.reference);
+  if (positive) {
+    ++totals->positives;
+    totals->false_rejects += detections == 0 ? 1 : 0;
+  } else {
+    totals->negative_s += static_cast<double>(pcm48.size()) / kRnnoiseRate;
+    totals->false_accepts += detections;
+  }
+  std::cout << "  " << (positive ? "wake   " : "no wake")
+            << " detections=" << detections << std::endl;
+}
+
+// A G1KW file exactly as laid out on disk (see keyword_spotter.hpp).
+struct KwsFile {
+  uint32_t header[12] = {};
+  float threshold = 0.f;
+  std::vector<float> conv, conv_bias, fc, fc_bias;
+  std::vector<std::vector<float>> dw, dw_bias, pw, pw_bias;
+
+  uint32_t n_mels() const { return header[2]; }
+  uint32_t n_frames() const { return header[3]; }
+  uint32_t channels() const { return header[4]; }
+  uint32_t blocks() const { return header[5]; }
+  uint32_t kernel_t() const { return header[6]; }
+  uint32_t kernel_f() const { return header[7]; }
+  uint32_t stride_t() const { return header[8]; }
+  uint32_t stride_f() const { return header[9]; }
+  uint32_t classes() const { return header[10]; }
+  uint32_t keyword_class() const { return header[11]; }
+
+  // Weights in file order.
+  std::vector<std::vector<float>*> Tensors() {
+    std::vector<std::vector<float>*> out = {&conv, &conv_bias};
+    for (uint32_t b = 0; b < blocks(); ++b) {
+      out.insert(out.end(), {&dw[b], &dw_bias[b], &pw[b], &pw_bias[b]});
+    }
+    out.insert(out.end(), {&fc, &fc_bias});
+    return out;
+  }
+
+  void Shape() {
+    const size_t c = channels();
+    conv.resize(c * kernel_t() * kernel_f());
+    conv_bias.resize(c);
+    dw.assign(blocks(), std::vector<float>(c * 9));
+    dw_bias.assign(blocks(), std::vector<float>(c));
+    pw.assign(blocks(), std::vector<float>(c * c));
+    pw_bias.assign(blocks(), std::vector<float>(c));
+    fc.resize(classes() * c);
+    fc_bias.resize(classes());
+  }
+
+  bool Read(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        !in.read(reinterpret_cast<char*>(&threshold), sizeof(threshold))) {
+      return false;
+    }
+    Shape();
+    for (std::vector<float>* t : Tensors()) {
+      if (!in.read(reinterpret_cast<char*>(t->data()),
+                   t->size() * sizeof(float))) {
+        return false;
+      }
+    }
+    return in.peek() == EOF;
+  }
+
+  bool Write(const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&threshold), sizeof(threshold));
+    for (std::vector<float>* t : Tensors()) {
+      out.write(reinterpret_cast<const char*>(t->data()),
+                t->size() * sizeof(float));
+    }
+    return static_cast<bool>(out);
+  }
+};
+
+// A small random model with non-square kernels, strides and band pooling,
+// so a transposed or misordered tensor changes the posterior.
+KwsFile RandomKwsModel() {
+  KwsFile model;
+  const uint32_t header[12] = {0x574b3147u, 1, 40, 25, 8, 2, 5, 3, 2, 2, 3, 1};
+  std::copy(header, header + 12, model.header);
+  model.threshold = 0.5f;
+  model.Shape();
+  std::mt19937 rng(45);
+  std::normal_distribution<float> normal(0.f, 0.5f);
+  for (std::vector<float>* t : model.Tensors()) {
+    for (float& w : *t) {
+      w = normal(rng);
+    }
+  }
+  return model;
+}
+
+// Conv with TensorFlow "SAME" padding over a [channels][h][w] input.
+std::vector<float> SameConv(const std::vector<float>& in, size_t in_c,
+                            size_t h, size_t w, size_t out_c, size_t kh,
+                            size_t kw, size_t sh, size_t sw, bool depthwise,
+                            const std::vector<float>& weights,
+                            const std::vector<float>& bias, size_t* out_h,
+                            size_t* out_w) {
+  *out_h = (h + sh - 1) / sh;
+  *out_w = (w + sw - 1) / sw;
+  const long pad_h = std::max<long>(
+      0, static_cast<long>((*out_h - 1) * sh + kh) - static_cast<long>(h)) / 2;
+  const long pad_w = std::max<long>(
+      0, static_cast<long>((*out_w - 1) * sw + kw) - static_cast<long>(w)) / 2;
+  std::vector<float> out(out_c * *out_h * *out_w);
+  for (size_t o = 0; o < out_c; ++o) {
+    for (size_t y = 0; y < *out_h; ++y) {
+      for (size_t x = 0; x < *out_w; ++x) {
+        double sum = bias[o];
+        for (size_t i = depthwise ? o : 0; i < (depthwise ? o + 1 : in_c);
+             ++i) {
+          for (size_t ky = 0; ky < kh; ++ky) {
+            for (size_t kx = 0; kx < kw; ++kx) {
+              const long iy = static_cast<long>(y * sh + ky) - pad_h;
+              const long ix = static_cast<long>(x * sw + kx) - pad_w;
+              if (iy < 0 || ix < 0 || iy >= static_cast<long>(h) ||
+                  ix >= static_cast<long>(w)) {
+                continue;
+              }
+              const size_t tap = ((depthwise ? o : o * in_c + i) * kh + ky) *
+                                     kw + kx;
+              sum += weights[tap] * in[(i * h + iy) * w + ix];
+            }
+          }
+        }
+        out[(o * *out_h + y) * *out_w + x] = std::max(0.0, sum);
+      }
+    }
+  }
+  return out;
+}
+
+// Keyword posterior of `window` ([n_frames][n_mels], model-scaled).
+float ReferencePosterior(const KwsFile& m, const std::vector<float>& window) {
+  const size_t c = m.channels();
+  size_t h, w;
+  std::vector<float> act =
+      SameConv(window, 1, m.n_frames(), m.n_mels(), c, m.kernel_t(),
+               m.kernel_f(), m.stride_t(), m.stride_f(), false, m.conv,
+               m.conv_bias, &h, &w);
+  for (uint32_t b = 0; b < m.blocks(); ++b) {
+    act = SameConv(act, c, h, w, c, 3, 3, 1, 1, true, m.dw[b], m.dw_bias[b],
+                   &h, &w);
+    act = SameConv(act, c, h, w, c, 1, 1, 1, 1, false, m.pw[b],
+                   m.pw_bias[b], &h, &w);
+  }
+  std::vector<double> logits(m.classes());
+  for (size_t k = 0; k < m.classes(); ++k) {
+    logits[k] = m.fc_bias[k];
+    for (size_t ch = 0; ch < c; ++ch) {
+      double pooled = 0.0;
+      for (size_t p = 0; p < h * w; ++p) {
+        pooled += act[ch * h * w + p];
+      }
+      logits[k] += m.fc[k * c + ch] * pooled / (h * w);
+    }
+  }
+  const double max_logit = *std::max_element(logits.begin(), logits.end());
+  double total = 0.0;
+  for (double l : logits) {
+    total += std::exp(l - max_logit);
+  }
+  return static_cast<float>(
+      std::exp(logits[m.keyword_class()] - max_logit) / total);
+}
+
+// Feeds a synthetic stream through KeywordSpotter with an evaluation on
+// every frame and compares each posterior with ReferencePosterior().
+bool KwsSelfTest(const std::string& path) {
+  KwsFile file;
+  if (!file.Read(path)) {
+    std::cout << "FAIL: " << path << " is not a G1KW file of the size its "
+              << "header implies." << std::endl;
+    return false;
+  }
+  g1_common::KeywordSpotterOptions options;
+  options.eval_every_frames = 1;
+  options.smooth_evals = 1;
+  options.threshold = 2.f;  // never detects
+  g1_common::KeywordSpotter kws(options);
+  if (!kws.Load(path)) {
+    return false;
+  }
+  g1_common::MelStream mel_stream(1000);
+  const size_t group = mel_stream.n_mels() / file.n_mels();
+  std::mt19937 rng(7);
+  std::normal_distribution<float> noise(0.f, 300.f);
+  const size_t chunk = kWhisperRate * kGateChunkMs / 1000;
+  std::vector<int16_t> pcm(chunk);
+  size_t checked = 0;
+  float worst = 0.f;
+  for (size_t offset = 0; offset < 3 * static_cast<size_t>(kWhisperRate);
+       offset += chunk) {
+    for (size_t i = 0; i < chunk; ++i) {
+      const double t = static_cast<double>(offset + i) / kWhisperRate;
+      pcm[i] = static_cast<int16_t>(std::clamp(
+          3000.0 * std::sin(2 * M_PI * (300 + 400 * t) * t) + noise(rng),
+          -32768.0, 32767.0));
+    }
+    mel_stream.Push(pcm.data(), pcm.size());
+    kws.Update(mel_stream);
+    if (mel_stream.end_frame() < file.n_frames()) {
+      continue;
+    }
+    std::vector<float> window;
+    for (uint64_t f = mel_stream.end_frame() - file.n_frames();
+         f < mel_stream.end_frame(); ++f) {
+      const float* mel = mel_stream.Frame(f);
+      for (size_t m = 0; m < file.n_mels(); ++m) {
+        float sum = 0.f;
+        for (size_t g = 0; g < group; ++g) {
+          sum += mel[m * group + g];
+        }
+        window.push_back((sum / group + 4.f) / 4.f);
+      }
+    }
+    const float expected = ReferencePosterior(file, window);
+    worst = std::max(worst, std::fabs(kws.last_score() - expected));
+    ++checked;
+  }
+  const bool ok = checked > 0 && worst < 1e-5f;
+  std::cout << (ok ? "PASS" : "FAIL") << ": " << checked
+            << " windows, max posterior error " << worst << std::endl;
+  return ok;
+}
+
+void PrintSummary(const char* name, const PathTotals& t) {
+  const double wer =
+      t.ref_words ? 100.0 * t.word_errors / t.ref_words : 0.0;
+  const double cpu_per_s = t.audio_s > 0 ? t.frontend_cpu_ms / t.audio_s : 0;
+  std::cout << std::left << std::setw(11) << name << std::right << std::fixed
+            << std::setprecision(2) << " WER=" << wer << "%"
+            << " frontend_cpu=" << cpu_per_s << " ms/s"
+            << " whisper=" << t.whisper_ms / 1000.0 << " s"
+            << " audio=" << t.audio_s << " s" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char const* argv[]) {
+  const std::string mode = argc >= 2 ? argv[1] : "";
+  const bool gate_mode = mode == "--gate";
+  const bool kws_mode = mode == "--kws";
+  if (mode == "--kws_selftest") {
+    std::string path = argc >= 3 ? argv[2] : "";
+    if (path.empty()) {
+      path = "/tmp/g1_kws_selftest.bin";
+      if (!RandomKwsModel().Write(path)) {
+        std::cout << "Failed to write " << path << std::endl;
+        return 1;
+      }
+    }
+    const bool ok = KwsSelfTest(path);
+    if (argc < 3) {
+      std::remove(path.c_str());
+    }
+    return ok ? 0 : 1;
+  }
+  if (argc < (gate_mode || kws_mode ? 3 : 2)) {
+    std::cout << "Usage: g1_asr_bench <manifest.tsv> [model_path]"
+              << std::endl;
+    std::cout << "       g1_asr_bench --gate <manifest.tsv>" << std::endl;
+    std::cout << "       g1_asr_bench --kws <manifest.tsv> [kws_model]"
+              << std::endl;
+    std::cout << "       g1_asr_bench --kws_selftest [kws_model]" << std::endl;
+    std::cout << "Manifest lines: <wav path>\\t<reference transcript>; wav "
+                 "paths are relative to the manifest. --gate treats an empty "
+                 "transcript as an ambient recording."
+              << std::endl;
+    return 1;
+  }
+
+  const std::vector<Fixture> fixtures =
+      ReadManifest(argv[gate_mode || kws_mode ? 2 : 1]);
+  if (fixtures.empty()) {
+    std::cout << "No fixtures." << std::endl;
+    return 1;
+  }
+
+  if (gate_mode) {
+    GateTotals ambient;
+    GateTotals speech;
+    for (const Fixture& fixture : fixtures) {
+      g1_common::WavFile wav;
+      if (!wav.Open(fixture.path)) {
+        continue;
+      }
+      std::cout << fixture.path << std::endl;
+      RunGate(fixture, LoadAt(wav, kRnnoiseRate),
+              fixture.reference.empty() ? &ambient : &speech);
+    }
+    std::cout << "\n" << std::fixed << std::setprecision(1);
+    if (ambient.audio_s > 0) {
+      const double hours = ambient.audio_s / 3600.0;
+      std::cout << "ambient " << ambient.audio_s << " s: ASR calls/hour"
+                << " legacy=" << ambient.legacy_calls / hours
+                << " endpointer=" << ambient.endpointer_calls / hours
+                << " filtered=" << ambient.filtered_calls / hours
+                << std::endl;
+    }
+    if (speech.audio_s > 0) {
+      std::cout << "speech  " << speech.audio_s << " s: utterances"
+                << " legacy=" << speech.legacy_calls
+                << " endpointer=" << speech.endpointer_calls
+                << " filtered=" << speech.filtered_calls << std::endl;
+    }
+    return 0;
+  }
+
+  if (kws_mode) {
+    const char* kws_env = std::getenv("KWS_MODEL");
+    const std::string kws_path =
+        argc >= 4 ? argv[3] : kws_env != nullptr ? kws_env : "";
+    g1_common::KeywordSpotter kws;
+    if (kws_path.empty() || !kws.Load(kws_path)) {
+      std::cout << "--kws needs a model (argument or KWS_MODEL)." << std::endl;
+      return 1;
+    }
+    KwsTotals totals;
+    for (const Fixture& fixture : fixtures) {
+      g1_common::WavFile wav;
+      if (!wav.Open(fixture.path)) {
+        continue;
+      }
+      std::cout << fixture.path << std::endl;
+      RunKws(fixture, LoadAt(wav, kRnnoiseRate), &kws, &totals);
+    }
+    const double audio_s = kws.stats().audio_ms / 1000.0;
+    std::cout << "\n" << std::fixed << std::setprecision(2)
+              << "threshold=" << kws.threshold() << " false_reject="
+              << (totals.positives
+                      ? 100.0 * totals.false_rejects / totals.positives
+                      : 0.0)
+              << "% (" << totals.false_rejects << "/" << totals.positives
+              << ") false_accepts/hour="
+              << (totals.negative_s > 0
+                      ? totals.false_accepts * 3600.0 / totals.negative_s
+                      : 0.0)
+              << " (" << totals.false_accepts << " in " << totals.negative_s
+              << " s) kws_cpu="
+              << (audio_s > 0 ? kws.stats().cpu_ms / audio_s : 0.0)
+              << " ms/s mel_cpu="
+              << (audio_s > 0 ? totals.mel_cpu_ms / audio_s : 0.0)
+              << " ms/s" << std::endl;
+    return 0;
+  }
+
+  const std::string model_path = argc >= 3 ? argv[2] : kDefaultModelPath;
+
+  whisper_context_params wparams = whisper_context_default_params();
+  wparams.use_gpu = false;
+  wparams.flash_attn = false;
+  whisper_context* ctx =
+      whisper_init_from_file_with_params(model_path.c_str(), wparams);
+  if (ctx == nullptr) {
+    std::cout << "Failed to load Whisper model: " << model_path << std::endl;
+    return 1;
+  }
+
+  PathTotals rnnoise_totals;
+  PathTotals spectral_totals;
+  PathTotals raw_totals;
+  PathTotals mel_totals;
+  for (const Fixture& fixture : fixtures) {
+    g1_common::WavFile wav;
+    if (!wav.Open(fixture.path)) {
+      continue;
+    }
+    std::cout << fixture.path << std::endl;
+    const std::vector<int16_t> pcm48 = LoadAt(wav, kRnnoiseRate);
+    const std::vector<int16_t> pcm16 = LoadAt(wav, kWhisperRate);
+
+    // Fresh denoiser state per fixture, as after a restart.
+    DenoiseState* rnnoise = rnnoise_create(nullptr);
+    RunPath("rnnoise48", ctx, fixture, pcm48, kRnnoiseRate,
+            [rnnoise](const int16_t* chunk, size_t n,
+                      std::vector<int16_t>* out) {
+              const std::vector<int16_t> pcm =
+                  Decimate3(DenoiseRnnoise(rnnoise, chunk, n));
+              out->insert(out->end(), pcm.begin(), pcm.end());
+            },
+            false, &rnnoise_totals);
+    rnnoise_destroy(rnnoise);
+
+    rnnoise = rnnoise_create(nullptr);
+    RunPath("rnnoise+mel", ctx, fixture, pcm48, kRnnoiseRate,
+            [rnnoise](const int16_t* chunk, size_t n,
+                      std::vector<int16_t>* out) {
+              const std::vector<int16_t> pcm =
+                  Decimate3(DenoiseRnnoise(rnnoise, chunk, n));
+              out->insert(out->end(), pcm.begin(), pcm.end());
+            },
+            true, &mel_totals);
+    rnnoise_destroy(rnnoise);
+
+    g1_common::SpectralDenoiser spectral;
+    RunPath("spectral16", ctx, fixture, pcm16, kWhisperRate,
+            [&spectral](const int16_t* chunk, size_t n,
+                        std::vector<int16_t>* out) {
+              spectral.Process(chunk, n, out);
+            },
+            false, &spectral_totals);
+
+    RunPath("raw16", ctx, fixture, pcm16, kWhisperRate,
+            [](const int16_t* chunk, size_t n, std::vector<int16_t>* out) {
+              out->insert(out->end(), chunk, chunk + n);
+            },
+            false, &raw_totals);
+  }
+
+  std::cout << "\n" << fixtures.size() << " fixtures" << std::endl;
+  PrintSummary("rnnoise48", rnnoise_totals);
+  PrintSummary("spectral16", spectral_totals);
+  PrintSummary("raw16", raw_totals);
+  PrintSummary("rnnoise+mel", mel_totals);
+  whisper_free(ctx);
+  return 0;
+}
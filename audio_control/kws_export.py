@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""Writes a DS-CNN keyword spotting model in the G1KW format.
+
+The layout is documented in common/keyword_spotter.hpp. Two sources:
+
+  kws_export.py model.keras out.kws --keyword-class 1 [--threshold 0.8]
+      A trained Keras DS-CNN ("Hello Edge" / ML-KWS-for-MCU style):
+      Conv2D, then blocks of DepthwiseConv2D(3x3) + Conv2D(1x1), each
+      optionally followed by BatchNormalization and ReLU, then
+      GlobalAveragePooling2D and a Dense softmax layer. The input is
+      (n_frames, n_mels, 1) of (log10 mel + 4) / 4 from the shared 80-band
+      front end (n_mels may be 80 / k; the spotter averages adjacent
+      bands). Batch norm is folded into the preceding convolution.
+      Needs numpy and tensorflow.
+
+  kws_export.py --random out.kws [--seed N]
+      A tiny untrained model, to exercise the loader:
+      g1_asr_bench --kws_selftest out.kws
+
+Check any exported model with g1_asr_bench --kws_selftest before
+deploying it, then tune its threshold with g1_asr_bench --kws.
+"""
+
+import argparse
+import random
+import struct
+import sys
+
+MAGIC = 0x574B3147  # 'G1KW'
+VERSION = 1
+
+
+def write_model(path, dims, threshold, tensors):
+    """dims: n_mels, n_frames, channels, blocks, kernel_t, kernel_f,
+    stride_t, stride_f, classes, keyword_class. tensors: flat float lists
+    in file order."""
+    with open(path, "wb") as out:
+        out.write(struct.pack("<12I", MAGIC, VERSION, *dims))
+        out.write(struct.pack("<f", threshold))
+        for tensor in tensors:
+            out.write(struct.pack("<%df" % len(tensor), *tensor))
+
+
+def random_model(path, seed):
+    rng = random.Random(seed)
+    n_mels, n_frames, channels, blocks = 40, 25, 8, 2
+    kernel_t, kernel_f, stride_t, stride_f = 5, 3, 2, 2
+    classes, keyword_class = 3, 1
+
+    def weights(n):
+        return [rng.gauss(0.0, 0.5) for _ in range(n)]
+
+    tensors = [weights(channels * kernel_t * kernel_f), weights(channels)]
+    for _ in range(blocks):
+        tensors += [weights(channels * 9), weights(channels),
+                    weights(channels * channels), weights(channels)]
+    tensors += [weights(classes * channels), weights(classes)]
+    write_model(path, [n_mels, n_frames, channels, blocks, kernel_t,
+                       kernel_f, stride_t, stride_f, classes, keyword_class],
+                0.5, tensors)
+
+
+def keras_model(path, out_path, keyword_class, threshold):
+    import numpy as np
+    import tensorflow as tf
+
+    model = tf.keras.models.load_model(path, compile=False)
+    _, n_frames, n_mels, in_ch = model.input_shape
+    if in_ch != 1:
+        sys.exit("expected a (frames, mels, 1) input, got %s"
+                 % (model.input_shape,))
+
+    # (kind, kernel, bias) per convolution, batch norm folded in.
+    convs = []
+    dense = None
+    first_conv = None
+    for layer in model.layers:
+        kind = type(layer).__name__
+        weights = layer.get_weights()
+        if kind == "DepthwiseConv2D":
+            if layer.kernel_size != (3, 3) or layer.strides != (1, 1) or \
+                    layer.padding != "same" or layer.depth_multiplier != 1:
+                sys.exit("%s: depthwise layers must be 3x3, stride 1, "
+                         "same padding" % layer.name)
+            kernel = weights[0][:, :, :, 0]  # [3][3][channels]
+            bias = weights[1] if layer.use_bias else \
+                np.zeros(kernel.shape[2], np.float32)
+            convs.append(["dw", kernel, bias])
+        elif kind == "Conv2D":
+            if layer.padding != "same":
+                sys.exit("%s: convolutions must use same padding"
+                         % layer.name)
+            kernel = weights[0]  # [kt][kf][in][out]
+            bias = weights[1] if layer.use_bias else \
+                np.zeros(kernel.shape[3], np.float32)
+            if first_conv is None:
+                first_conv = layer
+                convs.append(["conv", kernel[:, :, 0, :], bias])
+            else:
+                if layer.kernel_size != (1, 1) or layer.strides != (1, 1):
+                    sys.exit("%s: only the first convolution may be "
+                             "larger than 1x1" % layer.name)
+                convs.append(["pw", kernel[0, 0], bias])
+        elif kind == "BatchNormalization":
+            gamma, beta, mean, var = weights
+            scale = gamma / np.sqrt(var + layer.epsilon)
+            conv = convs[-1]
+            conv[1] = conv[1] * scale  # scales the output channel axis
+            conv[2] = (conv[2] - mean) * scale + beta
+        elif kind == "Dense":
+            dense = weights
+        elif kind in ("InputLayer", "ReLU", "Activation", "Dropout",
+                      "GlobalAveragePooling2D", "Reshape"):
+            pass
+        else:
+            sys.exit("unsupported layer %s (%s)" % (layer.name, kind))
+
+    if first_conv is None or dense is None or (len(convs) - 1) % 2:
+        sys.exit("not a DS-CNN: conv, (depthwise, pointwise) * n, dense")
+    channels = convs[0][1].shape[2]
+    blocks = (len(convs) - 1) // 2
+    kernel_t, kernel_f = first_conv.kernel_size
+    stride_t, stride_f = first_conv.strides
+    classes = dense[0].shape[1]
+
+    def flat(a):
+        return np.asarray(a, np.float32).ravel().tolist()
+
+    # The file wants output channels outermost.
+    tensors = [flat(np.transpose(convs[0][1], (2, 0, 1))), flat(convs[0][2])]
+    for b in range(blocks):
+        dw, pw = convs[1 + 2 * b], convs[2 + 2 * b]
+        if dw[0] != "dw" or pw[0] != "pw":
+            sys.exit("block %d is not depthwise then pointwise" % b)
+        tensors += [flat(np.transpose(dw[1], (2, 0, 1))), flat(dw[2]),
+                    flat(pw[1].T), flat(pw[2])]
+    tensors += [flat(dense[0].T), flat(dense[1])]
+    write_model(out_path, [n_mels, n_frames, channels, blocks, kernel_t,
+                           kernel_f, stride_t, stride_f, classes,
+                           keyword_class], threshold, tensors)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("model", nargs="?", help="trained Keras model")
+    parser.add_argument("out", help="G1KW file to write")
+    parser.add_argument("--random", action="store_true",
+                        help="write a tiny random model instead")
+    parser.add_argument("--seed", type=int, default=45)
+    parser.add_argument("--keyword-class", type=int, default=1)
+    parser.add_argument("--threshold", type=float, default=0.8)
+    args = parser.parse_args()
+    if args.random:
+        random_model(args.out, args.seed)
+    elif args.model:
+        keras_model(args.model, args.out, args.keyword_class, args.threshold)
+    else:
+        parser.error("give a Keras model or --random")
+
+
+if __name__ == "__main__":
+    main()
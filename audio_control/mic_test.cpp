@@ -1,16 +1,15 @@
 #include <arpa/inet.h>
-#include <errno.h>
-#include <ifaddrs.h>
-#include <net/if.h>
-#include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
-#include <cstring>
-#include <fstream>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -20,16 +19,19 @@
 #include <unitree/robot/channel/channel_subscriber.hpp>
 #include <unitree/robot/g1/audio/g1_audio_client.hpp>
 
+#include "mic_capture.hpp"
+#include "wav_writer.hpp"
+
 namespace {
 constexpr const char* kAudioSubscribeTopic = "rt/audio_msg";
-constexpr const char* kGroupIp = "239.168.123.161";
-constexpr int kPort = 5555;
 constexpr int kWavSeconds = 5;
-constexpr int kSampleRate = 16000;
-constexpr int kBytesPerSample = 2;
+constexpr int kSampleRate = g1_common::kMicGroupRate;
 constexpr int kChannels = 1;
-constexpr int kWavLen = kSampleRate * kBytesPerSample * kWavSeconds;
-constexpr int kWavLenOnce = kSampleRate * kBytesPerSample * 160 / 1000;
+constexpr int kRecordTimeoutMs = 10000;
+// Loopback test: a port the robot doesn't use, 20 ms packets.
+constexpr int kLoopbackPort = 5556;
+constexpr int kLoopbackPacketSamples = kSampleRate / 50;
+constexpr int kLoopbackPackets = 150;
 
 void AsrHandler(const void* msg) {
   auto* res_msg = (std_msgs::msg::dds_::String_*)msg;
@@ -37,169 +39,240 @@ void AsrHandler(const void* msg) {
             << res_msg->data() << std::endl;
 }
 
-std::string GetInterfaceIpv4(const std::string& iface) {
-  struct ifaddrs* ifaddr = nullptr;
-  if (getifaddrs(&ifaddr) == -1) {
-    return "";
+// Records from the mic multicast group; audio is also streamed to
+// `wav_path` as it arrives. The file is only created once samples do.
+std::vector<int16_t> RecordMicPcm(const std::string& iface,
+                                  const std::string& wav_path) {
+  g1_common::MulticastMicOptions options;
+  options.iface = iface;
+  g1_common::MulticastMicSource mic(options);
+  if (!mic.Start()) {
+    return {};
   }
 
-  std::string result;
-  for (struct ifaddrs* ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
-    if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET) {
-      continue;
+  const size_t target = static_cast<size_t>(kSampleRate) * kWavSeconds;
+  std::vector<int16_t> pcm_data;
+  pcm_data.reserve(target);
+  std::vector<int16_t> chunk(kSampleRate / 2);
+  g1_common::WavWriter wav;
+  std::cout << "start record! max " << kRecordTimeoutMs / 1000 << " seconds"
+            << std::endl;
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(kRecordTimeoutMs);
+  while (pcm_data.size() < target) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      std::cout << "record timeout after " << kRecordTimeoutMs / 1000
+                << " seconds." << std::endl;
+      break;
     }
-    if (iface != ifa->ifa_name) {
+    const size_t want = std::min(chunk.size(), target - pcm_data.size());
+    const size_t n =
+        mic.Read(chunk.data(), want, std::chrono::milliseconds(1000));
+    if (n == 0) {
+      std::cout << "recording... no data yet" << std::endl;
       continue;
     }
-
-    char host[NI_MAXHOST] = {0};
-    if (getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in), host, NI_MAXHOST,
-                    nullptr, 0, NI_NUMERICHOST) != 0) {
-      continue;
+    pcm_data.insert(pcm_data.end(), chunk.begin(), chunk.begin() + n);
+    if (pcm_data.size() == n) {
+      wav.Open(wav_path, kSampleRate, kChannels);  // first samples
     }
-
-    result = host;
-    break;
+    wav.Write(chunk.data(), n);
+    std::cout << "recorded samples: " << pcm_data.size() << "/" << target
+              << std::endl;
   }
 
-  freeifaddrs(ifaddr);
-  return result;
-}
-
-void WriteWav(const std::string& path, const std::vector<int16_t>& pcm_data) {
-  std::ofstream out(path, std::ios::binary);
-  if (!out) {
-    std::cout << "Failed to open " << path << " for writing." << std::endl;
-    return;
-  }
-
-  uint32_t data_size = static_cast<uint32_t>(pcm_data.size() * sizeof(int16_t));
-  uint32_t riff_size = 36 + data_size;
-  uint16_t audio_format = 1;
-  uint16_t num_channels = kChannels;
-  uint32_t sample_rate = kSampleRate;
-  uint16_t bits_per_sample = 16;
-  uint32_t byte_rate = sample_rate * num_channels * bits_per_sample / 8;
-  uint16_t block_align = num_channels * bits_per_sample / 8;
-
-  out.write("RIFF", 4);
-  out.write(reinterpret_cast<char*>(&riff_size), sizeof(riff_size));
-  out.write("WAVE", 4);
-  out.write("fmt ", 4);
-  uint32_t fmt_chunk_size = 16;
-  out.write(reinterpret_cast<char*>(&fmt_chunk_size), sizeof(fmt_chunk_size));
-  out.write(reinterpret_cast<char*>(&audio_format), sizeof(audio_format));
-  out.write(reinterpret_cast<char*>(&num_channels), sizeof(num_channels));
-  out.write(reinterpret_cast<char*>(&sample_rate), sizeof(sample_rate));
-  out.write(reinterpret_cast<char*>(&byte_rate), sizeof(byte_rate));
-  out.write(reinterpret_cast<char*>(&block_align), sizeof(block_align));
-  out.write(reinterpret_cast<char*>(&bits_per_sample), sizeof(bits_per_sample));
-  out.write("data", 4);
-  out.write(reinterpret_cast<char*>(&data_size), sizeof(data_size));
-  out.write(reinterpret_cast<const char*>(pcm_data.data()), data_size);
+  mic.Stop();
+  mic.PrintStats();
+  wav.Close();
+  return pcm_data;
 }
 
-std::vector<int16_t> RecordMicPcm(const std::string& iface) {
-  std::vector<int16_t> pcm_data;
-  int sock = socket(AF_INET, SOCK_DGRAM, 0);
-  if (sock < 0) {
-    std::cout << "Failed to create UDP socket." << std::endl;
-    return pcm_data;
-  }
-
-  sockaddr_in local_addr{};
-  local_addr.sin_family = AF_INET;
-  local_addr.sin_port = htons(kPort);
-  local_addr.sin_addr.s_addr = INADDR_ANY;
-  if (bind(sock, reinterpret_cast<sockaddr*>(&local_addr),
-           sizeof(local_addr)) < 0) {
-    std::cout << "Failed to bind UDP socket." << std::endl;
-    close(sock);
-    return pcm_data;
-  }
-
-  ip_mreqn mreq{};
-  if (inet_pton(AF_INET, kGroupIp, &mreq.imr_multiaddr) != 1) {
-    std::cout << "Failed to parse multicast IP." << std::endl;
-    close(sock);
-    return pcm_data;
-  }
-
-  std::string local_ip = GetInterfaceIpv4(iface);
-  std::cout << "local ip: " << local_ip << std::endl;
-  if (local_ip.empty()) {
-    std::cout << "No IPv4 found for interface " << iface << "." << std::endl;
-    close(sock);
-    return pcm_data;
-  }
-
-  mreq.imr_address.s_addr = inet_addr(local_ip.c_str());
-  mreq.imr_ifindex = if_nametoindex(iface.c_str());
-  if (mreq.imr_ifindex == 0) {
-    std::cout << "Failed to resolve interface index for " << iface << "."
+// Records `seconds` of capture exactly as the mic delivers it (MIC_SOURCE:
+// 48 kHz from ALSA, 16 kHz from the multicast group), before any
+// denoising, resampling or AGC, to raw.wav. These are the fixtures
+// g1_asr_bench needs: it runs every front end over the same raw audio.
+int RecordRawCapture(int seconds, const std::string& iface) {
+  g1_common::MicPipeline pipeline;
+  if (seconds <= 0 || !g1_common::MicPipelineFromEnv(&pipeline)) {
+    std::cout << "Usage: g1_audio_mic_test --raw=<seconds> [iface]"
               << std::endl;
-    close(sock);
-    return pcm_data;
+    return 1;
   }
-
-  if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &mreq,
-                 sizeof(mreq)) < 0) {
-    std::cout << "Failed to set multicast interface: errno=" << errno
-              << std::endl;
+  const char* alsa_env = std::getenv("ALSA_DEVICE");
+  const std::string alsa_device =
+      alsa_env != nullptr && alsa_env[0] != '\0' ? alsa_env : "default";
+  std::unique_ptr<g1_common::CaptureSource> mic =
+      g1_common::MakeCaptureSource(pipeline, alsa_device, iface);
+  if (!mic->Start()) {
+    std::cout << "Failed to start microphone capture." << std::endl;
+    return 1;
   }
-  if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
-                 sizeof(mreq)) < 0) {
-    std::cout << "Failed to join multicast group: errno=" << errno
-              << std::endl;
-    close(sock);
-    return pcm_data;
-  }
-
-  timeval timeout{};
-  timeout.tv_sec = 1;
-  timeout.tv_usec = 0;
-  if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) <
-      0) {
-    std::cout << "Failed to set socket timeout." << std::endl;
-  }
-
-  int total_bytes = 0;
-  pcm_data.reserve(kWavLen / 2);
-  std::cout << "start record! max 10 seconds" << std::endl;
-  int64_t start_ms = unitree::common::GetCurrentTimeMillisecond();
-  while (total_bytes < kWavLen) {
-    int64_t now_ms = unitree::common::GetCurrentTimeMillisecond();
-    if (now_ms - start_ms >= 10000) {
-      std::cout << "record timeout after 10 seconds." << std::endl;
+  std::cout << "Recording " << seconds << " s of raw " << mic->name()
+            << " audio to raw.wav..." << std::endl;
+  const size_t target = static_cast<size_t>(mic->sample_rate()) * seconds;
+  std::vector<int16_t> chunk(mic->sample_rate() / 10);
+  g1_common::WavWriter wav;
+  size_t recorded = 0;
+  while (recorded < target) {
+    const size_t n =
+        mic->Read(chunk.data(), std::min(chunk.size(), target - recorded),
+                  std::chrono::milliseconds(2000));
+    if (n == 0) {
+      std::cout << "No audio for 2 s, stopping." << std::endl;
       break;
     }
-    char buffer[kWavLenOnce];
-    ssize_t len = recvfrom(sock, buffer, sizeof(buffer), 0, nullptr, nullptr);
-    if (len > 0) {
-      size_t sample_count = static_cast<size_t>(len) / 2;
-      const int16_t* samples = reinterpret_cast<const int16_t*>(buffer);
-      pcm_data.insert(pcm_data.end(), samples, samples + sample_count);
-      total_bytes += static_cast<int>(len);
-      std::cout << "recorded bytes: " << total_bytes << "/" << kWavLen
-                << std::endl;
-    } else {
-      std::cout << "recording... no data yet (errno=" << errno << ")"
-                << std::endl;
+    // Opened on the first samples so a dead mic leaves no empty file.
+    if (!wav.is_open() &&
+        !wav.Open("raw.wav", mic->sample_rate(), kChannels)) {
+      break;
     }
+    wav.Write(chunk.data(), n);
+    recorded += n;
   }
+  mic->Stop();
+  mic->PrintStats();
+  wav.Close();
+  std::cout << "Recorded " << recorded << " samples at " << mic->sample_rate()
+            << " Hz." << std::endl;
+  return recorded > 0 ? 0 : 1;
+}
+
+// Sends a paced 440 Hz tone to a local multicast group with some packets
+// withheld, and checks the receiver rebuilds the stream: every packet in
+// its place, the short gap ramped and the long one silent.
+int RunLoopbackTest() {
+  g1_common::MulticastMicOptions options;
+  options.port = kLoopbackPort;
+  g1_common::MulticastMicSource mic(options);
+  if (!mic.Start()) {
+    return 1;
+  }
+
+  const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  int loop = 1;
+  int ttl = 0;  // never leaves the host
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  sockaddr_in group{};
+  group.sin_family = AF_INET;
+  group.sin_port = htons(kLoopbackPort);
+  inet_pton(AF_INET, g1_common::kMicGroupIp, &group.sin_addr);
 
+  // One lost packet (within interpolate_ms), then a run of five (beyond
+  // it).
+  auto dropped = [](int i) { return i == 40 || (i >= 90 && i < 95); };
+  const int expected_gaps = 2;
+  auto tone = [](size_t n) {
+    return static_cast<int16_t>(
+        8000 * std::sin(2.0 * M_PI * 440.0 * n / kSampleRate));
+  };
+
+  std::thread sender([&] {
+    std::vector<int16_t> packet(kLoopbackPacketSamples);
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLoopbackPackets; ++i) {
+      for (int k = 0; k < kLoopbackPacketSamples; ++k) {
+        packet[k] = tone(static_cast<size_t>(i) * kLoopbackPacketSamples + k);
+      }
+      next += std::chrono::milliseconds(1000 * kLoopbackPacketSamples /
+                                        kSampleRate);
+      std::this_thread::sleep_until(next);
+      if (dropped(i)) {
+        continue;
+      }
+      sendto(sock, packet.data(), packet.size() * sizeof(int16_t), 0,
+             reinterpret_cast<sockaddr*>(&group), sizeof(group));
+    }
+  });
+
+  std::vector<int16_t> chunk(kSampleRate / 10);
+  std::vector<int16_t> received;
+  while (true) {
+    const size_t n =
+        mic.Read(chunk.data(), chunk.size(), std::chrono::milliseconds(500));
+    if (n == 0) {
+      break;
+    }
+    received.insert(received.end(), chunk.begin(), chunk.begin() + n);
+  }
+  sender.join();
   close(sock);
-  return pcm_data;
+  mic.Stop();
+  mic.PrintStats();
+
+  // The stream as the receiver should rebuild it.
+  const size_t packet = kLoopbackPacketSamples;
+  std::vector<int16_t> expected(kLoopbackPackets * packet);
+  for (size_t n = 0; n < expected.size(); ++n) {
+    expected[n] = tone(n);
+  }
+  for (int i = 0; i < kLoopbackPackets;) {
+    int end = i;
+    while (end < kLoopbackPackets && dropped(end)) {
+      ++end;
+    }
+    if (end == i) {
+      ++i;
+      continue;
+    }
+    const size_t first = i * packet;
+    const size_t missing = (end - i) * packet;
+    const bool ramp = missing * 1000 <=
+                      static_cast<size_t>(options.interpolate_ms) * kSampleRate;
+    const int16_t before = expected[first - 1];
+    const int16_t after = expected[first + missing];
+    for (size_t k = 0; k < missing; ++k) {
+      const float t = static_cast<float>(k + 1) / (missing + 1);
+      expected[first + k] =
+          ramp ? static_cast<int16_t>(before + (after - before) * t) : 0;
+    }
+    i = end;
+  }
+  size_t mismatches = 0;
+  size_t first_mismatch = 0;
+  for (size_t n = 0; n < std::min(received.size(), expected.size()); ++n) {
+    if (std::abs(received[n] - expected[n]) > 1 && mismatches++ == 0) {
+      first_mismatch = n;
+    }
+  }
+
+  const g1_common::MulticastMicStats stats = mic.stats();
+  std::cout << "Loopback: expected " << expected.size()
+            << " samples, received " << received.size() << " (gaps "
+            << stats.gaps << "/" << expected_gaps << ", concealed "
+            << stats.concealed_samples << ", mismatched " << mismatches;
+  if (mismatches > 0) {
+    std::cout << " from sample " << first_mismatch << ", packet "
+              << first_mismatch / packet;
+  }
+  std::cout << ")" << std::endl;
+  const bool ok = stats.gaps == expected_gaps &&
+                  received.size() == expected.size() && mismatches == 0;
+  std::cout << (ok ? "Loopback test passed." : "Loopback test FAILED.")
+            << std::endl;
+  return ok ? 0 : 1;
 }
 }  // namespace
 
 int main(int argc, char const* argv[]) {
   if (argc < 2) {
-    std::cout << "Usage: g1_audio_mic_test [NetWorkInterface(eth0)]"
+    std::cout << "Usage: g1_audio_mic_test [NetWorkInterface(eth0)|--loopback]"
+              << std::endl;
+    std::cout << "       g1_audio_mic_test --raw=<seconds> [NetWorkInterface]"
+              << std::endl;
+    std::cout << "         records unprocessed MIC_SOURCE audio to raw.wav "
+                 "(g1_asr_bench fixtures)"
               << std::endl;
     return 1;
   }
 
+  if (std::string(argv[1]) == "--loopback") {
+    return RunLoopbackTest();
+  }
+  if (std::string(argv[1]).rfind("--raw=", 0) == 0) {
+    return RecordRawCapture(std::atoi(argv[1] + 6), argc >= 3 ? argv[2] : "");
+  }
+
   unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
 
   unitree::robot::g1::AudioClient client;
@@ -217,11 +290,10 @@ int main(int argc, char const* argv[]) {
 
   std::cout << "Test 1: receive microphone audio (no ASR)..." << std::endl;
 
-  std::vector<int16_t> pcm_data = RecordMicPcm(argv[1]);
+  std::vector<int16_t> pcm_data = RecordMicPcm(argv[1], "record.wav");
   if (pcm_data.empty()) {
     std::cout << "record finish! no audio captured." << std::endl;
   } else {
-    WriteWav("record.wav", pcm_data);
     std::cout << "record finish! save to record.wav" << std::endl;
   }
 
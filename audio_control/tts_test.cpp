@@ -1,30 +1,53 @@
 #include <iostream>
+#include <string>
 
 #include <unitree/common/time/time_tool.hpp>
 #include <unitree/robot/channel/channel_factory.hpp>
 #include <unitree/robot/g1/audio/g1_audio_client.hpp>
 
-int main(int argc, char const* argv[]) {
-  if (argc < 2) {
-    std::cout << "Usage: g1_audio_tts_test [NetWorkInterface(eth0)]" << std::endl;
-    return 1;
-  }
-
-  unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
+#include "robot_client.hpp"
 
-  unitree::robot::g1::AudioClient client;
-  client.Init();
-  client.SetTimeout(10.0f);
+namespace {
 
+// Templated so it runs on AudioClient or through g1_robotd.
+template <typename Client>
+int RunTts(Client* client) {
   uint8_t volume = 0;
-  int32_t vol_ret = client.GetVolume(volume);
+  int32_t vol_ret = client->GetVolume(volume);
   std::cout << "GetVolume API ret: " << vol_ret
             << " volume: " << static_cast<int>(volume) << std::endl;
 
-  int32_t ret = client.TtsMaker(
+  int32_t ret = client->TtsMaker(
       "Hello. This is a G1 audio control TTS test in English.", 1);
   std::cout << "TtsMaker API ret: " << ret << std::endl;
 
   unitree::common::Sleep(2);
   return ret == 0 ? 0 : 1;
 }
+
+}  // namespace
+
+int main(int argc, char const* argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: g1_audio_tts_test [NetWorkInterface(eth0)|robotd]"
+              << std::endl;
+    return 1;
+  }
+
+  if (std::string(argv[1]) == "robotd") {
+    g1_daemon::RobotDaemonClient client;
+    client.Init();
+    if (!client.connected()) {
+      return 1;
+    }
+    client.SetTimeout(10.0f);
+    return RunTts(&client);
+  }
+
+  unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
+
+  unitree::robot::g1::AudioClient client;
+  client.Init();
+  client.SetTimeout(10.0f);
+  return RunTts(&client);
+}
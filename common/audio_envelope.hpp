@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace g1_common {
+
+struct EnvelopeOptions {
+  int block_ms = 10;
+  // Block RMS is mapped from [floor_db, ceil_db] dBFS onto 0..1.
+  float floor_db = -50.f;
+  float ceil_db = -12.f;
+  float attack_ms = 5.f;
+  float release_ms = 120.f;
+};
+
+// Streaming envelope follower: RMS per `block_ms` block, mapped to a 0..1
+// loudness and smoothed with separate attack/release. Samples can arrive in
+// any chunk size; partial blocks carry over to the next call.
+class EnvelopeFollower {
+ public:
+  EnvelopeFollower(int sample_rate, const EnvelopeOptions& options = {})
+      : options_(options),
+        block_samples_(std::max(1, sample_rate * options.block_ms / 1000)),
+        attack_(Coefficient(options.attack_ms)),
+        release_(Coefficient(options.release_ms)) {}
+
+  // Calls `on_block(level)` once per completed block.
+  template <typename OnBlock>
+  void Process(const int16_t* pcm, size_t count, OnBlock&& on_block) {
+    for (size_t i = 0; i < count; ++i) {
+      const float v = pcm[i];
+      sum_sq_ += v * v;
+      if (++filled_ == block_samples_) {
+        on_block(FinishBlock());
+      }
+    }
+  }
+
+  void Reset() {
+    level_ = 0.f;
+    sum_sq_ = 0.f;
+    filled_ = 0;
+  }
+
+  float level() const { return level_; }
+  int block_ms() const { return options_.block_ms; }
+  int block_samples() const { return block_samples_; }
+
+ private:
+  float Coefficient(float time_ms) const {
+    return time_ms <= 0.f ? 1.f
+                          : 1.f - std::exp(-options_.block_ms / time_ms);
+  }
+
+  float FinishBlock() {
+    const float rms = std::sqrt(sum_sq_ / block_samples_) / 32768.f;
+    sum_sq_ = 0.f;
+    filled_ = 0;
+    const float db = 20.f * std::log10(std::max(rms, 1e-6f));
+    const float target = std::clamp(
+        (db - options_.floor_db) / (options_.ceil_db - options_.floor_db), 0.f,
+        1.f);
+    level_ += (target - level_) * (target > level_ ? attack_ : release_);
+    return level_;
+  }
+
+  EnvelopeOptions options_;
+  int block_samples_;
+  float attack_;
+  float release_;
+  float level_ = 0.f;
+  float sum_sq_ = 0.f;
+  int filled_ = 0;
+};
+
+// Envelope levels laid out on the wall clock of the audio they describe.
+//
+// Producers schedule PCM (or precomputed levels) at the time it will be
+// heard; LevelAt(now) returns the block being heard now, so LED animation
+// lines up with the sound rather than with when data was handed to the
+// speaker. Thread safe.
+class PlaybackEnvelope {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  PlaybackEnvelope(int sample_rate, const EnvelopeOptions& options = {},
+                   Clock::duration output_latency = Clock::duration::zero())
+      : follower_(sample_rate, options),
+        block_(std::chrono::milliseconds(options.block_ms)),
+        latency_(output_latency) {}
+
+  // Queues `pcm` to be heard from `start`; returns when it ends.
+  Clock::time_point Schedule(const int16_t* pcm, size_t count,
+                             Clock::time_point start) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t index = BeginAt(start);
+    follower_.Process(pcm, count, [&](float level) { Put(index++, level); });
+    return base_ + block_ * static_cast<int64_t>(index);
+  }
+
+  // Same, for levels already computed per block (e.g. a synthetic TTS
+  // envelope).
+  Clock::time_point ScheduleLevels(const std::vector<float>& levels,
+                                   Clock::time_point start) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t index = BeginAt(start);
+    for (float level : levels) {
+      Put(index++, level);
+    }
+    return base_ + block_ * static_cast<int64_t>(index);
+  }
+
+  float LevelAt(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Clock::time_point heard = now - latency_;
+    // Forget blocks that are over.
+    while (!levels_.empty() && base_ + block_ <= heard) {
+      levels_.pop_front();
+      base_ += block_;
+    }
+    if (levels_.empty() || heard < base_) {
+      return 0.f;
+    }
+    return levels_.front();
+  }
+
+  // When the last scheduled block ends (now or earlier if nothing queued).
+  Clock::time_point end() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return base_ + block_ * static_cast<int64_t>(levels_.size());
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    levels_.clear();
+    follower_.Reset();
+  }
+
+ private:
+  // Index of the block containing `start`, padding gaps with silence. A
+  // start before the queued audio ends overwrites from there on.
+  size_t BeginAt(Clock::time_point start) {
+    if (levels_.empty()) {
+      base_ = start;
+      return 0;
+    }
+    if (start < base_) {
+      start = base_;
+    }
+    const size_t index = static_cast<size_t>((start - base_) / block_);
+    if (index < levels_.size()) {
+      levels_.resize(index);
+    }
+    while (levels_.size() < index) {
+      levels_.push_back(0.f);
+    }
+    return index;
+  }
+
+  void Put(size_t index, float level) {
+    if (index < levels_.size()) {
+      levels_[index] = level;
+    } else {
+      levels_.push_back(level);
+    }
+  }
+
+  mutable std::mutex mutex_;
+  EnvelopeFollower follower_;
+  Clock::duration block_;
+  Clock::duration latency_;
+  Clock::time_point base_{};
+  std::deque<float> levels_;
+};
+
+// Rough syllable-rate envelope for text spoken by the robot's TTS, whose
+// audio we never see: one ~180 ms bump per vowel group, short gaps between
+// words and longer ones at punctuation. Good enough to make the LEDs "talk".
+inline std::vector<float> SyntheticSpeechEnvelope(const std::string& text,
+                                                  int block_ms = 10) {
+  std::vector<float> levels;
+  auto append = [&](int ms, float peak, bool syllable) {
+    const int blocks = std::max(1, ms / block_ms);
+    for (int i = 0; i < blocks; ++i) {
+      if (!syllable) {
+        levels.push_back(0.f);
+        continue;
+      }
+      // Fast rise, slower fall.
+      const float x = static_cast<float>(i) / blocks;
+      const float shape = x < 0.2f ? x / 0.2f : 1.f - (x - 0.2f) / 0.8f;
+      levels.push_back(peak * (0.25f + 0.75f * shape));
+    }
+  };
+
+  auto is_vowel = [](char c) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' ||
+           c == 'y';
+  };
+
+  bool in_vowel = false;
+  unsigned syllable = 0;
+  for (char c : text) {
+    if (std::isalpha(static_cast<unsigned char>(c))) {
+      if (is_vowel(c) && !in_vowel) {
+        // Vary the peaks a little so it doesn't look mechanical.
+        const float peak = 0.65f + 0.35f * ((syllable * 7919u) % 5) / 4.f;
+        append(180, peak, true);
+        ++syllable;
+      }
+      in_vowel = is_vowel(c);
+    } else {
+      in_vowel = false;
+      if (c == ' ') {
+        append(40, 0.f, false);
+      } else if (c == ',' || c == '.' || c == '!' || c == '?' || c == ';') {
+        append(250, 0.f, false);
+      }
+    }
+  }
+  return levels;
+}
+
+}  // namespace g1_common
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace g1_common {
+
+struct ChatMessage {
+  std::string role;
+  std::string content;
+};
+
+inline std::string EscapeJson(const std::string& input) {
+  std::string output;
+  output.reserve(input.size() * 2);
+  for (char ch : input) {
+    switch (ch) {
+      case '"':
+        output += "\\\"";
+        break;
+      case '\\':
+        output += "\\\\";
+        break;
+      case '\b':
+        output += "\\b";
+        break;
+      case '\f':
+        output += "\\f";
+        break;
+      case '\n':
+        output += "\\n";
+        break;
+      case '\r':
+        output += "\\r";
+        break;
+      case '\t':
+        output += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(ch) < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(ch));
+          output += buf;
+        } else {
+          output += ch;
+        }
+        break;
+    }
+  }
+  return output;
+}
+
+// One element of an OpenAI-style "messages" array.
+inline std::string MessageJson(const std::string& role,
+                               const std::string& content) {
+  return "{\"role\":\"" + role + "\",\"content\":\"" + EscapeJson(content) +
+         "\"}";
+}
+
+inline std::string BuildMessagesJson(const std::vector<ChatMessage>& messages) {
+  std::string out = "[";
+  for (size_t i = 0; i < messages.size(); ++i) {
+    if (i > 0) {
+      out += ",";
+    }
+    out += MessageJson(messages[i].role, messages[i].content);
+  }
+  return out + "]";
+}
+
+// Rough prompt size: ~4 characters per token for English under the BPE
+// tokenizers the hosted models use, plus the chat template's per-message
+// overhead. Only used for budgeting, so it needn't be exact.
+inline size_t EstimateTokens(const std::string& text) {
+  return text.size() / 4 + 4;
+}
+
+struct ConversationContextOptions {
+  // Prompt budget for the system prompt, summary and turns (estimated
+  // tokens). Beyond it the oldest turns are dropped unsummarised.
+  size_t max_tokens = 1500;
+  // Above this, NeedsSummary() asks for older turns to be folded into the
+  // summary...
+  size_t summarize_above_tokens = 900;
+  // ...keeping at least this many recent messages verbatim.
+  size_t keep_recent_messages = 4;
+};
+
+struct ConversationContextStats {
+  uint64_t messages = 0;
+  uint64_t summaries = 0;        // folds applied
+  uint64_t summarised = 0;       // messages folded into the summary
+  uint64_t dropped = 0;          // messages dropped over max_tokens
+  uint64_t prefix_rebuilds = 0;  // full re-serialisations of the prefix
+  uint64_t requests = 0;
+};
+
+// The LLM context of one conversation: a system prompt, a running summary
+// of older turns and the recent turns, kept within a token budget.
+//
+// The messages JSON up to the recent turns is cached and extended in
+// place as turns are added, so building a request costs one copy of a
+// bounded prefix rather than re-serialising the history. Summarize() folds
+// the oldest turns into the summary with a caller-supplied (blocking,
+// typically LLM) summariser; run it from a background thread while the
+// robot is idle. Turns added meanwhile are kept. All methods are
+// thread-safe.
+class ConversationContext {
+ public:
+  // Returns the new summary given the previous one (may be empty) and the
+  // turns to fold in; "" on failure.
+  using Summarizer = std::function<std::string(
+      const std::string& summary, const std::vector<ChatMessage>& turns)>;
+
+  explicit ConversationContext(std::string system_prompt,
+                               const ConversationContextOptions& options = {})
+      : options_(options),
+        system_json_(MessageJson("system", system_prompt)),
+        system_tokens_(EstimateTokens(system_prompt)) {}
+
+  ConversationContext(const ConversationContext&) = delete;
+  ConversationContext& operator=(const ConversationContext&) = delete;
+
+  void Add(const std::string& role, const std::string& content) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Turn turn;
+    turn.seq = next_seq_++;
+    turn.json = MessageJson(role, content);
+    turn.message = {role, content};
+    turn.tokens = EstimateTokens(content);
+    turn_tokens_ += turn.tokens;
+    if (prefix_valid_) {
+      prefix_ += "," + turn.json;
+    }
+    turns_.push_back(std::move(turn));
+    ++stats_.messages;
+    while (TokensLocked() > options_.max_tokens &&
+           turns_.size() > options_.keep_recent_messages) {
+      PopFront();
+      ++stats_.dropped;
+    }
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    turns_.clear();
+    turn_tokens_ = 0;
+    summary_.clear();
+    summary_tokens_ = 0;
+    prefix_valid_ = false;
+    ++generation_;
+  }
+
+  // The full "messages" array: the cached prefix plus `user_content` as
+  // the final user message.
+  std::string MessagesJson(const std::string& user_content) {
+    const std::string user = MessageJson("user", user_content);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.requests;
+    if (!prefix_valid_) {
+      RebuildPrefix();
+    }
+    std::string out;
+    out.reserve(prefix_.size() + user.size() + 2);
+    out += prefix_;
+    out += ",";
+    out += user;
+    out += "]";
+    return out;
+  }
+
+  size_t tokens() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return TokensLocked();
+  }
+
+  bool NeedsSummary() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return NeedsSummaryLocked();
+  }
+
+  // Folds all but the recent turns into the summary. Blocks for the
+  // summariser; true if the context was updated.
+  bool Summarize(const Summarizer& summarize) {
+    std::string summary;
+    std::vector<ChatMessage> turns;
+    uint64_t generation = 0;
+    uint64_t last_seq = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!NeedsSummaryLocked()) {
+        return false;
+      }
+      const size_t count = turns_.size() - options_.keep_recent_messages;
+      for (size_t i = 0; i < count; ++i) {
+        turns.push_back(turns_[i].message);
+      }
+      last_seq = turns_[count - 1].seq;
+      summary = summary_;
+      generation = generation_;
+    }
+    std::string updated = summarize(summary, turns);
+    if (updated.empty()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+      return false;  // cleared meanwhile
+    }
+    // Add() may have dropped some of them already.
+    while (!turns_.empty() && turns_.front().seq <= last_seq) {
+      PopFront();
+      ++stats_.summarised;
+    }
+    summary_ = std::move(updated);
+    summary_tokens_ = EstimateTokens(summary_);
+    prefix_valid_ = false;
+    ++stats_.summaries;
+    return true;
+  }
+
+  // The last `count` turns, oldest first.
+  std::vector<ChatMessage> Recent(size_t count) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ChatMessage> out;
+    for (size_t i = turns_.size() - std::min(count, turns_.size());
+         i < turns_.size(); ++i) {
+      out.push_back(turns_[i].message);
+    }
+    return out;
+  }
+
+  std::string summary() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return summary_;
+  }
+
+  ConversationContextStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Turn {
+    uint64_t seq = 0;
+    ChatMessage message;
+    std::string json;
+    size_t tokens = 0;
+  };
+
+  size_t TokensLocked() const {
+    return system_tokens_ + summary_tokens_ + turn_tokens_;
+  }
+
+  bool NeedsSummaryLocked() const {
+    return TokensLocked() > options_.summarize_above_tokens &&
+           turns_.size() > options_.keep_recent_messages;
+  }
+
+  void PopFront() {
+    turn_tokens_ -= turns_.front().tokens;
+    turns_.pop_front();
+    prefix_valid_ = false;
+  }
+
+  // "[" + system + summary + turns, without the closing bracket.
+  void RebuildPrefix() {
+    prefix_ = "[" + system_json_;
+    if (!summary_.empty()) {
+      prefix_ += "," + MessageJson("system",
+                                   "Summary of the conversation so far: " +
+                                       summary_);
+    }
+    for (const Turn& turn : turns_) {
+      prefix_ += "," + turn.json;
+    }
+    prefix_valid_ = true;
+    ++stats_.prefix_rebuilds;
+  }
+
+  ConversationContextOptions options_;
+  std::string system_json_;
+  size_t system_tokens_;
+  mutable std::mutex mutex_;
+  std::deque<Turn> turns_;
+  size_t turn_tokens_ = 0;
+  std::string summary_;
+  size_t summary_tokens_ = 0;
+  std::string prefix_;
+  bool prefix_valid_ = false;
+  uint64_t next_seq_ = 0;
+  uint64_t generation_ = 0;
+  ConversationContextStats stats_;
+};
+
+}  // namespace g1_common
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace g1_common {
+
+// Real-input FFT of a fixed even size. Twiddles and the factorisation are
+// computed once in the constructor, so per-frame transforms don't call
+// sin/cos or allocate. A length-n real transform is done as a length-n/2
+// complex one plus a split step; the complex transform is mixed radix
+// (4, 2, 3, 5, then any other prime), so sizes like 400 work as well as
+// powers of two, best when n/2 has only small factors.
+class RealFft {
+ public:
+  explicit RealFft(size_t n) : n_(n), half_(n / 2) {
+    size_t rest = half_;
+    for (size_t p : {4, 2, 3, 5}) {
+      while (rest % p == 0) {
+        factors_.push_back(p);
+        rest /= p;
+      }
+    }
+    for (size_t p = 7; rest > 1; p += 2) {
+      while (rest % p == 0) {
+        factors_.push_back(p);
+        rest /= p;
+      }
+    }
+    size_t max_radix = 1;
+    for (size_t p : factors_) {
+      max_radix = std::max(max_radix, p);
+    }
+    scratch_.resize(max_radix);
+
+    // e^{-2 pi i k / (n/2)} for k = 0..n/2-1.
+    twiddle_.resize(half_);
+    for (size_t k = 0; k < half_; ++k) {
+      twiddle_[k] =
+          std::polar(1.0f, static_cast<float>(-2.0 * M_PI * k / half_));
+    }
+    // Split step: e^{-2 pi i k / n} for k = 0..n/2.
+    split_.resize(half_ + 1);
+    for (size_t k = 0; k <= half_; ++k) {
+      split_[k] = std::polar(1.0f, static_cast<float>(-2.0 * M_PI * k / n_));
+    }
+    packed_.resize(half_);
+    work_.resize(half_);
+  }
+
+  size_t size() const { return n_; }
+  size_t bins() const { return half_ + 1; }
+
+  // `in` has size() samples; `out` receives bins() = n/2 + 1 values.
+  void Forward(const float* in, std::complex<float>* out) {
+    for (size_t i = 0; i < half_; ++i) {
+      packed_[i] = {in[2 * i], in[2 * i + 1]};
+    }
+    Transform(packed_.data(), work_.data(), half_, 1, 0, false);
+    const std::complex<float> z0 = work_[0];
+    out[0] = {z0.real() + z0.imag(), 0.f};
+    out[half_] = {z0.real() - z0.imag(), 0.f};
+    for (size_t k = 1; k < half_; ++k) {
+      const std::complex<float> a = work_[k];
+      const std::complex<float> b = std::conj(work_[half_ - k]);
+      const std::complex<float> even = 0.5f * (a + b);
+      const std::complex<float> odd =
+          std::complex<float>(0.f, -0.5f) * (a - b);
+      out[k] = even + split_[k] * odd;
+    }
+  }
+
+  // Inverse of Forward(): `in` has bins() values, `out` gets size()
+  // samples (scaled so Inverse(Forward(x)) == x).
+  void Inverse(const std::complex<float>* in, float* out) {
+    for (size_t k = 0; k < half_; ++k) {
+      const std::complex<float> a = in[k];
+      const std::complex<float> b = std::conj(in[half_ - k]);
+      const std::complex<float> even = 0.5f * (a + b);
+      const std::complex<float> odd = 0.5f * (a - b) * std::conj(split_[k]);
+      packed_[k] = even + std::complex<float>(0.f, 1.f) * odd;
+    }
+    Transform(packed_.data(), work_.data(), half_, 1, 0, true);
+    const float scale = 1.f / static_cast<float>(half_);
+    for (size_t i = 0; i < half_; ++i) {
+      out[2 * i] = work_[i].real() * scale;
+      out[2 * i + 1] = work_[i].imag() * scale;
+    }
+  }
+
+ private:
+  std::complex<float> Twiddle(size_t index, bool inverse) const {
+    const std::complex<float> w = twiddle_[index % half_];
+    return inverse ? std::conj(w) : w;
+  }
+
+  // Decimation in time: the length-n DFT of in[0], in[stride], ... is
+  // written to out[0..n). Sub-transforms of the factors_[stage]
+  // interleaved subsequences are combined with one radix-p pass.
+  void Transform(const std::complex<float>* in, std::complex<float>* out,
+                 size_t n, size_t stride, size_t stage, bool inverse) {
+    if (n == 1) {
+      out[0] = in[0];
+      return;
+    }
+    const size_t p = factors_[stage];
+    const size_t m = n / p;
+    for (size_t q = 0; q < p; ++q) {
+      Transform(in + q * stride, out + q * m, m, stride * p, stage + 1,
+                inverse);
+    }
+    // W_n^j is twiddle_[j * step].
+    const size_t step = half_ / n;
+    for (size_t k = 0; k < m; ++k) {
+      for (size_t q = 0; q < p; ++q) {
+        scratch_[q] = out[q * m + k] * Twiddle(q * k * step, inverse);
+      }
+      if (p == 2) {
+        out[k] = scratch_[0] + scratch_[1];
+        out[m + k] = scratch_[0] - scratch_[1];
+      } else if (p == 4) {
+        const std::complex<float> a = scratch_[0] + scratch_[2];
+        const std::complex<float> b = scratch_[0] - scratch_[2];
+        const std::complex<float> c = scratch_[1] + scratch_[3];
+        // -i (forward) or +i (inverse) times (x1 - x3).
+        const std::complex<float> d =
+            (scratch_[1] - scratch_[3]) *
+            std::complex<float>(0.f, inverse ? 1.f : -1.f);
+        out[k] = a + c;
+        out[m + k] = b + d;
+        out[2 * m + k] = a - c;
+        out[3 * m + k] = b - d;
+      } else {
+        // Plain DFT over the p inputs; W_p^x is W_n^{x m}.
+        for (size_t r = 0; r < p; ++r) {
+          std::complex<float> sum = scratch_[0];
+          for (size_t q = 1; q < p; ++q) {
+            sum += scratch_[q] * Twiddle((q * r % p) * m * step, inverse);
+          }
+          out[r * m + k] = sum;
+        }
+      }
+    }
+  }
+
+  size_t n_;
+  size_t half_;
+  std::vector<size_t> factors_;
+  std::vector<std::complex<float>> twiddle_;
+  std::vector<std::complex<float>> split_;
+  std::vector<std::complex<float>> packed_;
+  std::vector<std::complex<float>> work_;
+  std::vector<std::complex<float>> scratch_;
+};
+
+}  // namespace g1_common
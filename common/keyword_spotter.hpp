@@ -0,0 +1,450 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "log_mel.hpp"
+
+namespace g1_common {
+
+// DS-CNN keyword spotting model ("Hello Edge", Zhang et al. 2017) over
+// log-mel frames: one regular convolution, then depthwise-separable
+// blocks (3x3 depthwise + 1x1 pointwise, each with ReLU), global average
+// pooling and a fully connected layer with softmax. Batch norm is folded
+// into the weights by the exporter.
+//
+// File layout, little endian:
+//   uint32 magic 'G1KW' (0x574b3147), uint32 version (1)
+//   uint32 n_mels, n_frames, channels, blocks,
+//          kernel_t, kernel_f, stride_t, stride_f, classes, keyword_class
+//   float32 threshold
+//   float32 conv    [channels][kernel_t][kernel_f], bias [channels]
+//   per block:
+//   float32 dw      [channels][3][3], bias [channels]
+//   float32 pw      [channels out][channels in], bias [channels]
+//   float32 fc      [classes][channels], bias [classes]
+// Inputs are (log10 mel + 4) / 4, Whisper's scaling. n_mels may be below
+// the front end's 80 if it divides it; adjacent bands are averaged.
+// audio_control/kws_export.py writes this from a trained Keras DS-CNN, and
+// g1_asr_bench --kws_selftest checks a model file against the layout.
+struct DsCnnModel {
+  uint32_t n_mels = 0;
+  uint32_t n_frames = 0;
+  uint32_t channels = 0;
+  uint32_t blocks = 0;
+  uint32_t kernel_t = 0;
+  uint32_t kernel_f = 0;
+  uint32_t stride_t = 1;
+  uint32_t stride_f = 1;
+  uint32_t classes = 0;
+  uint32_t keyword_class = 0;
+  float threshold = 0.5f;
+  // After Load() the weights are tap-major with channels innermost
+  // (conv [kernel_t * kernel_f][channels], dw [9][channels], pw [in][out])
+  // so the inference loops run over contiguous channels.
+  std::vector<float> conv;
+  std::vector<float> conv_bias;
+  std::vector<float> dw;  // blocks * channels * 9
+  std::vector<float> dw_bias;
+  std::vector<float> pw;  // blocks * channels * channels
+  std::vector<float> pw_bias;
+  std::vector<float> fc;
+  std::vector<float> fc_bias;
+
+  bool Load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::cout << "Failed to open KWS model: " << path << std::endl;
+      return false;
+    }
+    uint32_t header[12];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        !in.read(reinterpret_cast<char*>(&threshold), sizeof(threshold))) {
+      std::cout << "KWS model truncated: " << path << std::endl;
+      return false;
+    }
+    if (header[0] != 0x574b3147u || header[1] != 1) {
+      std::cout << "Not a version 1 KWS model: " << path << std::endl;
+      return false;
+    }
+    n_mels = header[2];
+    n_frames = header[3];
+    channels = header[4];
+    blocks = header[5];
+    kernel_t = header[6];
+    kernel_f = header[7];
+    stride_t = header[8];
+    stride_f = header[9];
+    classes = header[10];
+    keyword_class = header[11];
+    if (n_mels == 0 || n_frames == 0 || channels == 0 || kernel_t == 0 ||
+        kernel_f == 0 || stride_t == 0 || stride_f == 0 ||
+        keyword_class >= classes) {
+      std::cout << "Bad KWS model dimensions: " << path << std::endl;
+      return false;
+    }
+    const size_t c = channels;
+    const bool ok = Read(in, &conv, c * kernel_t * kernel_f) &&
+                    Read(in, &conv_bias, c) &&
+                    ReadBlocks(in, c) &&
+                    Read(in, &fc, classes * c) && Read(in, &fc_bias, classes);
+    if (!ok) {
+      std::cout << "KWS model truncated: " << path << std::endl;
+      return false;
+    }
+    conv = Transpose(conv, 0, c, kernel_t * kernel_f);
+    for (uint32_t b = 0; b < blocks; ++b) {
+      dw = Transpose(dw, b * c * 9, c, 9);
+      pw = Transpose(pw, b * c * c, c, c);
+    }
+    return true;
+  }
+
+ private:
+  // Transposes the rows x cols matrix at `offset` in `v`.
+  static std::vector<float> Transpose(const std::vector<float>& v,
+                                      size_t offset, size_t rows,
+                                      size_t cols) {
+    std::vector<float> out = v;
+    for (size_t r = 0; r < rows; ++r) {
+      for (size_t col = 0; col < cols; ++col) {
+        out[offset + col * rows + r] = v[offset + r * cols + col];
+      }
+    }
+    return out;
+  }
+
+  static bool Read(std::istream& in, std::vector<float>* out, size_t n) {
+    const size_t old = out->size();
+    out->resize(old + n);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&(*out)[old]),
+                                     n * sizeof(float)));
+  }
+
+  bool ReadBlocks(std::istream& in, size_t c) {
+    for (uint32_t b = 0; b < blocks; ++b) {
+      if (!Read(in, &dw, c * 9) || !Read(in, &dw_bias, c) ||
+          !Read(in, &pw, c * c) || !Read(in, &pw_bias, c)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+struct KeywordSpotterOptions {
+  // Run the network every this many 10 ms frames.
+  int eval_every_frames = 10;
+  // Keyword posterior is averaged over this many evaluations.
+  int smooth_evals = 3;
+  // Detection threshold; <= 0 uses the model's.
+  float threshold = 0.f;
+  // No second detection within this long of the first.
+  int refractory_ms = 1500;
+};
+
+struct KeywordSpotterStats {
+  uint64_t audio_ms = 0;
+  uint64_t evaluations = 0;
+  uint64_t detections = 0;
+  double cpu_ms = 0.0;  // thread CPU time spent in Update(), mels excluded
+};
+
+// Always-on keyword spotter over a shared MelStream: its log-mel frames
+// into a sliding window, the DS-CNN every few frames, smoothed posterior
+// against a threshold.
+class KeywordSpotter {
+ public:
+  explicit KeywordSpotter(const KeywordSpotterOptions& options = {})
+      : options_(options) {}
+
+  bool Load(const std::string& path) {
+    DsCnnModel model;
+    if (!model.Load(path)) {
+      return false;
+    }
+    if (model.n_mels > frontend_mels_ || frontend_mels_ % model.n_mels != 0) {
+      std::cout << "KWS model wants " << model.n_mels
+                << " mel bands; the front end has " << frontend_mels_
+                << std::endl;
+      return false;
+    }
+    model_ = std::move(model);
+    loaded_ = true;
+    window_.assign(model_.n_frames * model_.n_mels, 0.f);
+    threshold_ = options_.threshold > 0.f ? options_.threshold
+                                           : model_.threshold;
+    Reset();
+    return true;
+  }
+
+  bool loaded() const { return loaded_; }
+  float threshold() const { return threshold_; }
+  float last_score() const { return score_; }
+
+  // Also rewinds to the start of a new stream.
+  void Reset() {
+    next_frame_ = 0;
+    window_start_ = 0;
+    window_frames_ = 0;
+    posteriors_.clear();
+    since_eval_ = 0;
+    refractory_frames_ = 0;
+    score_ = 0.f;
+  }
+
+  // Consumes the frames `mel` gained since the last call. True if the
+  // keyword was detected in them.
+  bool Update(const MelStream& mel) {
+    if (!loaded_ || mel.n_mels() != frontend_mels_) {
+      return false;
+    }
+    const double cpu_start = ThreadCpuMs();
+    if (next_frame_ < mel.begin_frame()) {
+      // Fell behind the ring; the window restarts.
+      window_start_ = 0;
+      window_frames_ = 0;
+      next_frame_ = mel.begin_frame();
+    }
+    const uint64_t added = mel.end_frame() - next_frame_;
+    bool detected = false;
+    for (; next_frame_ < mel.end_frame(); ++next_frame_) {
+      AddFrame(mel.Frame(next_frame_));
+      if (refractory_frames_ > 0) {
+        --refractory_frames_;
+      }
+      if (window_frames_ < model_.n_frames ||
+          ++since_eval_ < options_.eval_every_frames) {
+        continue;
+      }
+      since_eval_ = 0;
+      posteriors_.push_back(Evaluate());
+      if (posteriors_.size() > static_cast<size_t>(options_.smooth_evals)) {
+        posteriors_.pop_front();
+      }
+      float sum = 0.f;
+      for (float p : posteriors_) {
+        sum += p;
+      }
+      score_ = sum / posteriors_.size();
+      if (score_ >= threshold_ && refractory_frames_ == 0) {
+        detected = true;
+        ++stats_.detections;
+        refractory_frames_ = options_.refractory_ms / 10;
+        posteriors_.clear();
+      }
+    }
+    stats_.audio_ms += added * mel.hop_ms();
+    stats_.cpu_ms += ThreadCpuMs() - cpu_start;
+    return detected;
+  }
+
+  const KeywordSpotterStats& stats() const { return stats_; }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const double hours = stats_.audio_ms / 3.6e6;
+    out << "[kws] audio_s=" << stats_.audio_ms / 1000
+        << " detections=" << stats_.detections;
+    if (hours > 0) {
+      out << " (" << stats_.detections / hours << "/hour)"
+          << " cpu_ms_per_s=" << stats_.cpu_ms / (stats_.audio_ms / 1000.0);
+    }
+    out << " evaluations=" << stats_.evaluations << std::endl;
+  }
+
+ private:
+  // Scales `mel` into the window, over its oldest frame once it is full.
+  void AddFrame(const float* mel) {
+    const size_t n = model_.n_frames;
+    const size_t group = frontend_mels_ / model_.n_mels;
+    float* row = WindowRow(window_frames_ % n);
+    for (size_t m = 0; m < model_.n_mels; ++m) {
+      float sum = 0.f;
+      for (size_t g = 0; g < group; ++g) {
+        sum += mel[m * group + g];
+      }
+      row[m] = (sum / group + 4.f) / 4.f;
+    }
+    if (window_frames_ < n) {
+      ++window_frames_;
+    } else {
+      window_start_ = (window_start_ + 1) % n;
+    }
+  }
+
+  // Frame `index` of the window, 0 being the oldest.
+  float* WindowRow(size_t index) {
+    return &window_[((window_start_ + index) % model_.n_frames) *
+                    model_.n_mels];
+  }
+
+  // TensorFlow "SAME" padding.
+  static void SamePadding(size_t in, size_t kernel, size_t stride,
+                          size_t* out, size_t* pad_before) {
+    *out = (in + stride - 1) / stride;
+    const size_t needed = (*out - 1) * stride + kernel;
+    *pad_before = needed > in ? (needed - in) / 2 : 0;
+  }
+
+  // Keyword posterior for the current window.
+  float Evaluate() {
+    ++stats_.evaluations;
+    const size_t c = model_.channels;
+    size_t out_t, out_f, pad_t, pad_f;
+    SamePadding(model_.n_frames, model_.kernel_t, model_.stride_t, &out_t,
+                &pad_t);
+    SamePadding(model_.n_mels, model_.kernel_f, model_.stride_f, &out_f,
+                &pad_f);
+
+    // First convolution, channel-last output [t][f][c].
+    act_.assign(out_t * out_f * c, 0.f);
+    for (size_t t = 0; t < out_t; ++t) {
+      for (size_t f = 0; f < out_f; ++f) {
+        float* dst = &act_[(t * out_f + f) * c];
+        std::copy(model_.conv_bias.begin(), model_.conv_bias.end(), dst);
+        for (size_t kt = 0; kt < model_.kernel_t; ++kt) {
+          const long it = static_cast<long>(t * model_.stride_t + kt) -
+                          static_cast<long>(pad_t);
+          if (it < 0 || it >= static_cast<long>(model_.n_frames)) {
+            continue;
+          }
+          const float* row = WindowRow(it);
+          for (size_t kf = 0; kf < model_.kernel_f; ++kf) {
+            const long jf = static_cast<long>(f * model_.stride_f + kf) -
+                            static_cast<long>(pad_f);
+            if (jf < 0 || jf >= static_cast<long>(model_.n_mels)) {
+              continue;
+            }
+            const float x = row[jf];
+            const float* w =
+                &model_.conv[(kt * model_.kernel_f + kf) * c];
+            for (size_t ch = 0; ch < c; ++ch) {
+              dst[ch] += x * w[ch];
+            }
+          }
+        }
+        for (size_t ch = 0; ch < c; ++ch) {
+          dst[ch] = std::max(dst[ch], 0.f);
+        }
+      }
+    }
+
+    for (uint32_t b = 0; b < model_.blocks; ++b) {
+      Depthwise(b, out_t, out_f);
+      Pointwise(b, out_t * out_f);
+    }
+
+    // Average pool, fully connected, softmax.
+    std::vector<float> pooled(c, 0.f);
+    const size_t positions = out_t * out_f;
+    for (size_t p = 0; p < positions; ++p) {
+      for (size_t ch = 0; ch < c; ++ch) {
+        pooled[ch] += act_[p * c + ch];
+      }
+    }
+    std::vector<float> logits(model_.classes);
+    float max_logit = -1e30f;
+    for (size_t k = 0; k < model_.classes; ++k) {
+      float sum = model_.fc_bias[k];
+      for (size_t ch = 0; ch < c; ++ch) {
+        sum += model_.fc[k * c + ch] * pooled[ch] / positions;
+      }
+      logits[k] = sum;
+      max_logit = std::max(max_logit, sum);
+    }
+    float total = 0.f;
+    for (float& l : logits) {
+      l = std::exp(l - max_logit);
+      total += l;
+    }
+    return logits[model_.keyword_class] / total;
+  }
+
+  // 3x3 depthwise, stride 1, SAME padding, ReLU.
+  void Depthwise(uint32_t block, size_t height, size_t width) {
+    const size_t c = model_.channels;
+    const float* w = &model_.dw[block * c * 9];
+    const float* bias = &model_.dw_bias[block * c];
+    tmp_.resize(act_.size());
+    for (size_t t = 0; t < height; ++t) {
+      for (size_t f = 0; f < width; ++f) {
+        float* dst = &tmp_[(t * width + f) * c];
+        std::copy(bias, bias + c, dst);
+        for (int dt = -1; dt <= 1; ++dt) {
+          const long it = static_cast<long>(t) + dt;
+          if (it < 0 || it >= static_cast<long>(height)) {
+            continue;
+          }
+          for (int df = -1; df <= 1; ++df) {
+            const long jf = static_cast<long>(f) + df;
+            if (jf < 0 || jf >= static_cast<long>(width)) {
+              continue;
+            }
+            const float* src = &act_[(it * width + jf) * c];
+            const float* tap = &w[((dt + 1) * 3 + (df + 1)) * c];
+            for (size_t ch = 0; ch < c; ++ch) {
+              dst[ch] += src[ch] * tap[ch];
+            }
+          }
+        }
+        for (size_t ch = 0; ch < c; ++ch) {
+          dst[ch] = std::max(dst[ch], 0.f);
+        }
+      }
+    }
+    act_.swap(tmp_);
+  }
+
+  // 1x1 convolution across channels, ReLU.
+  void Pointwise(uint32_t block, size_t positions) {
+    const size_t c = model_.channels;
+    const float* w = &model_.pw[block * c * c];
+    const float* bias = &model_.pw_bias[block * c];
+    tmp_.resize(act_.size());
+    for (size_t p = 0; p < positions; ++p) {
+      const float* src = &act_[p * c];
+      float* dst = &tmp_[p * c];
+      std::copy(bias, bias + c, dst);
+      for (size_t i = 0; i < c; ++i) {
+        const float x = src[i];
+        const float* row = &w[i * c];
+        for (size_t o = 0; o < c; ++o) {
+          dst[o] += row[o] * x;
+        }
+      }
+      for (size_t o = 0; o < c; ++o) {
+        dst[o] = std::max(dst[o], 0.f);
+      }
+    }
+    act_.swap(tmp_);
+  }
+
+  KeywordSpotterOptions options_;
+  size_t frontend_mels_ = LogMelOptions().n_mels;
+  uint64_t next_frame_ = 0;
+  DsCnnModel model_;
+  bool loaded_ = false;
+  float threshold_ = 0.5f;
+  // The last n_frames model-scaled frames, a ring of n_mels rows from
+  // window_start_.
+  std::vector<float> window_;
+  size_t window_start_ = 0;
+  size_t window_frames_ = 0;
+  std::deque<float> posteriors_;
+  std::vector<float> act_;
+  std::vector<float> tmp_;
+  int since_eval_ = 0;
+  int refractory_frames_ = 0;
+  float score_ = 0.f;
+  KeywordSpotterStats stats_;
+};
+
+}  // namespace g1_common
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "led_scheduler.hpp"
+
+namespace g1_common {
+
+// Where rendered frames go. `time_ms` is the engine clock of the frame.
+class LedSink {
+ public:
+  virtual ~LedSink() = default;
+  virtual void Show(const LedColor& color, uint32_t time_ms) = 0;
+};
+
+// Hands frames to a LedScheduler, which decides what is worth an RPC.
+class SchedulerLedSink : public LedSink {
+ public:
+  explicit SchedulerLedSink(LedScheduler* scheduler) : scheduler_(scheduler) {}
+  void Show(const LedColor& color, uint32_t) override {
+    scheduler_->SetTarget(color);
+  }
+
+ private:
+  LedScheduler* scheduler_;
+};
+
+// Keeps every frame; for tests and TEST modes.
+class RecordingLedSink : public LedSink {
+ public:
+  struct Frame {
+    uint32_t time_ms;
+    LedColor color;
+  };
+
+  void Show(const LedColor& color, uint32_t time_ms) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.push_back(Frame{time_ms, color});
+  }
+
+  std::vector<Frame> frames() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<Frame> frames_;
+};
+
+// An animation baked into a table: one Q8.8 RGB triple per tick. Playing it
+// is an index computation plus, for envelope-driven animations, one integer
+// multiply per channel.
+struct CompiledLedAnimation {
+  uint32_t tick_ms = 20;
+  bool loop = false;
+  bool envelope = false;
+  uint16_t envelope_floor_q8 = 0;    // brightness at zero envelope, 0..256
+  std::vector<uint16_t> rgb_q8;      // 3 entries per frame
+
+  size_t frames() const { return rgb_q8.size() / 3; }
+  uint32_t duration_ms() const {
+    return static_cast<uint32_t>(frames()) * tick_ms;
+  }
+};
+
+// Declarative description of an animation as a chain of segments starting
+// from `start`. Compile() samples it once into a CompiledLedAnimation.
+//
+//   LedTimeline(off).FadeTo(blue, 500).Hold(1000).FadeTo(off, 500).Loop()
+class LedTimeline {
+ public:
+  explicit LedTimeline(const LedColor& start = LedColor{}) : start_(start) {}
+
+  // Linear fade from the current colour.
+  LedTimeline& FadeTo(const LedColor& color, uint32_t ms) {
+    segments_.push_back(Segment{color, ms, true});
+    return *this;
+  }
+  LedTimeline& Hold(uint32_t ms) {
+    segments_.push_back(Segment{Current(), ms, false});
+    return *this;
+  }
+  // Switch instantly, then hold for `ms`.
+  LedTimeline& Set(const LedColor& color, uint32_t ms) {
+    segments_.push_back(Segment{color, ms, false});
+    return *this;
+  }
+  // Appends the segments so far `times - 1` more times.
+  LedTimeline& Repeat(int times) {
+    const std::vector<Segment> once = segments_;
+    for (int i = 1; i < times; ++i) {
+      segments_.insert(segments_.end(), once.begin(), once.end());
+    }
+    return *this;
+  }
+  LedTimeline& Loop(bool loop = true) {
+    loop_ = loop;
+    return *this;
+  }
+  // Scale brightness by the engine's envelope; `floor` is the brightness
+  // kept at silence.
+  LedTimeline& FollowEnvelope(float floor = 0.f) {
+    envelope_ = true;
+    envelope_floor_ = std::clamp(floor, 0.f, 1.f);
+    return *this;
+  }
+
+  CompiledLedAnimation Compile(uint32_t tick_ms = 20) const {
+    CompiledLedAnimation out;
+    out.tick_ms = tick_ms;
+    out.loop = loop_;
+    out.envelope = envelope_;
+    out.envelope_floor_q8 =
+        static_cast<uint16_t>(std::lround(envelope_floor_ * 256.f));
+    LedColor from = start_;
+    for (const Segment& seg : segments_) {
+      const uint32_t n =
+          std::max<uint32_t>(1, (seg.ms + tick_ms / 2) / tick_ms);
+      for (uint32_t i = 0; i < n; ++i) {
+        const float t = seg.fade ? static_cast<float>(i + 1) / n : 1.f;
+        Emit(&out, from, seg.color, t);
+      }
+      from = seg.color;
+    }
+    if (out.rgb_q8.empty()) {
+      Emit(&out, start_, start_, 1.f);
+    }
+    return out;
+  }
+
+ private:
+  struct Segment {
+    LedColor color;
+    uint32_t ms;
+    bool fade;
+  };
+
+  LedColor Current() const {
+    return segments_.empty() ? start_ : segments_.back().color;
+  }
+
+  static void Emit(CompiledLedAnimation* out, const LedColor& a,
+                   const LedColor& b, float t) {
+    auto q8 = [t](uint8_t x, uint8_t y) {
+      return static_cast<uint16_t>(std::lround((x + (y - x) * t) * 256.f));
+    };
+    out->rgb_q8.push_back(q8(a.r, b.r));
+    out->rgb_q8.push_back(q8(a.g, b.g));
+    out->rgb_q8.push_back(q8(a.b, b.b));
+  }
+
+  LedColor start_;
+  std::vector<Segment> segments_;
+  bool loop_ = false;
+  bool envelope_ = false;
+  float envelope_floor_ = 0.f;
+};
+
+// Stock animations.
+inline CompiledLedAnimation LedPulse(const LedColor& color, uint32_t period_ms,
+                                     float min_level = 0.1f) {
+  const LedColor low = LerpColor(LedColor{}, color, min_level);
+  return LedTimeline(low)
+      .FadeTo(color, period_ms / 2)
+      .FadeTo(low, period_ms / 2)
+      .Loop()
+      .Compile();
+}
+
+inline CompiledLedAnimation LedBlink(const LedColor& color, uint32_t on_ms,
+                                     uint32_t off_ms, int count) {
+  LedTimeline timeline;
+  timeline.Set(color, on_ms).Set(LedColor{}, off_ms);
+  if (count > 0) {
+    timeline.Repeat(count);
+  } else {
+    timeline.Loop();
+  }
+  return timeline.Compile();
+}
+
+// Cycles through `palette`, fading `segment_ms` between neighbours, with
+// brightness following the envelope.
+inline CompiledLedAnimation LedPaletteCycle(
+    const std::vector<LedColor>& palette, uint32_t segment_ms,
+    float envelope_floor = 0.f) {
+  LedTimeline timeline(palette.empty() ? LedColor{} : palette.front());
+  for (size_t i = 1; i <= palette.size(); ++i) {
+    timeline.FadeTo(palette[i % palette.size()], segment_ms);
+  }
+  return timeline.Loop().FollowEnvelope(envelope_floor).Compile();
+}
+
+// Priority layers; the highest active one is shown.
+enum LedLayer : int {
+  kLedLayerIdle = 0,
+  kLedLayerListening,
+  kLedLayerSpeaking,
+  kLedLayerError,
+  kLedLayerCount,
+};
+
+struct LedEnvelopeOptions {
+  // One-pole time constants for envelope levels. Use 0 for sources that
+  // are already smoothed (e.g. an EnvelopeFollower).
+  float attack_ms = 40.f;
+  float release_ms = 250.f;
+};
+
+// Plays compiled animations on priority layers and renders the winner to a
+// single LedSink. Tick() drives it from any clock (tests pass synthetic
+// times); Start() runs it on its own thread against steady_clock.
+class LedAnimationEngine {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit LedAnimationEngine(LedSink* sink, uint32_t tick_ms = 20,
+                              const LedEnvelopeOptions& envelope = {})
+      : sink_(sink), tick_ms_(tick_ms), envelope_options_(envelope) {}
+
+  ~LedAnimationEngine() { Stop(); }
+
+  LedAnimationEngine(const LedAnimationEngine&) = delete;
+  LedAnimationEngine& operator=(const LedAnimationEngine&) = delete;
+
+  // Starts `animation` on `layer` at the next tick, replacing whatever was
+  // there. One-shot animations clear their layer when they end.
+  void Play(LedLayer layer,
+            std::shared_ptr<const CompiledLedAnimation> animation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    layers_[layer].animation = std::move(animation);
+    layers_[layer].restart = true;
+  }
+  void Play(LedLayer layer, CompiledLedAnimation animation) {
+    Play(layer,
+         std::make_shared<const CompiledLedAnimation>(std::move(animation)));
+  }
+
+  void Clear(LedLayer layer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    layers_[layer].animation.reset();
+  }
+
+  bool active(LedLayer layer) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return layers_[layer].animation != nullptr;
+  }
+
+  // Audio level 0..1 for envelope-driven animations; smoothed per tick.
+  void SetEnvelope(float level) {
+    envelope_target_.store(std::clamp(level, 0.f, 1.f));
+  }
+
+  // Polled once per tick instead of the SetEnvelope() level, e.g. a
+  // PlaybackEnvelope so brightness follows the audio being heard right now.
+  // Pass nullptr to go back to SetEnvelope().
+  void SetEnvelopeSource(std::function<float()> source) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    envelope_source_ = std::move(source);
+  }
+
+  // Renders the frame for `now_ms` and sends it if it differs from the
+  // last one.
+  void Tick(uint32_t now_ms) {
+    LedColor color;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      UpdateEnvelope(now_ms);
+      color = RenderLocked(now_ms);
+    }
+    if (!have_shown_ || color != last_shown_) {
+      sink_->Show(color, now_ms);
+      last_shown_ = color;
+      have_shown_ = true;
+    }
+  }
+
+  void Start() {
+    if (running_.exchange(true)) {
+      return;
+    }
+    thread_ = std::thread([this] {
+      const Clock::time_point origin = Clock::now();
+      Clock::time_point next = origin;
+      while (running_.load()) {
+        Tick(static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                Clock::now() - origin)
+                .count()));
+        next += std::chrono::milliseconds(tick_ms_);
+        std::this_thread::sleep_until(next);
+      }
+    });
+  }
+
+  void Stop() {
+    if (running_.exchange(false)) {
+      thread_.join();
+    }
+  }
+
+  uint32_t tick_ms() const { return tick_ms_; }
+
+ private:
+  struct LayerState {
+    std::shared_ptr<const CompiledLedAnimation> animation;
+    uint32_t start_ms = 0;
+    bool restart = false;
+  };
+
+  void UpdateEnvelope(uint32_t now_ms) {
+    const float dt = have_envelope_time_
+                         ? static_cast<float>(now_ms - envelope_time_ms_)
+                         : static_cast<float>(tick_ms_);
+    envelope_time_ms_ = now_ms;
+    have_envelope_time_ = true;
+    const float target = envelope_source_
+                             ? std::clamp(envelope_source_(), 0.f, 1.f)
+                             : envelope_target_.load();
+    const float tau = target > envelope_ ? envelope_options_.attack_ms
+                                         : envelope_options_.release_ms;
+    envelope_ += (target - envelope_) *
+                 (tau <= 0.f ? 1.f : 1.f - std::exp(-dt / tau));
+  }
+
+  LedColor RenderLocked(uint32_t now_ms) {
+    for (int l = kLedLayerCount - 1; l >= 0; --l) {
+      LayerState& layer = layers_[l];
+      if (!layer.animation) {
+        continue;
+      }
+      if (layer.restart) {
+        layer.start_ms = now_ms;
+        layer.restart = false;
+      }
+      const CompiledLedAnimation& anim = *layer.animation;
+      size_t frame = (now_ms - layer.start_ms) / anim.tick_ms;
+      if (frame >= anim.frames()) {
+        if (!anim.loop) {
+          layer.animation.reset();
+          continue;
+        }
+        frame %= anim.frames();
+      }
+      const uint16_t* q = &anim.rgb_q8[frame * 3];
+      // Q8.8 colour x Q8 gain -> 8 bit.
+      uint32_t gain = 256;
+      if (anim.envelope) {
+        gain = anim.envelope_floor_q8 +
+               static_cast<uint32_t>(std::lround(
+                   envelope_ * (256 - anim.envelope_floor_q8)));
+      }
+      auto channel = [gain](uint16_t v) {
+        return static_cast<uint8_t>(
+            std::min<uint32_t>(255, (v * gain + (1u << 15)) >> 16));
+      };
+      return LedColor{channel(q[0]), channel(q[1]), channel(q[2])};
+    }
+    return LedColor{};
+  }
+
+  LedSink* sink_;
+  uint32_t tick_ms_;
+  LedEnvelopeOptions envelope_options_;
+  mutable std::mutex mutex_;
+  std::array<LayerState, kLedLayerCount> layers_;
+  std::atomic<float> envelope_target_{0.f};
+  std::function<float()> envelope_source_;
+  float envelope_ = 0.f;
+  uint32_t envelope_time_ms_ = 0;
+  bool have_envelope_time_ = false;
+  LedColor last_shown_;
+  bool have_shown_ = false;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
+
+}  // namespace g1_common
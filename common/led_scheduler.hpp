@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace g1_common {
+
+struct LedColor {
+  uint8_t r = 0;
+  uint8_t g = 0;
+  uint8_t b = 0;
+
+  bool operator==(const LedColor& o) const {
+    return r == o.r && g == o.g && b == o.b;
+  }
+  bool operator!=(const LedColor& o) const { return !(*this == o); }
+};
+
+// Approximate perceived distance between two colours ("redmean" weighting;
+// 0..~765). Steps below ~8 are hard to see on the head LED.
+inline float LedColorDistance(const LedColor& a, const LedColor& b) {
+  const float rmean = (a.r + b.r) * 0.5f;
+  const float dr = static_cast<float>(a.r) - b.r;
+  const float dg = static_cast<float>(a.g) - b.g;
+  const float db = static_cast<float>(a.b) - b.b;
+  return std::sqrt((2.f + rmean / 256.f) * dr * dr + 4.f * dg * dg +
+                   (2.f + (255.f - rmean) / 256.f) * db * db);
+}
+
+inline LedColor LerpColor(const LedColor& a, const LedColor& b, float t) {
+  auto mix = [t](uint8_t x, uint8_t y) {
+    return static_cast<uint8_t>(std::lround(x + (y - x) * t));
+  };
+  return LedColor{mix(a.r, b.r), mix(a.g, b.g), mix(a.b, b.b)};
+}
+
+struct LedSchedulerOptions {
+  // Upper bound on LedControl calls; the audio service starts queueing
+  // requests well above this.
+  float max_rate_hz = 20.f;
+  // Frames closer than this to the last one sent are skipped...
+  float min_delta = 8.f;
+  // ...unless the target has stayed put this long, so the exact final
+  // colour always lands.
+  std::chrono::milliseconds settle_time{250};
+};
+
+// Owns the LED. Callers set the colour they want (optionally with a fade
+// time) as often as they like; a single thread sends at most max_rate_hz
+// LedControl calls, interpolating fades itself and skipping frames that
+// wouldn't visibly change the LED. Only the newest target is kept.
+class LedScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Writer = std::function<int32_t(uint8_t, uint8_t, uint8_t)>;
+
+  struct Stats {
+    uint64_t requests = 0;  // SetTarget calls
+    uint64_t sent = 0;      // LedControl calls
+    uint64_t skipped = 0;   // frames below min_delta
+    uint64_t failures = 0;  // LedControl returned non-zero
+  };
+
+  explicit LedScheduler(Writer writer,
+                        const LedSchedulerOptions& options = {})
+      : writer_(std::move(writer)), options_(options) {
+    thread_ = std::thread(&LedScheduler::Loop, this);
+  }
+
+  ~LedScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  LedScheduler(const LedScheduler&) = delete;
+  LedScheduler& operator=(const LedScheduler&) = delete;
+
+  // Fades from the colour currently being shown to `color` over `fade`.
+  void SetTarget(const LedColor& color,
+                 Clock::duration fade = Clock::duration::zero()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      from_ = shown_;
+      to_ = color;
+      fade_start_ = Clock::now();
+      fade_ = fade;
+      settled_ = false;
+      ++stats_.requests;
+    }
+    cv_.notify_all();
+  }
+
+  void SetTarget(uint8_t r, uint8_t g, uint8_t b,
+                 Clock::duration fade = Clock::duration::zero()) {
+    SetTarget(LedColor{r, g, b}, fade);
+  }
+
+  // Blocks until the current target has been sent (or `timeout` passes).
+  bool Flush(Clock::duration timeout = std::chrono::seconds(5)) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [this] { return settled_; });
+  }
+
+  LedColor shown() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return shown_;
+  }
+
+  int32_t last_ret() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_ret_;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const Stats s = stats();
+    out << "[led] requests=" << s.requests << " sent=" << s.sent
+        << " skipped=" << s.skipped << " failures=" << s.failures << std::endl;
+  }
+
+ private:
+  void Loop() {
+    const auto min_interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(1.f / options_.max_rate_hz));
+    Clock::time_point last_send = Clock::now() - min_interval;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stopping_ || !settled_; });
+      if (stopping_) {
+        return;
+      }
+      // Rate cap: wait out the rest of the interval (new targets may land
+      // meanwhile; only the newest is used).
+      const Clock::time_point earliest = last_send + min_interval;
+      if (Clock::now() < earliest) {
+        cv_.wait_until(lock, earliest, [this] { return stopping_; });
+        if (stopping_) {
+          return;
+        }
+      }
+
+      const Clock::time_point now = Clock::now();
+      const bool fade_done = fade_ <= Clock::duration::zero() ||
+                             now - fade_start_ >= fade_;
+      LedColor frame = to_;
+      if (!fade_done) {
+        const float t = std::chrono::duration<float>(now - fade_start_) /
+                        std::chrono::duration<float>(fade_);
+        frame = LerpColor(from_, to_, t);
+      }
+
+      // The LED's state is unknown until the first send.
+      if (shown_valid_ && frame == shown_ && fade_done) {
+        settled_ = true;
+        cv_.notify_all();
+        continue;
+      }
+      const bool settling = fade_done &&
+                            now - fade_start_ - fade_ >= options_.settle_time;
+      if (shown_valid_ && !settling &&
+          LedColorDistance(frame, shown_) < options_.min_delta) {
+        // Nothing visible yet; look again after one more interval.
+        ++stats_.skipped;
+        last_send = now;
+        continue;
+      }
+
+      lock.unlock();
+      const int32_t ret = writer_(frame.r, frame.g, frame.b);
+      lock.lock();
+      last_send = Clock::now();
+      last_ret_ = ret;
+      ++stats_.sent;
+      if (ret != 0) {
+        ++stats_.failures;
+      }
+      shown_ = frame;
+      shown_valid_ = true;
+      if (fade_done && frame == to_) {
+        settled_ = true;
+        cv_.notify_all();
+      }
+    }
+  }
+
+  Writer writer_;
+  LedSchedulerOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  LedColor shown_;
+  bool shown_valid_ = false;
+  LedColor from_;
+  LedColor to_;
+  Clock::time_point fade_start_{};
+  Clock::duration fade_{};
+  bool settled_ = true;
+  bool stopping_ = false;
+  int32_t last_ret_ = 0;
+  Stats stats_;
+  std::thread thread_;
+};
+
+}  // namespace g1_common
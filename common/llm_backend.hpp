@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rpc_executor.hpp"
+
+namespace g1_common {
+
+struct LlmRequest {
+  std::string messages_json;  // OpenAI-style "messages" array
+  int max_tokens = 150;
+  float temperature = 0.7f;
+};
+
+// A chat completion service (a hosted API, a local server, ...).
+class LlmBackend {
+ public:
+  virtual ~LlmBackend() = default;
+
+  virtual std::string name() const = 0;
+
+  // Blocks until the reply is in *reply (true) or a speakable error is
+  // (false). Should give up soon after `cancel` is set.
+  virtual bool Complete(const LlmRequest& request,
+                        const std::atomic<bool>& cancel,
+                        std::string* reply) = 0;
+};
+
+struct LlmRouterOptions {
+  // Labels the stats.
+  std::string name = "llm";
+  // Longest Complete() waits for a usable reply.
+  int budget_ms = 10000;
+  // The fallbacks start once the preferred backend has failed or has not
+  // answered within this long; 0 races every backend from the start.
+  int hedge_after_ms = 2500;
+};
+
+struct LlmBackendStats {
+  uint64_t wins = 0;
+  uint64_t failures = 0;
+  uint64_t late = 0;  // answered after another backend won or the budget
+};
+
+struct LlmRouterStats {
+  uint64_t requests = 0;
+  uint64_t timeouts = 0;
+  uint64_t failures = 0;  // every backend failed
+  std::vector<LlmBackendStats> backends;
+};
+
+// Sends each request to a list of backends in order of preference and
+// returns the first usable reply.
+//
+// Every backend runs on its own RpcExecutor, one request at a time. The
+// loser of a race is cancelled and finishes in the background, and a
+// request that was still queued when its race ended is skipped, so a slow
+// local model never works through a backlog. The preferred backend starts
+// at once; the others join at hedge_after_ms or as soon as it fails, so a
+// down uplink costs a connect timeout rather than the whole budget.
+// Complete() is for one caller thread at a time; give each thread that
+// needs completions its own router.
+class LlmRouter {
+ public:
+  explicit LlmRouter(const LlmRouterOptions& options = {})
+      : options_(options) {}
+
+  // Cancels requests in flight and waits for their backends to return.
+  ~LlmRouter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (current_) {
+        current_->cancel.store(true);
+      }
+    }
+    executors_.clear();
+  }
+
+  LlmRouter(const LlmRouter&) = delete;
+  LlmRouter& operator=(const LlmRouter&) = delete;
+
+  // Backends are preferred in the order they are added. Add them all
+  // before the first Complete().
+  void Add(std::unique_ptr<LlmBackend> backend) {
+    executors_.push_back(std::make_unique<RpcExecutor>(options_.name + "/" +
+                                                       backend->name()));
+    backends_.push_back(std::move(backend));
+    stats_.backends.emplace_back();
+  }
+
+  size_t size() const { return backends_.size(); }
+  const LlmBackend& backend(size_t index) const { return *backends_[index]; }
+
+  // Returns true with the winning reply, or false with the preferred
+  // backend's error (or a timeout message). *winner is the index of the
+  // backend that answered, -1 if none did.
+  bool Complete(const LlmRequest& request, std::string* reply,
+                int* winner = nullptr) {
+    if (winner != nullptr) {
+      *winner = -1;
+    }
+    if (backends_.empty()) {
+      *reply = "Error: no language model configured.";
+      return false;
+    }
+    auto race = std::make_shared<Race>();
+    race->request = request;
+    race->errors.resize(backends_.size());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      current_ = race;
+      ++stats_.requests;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline =
+        start + std::chrono::milliseconds(options_.budget_ms);
+    const auto hedge_at =
+        start + std::chrono::milliseconds(options_.hedge_after_ms);
+    size_t started = 0;
+    Start(race, started++);
+
+    std::unique_lock<std::mutex> lock(race->mutex);
+    while (race->winner < 0) {
+      const auto now = std::chrono::steady_clock::now();
+      if (started < backends_.size() &&
+          (now >= hedge_at || race->finished == started)) {
+        lock.unlock();
+        while (started < backends_.size()) {
+          Start(race, started++);
+        }
+        lock.lock();
+        continue;
+      }
+      if (race->finished == backends_.size() || now >= deadline) {
+        break;
+      }
+      race->cv.wait_until(
+          lock, started < backends_.size() ? std::min(hedge_at, deadline)
+                                           : deadline);
+    }
+    race->cancel.store(true);
+    race->closed = true;
+    const int won = race->winner;
+    if (won >= 0) {
+      *reply = race->reply;
+    } else if (race->finished == backends_.size()) {
+      *reply = race->errors[0];
+    } else {
+      *reply = "Error: no reply within " + std::to_string(options_.budget_ms) +
+               " ms.";
+    }
+    const bool timed_out = won < 0 && race->finished < backends_.size();
+    lock.unlock();
+
+    std::lock_guard<std::mutex> stats_lock(mutex_);
+    if (won >= 0) {
+      ++stats_.backends[won].wins;
+    } else if (timed_out) {
+      ++stats_.timeouts;
+    } else {
+      ++stats_.failures;
+    }
+    if (current_ == race) {
+      current_.reset();
+    }
+    if (winner != nullptr) {
+      *winner = won;
+    }
+    return won >= 0;
+  }
+
+  LlmRouterStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const LlmRouterStats s = stats();
+    out << "[" << options_.name << "] requests=" << s.requests
+        << " timeouts=" << s.timeouts << " failures=" << s.failures
+        << std::endl;
+    for (size_t i = 0; i < backends_.size(); ++i) {
+      out << "  " << backends_[i]->name() << " wins=" << s.backends[i].wins
+          << " failures=" << s.backends[i].failures
+          << " late=" << s.backends[i].late << std::endl;
+      executors_[i]->PrintStats(out);
+    }
+  }
+
+ private:
+  struct Race {
+    LlmRequest request;
+    std::atomic<bool> cancel{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+    int winner = -1;
+    size_t finished = 0;
+    bool closed = false;  // Complete() has returned
+    std::string reply;
+    std::vector<std::string> errors;
+  };
+
+  void Start(const std::shared_ptr<Race>& race, size_t index) {
+    LlmBackend* backend = backends_[index].get();
+    auto text = std::make_shared<std::string>();
+    executors_[index]->Post(
+        "complete",
+        [race, backend, text]() -> int32_t {
+          if (race->cancel.load()) {
+            return kRpcCancelled;
+          }
+          return backend->Complete(race->request, race->cancel, text.get())
+                     ? 0
+                     : -1;
+        },
+        "",
+        [this, race, index, text](int32_t ret) {
+          Finish(race, index, ret, *text);
+        });
+  }
+
+  // Runs on the backend's executor thread. The stats are updated before
+  // Complete() can see the result, so they are current when it returns.
+  void Finish(const std::shared_ptr<Race>& race, size_t index, int32_t ret,
+              const std::string& text) {
+    {
+      std::lock_guard<std::mutex> lock(race->mutex);
+      ++race->finished;
+      std::lock_guard<std::mutex> stats_lock(mutex_);
+      if (race->closed || race->winner >= 0) {
+        ++stats_.backends[index].late;
+      } else if (ret == 0 && !text.empty()) {
+        race->winner = static_cast<int>(index);
+        race->reply = text;
+      } else {
+        race->errors[index] =
+            text.empty() ? backends_[index]->name() + " failed." : text;
+        ++stats_.backends[index].failures;
+      }
+    }
+    race->cv.notify_all();
+  }
+
+  LlmRouterOptions options_;
+  std::vector<std::unique_ptr<LlmBackend>> backends_;
+  // Declared after backends_ so they stop (and join) first.
+  std::vector<std::unique_ptr<RpcExecutor>> executors_;
+  mutable std::mutex mutex_;
+  std::shared_ptr<Race> current_;
+  LlmRouterStats stats_;
+};
+
+}  // namespace g1_common
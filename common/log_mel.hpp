@@ -0,0 +1,287 @@
+#pragma once
+
+#include <time.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "fft.hpp"
+
+namespace g1_common {
+
+// Defaults match Whisper's front end: 16 kHz, 25 ms Hann window, 10 ms
+// hop, 80 Slaney-normalised mel bands up to 8 kHz.
+struct LogMelOptions {
+  int sample_rate = 16000;
+  size_t window = 400;
+  size_t hop = 160;
+  size_t n_mels = 80;
+  float f_min = 0.f;
+  float f_max = 8000.f;
+};
+
+// Slaney mel scale (linear below 1 kHz, logarithmic above), as librosa
+// and Whisper use.
+inline double HzToMel(double hz) {
+  constexpr double kLinear = 200.0 / 3.0;
+  const double log_step = std::log(6.4) / 27.0;
+  return hz < 1000.0 ? hz / kLinear
+                     : 15.0 + std::log(hz / 1000.0) / log_step;
+}
+
+inline double MelToHz(double mel) {
+  constexpr double kLinear = 200.0 / 3.0;
+  const double log_step = std::log(6.4) / 27.0;
+  return mel < 15.0 ? mel * kLinear
+                     : 1000.0 * std::exp(log_step * (mel - 15.0));
+}
+
+// Band edges in Hz: band m spans edges[m]..edges[m + 2], peaking at
+// edges[m + 1].
+inline std::vector<double> MelBandEdges(const LogMelOptions& options) {
+  const double mel_lo = HzToMel(options.f_min);
+  const double mel_hi = HzToMel(options.f_max);
+  std::vector<double> edges(options.n_mels + 2);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    edges[i] = MelToHz(mel_lo + (mel_hi - mel_lo) * i / (edges.size() - 1));
+  }
+  return edges;
+}
+
+inline double ThreadCpuMs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Streaming log10 mel spectrogram. The FFT is window-length (400 points
+// for Whisper's settings) so bins and band energies match Whisper's STFT.
+class LogMelFrontend {
+ public:
+  explicit LogMelFrontend(const LogMelOptions& options = {})
+      : options_(options),
+        fft_(options.window),
+        window_(options.window),
+        frame_(options.window),
+        spectrum_(fft_.bins()),
+        power_(fft_.bins()) {
+    for (size_t i = 0; i < options_.window; ++i) {
+      // Periodic Hann, as torch.hann_window.
+      window_[i] = static_cast<float>(
+          0.5 - 0.5 * std::cos(2.0 * M_PI * i / options_.window));
+    }
+    BuildFilterbank();
+  }
+
+  size_t n_mels() const { return options_.n_mels; }
+  size_t hop() const { return options_.hop; }
+  const LogMelOptions& options() const { return options_; }
+
+  void Reset() { input_.clear(); }
+
+  // Appends n_mels() log10 band energies for every frame completed by
+  // `count` more samples to `out`. Returns the number of frames added.
+  size_t Push(const int16_t* pcm, size_t count, std::vector<float>* out) {
+    input_.insert(input_.end(), pcm, pcm + count);
+    size_t frames = 0;
+    size_t pos = 0;
+    while (input_.size() - pos >= options_.window) {
+      ComputeFrame(&input_[pos], out);
+      pos += options_.hop;
+      ++frames;
+    }
+    input_.erase(input_.begin(), input_.begin() + pos);
+    return frames;
+  }
+
+ private:
+  void BuildFilterbank() {
+    const size_t bins = fft_.bins();
+    const double bin_hz =
+        static_cast<double>(options_.sample_rate) / fft_.size();
+    const std::vector<double> edges = MelBandEdges(options_);
+    filters_.assign(options_.n_mels, {});
+    for (size_t m = 0; m < options_.n_mels; ++m) {
+      const double lo = edges[m];
+      const double center = edges[m + 1];
+      const double hi = edges[m + 2];
+      const double norm = 2.0 / (hi - lo);
+      Filter& filter = filters_[m];
+      for (size_t k = 0; k < bins; ++k) {
+        const double hz = k * bin_hz;
+        const double w =
+            std::min((hz - lo) / (center - lo), (hi - hz) / (hi - center));
+        if (w <= 0.0) {
+          continue;
+        }
+        if (filter.weights.empty()) {
+          filter.first_bin = k;
+        }
+        // Bins between two non-zero ones are never zero for a triangle,
+        // so a filter is one contiguous run.
+        filter.weights.push_back(static_cast<float>(w * norm));
+      }
+    }
+  }
+
+  void ComputeFrame(const int16_t* in, std::vector<float>* out) {
+    for (size_t i = 0; i < options_.window; ++i) {
+      frame_[i] = in[i] / 32768.f * window_[i];
+    }
+    fft_.Forward(frame_.data(), spectrum_.data());
+    // Plain re^2 + im^2 so the loop vectorises (std::norm may not).
+    const float* bins = reinterpret_cast<const float*>(spectrum_.data());
+    for (size_t k = 0; k < power_.size(); ++k) {
+      power_[k] = bins[2 * k] * bins[2 * k] + bins[2 * k + 1] * bins[2 * k + 1];
+    }
+    for (const Filter& filter : filters_) {
+      float energy = 0.f;
+      const float* power = &power_[filter.first_bin];
+      for (size_t j = 0; j < filter.weights.size(); ++j) {
+        energy += filter.weights[j] * power[j];
+      }
+      out->push_back(std::log10(std::max(energy, 1e-10f)));
+    }
+  }
+
+  struct Filter {
+    size_t first_bin = 0;
+    std::vector<float> weights;
+  };
+
+  LogMelOptions options_;
+  RealFft fft_;
+  std::vector<float> window_;
+  std::vector<float> frame_;
+  std::vector<std::complex<float>> spectrum_;
+  std::vector<float> power_;
+  std::vector<Filter> filters_;
+  std::vector<int16_t> input_;
+};
+
+// Log-mel frames of one 16 kHz stream, computed once per hop and kept in
+// a ring so every consumer (keyword spotter, utterance filter, Whisper)
+// reads the same frames instead of running its own FFTs. Frame k covers
+// stream samples [k * hop, k * hop + window). Not thread-safe: push and
+// read from the capture thread and copy out what other threads need.
+class MelStream {
+ public:
+  explicit MelStream(size_t capacity_frames,
+                     const LogMelOptions& options = {})
+      : frontend_(options),
+        capacity_(capacity_frames),
+        ring_(capacity_frames * options.n_mels) {}
+
+  const LogMelFrontend& frontend() const { return frontend_; }
+  size_t n_mels() const { return frontend_.n_mels(); }
+  uint64_t hop_ms() const {
+    return frontend_.hop() * 1000 / frontend_.options().sample_rate;
+  }
+
+  void Push(const int16_t* pcm, size_t count) {
+    const double cpu_start = ThreadCpuMs();
+    scratch_.clear();
+    const size_t added = frontend_.Push(pcm, count, &scratch_);
+    const size_t n = n_mels();
+    for (size_t f = 0; f < added; ++f) {
+      std::copy(&scratch_[f * n], &scratch_[(f + 1) * n],
+                &ring_[(end_ % capacity_) * n]);
+      ++end_;
+    }
+    cpu_ms_ += ThreadCpuMs() - cpu_start;
+  }
+
+  // Frames [begin_frame(), end_frame()) are held.
+  uint64_t end_frame() const { return end_; }
+  uint64_t begin_frame() const {
+    return end_ > capacity_ ? end_ - capacity_ : 0;
+  }
+
+  // n_mels() values, or nullptr if the frame isn't held.
+  const float* Frame(uint64_t index) const {
+    if (index < begin_frame() || index >= end_) {
+      return nullptr;
+    }
+    return &ring_[(index % capacity_) * n_mels()];
+  }
+
+  // Appends the held frames centred within stream samples
+  // [first_sample, first_sample + samples) to `out`, frame-major, with
+  // `log10_offset` added (gain_db / 10 for a gain applied to the audio
+  // afterwards). That is Whisper's (centred) framing of the same audio to
+  // within a hop. Returns the number of frames.
+  size_t ReadSpan(uint64_t first_sample, uint64_t samples, float log10_offset,
+                  std::vector<float>* out) const {
+    const uint64_t hop = frontend_.hop();
+    const uint64_t half = frontend_.options().window / 2;
+    const auto first_centred_at = [hop, half](uint64_t sample) {
+      return sample > half ? (sample - half + hop - 1) / hop : 0;
+    };
+    const uint64_t first =
+        std::max(first_centred_at(first_sample), begin_frame());
+    const uint64_t last =
+        std::min(first_centred_at(first_sample + samples), end_);
+    for (uint64_t i = first; i < last; ++i) {
+      const float* frame = Frame(i);
+      for (size_t m = 0; m < n_mels(); ++m) {
+        out->push_back(frame[m] + log10_offset);
+      }
+    }
+    return last > first ? static_cast<size_t>(last - first) : 0;
+  }
+
+  double cpu_ms() const { return cpu_ms_; }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const double seconds = end_ * hop_ms() / 1000.0;
+    out << "[mel] frames=" << end_;
+    if (seconds > 0) {
+      out << " cpu_ms_per_s=" << cpu_ms_ / seconds;
+    }
+    out << std::endl;
+  }
+
+ private:
+  LogMelFrontend frontend_;
+  size_t capacity_;
+  std::vector<float> ring_;
+  std::vector<float> scratch_;
+  uint64_t end_ = 0;
+  double cpu_ms_ = 0.0;
+};
+
+// Turns frame-major log10 mel frames into whisper_set_mel() input the way
+// whisper_pcm_to_mel() would have: floor at max - 8, scale to
+// (x + 4) / 4, mel-major layout, then 30 s of silence frames (Whisper
+// pads the audio with 30 s of zeros; without the padding the encoder
+// would see 0.0, not silence, past the end). Pass
+// whisper_full_params.duration_ms = frames * 10 so decoding stops at the
+// utterance's end. Sets *n_len to the padded frame count.
+inline std::vector<float> ToWhisperMel(const std::vector<float>& frames,
+                                       size_t n_mels, int* n_len) {
+  constexpr size_t kPadFrames = 3000;
+  const size_t count = frames.size() / n_mels;
+  float max_value = -10.f;
+  for (float v : frames) {
+    max_value = std::max(max_value, v);
+  }
+  const float floor_value = max_value - 8.f;
+  const float silence = (std::max(-10.f, floor_value) + 4.f) / 4.f;
+  const size_t total = count + kPadFrames;
+  std::vector<float> out(n_mels * total, silence);
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t m = 0; m < n_mels; ++m) {
+      out[m * total + i] =
+          (std::max(frames[i * n_mels + m], floor_value) + 4.f) / 4.f;
+    }
+  }
+  *n_len = static_cast<int>(total);
+  return out;
+}
+
+}  // namespace g1_common
@@ -0,0 +1,702 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace g1_common {
+
+// The robot publishes its mic array here as 16 kHz mono S16 datagrams.
+constexpr const char* kMicGroupIp = "239.168.123.161";
+constexpr int kMicGroupPort = 5555;
+constexpr int kMicGroupRate = 16000;
+
+// Bounded mono S16 FIFO between a capture thread and its consumer. When the
+// consumer falls behind, the oldest audio is overwritten (and counted) so
+// the capture thread never blocks.
+class PcmRingBuffer {
+ public:
+  explicit PcmRingBuffer(size_t capacity)
+      : buffer_(std::max<size_t>(1, capacity)) {}
+
+  void Write(const int16_t* samples, size_t count) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const size_t capacity = buffer_.size();
+      if (count > capacity) {
+        // Only the newest `capacity` samples can survive.
+        overwritten_ += size_ + count - capacity;
+        samples += count - capacity;
+        count = capacity;
+        head_ = 0;
+        size_ = 0;
+      } else if (size_ + count > capacity) {
+        const size_t drop = size_ + count - capacity;
+        head_ = (head_ + drop) % capacity;
+        size_ -= drop;
+        overwritten_ += drop;
+      }
+      size_t tail = (head_ + size_) % capacity;
+      size_ += count;
+      while (count > 0) {
+        const size_t n = std::min(count, capacity - tail);
+        std::memcpy(&buffer_[tail], samples, n * sizeof(int16_t));
+        samples += n;
+        count -= n;
+        tail = 0;
+      }
+    }
+    cv_.notify_one();
+  }
+
+  // Waits up to `timeout` for `count` samples and copies what is there.
+  // Returns fewer than `count` on timeout or after Close().
+  size_t Read(int16_t* out, size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const size_t capacity = buffer_.size();
+    cv_.wait_for(lock, timeout, [&] {
+      return closed_ || size_ >= std::min(count, capacity);
+    });
+    const size_t total = std::min(count, size_);
+    size_t left = total;
+    while (left > 0) {
+      const size_t n = std::min(left, capacity - head_);
+      std::memcpy(out, &buffer_[head_], n * sizeof(int16_t));
+      out += n;
+      left -= n;
+      head_ = (head_ + n) % capacity;
+    }
+    size_ -= total;
+    return total;
+  }
+
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  void Reopen() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = false;
+  }
+
+  uint64_t overwritten() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return overwritten_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<int16_t> buffer_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+  uint64_t overwritten_ = 0;
+  bool closed_ = false;
+};
+
+// A running mic: a thread fills a PcmRingBuffer, consumers Read() from it.
+class CaptureSource {
+ public:
+  virtual ~CaptureSource() = default;
+
+  virtual bool Start() = 0;
+  virtual void Stop() = 0;
+  virtual int sample_rate() const = 0;
+  virtual std::string name() const = 0;
+  virtual void PrintStats(std::ostream& out = std::cout) const = 0;
+
+  size_t Read(int16_t* out, size_t count, std::chrono::milliseconds timeout) {
+    return ring_.Read(out, count, timeout);
+  }
+
+ protected:
+  explicit CaptureSource(size_t ring_samples) : ring_(ring_samples) {}
+
+  PcmRingBuffer ring_;
+};
+
+inline std::string GetInterfaceIpv4(const std::string& iface) {
+  struct ifaddrs* ifaddr = nullptr;
+  if (getifaddrs(&ifaddr) == -1) {
+    return "";
+  }
+
+  std::string result;
+  for (struct ifaddrs* ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET) {
+      continue;
+    }
+    if (iface != ifa->ifa_name) {
+      continue;
+    }
+
+    char host[NI_MAXHOST] = {0};
+    if (getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in), host, NI_MAXHOST,
+                    nullptr, 0, NI_NUMERICHOST) != 0) {
+      continue;
+    }
+
+    result = host;
+    break;
+  }
+
+  freeifaddrs(ifaddr);
+  return result;
+}
+
+// Local ALSA mic through a long-running `arecord` child writing raw S16 to
+// a pipe.
+class ArecordCaptureSource : public CaptureSource {
+ public:
+  ArecordCaptureSource(std::string device, int sample_rate,
+                       size_t ring_seconds = 10)
+      : CaptureSource(static_cast<size_t>(sample_rate) * ring_seconds),
+        device_(std::move(device)),
+        sample_rate_(sample_rate) {}
+  ~ArecordCaptureSource() override { Stop(); }
+
+  bool Start() override {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      std::cout << "Failed to create arecord pipe." << std::endl;
+      return false;
+    }
+    const std::string rate = std::to_string(sample_rate_);
+    pid_ = fork();
+    if (pid_ < 0) {
+      std::cout << "Failed to fork arecord." << std::endl;
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+    }
+    if (pid_ == 0) {
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      execlp("arecord", "arecord", "-q", "-D", device_.c_str(), "-f",
+             "S16_LE", "-r", rate.c_str(), "-c", "1", "-t", "raw",
+             static_cast<char*>(nullptr));
+      _exit(127);
+    }
+    close(fds[1]);
+    fd_ = fds[0];
+    ring_.Reopen();
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  void Stop() override {
+    if (pid_ > 0) {
+      kill(pid_, SIGTERM);
+      waitpid(pid_, nullptr, 0);
+      pid_ = -1;
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    ring_.Close();
+  }
+
+  int sample_rate() const override { return sample_rate_; }
+  std::string name() const override { return "arecord:" + device_; }
+  void PrintStats(std::ostream& out = std::cout) const override {
+    out << "[mic " << name() << "] samples=" << samples_.load()
+        << " overwritten=" << ring_.overwritten() << std::endl;
+  }
+
+ private:
+  void Run() {
+    std::vector<int16_t> buffer(static_cast<size_t>(sample_rate_) / 50);
+    size_t carry = 0;  // a read can end mid-sample
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(buffer.data());
+    while (true) {
+      const ssize_t n = read(fd_, bytes + carry,
+                             buffer.size() * sizeof(int16_t) - carry);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;  // arecord exited
+      }
+      const size_t total = carry + static_cast<size_t>(n);
+      const size_t samples = total / sizeof(int16_t);
+      ring_.Write(buffer.data(), samples);
+      samples_ += samples;
+      carry = total % sizeof(int16_t);
+      if (carry != 0) {
+        bytes[0] = bytes[total - 1];
+      }
+    }
+    ring_.Close();
+  }
+
+  std::string device_;
+  int sample_rate_;
+  pid_t pid_ = -1;
+  int fd_ = -1;
+  std::atomic<uint64_t> samples_{0};
+  std::thread thread_;
+};
+
+struct MulticastMicOptions {
+  std::string group = kMicGroupIp;
+  int port = kMicGroupPort;
+  // Interface to join on; empty joins on the default multicast route.
+  std::string iface;
+  int sample_rate = kMicGroupRate;
+  size_t ring_seconds = 10;
+  int rcvbuf_bytes = 4 * 1024 * 1024;
+  // Arrival later than the stream clock by more than this and by more than
+  // half a packet is treated as lost packets.
+  int jitter_ms = 10;
+  // Gaps up to this long are bridged by interpolation; longer ones (up to
+  // max_conceal_ms) get silence. Beyond that the stream is assumed to have
+  // paused and only the clock is re-anchored.
+  int interpolate_ms = 60;
+  int max_conceal_ms = 500;
+};
+
+struct MulticastMicStats {
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t batches = 0;  // recvmmsg calls that returned data
+  uint64_t max_batch = 0;
+  uint64_t gaps = 0;
+  uint64_t concealed_samples = 0;
+  uint64_t resyncs = 0;  // gaps too long to conceal
+};
+
+// Receives the robot's mic multicast stream on its own thread.
+//
+// Datagrams are drained in batches with recvmmsg() into a large socket
+// buffer. The stream carries no sequence numbers, so loss is inferred from
+// kernel receive timestamps (SO_TIMESTAMPNS): each packet is expected when
+// the samples received so far have played out from the first packet's
+// arrival. A packet arriving notably later than that suggests datagrams were
+// lost. Such a packet is held until the next one arrives: if that one is
+// just as late the loss is confirmed and the gap is filled in before the
+// held packet; if it is back on time the held packet was merely delayed.
+// Only packets that look like they follow a loss are delayed this way.
+// The clock anchor follows early arrivals immediately and late ones slowly,
+// so network delay and sender clock drift don't read as loss. Reordering
+// can't be detected this way and is passed through as-is.
+class MulticastMicSource : public CaptureSource {
+ public:
+  static constexpr int kBatch = 32;
+  static constexpr size_t kMaxDatagram = 8192;
+
+  explicit MulticastMicSource(const MulticastMicOptions& options = {})
+      : CaptureSource(static_cast<size_t>(options.sample_rate) *
+                      options.ring_seconds),
+        options_(options),
+        storage_(static_cast<size_t>(kBatch) * kMaxDatagram) {}
+  ~MulticastMicSource() override { Stop(); }
+
+  bool Start() override {
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_ < 0) {
+      std::cout << "Failed to create UDP socket." << std::endl;
+      return false;
+    }
+    int reuse = 1;
+    setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int rcvbuf = options_.rcvbuf_bytes;
+    if (setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) <
+        0) {
+      std::cout << "Failed to set SO_RCVBUF: errno=" << errno << std::endl;
+    }
+    int on = 1;
+    if (setsockopt(sock_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+      std::cout << "SO_TIMESTAMPNS unavailable; using receive time."
+                << std::endl;
+    }
+
+    sockaddr_in local_addr{};
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock_, reinterpret_cast<sockaddr*>(&local_addr),
+             sizeof(local_addr)) < 0) {
+      std::cout << "Failed to bind UDP socket." << std::endl;
+      CloseSocket();
+      return false;
+    }
+
+    ip_mreqn mreq{};
+    if (inet_pton(AF_INET, options_.group.c_str(), &mreq.imr_multiaddr) !=
+        1) {
+      std::cout << "Failed to parse multicast IP." << std::endl;
+      CloseSocket();
+      return false;
+    }
+    if (!options_.iface.empty()) {
+      const std::string local_ip = GetInterfaceIpv4(options_.iface);
+      if (local_ip.empty()) {
+        std::cout << "No IPv4 found for interface " << options_.iface << "."
+                  << std::endl;
+        CloseSocket();
+        return false;
+      }
+      mreq.imr_address.s_addr = inet_addr(local_ip.c_str());
+      mreq.imr_ifindex = if_nametoindex(options_.iface.c_str());
+      if (mreq.imr_ifindex == 0) {
+        std::cout << "Failed to resolve interface index for "
+                  << options_.iface << "." << std::endl;
+        CloseSocket();
+        return false;
+      }
+      if (setsockopt(sock_, IPPROTO_IP, IP_MULTICAST_IF, &mreq,
+                     sizeof(mreq)) < 0) {
+        std::cout << "Failed to set multicast interface: errno=" << errno
+                  << std::endl;
+      }
+    }
+    if (setsockopt(sock_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                   sizeof(mreq)) < 0) {
+      std::cout << "Failed to join multicast group: errno=" << errno
+                << std::endl;
+      CloseSocket();
+      return false;
+    }
+
+    ring_.Reopen();
+    anchored_ = false;
+    last_sample_ = 0;
+    held_.clear();
+    held_missing_ = 0;
+    stopping_ = false;
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  void Stop() override {
+    stopping_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    CloseSocket();
+    ring_.Close();
+  }
+
+  int sample_rate() const override { return options_.sample_rate; }
+  std::string name() const override {
+    return "multicast:" + options_.group + ":" + std::to_string(options_.port);
+  }
+
+  MulticastMicStats stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const override {
+    const MulticastMicStats s = stats();
+    out << "[mic " << name() << "] packets=" << s.packets
+        << " bytes=" << s.bytes << " batches=" << s.batches
+        << " max_batch=" << s.max_batch << " gaps=" << s.gaps
+        << " concealed_samples=" << s.concealed_samples
+        << " resyncs=" << s.resyncs << " overwritten=" << ring_.overwritten()
+        << std::endl;
+  }
+
+ private:
+  void CloseSocket() {
+    if (sock_ >= 0) {
+      close(sock_);
+      sock_ = -1;
+    }
+  }
+
+  static double ToSeconds(const timespec& ts) {
+    return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+  }
+
+  static double PacketTime(msghdr* hdr) {
+    for (cmsghdr* c = CMSG_FIRSTHDR(hdr); c != nullptr;
+         c = CMSG_NXTHDR(hdr, c)) {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+        timespec ts;
+        std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        return ToSeconds(ts);
+      }
+    }
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return ToSeconds(now);
+  }
+
+  void Run() {
+    mmsghdr msgs[kBatch];
+    iovec iovs[kBatch];
+    // Room for one SCM_TIMESTAMPNS per message.
+    alignas(cmsghdr) char control[kBatch][CMSG_SPACE(sizeof(timespec))];
+
+    while (!stopping_) {
+      pollfd pfd{sock_, POLLIN, 0};
+      const int ready = poll(&pfd, 1, 200);
+      if (ready <= 0) {
+        FlushHeld();
+        continue;
+      }
+      for (int i = 0; i < kBatch; ++i) {
+        iovs[i].iov_base =
+            storage_.data() + static_cast<size_t>(i) * kMaxDatagram;
+        iovs[i].iov_len = kMaxDatagram;
+        std::memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+      }
+      const int n = recvmmsg(sock_, msgs, kBatch, MSG_DONTWAIT, nullptr);
+      if (n <= 0) {
+        continue;
+      }
+      uint64_t bytes = 0;
+      for (int i = 0; i < n; ++i) {
+        const size_t len = msgs[i].msg_len & ~1u;
+        bytes += len;
+        Deliver(reinterpret_cast<const int16_t*>(iovs[i].iov_base),
+                len / sizeof(int16_t), PacketTime(&msgs[i].msg_hdr));
+      }
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.packets += static_cast<uint64_t>(n);
+      stats_.bytes += bytes;
+      ++stats_.batches;
+      stats_.max_batch = std::max<uint64_t>(stats_.max_batch, n);
+    }
+  }
+
+  void Deliver(const int16_t* samples, size_t count, double arrival) {
+    if (count == 0) {
+      return;
+    }
+    const double rate = options_.sample_rate;
+    const double packet_s = count / rate;
+    if (!anchored_) {
+      anchor_ = arrival - packet_s;
+      received_ = 0;
+      anchored_ = true;
+    }
+    // How much later than the stream clock this packet arrived.
+    double late = arrival - (anchor_ + (received_ + count) / rate);
+
+    if (!held_.empty()) {
+      // The held packet arrived as if packets before it were lost. If this
+      // one is just as late they were; if it is back on time, the held
+      // packet was only delayed.
+      const double held_gap = held_missing_ / rate;
+      if (late > held_gap - packet_s / 2) {
+        Conceal(held_missing_, held_[0]);
+        received_ += held_missing_;
+        late -= held_gap;
+      }
+      Emit(held_.data(), held_.size());
+      held_.clear();
+    }
+
+    const long lost_packets =
+        late > options_.jitter_ms / 1000.0 ? std::lround(late / packet_s) : 0;
+    if (lost_packets > 0) {
+      // Datagrams are a fixed size, so assume whole packets went missing.
+      const size_t missing = static_cast<size_t>(lost_packets) * count;
+      if (missing * 1000 <= static_cast<size_t>(options_.max_conceal_ms) *
+                                options_.sample_rate) {
+        // Hold this packet until the next one confirms the gap.
+        held_.assign(samples, samples + count);
+        held_missing_ = missing;
+        received_ += count;
+        return;
+      }
+      // Too long to be loss; start the clock over from this packet.
+      {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        ++stats_.resyncs;
+      }
+      anchor_ = arrival - packet_s;
+      received_ = 0;
+    } else if (late < 0) {
+      // Early: the network delay dropped or the sender runs fast.
+      anchor_ += late;
+    } else {
+      // Let slow sender drift catch up without calling it loss.
+      anchor_ += late * 0.001;
+    }
+    Emit(samples, count);
+    received_ += count;
+  }
+
+  // Releases a held packet when no confirmation arrives (stream paused).
+  void FlushHeld() {
+    if (!held_.empty()) {
+      Emit(held_.data(), held_.size());
+      held_.clear();
+    }
+  }
+
+  void Emit(const int16_t* samples, size_t count) {
+    ring_.Write(samples, count);
+    last_sample_ = samples[count - 1];
+  }
+
+  // Writes `missing` samples to bridge the gap before a packet starting at
+  // `next`.
+  void Conceal(size_t missing, int16_t next) {
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      ++stats_.gaps;
+      stats_.concealed_samples += missing;
+    }
+    conceal_.resize(missing);
+    if (missing * 1000 <= static_cast<size_t>(options_.interpolate_ms) *
+                              options_.sample_rate) {
+      // Linear ramp from the last sample heard to the next one, so the
+      // splice doesn't click.
+      for (size_t i = 0; i < missing; ++i) {
+        const float t = static_cast<float>(i + 1) / (missing + 1);
+        conceal_[i] = static_cast<int16_t>(last_sample_ +
+                                           (next - last_sample_) * t);
+      }
+    } else {
+      std::fill(conceal_.begin(), conceal_.end(), 0);
+    }
+    ring_.Write(conceal_.data(), conceal_.size());
+  }
+
+  MulticastMicOptions options_;
+  int sock_ = -1;
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+  std::vector<uint8_t> storage_;
+  std::vector<int16_t> conceal_;
+
+  // Receive thread only.
+  bool anchored_ = false;
+  double anchor_ = 0.0;
+  double received_ = 0.0;
+  int16_t last_sample_ = 0;
+  std::vector<int16_t> held_;
+  size_t held_missing_ = 0;
+
+  mutable std::mutex stats_mutex_;
+  MulticastMicStats stats_;
+};
+
+// Noise suppression applied to captured chunks before the speech gate.
+enum class MicDenoise {
+  kRnnoise,   // RNNoise; needs 48 kHz capture, decimated to 16 kHz for ASR
+  kSpectral,  // SpectralDenoiser at 16 kHz
+  kOff,
+};
+
+// Which mic and denoiser the ASR programs use, from the environment:
+//   MIC_SOURCE=alsa|multicast   local device via arecord (default) or the
+//                               robot's 16 kHz mic array
+//   MIC_DENOISE=rnnoise|spectral|off
+//                               default rnnoise for alsa, off for multicast
+// Anything but rnnoise captures at 16 kHz, which is what Whisper takes.
+struct MicPipeline {
+  std::string source = "alsa";
+  MicDenoise denoise = MicDenoise::kRnnoise;
+
+  int capture_rate() const {
+    return denoise == MicDenoise::kRnnoise ? 48000 : kMicGroupRate;
+  }
+  const char* denoise_name() const {
+    switch (denoise) {
+      case MicDenoise::kRnnoise:
+        return "rnnoise";
+      case MicDenoise::kSpectral:
+        return "spectral";
+      case MicDenoise::kOff:
+        break;
+    }
+    return "off";
+  }
+};
+
+// Returns false (after explaining why) for unknown or unsupported settings.
+inline bool MicPipelineFromEnv(MicPipeline* pipeline) {
+  const char* source = std::getenv("MIC_SOURCE");
+  if (source != nullptr && source[0] != '\0') {
+    pipeline->source = source;
+  }
+  if (pipeline->source != "alsa" && pipeline->source != "multicast") {
+    std::cout << "Unknown MIC_SOURCE '" << pipeline->source
+              << "' (expected alsa or multicast)." << std::endl;
+    return false;
+  }
+  pipeline->denoise = pipeline->source == "multicast" ? MicDenoise::kOff
+                                                      : MicDenoise::kRnnoise;
+  const char* denoise = std::getenv("MIC_DENOISE");
+  if (denoise != nullptr && denoise[0] != '\0') {
+    const std::string name = denoise;
+    if (name == "rnnoise") {
+      pipeline->denoise = MicDenoise::kRnnoise;
+    } else if (name == "spectral") {
+      pipeline->denoise = MicDenoise::kSpectral;
+    } else if (name == "off") {
+      pipeline->denoise = MicDenoise::kOff;
+    } else {
+      std::cout << "Unknown MIC_DENOISE '" << name
+                << "' (expected rnnoise, spectral or off)." << std::endl;
+      return false;
+    }
+  }
+  if (pipeline->source == "multicast" &&
+      pipeline->denoise == MicDenoise::kRnnoise) {
+    std::cout << "RNNoise needs 48 kHz capture; the multicast mic is 16 kHz. "
+                 "Use MIC_DENOISE=spectral or off."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Builds the capture backend for `pipeline`. The multicast group is joined
+// on `iface`, or on the default route if empty.
+inline std::unique_ptr<CaptureSource> MakeCaptureSource(
+    const MicPipeline& pipeline, const std::string& alsa_device,
+    const std::string& iface) {
+  if (pipeline.source == "multicast") {
+    MulticastMicOptions options;
+    options.iface = iface;
+    return std::make_unique<MulticastMicSource>(options);
+  }
+  return std::make_unique<ArecordCaptureSource>(alsa_device,
+                                                pipeline.capture_rate());
+}
+
+}  // namespace g1_common
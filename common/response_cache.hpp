@@ -0,0 +1,496 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace g1_common {
+
+inline uint64_t Fnv1a64(const void* data, size_t size,
+                        uint64_t hash = 14695981039346656037ull) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ p[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+inline uint64_t Fnv1a64(const std::string& text,
+                        uint64_t hash = 14695981039346656037ull) {
+  return Fnv1a64(text.data(), text.size(), hash);
+}
+
+struct ResponseCacheOptions {
+  // File size limit. Past it NeedsCompaction() is true, and Compact()
+  // brings the file down to the newest live entries filling at most half
+  // of it. Put() keeps appending up to twice the limit meanwhile.
+  size_t max_bytes = 4 << 20;
+  // Lifetime of entries put without an explicit TTL.
+  int64_t ttl_s = 7 * 24 * 3600;
+};
+
+struct ResponseCacheStats {
+  uint64_t entries = 0;
+  uint64_t file_bytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t expired = 0;
+  uint64_t puts = 0;
+  uint64_t dropped_puts = 0;  // at twice max_bytes, awaiting compaction
+  uint64_t compactions = 0;
+  uint64_t torn_bytes = 0;  // incomplete tail dropped when opening
+  double max_lookup_us = 0.0;
+};
+
+// Persistent string -> string cache in one append-only file.
+//
+// The file is a header followed by records (header, key, value), each
+// with its expiry time and a checksum. Put() appends a record with
+// pwrite(); the last record for a key wins. Open() scans the file once to
+// build an in-memory index of key hash -> record, dropping an incomplete
+// tail left by a crash. Keys whose hashes collide share a bucket and are
+// told apart by their bytes. Lookups read through a read-only shared
+// mapping sized to the hard limit up front, so they are one hash probe and
+// a copy with no syscalls, and appends become visible without remapping.
+// Expiry uses wall-clock time so TTLs hold across restarts. All methods
+// are thread-safe; Compact() writes the new file without holding the lock,
+// so run it on a background thread and lookups carry on meanwhile.
+class ResponseCache {
+ public:
+  explicit ResponseCache(const ResponseCacheOptions& options = {})
+      : options_(options) {
+    options_.max_bytes = std::max<size_t>(options_.max_bytes, 64 * 1024);
+  }
+  ~ResponseCache() { Close(); }
+
+  ResponseCache(const ResponseCache&) = delete;
+  ResponseCache& operator=(const ResponseCache&) = delete;
+
+  bool Open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CloseLocked();
+    path_ = path;
+    stats_ = ResponseCacheStats{};
+    if (!OpenLocked()) {
+      CloseLocked();
+      return false;
+    }
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CloseLocked();
+  }
+
+  bool is_open() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0;
+  }
+
+  // True with the cached value in *value if `key` is present and fresh.
+  bool Lookup(const std::string& key, std::string* value) {
+    const auto start = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+      return false;
+    }
+    bool hit = false;
+    const auto it = FindLocked(key.data(), key.size());
+    if (it != index_.end()) {
+      if (it->second.expires_s <= Now()) {
+        index_.erase(it);
+        ++stats_.expired;
+      } else {
+        const char* data =
+            map_ + it->second.offset + sizeof(RecordHeader) + key.size();
+        value->assign(data, it->second.value_bytes);
+        hit = true;
+      }
+    }
+    ++(hit ? stats_.hits : stats_.misses);
+    const double us = std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    stats_.max_lookup_us = std::max(stats_.max_lookup_us, us);
+    return hit;
+  }
+
+  // Stores `value` for `ttl_s` seconds (options.ttl_s if <= 0). Returns
+  // false if the cache is closed, the entry is too large, the file is at
+  // twice max_bytes waiting for Compact() or the write failed.
+  bool Put(const std::string& key, const std::string& value,
+           int64_t ttl_s = 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+      return false;
+    }
+    const size_t bytes = sizeof(RecordHeader) + key.size() + value.size();
+    if (bytes > options_.max_bytes / 4) {
+      return false;
+    }
+    if (end_ + bytes > HardLimit()) {
+      ++stats_.dropped_puts;
+      return false;
+    }
+    RecordHeader header;
+    header.magic = kRecordMagic;
+    header.key_bytes = static_cast<uint32_t>(key.size());
+    header.value_bytes = static_cast<uint32_t>(value.size());
+    header.expires_s = Now() + (ttl_s > 0 ? ttl_s : options_.ttl_s);
+    header.checksum = Checksum(key.data(), key.size(), value.data(),
+                               value.size());
+    std::string record(reinterpret_cast<const char*>(&header),
+                       sizeof(header));
+    record += key;
+    record += value;
+    if (!PwriteAll(record.data(), record.size(), end_)) {
+      return false;
+    }
+    IndexLocked(Entry{end_, header.key_bytes, header.value_bytes,
+                      header.expires_s});
+    end_ += bytes;
+    ++stats_.puts;
+    return true;
+  }
+
+  bool NeedsCompaction() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0 && end_ > options_.max_bytes;
+  }
+
+  // Rewrites the newest live entries to a new file and swaps it in. The
+  // new file is written and synced without the lock; records put
+  // meanwhile are carried over at the swap.
+  bool Compact() {
+    std::string data;
+    std::string tmp_path;
+    uint64_t snapshot_end = 0;
+    uint64_t generation = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (fd_ < 0 || compacting_) {
+        return false;
+      }
+      compacting_ = true;
+      data = LiveRecordsLocked();
+      tmp_path = path_ + ".tmp";
+      snapshot_end = end_;
+      generation = generation_;
+    }
+    const int tmp = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = tmp >= 0 && WriteAll(tmp, data.data(), data.size()) &&
+              fdatasync(tmp) == 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    compacting_ = false;
+    // Unsynced, but a crash only loses them: Open() drops a torn tail.
+    ok = ok && generation == generation_ &&
+         WriteAll(tmp, map_ + snapshot_end, end_ - snapshot_end);
+    if (tmp >= 0) {
+      close(tmp);
+    }
+    return ok ? SwapInLocked(tmp_path) : CompactionFailed(tmp_path);
+  }
+
+  ResponseCacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ResponseCacheStats s = stats_;
+    s.entries = index_.size();
+    s.file_bytes = end_;
+    return s;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const ResponseCacheStats s = stats();
+    out << "[cache] " << path_ << " entries=" << s.entries
+        << " bytes=" << s.file_bytes << " hits=" << s.hits
+        << " misses=" << s.misses << " expired=" << s.expired
+        << " puts=" << s.puts << " dropped_puts=" << s.dropped_puts
+        << " compactions=" << s.compactions
+        << " torn_bytes=" << s.torn_bytes
+        << " max_lookup_us=" << s.max_lookup_us << std::endl;
+  }
+
+ private:
+  static constexpr char kFileMagic[8] = {'G', '1', 'R', 'C',
+                                         'A', 'C', 'H', '1'};
+  static constexpr size_t kFileHeaderBytes = sizeof(kFileMagic);
+  static constexpr uint32_t kRecordMagic = 0x52314731;  // "G1R1"
+
+  struct RecordHeader {
+    uint32_t magic = 0;
+    uint32_t key_bytes = 0;
+    uint32_t value_bytes = 0;
+    uint32_t checksum = 0;
+    int64_t expires_s = 0;
+  };
+  static_assert(sizeof(RecordHeader) == 24, "RecordHeader is on disk");
+
+  struct Entry {
+    uint64_t offset = 0;  // of the record header
+    uint32_t key_bytes = 0;
+    uint32_t value_bytes = 0;
+    int64_t expires_s = 0;
+  };
+
+  static int64_t Now() { return static_cast<int64_t>(std::time(nullptr)); }
+
+  size_t HardLimit() const { return options_.max_bytes * 2; }
+
+  std::unordered_multimap<uint64_t, Entry>::iterator FindLocked(
+      const char* key, size_t key_bytes) {
+    const auto range = index_.equal_range(Fnv1a64(key, key_bytes));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.key_bytes == key_bytes &&
+          std::memcmp(map_ + it->second.offset + sizeof(RecordHeader), key,
+                      key_bytes) == 0) {
+        return it;
+      }
+    }
+    return index_.end();
+  }
+
+  // Points the record's key at it, replacing the key's older record.
+  void IndexLocked(const Entry& entry) {
+    const char* key = map_ + entry.offset + sizeof(RecordHeader);
+    const auto it = FindLocked(key, entry.key_bytes);
+    if (it != index_.end()) {
+      it->second = entry;
+    } else {
+      index_.emplace(Fnv1a64(key, entry.key_bytes), entry);
+    }
+  }
+
+  static uint32_t Checksum(const char* key, size_t key_bytes,
+                           const char* value, size_t value_bytes) {
+    const uint64_t hash = Fnv1a64(value, value_bytes, Fnv1a64(key, key_bytes));
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+  }
+
+  bool OpenLocked() {
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      std::cout << "Failed to open cache " << path_ << std::endl;
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (!Map(std::max<uint64_t>(size, HardLimit()))) {
+      return false;
+    }
+    if (size < kFileHeaderBytes ||
+        std::memcmp(map_, kFileMagic, kFileHeaderBytes) != 0) {
+      // New or foreign: start over.
+      if (size > 0) {
+        std::cout << "Resetting cache " << path_ << std::endl;
+      }
+      return Reset();
+    }
+    end_ = Scan(size);
+    if (end_ < size) {
+      stats_.torn_bytes = size - end_;
+      if (ftruncate(fd_, static_cast<off_t>(end_)) != 0) {
+        return false;
+      }
+    }
+    if (end_ > options_.max_bytes) {
+      // Written with a larger limit, or closed before compacting.
+      return CompactLocked();
+    }
+    return true;
+  }
+
+  // Indexes the valid records of the first `size` bytes; returns the end
+  // of the last one.
+  uint64_t Scan(uint64_t size) {
+    index_.clear();
+    uint64_t pos = kFileHeaderBytes;
+    while (pos + sizeof(RecordHeader) <= size) {
+      RecordHeader header;
+      std::memcpy(&header, map_ + pos, sizeof(header));
+      const uint64_t bytes = sizeof(RecordHeader) +
+                             static_cast<uint64_t>(header.key_bytes) +
+                             header.value_bytes;
+      if (header.magic != kRecordMagic || pos + bytes > size) {
+        break;
+      }
+      const char* key = map_ + pos + sizeof(RecordHeader);
+      const char* value = key + header.key_bytes;
+      if (header.checksum !=
+          Checksum(key, header.key_bytes, value, header.value_bytes)) {
+        break;
+      }
+      IndexLocked(
+          Entry{pos, header.key_bytes, header.value_bytes, header.expires_s});
+      pos += bytes;
+    }
+    return pos;
+  }
+
+  bool Reset() {
+    index_.clear();
+    if (ftruncate(fd_, 0) != 0 ||
+        !PwriteAll(kFileMagic, kFileHeaderBytes, 0)) {
+      return false;
+    }
+    end_ = kFileHeaderBytes;
+    return true;
+  }
+
+  // The newest live records, filling at most half of max_bytes, after
+  // the file header. They keep their file order, oldest first, so the
+  // next compaction still tells the newest apart.
+  std::string LiveRecordsLocked() const {
+    const int64_t now = Now();
+    std::vector<Entry> live;
+    live.reserve(index_.size());
+    for (const auto& item : index_) {
+      if (item.second.expires_s > now) {
+        live.push_back(item.second);
+      }
+    }
+    std::sort(live.begin(), live.end(), [](const Entry& a, const Entry& b) {
+      return a.offset > b.offset;
+    });
+    size_t total = kFileHeaderBytes;
+    size_t keep = 0;
+    for (; keep < live.size(); ++keep) {
+      const Entry& entry = live[keep];
+      const size_t bytes =
+          sizeof(RecordHeader) + entry.key_bytes + entry.value_bytes;
+      if (total + bytes > options_.max_bytes / 2) {
+        break;
+      }
+      total += bytes;
+    }
+    std::string data;
+    data.reserve(total);
+    data.append(kFileMagic, kFileHeaderBytes);
+    for (size_t i = keep; i-- > 0;) {
+      const Entry& entry = live[i];
+      data.append(map_ + entry.offset,
+                  sizeof(RecordHeader) + entry.key_bytes + entry.value_bytes);
+    }
+    return data;
+  }
+
+  // Compact() for Open(), which already holds the lock.
+  bool CompactLocked() {
+    const std::string tmp_path = path_ + ".tmp";
+    const std::string data = LiveRecordsLocked();
+    const int tmp = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    const bool ok = tmp >= 0 && WriteAll(tmp, data.data(), data.size()) &&
+                    fdatasync(tmp) == 0;
+    if (tmp >= 0) {
+      close(tmp);
+    }
+    return ok ? SwapInLocked(tmp_path) : CompactionFailed(tmp_path);
+  }
+
+  // Replaces the file with the compacted one and reopens it.
+  bool SwapInLocked(const std::string& tmp_path) {
+    if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+      return CompactionFailed(tmp_path);
+    }
+    const ResponseCacheStats stats = stats_;
+    CloseLocked();
+    stats_ = stats;
+    ++stats_.compactions;
+    if (!OpenLocked()) {
+      CloseLocked();
+      return false;
+    }
+    return true;
+  }
+
+  bool CompactionFailed(const std::string& tmp_path) {
+    std::cout << "Failed to compact cache " << path_ << std::endl;
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  static bool WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+      const ssize_t n = write(fd, data, size);
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  bool Map(size_t bytes) {
+    void* map = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+      std::cout << "Failed to map cache " << path_ << std::endl;
+      return false;
+    }
+    map_ = static_cast<const char*>(map);
+    map_bytes_ = bytes;
+    return true;
+  }
+
+  bool PwriteAll(const void* data, size_t size, uint64_t offset) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+      const ssize_t n = pwrite(fd_, p, size, static_cast<off_t>(offset));
+      if (n <= 0) {
+        std::cout << "Failed to write cache " << path_ << std::endl;
+        return false;
+      }
+      p += n;
+      size -= static_cast<size_t>(n);
+      offset += static_cast<uint64_t>(n);
+    }
+    return true;
+  }
+
+  void CloseLocked() {
+    if (map_ != nullptr) {
+      munmap(const_cast<char*>(map_), map_bytes_);
+      map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    index_.clear();
+    end_ = 0;
+    ++generation_;
+  }
+
+  ResponseCacheOptions options_;
+  std::string path_;
+  mutable std::mutex mutex_;
+  int fd_ = -1;
+  const char* map_ = nullptr;
+  size_t map_bytes_ = 0;
+  uint64_t end_ = 0;
+  // Key hash -> record; colliding keys share a bucket.
+  std::unordered_multimap<uint64_t, Entry> index_;
+  uint64_t generation_ = 0;  // bumped whenever the file is closed
+  bool compacting_ = false;
+  ResponseCacheStats stats_;
+};
+
+}  // namespace g1_common
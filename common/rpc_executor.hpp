@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace g1_common {
+
+// Results reported for requests that never reached the robot. Kept clear of
+// the SDK's own return codes.
+constexpr int32_t kRpcSuperseded = -9100;
+constexpr int32_t kRpcCancelled = -9101;
+
+// Latency histogram with quarter-octave buckets from 1 us to ~1 hour.
+class LatencyHistogram {
+ public:
+  static constexpr int kBuckets = 128;
+
+  void Add(double us) {
+    const int bucket =
+        us < 1.0 ? 0
+                 : std::min(kBuckets - 1,
+                            static_cast<int>(4.0 * std::log2(us)) + 1);
+    ++counts_[bucket];
+    ++total_;
+    max_us_ = std::max(max_us_, us);
+  }
+
+  // Upper edge of the bucket holding quantile `q` (0..1).
+  double Quantile(double q) const {
+    if (total_ == 0) {
+      return 0.0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(std::ceil(q * total_));
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+      seen += counts_[b];
+      if (seen >= rank && counts_[b] > 0) {
+        return std::min(max_us_, std::exp2(b / 4.0));
+      }
+    }
+    return max_us_;
+  }
+
+  uint64_t total() const { return total_; }
+  double max_us() const { return max_us_; }
+
+ private:
+  std::array<uint64_t, kBuckets> counts_{};
+  uint64_t total_ = 0;
+  double max_us_ = 0.0;
+};
+
+struct RpcStats {
+  uint64_t calls = 0;
+  uint64_t failures = 0;    // SDK returned non-zero
+  uint64_t superseded = 0;  // replaced by a newer request before running
+  LatencyHistogram queue_wait;
+  LatencyHistogram call;
+};
+
+// Runs blocking SDK calls (LedControl, ExecuteAction, SetFsmId, ...) on one
+// dedicated thread so the caller never waits on a slow response.
+//
+// Submit() returns a future for the call's return code; Post() takes a
+// completion callback instead (run on the executor thread). Requests given
+// the same non-empty coalesce key replace each other while still queued:
+// the older one completes with kRpcSuperseded and the newer one takes its
+// place in the queue, so a stream of LED colours never backs up behind a
+// stalled call. Calls run in submission order, one at a time, which also
+// keeps a non-thread-safe client safe to share.
+class RpcExecutor {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Call = std::function<int32_t()>;
+  using Done = std::function<void(int32_t)>;
+
+  explicit RpcExecutor(std::string name = "rpc") : name_(std::move(name)) {
+    thread_ = std::thread(&RpcExecutor::Loop, this);
+  }
+
+  // Queued requests complete with kRpcCancelled; an in-flight call is
+  // waited for.
+  ~RpcExecutor() {
+    std::deque<Job> dropped;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      dropped.swap(queue_);
+    }
+    cv_.notify_all();
+    for (Job& job : dropped) {
+      Complete(&job, kRpcCancelled);
+    }
+    thread_.join();
+  }
+
+  RpcExecutor(const RpcExecutor&) = delete;
+  RpcExecutor& operator=(const RpcExecutor&) = delete;
+
+  std::future<int32_t> Submit(const std::string& rpc, Call call,
+                              const std::string& coalesce_key = "") {
+    auto promise = std::make_shared<std::promise<int32_t>>();
+    std::future<int32_t> future = promise->get_future();
+    Enqueue(rpc, std::move(call), coalesce_key, std::move(promise), nullptr);
+    return future;
+  }
+
+  void Post(const std::string& rpc, Call call,
+            const std::string& coalesce_key = "", Done done = nullptr) {
+    Enqueue(rpc, std::move(call), coalesce_key, nullptr, std::move(done));
+  }
+
+  // Blocks until everything queued so far has run.
+  void Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+  }
+
+  size_t pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+  std::map<std::string, RpcStats> Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const auto stats = Stats();
+    out << "[" << name_ << "] RPC latency (us):" << std::endl;
+    for (const auto& entry : stats) {
+      const RpcStats& s = entry.second;
+      out << "  " << std::left << std::setw(16) << entry.first << std::right
+          << " calls=" << s.calls << " fail=" << s.failures
+          << " superseded=" << s.superseded << std::fixed
+          << std::setprecision(0) << " p50=" << s.call.Quantile(0.5)
+          << " p99=" << s.call.Quantile(0.99) << " max=" << s.call.max_us()
+          << " wait_p99=" << s.queue_wait.Quantile(0.99) << std::endl;
+      out.unsetf(std::ios::floatfield);
+    }
+  }
+
+ private:
+  struct Job {
+    std::string rpc;
+    std::string key;
+    Call call;
+    std::shared_ptr<std::promise<int32_t>> promise;
+    Done done;
+    Clock::time_point enqueued;
+  };
+
+  static double Micros(Clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+  }
+
+  static void Complete(Job* job, int32_t ret) {
+    if (job->promise) {
+      job->promise->set_value(ret);
+    }
+    if (job->done) {
+      job->done(ret);
+    }
+  }
+
+  void Enqueue(const std::string& rpc, Call call, const std::string& key,
+               std::shared_ptr<std::promise<int32_t>> promise, Done done) {
+    Job job{rpc, key, std::move(call), std::move(promise), std::move(done),
+            Clock::now()};
+    Job replaced;
+    bool has_replaced = false;
+    int32_t replaced_ret = kRpcSuperseded;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        has_replaced = true;
+        replaced_ret = kRpcCancelled;
+        replaced = std::move(job);
+      } else {
+        auto it = queue_.end();
+        if (!key.empty()) {
+          it = std::find_if(queue_.begin(), queue_.end(),
+                            [&key](const Job& j) { return j.key == key; });
+        }
+        if (it != queue_.end()) {
+          // Keep the older request's queue position (and wait time).
+          job.enqueued = it->enqueued;
+          replaced = std::move(*it);
+          *it = std::move(job);
+          has_replaced = true;
+          ++stats_[replaced.rpc].superseded;
+        } else {
+          queue_.push_back(std::move(job));
+        }
+      }
+    }
+    cv_.notify_one();
+    if (has_replaced) {
+      Complete(&replaced, replaced_ret);
+    }
+  }
+
+  void Loop() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        job = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+      }
+      const Clock::time_point start = Clock::now();
+      const int32_t ret = job.call();
+      const Clock::time_point end = Clock::now();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RpcStats& s = stats_[job.rpc];
+        ++s.calls;
+        if (ret != 0) {
+          ++s.failures;
+        }
+        s.queue_wait.Add(Micros(start - job.enqueued));
+        s.call.Add(Micros(end - start));
+      }
+      Complete(&job, ret);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        busy_ = false;
+      }
+      idle_cv_.notify_all();
+    }
+  }
+
+  std::string name_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;
+  std::deque<Job> queue_;
+  std::map<std::string, RpcStats> stats_;
+  bool busy_ = false;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+}  // namespace g1_common
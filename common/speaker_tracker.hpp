@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace g1_common {
+
+struct SpeakerTrackerOptions {
+  // MFCCs c1..n_ceps; c0 is loudness and says nothing about who spoke.
+  size_t n_ceps = 19;
+  // Utterances closer than this to a speaker's voiceprint are theirs
+  // (see SpeakerTracker::Distance()).
+  float max_distance = 0.5f;
+  // Speakers remembered; the least recently heard one is dropped beyond.
+  size_t max_speakers = 4;
+  // Utterances with fewer active frames (0.3 s) can't be told apart and
+  // go to whoever spoke last.
+  size_t min_frames = 30;
+  // A voiceprint keeps about this many frames (60 s); older ones decay
+  // so it follows the voice and its memory stays bounded.
+  size_t max_frames = 6000;
+  // Frames this far below the utterance's loudest (pauses, hangover)
+  // are left out.
+  float active_range_db = 15.f;
+  // Pitch search range and the normalised autocorrelation a 40 ms frame
+  // needs to count as voiced.
+  float min_pitch_hz = 60.f;
+  float max_pitch_hz = 400.f;
+  float voicing = 0.5f;
+  // Weight of the pitch distance against the MFCC one. Short utterances'
+  // MFCC means depend a lot on what was said; pitch much less.
+  float pitch_weight = 2.f;
+};
+
+// Diagonal Gaussian statistics of a feature vector.
+struct GaussianStats {
+  double count = 0.0;
+  std::vector<double> sum;
+  std::vector<double> sum_sq;
+
+  explicit GaussianStats(size_t dims = 0) : sum(dims), sum_sq(dims) {}
+
+  void Accumulate(const double* x) {
+    count += 1.0;
+    for (size_t k = 0; k < sum.size(); ++k) {
+      sum[k] += x[k];
+      sum_sq[k] += x[k] * x[k];
+    }
+  }
+  double Mean(size_t k) const { return sum[k] / count; }
+  double Var(size_t k, double floor) const {
+    const double mean = Mean(k);
+    return std::max(sum_sq[k] / count - mean * mean, floor);
+  }
+  void Add(const GaussianStats& other) {
+    count += other.count;
+    for (size_t k = 0; k < sum.size(); ++k) {
+      sum[k] += other.sum[k];
+      sum_sq[k] += other.sum_sq[k];
+    }
+  }
+  void Scale(double factor) {
+    count *= factor;
+    for (size_t k = 0; k < sum.size(); ++k) {
+      sum[k] *= factor;
+      sum_sq[k] *= factor;
+    }
+  }
+
+  // Mean over dimensions of (mean_a - mean_b)^2 / (var_a + var_b): how
+  // far apart the two sit relative to how much each varies from sound to
+  // sound. Needs no statistics of the population.
+  static double Distance(const GaussianStats& a, const GaussianStats& b,
+                         double var_floor) {
+    if (a.sum.empty() || a.count <= 0.0 || b.count <= 0.0) {
+      return 0.0;
+    }
+    double sum = 0.0;
+    for (size_t k = 0; k < a.sum.size(); ++k) {
+      const double d = a.Mean(k) - b.Mean(k);
+      sum += d * d / (a.Var(k, var_floor) + b.Var(k, var_floor));
+    }
+    return sum / a.sum.size();
+  }
+};
+
+// An utterance's (or a speaker's) voiceprint: MFCC statistics over its
+// active frames and log-pitch statistics over its voiced ones. Being
+// sufficient statistics, a speaker's voiceprint is the sum of theirs.
+struct SpeakerEmbedding {
+  GaussianStats cepstra;
+  GaussianStats pitch{1};
+
+  bool empty() const { return cepstra.count <= 0.0; }
+  double frames() const { return cepstra.count; }
+
+  void Add(const SpeakerEmbedding& other) {
+    if (empty()) {
+      *this = other;
+      return;
+    }
+    cepstra.Add(other.cepstra);
+    pitch.Add(other.pitch);
+  }
+  void Scale(double factor) {
+    cepstra.Scale(factor);
+    pitch.Scale(factor);
+  }
+};
+
+struct SpeakerTrackerStats {
+  uint64_t utterances = 0;
+  uint64_t speakers = 0;   // voiceprints created
+  uint64_t evictions = 0;  // dropped by the LRU
+  uint64_t too_short = 0;  // given to the last speaker unchecked
+};
+
+// Tells apart the people talking to the robot, cheaply enough to run per
+// utterance (~2 ms for a 1.5 s one): MFCCs from the log-mel frames the
+// capture thread already has plus autocorrelation pitch give a
+// voiceprint, which is compared with a small LRU of speakers' and either
+// joins the closest or starts a new speaker. Ids start at 1; 0 means
+// unknown.
+//
+// Embed() is const and may run on the capture thread; Identify() and the
+// rest belong to one thread.
+class SpeakerTracker {
+ public:
+  SpeakerTracker(size_t n_mels, const SpeakerTrackerOptions& options = {})
+      : options_(options), n_mels_(n_mels) {
+    dct_.resize(options_.n_ceps * n_mels_);
+    for (size_t k = 0; k < options_.n_ceps; ++k) {
+      for (size_t m = 0; m < n_mels_; ++m) {
+        dct_[k * n_mels_ + m] = static_cast<float>(
+            std::cos(M_PI * (k + 1) * (m + 0.5) / n_mels_));
+      }
+    }
+  }
+
+  // The voiceprint of one utterance from its log10 mel frames
+  // (frame-major) and its 16 kHz audio (for pitch). Empty if the frames
+  // are.
+  SpeakerEmbedding Embed(const std::vector<float>& mel,
+                         const std::vector<int16_t>& pcm16) const {
+    SpeakerEmbedding e;
+    e.cepstra = GaussianStats(options_.n_ceps);
+    const size_t frames = mel.size() / n_mels_;
+    std::vector<float> level_db(frames);
+    float max_db = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < frames; ++i) {
+      double power = 0.0;
+      for (size_t m = 0; m < n_mels_; ++m) {
+        power += std::pow(10.0, mel[i * n_mels_ + m]);
+      }
+      level_db[i] = static_cast<float>(10.0 * std::log10(power + 1e-10));
+      max_db = std::max(max_db, level_db[i]);
+    }
+    std::vector<double> ceps(options_.n_ceps);
+    for (size_t i = 0; i < frames; ++i) {
+      if (level_db[i] < max_db - options_.active_range_db) {
+        continue;
+      }
+      const float* frame = &mel[i * n_mels_];
+      for (size_t k = 0; k < options_.n_ceps; ++k) {
+        const float* basis = &dct_[k * n_mels_];
+        float c = 0.f;
+        for (size_t m = 0; m < n_mels_; ++m) {
+          c += basis[m] * frame[m];
+        }
+        ceps[k] = c;
+      }
+      e.cepstra.Accumulate(ceps.data());
+    }
+    AccumulatePitch(pcm16, &e.pitch);
+    return e;
+  }
+
+  // MFCC distance plus pitch_weight times the pitch distance (when both
+  // have voiced frames), normalised by the total weight.
+  double Distance(const SpeakerEmbedding& a, const SpeakerEmbedding& b) const {
+    // Cepstral variances below 0.01 and log-pitch ones below 0.05^2 (a
+    // semitone is 0.058) are noise, not a steady voice.
+    const double ceps = GaussianStats::Distance(a.cepstra, b.cepstra, 1e-2);
+    if (a.pitch.count < kMinVoicedFrames || b.pitch.count < kMinVoicedFrames) {
+      return ceps;
+    }
+    const double pitch = GaussianStats::Distance(a.pitch, b.pitch, 2.5e-3);
+    return (ceps + options_.pitch_weight * pitch) /
+           (1.0 + options_.pitch_weight);
+  }
+
+  // The speaker of an utterance with voiceprint `e`. Sets *evicted to the
+  // id of a speaker dropped to make room (0 if none), so their state can
+  // be freed.
+  int Identify(const SpeakerEmbedding& e, int* evicted) {
+    *evicted = 0;
+    ++stats_.utterances;
+    ++tick_;
+    if (e.frames() < options_.min_frames) {
+      ++stats_.too_short;
+      Touch(last_);
+      return last_;
+    }
+    Speaker* best = nullptr;
+    last_distance_ = std::numeric_limits<double>::infinity();
+    for (Speaker& speaker : speakers_) {
+      const double d = Distance(e, speaker.voiceprint);
+      if (d < last_distance_) {
+        last_distance_ = d;
+        best = &speaker;
+      }
+    }
+    if (best == nullptr || last_distance_ > options_.max_distance) {
+      if (speakers_.size() >= options_.max_speakers) {
+        auto lru = std::min_element(
+            speakers_.begin(), speakers_.end(),
+            [](const Speaker& a, const Speaker& b) {
+              return a.last_heard < b.last_heard;
+            });
+        *evicted = lru->id;
+        speakers_.erase(lru);
+        ++stats_.evictions;
+      }
+      speakers_.push_back({next_id_++, SpeakerEmbedding(), 0});
+      best = &speakers_.back();
+      ++stats_.speakers;
+    }
+    best->voiceprint.Add(e);
+    if (best->voiceprint.frames() > options_.max_frames) {
+      best->voiceprint.Scale(options_.max_frames / best->voiceprint.frames());
+    }
+    best->last_heard = tick_;
+    last_ = best->id;
+    return last_;
+  }
+
+  // Distance of the last identified utterance to its closest voiceprint
+  // (infinity if there was none).
+  double last_distance() const { return last_distance_; }
+  size_t speaker_count() const { return speakers_.size(); }
+  const SpeakerTrackerStats& stats() const { return stats_; }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    out << "[speakers] utterances=" << stats_.utterances
+        << " speakers=" << stats_.speakers
+        << " active=" << speakers_.size()
+        << " evictions=" << stats_.evictions
+        << " too_short=" << stats_.too_short << std::endl;
+  }
+
+ private:
+  static constexpr double kMinVoicedFrames = 5.0;
+  // Pitch is tracked on the audio averaged down to 8 kHz, plenty for
+  // 60 - 400 Hz and a quarter of the work.
+  static constexpr int kPitchRate = 8000;
+  static constexpr size_t kPitchFrame = 320;  // 40 ms
+
+  // Log pitch of the voiced 40 ms frames (20 ms apart) by normalised
+  // autocorrelation. The shortest lag within 10% of the best one wins,
+  // which keeps octave-down errors out.
+  void AccumulatePitch(const std::vector<int16_t>& pcm16,
+                       GaussianStats* pitch) const {
+    const size_t min_lag =
+        static_cast<size_t>(kPitchRate / options_.max_pitch_hz);
+    const size_t max_lag =
+        static_cast<size_t>(kPitchRate / options_.min_pitch_hz);
+    const size_t window = kPitchFrame - max_lag;
+    std::vector<float> pcm(pcm16.size() / 2);
+    for (size_t i = 0; i < pcm.size(); ++i) {
+      pcm[i] = 0.5f * (pcm16[2 * i] + pcm16[2 * i + 1]);
+    }
+    if (pcm.size() < kPitchFrame || window < min_lag) {
+      return;
+    }
+    std::vector<float> r(max_lag + 1);
+    std::vector<double> energies;
+    for (size_t pos = 0; pos + kPitchFrame <= pcm.size();
+         pos += kPitchFrame / 2) {
+      double energy = 0.0;
+      for (size_t i = 0; i < kPitchFrame; ++i) {
+        energy += static_cast<double>(pcm[pos + i]) * pcm[pos + i];
+      }
+      energies.push_back(energy);
+    }
+    const double max_energy =
+        *std::max_element(energies.begin(), energies.end());
+    const double min_energy =
+        max_energy * std::pow(10.0, -options_.active_range_db / 10.0);
+    for (size_t f = 0; f < energies.size(); ++f) {
+      if (energies[f] < min_energy || energies[f] <= 0.0) {
+        continue;
+      }
+      const float* x = &pcm[f * kPitchFrame / 2];
+      float e0 = 0.f;
+      for (size_t i = 0; i < window; ++i) {
+        e0 += x[i] * x[i];
+      }
+      float best = 0.f;
+      for (size_t lag = min_lag; lag <= max_lag; ++lag) {
+        float cross = 0.f;
+        float e1 = 0.f;
+        for (size_t i = 0; i < window; ++i) {
+          cross += x[i] * x[i + lag];
+          e1 += x[i + lag] * x[i + lag];
+        }
+        r[lag] = cross / std::sqrt(e0 * e1 + 1.f);
+        best = std::max(best, r[lag]);
+      }
+      if (best < options_.voicing) {
+        continue;
+      }
+      for (size_t lag = min_lag; lag <= max_lag; ++lag) {
+        if (r[lag] >= 0.9f * best) {
+          const double log_f0 =
+              std::log(static_cast<double>(kPitchRate) / lag);
+          pitch->Accumulate(&log_f0);
+          break;
+        }
+      }
+    }
+  }
+
+  struct Speaker {
+    int id = 0;
+    SpeakerEmbedding voiceprint;
+    uint64_t last_heard = 0;
+  };
+
+  void Touch(int id) {
+    for (Speaker& speaker : speakers_) {
+      if (speaker.id == id) {
+        speaker.last_heard = tick_;
+      }
+    }
+  }
+
+  SpeakerTrackerOptions options_;
+  size_t n_mels_;
+  std::vector<float> dct_;
+  std::vector<Speaker> speakers_;
+  int next_id_ = 1;
+  int last_ = 0;
+  uint64_t tick_ = 0;
+  double last_distance_ = 0.0;
+  SpeakerTrackerStats stats_;
+};
+
+}  // namespace g1_common
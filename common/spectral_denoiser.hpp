@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fft.hpp"
+
+namespace g1_common {
+
+struct SpectralDenoiserOptions {
+  int sample_rate = 16000;
+  // 16 ms frames with 50% overlap at 16 kHz.
+  size_t fft_size = 256;
+  // Smoothing of the decision-directed a priori SNR (closer to 1 means
+  // less musical noise, slower onsets).
+  float dd_alpha = 0.96f;
+  // Lowest gain applied to any bin. Whisper copes with residual noise far
+  // better than with over-suppressed speech, so this stays mild (-16 dB).
+  float gain_floor = 0.16f;
+  // The noise estimate follows the smoothed power down immediately and up
+  // by at most this factor per frame (~1.5 dB/s at 125 frames/s).
+  float noise_rise = 1.0028f;
+  // Band used for the per-frame speech probability.
+  float speech_lo_hz = 300.f;
+  float speech_hi_hz = 3400.f;
+};
+
+// Streaming single-channel noise suppressor for 16 kHz speech.
+//
+// STFT with a sqrt-Hann window at 50% overlap (so analysis+synthesis
+// reconstructs exactly), a minimum-tracking noise estimate per bin, and a
+// Wiener gain from the decision-directed a priori SNR with a gain floor.
+// Output lags input by fft_size / 2 samples. Each frame also yields a
+// speech probability (mean Wiener gain over the voice band), which plays
+// the role of RNNoise's VAD output.
+class SpectralDenoiser {
+ public:
+  explicit SpectralDenoiser(const SpectralDenoiserOptions& options = {})
+      : options_(options),
+        hop_(options.fft_size / 2),
+        fft_(options.fft_size),
+        window_(options.fft_size),
+        frame_(options.fft_size),
+        spectrum_(fft_.bins()),
+        overlap_(hop_, 0.f) {
+    for (size_t i = 0; i < options_.fft_size; ++i) {
+      // Periodic Hann, square-rooted for analysis and synthesis.
+      window_[i] = static_cast<float>(
+          std::sqrt(0.5 - 0.5 * std::cos(2.0 * M_PI * i / options_.fft_size)));
+    }
+    const float bin_hz =
+        static_cast<float>(options_.sample_rate) / options_.fft_size;
+    speech_lo_ = std::max<size_t>(
+        1, static_cast<size_t>(options_.speech_lo_hz / bin_hz));
+    speech_hi_ = std::min(fft_.bins() - 1,
+                          static_cast<size_t>(options_.speech_hi_hz / bin_hz));
+    Reset();
+  }
+
+  void Reset() {
+    const size_t bins = fft_.bins();
+    smoothed_.assign(bins, 0.f);
+    noise_.assign(bins, 0.f);
+    prev_clean_.assign(bins, 0.f);
+    input_.clear();
+    std::fill(overlap_.begin(), overlap_.end(), 0.f);
+    frames_ = 0;
+  }
+
+  // Appends denoised audio for the frames completed by `count` more input
+  // samples to `out`. Returns the mean speech probability of those frames
+  // (0 if none completed).
+  float Process(const int16_t* in, size_t count, std::vector<int16_t>* out) {
+    input_.insert(input_.end(), in, in + count);
+    float prob_sum = 0.f;
+    int prob_frames = 0;
+    size_t pos = 0;
+    while (input_.size() - pos >= options_.fft_size) {
+      prob_sum += ProcessFrame(&input_[pos], out);
+      ++prob_frames;
+      pos += hop_;
+    }
+    input_.erase(input_.begin(), input_.begin() + pos);
+    return prob_frames > 0 ? prob_sum / prob_frames : 0.f;
+  }
+
+  size_t latency_samples() const { return hop_; }
+
+ private:
+  float ProcessFrame(const int16_t* in, std::vector<int16_t>* out) {
+    const size_t n = options_.fft_size;
+    for (size_t i = 0; i < n; ++i) {
+      frame_[i] = in[i] * window_[i];
+    }
+    fft_.Forward(frame_.data(), spectrum_.data());
+
+    const size_t bins = fft_.bins();
+    // The first frame seeds the noise estimate; minimum tracking pulls it
+    // down from there if that frame was speech.
+    const bool first = frames_++ == 0;
+    float speech = 0.f;
+    for (size_t k = 0; k < bins; ++k) {
+      const float power = std::norm(spectrum_[k]);
+      smoothed_[k] = first ? power : 0.8f * smoothed_[k] + 0.2f * power;
+      if (first || smoothed_[k] < noise_[k]) {
+        noise_[k] = smoothed_[k];
+      } else {
+        noise_[k] = std::min(smoothed_[k], noise_[k] * options_.noise_rise);
+      }
+      const float noise = std::max(noise_[k], 1e-3f);
+      const float post = power / noise;
+      const float prior =
+          options_.dd_alpha * prev_clean_[k] / noise +
+          (1.f - options_.dd_alpha) * std::max(post - 1.f, 0.f);
+      const float wiener = prior / (1.f + prior);
+      const float gain = std::max(wiener, options_.gain_floor);
+      prev_clean_[k] = gain * gain * power;
+      spectrum_[k] *= gain;
+      if (k >= speech_lo_ && k <= speech_hi_) {
+        speech += wiener;
+      }
+    }
+
+    fft_.Inverse(spectrum_.data(), frame_.data());
+    for (size_t i = 0; i < hop_; ++i) {
+      const float v = overlap_[i] + frame_[i] * window_[i];
+      out->push_back(static_cast<int16_t>(
+          std::clamp(std::lround(v), -32768L, 32767L)));
+      overlap_[i] = frame_[i + hop_] * window_[i + hop_];
+    }
+    return speech / static_cast<float>(speech_hi_ - speech_lo_ + 1);
+  }
+
+  SpectralDenoiserOptions options_;
+  size_t hop_;
+  RealFft fft_;
+  std::vector<float> window_;
+  std::vector<float> frame_;
+  std::vector<std::complex<float>> spectrum_;
+  std::vector<float> overlap_;
+  std::vector<float> smoothed_;
+  std::vector<float> noise_;
+  std::vector<float> prev_clean_;
+  std::vector<int16_t> input_;
+  size_t speech_lo_ = 1;
+  size_t speech_hi_ = 1;
+  uint64_t frames_ = 0;
+};
+
+}  // namespace g1_common
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+namespace g1_common {
+
+struct EndpointerOptions {
+  int frame_ms = 20;
+  // Speech starts when frames are this far above the noise floor and keeps
+  // going while they stay `continue_margin_db` above it. Speech in a loud
+  // room is only a few dB over the floor; brief noise that clears the
+  // margin is left to start_ms and min_voiced_ms.
+  float start_margin_db = 6.f;
+  float continue_margin_db = 4.f;
+  // Nothing quieter than this starts speech, however quiet the room.
+  float min_level_db = -55.f;
+  // Start once this much of the last start_window_ms was voiced.
+  int start_ms = 120;
+  int start_window_ms = 200;
+  int end_silence_ms = 500;
+  // Utterances with less voiced audio than this are dropped (coughs,
+  // clicks, door slams) and never reach ASR.
+  int min_voiced_ms = 250;
+  int max_utterance_ms = 8000;
+  // Audio kept from before the start decision.
+  int preroll_ms = 250;
+  // Frames also need the denoiser's speech probability at least this high
+  // (when one is supplied). 0 disables.
+  float vad_threshold = 0.f;
+  // Noise floor: follows quieter frames with floor_fall_ms and louder ones,
+  // outside speech only, with floor_rise_ms.
+  float floor_fall_ms = 300.f;
+  float floor_rise_ms = 4000.f;
+  // AGC: each utterance is scaled so its voiced frames average this level,
+  // within the gain limits and without clipping.
+  float agc_target_db = -22.f;
+  float agc_max_gain_db = 24.f;
+  float agc_min_gain_db = -12.f;
+};
+
+struct EndpointerStats {
+  uint64_t audio_ms = 0;
+  uint64_t utterances = 0;      // handed to ASR
+  uint64_t rejected_short = 0;  // started but too little voiced audio
+  uint64_t forced_end = 0;      // hit max_utterance_ms
+  float noise_floor_db = 0.f;
+  float last_gain_db = 0.f;
+};
+
+struct EndpointedUtterance {
+  std::vector<int16_t> pcm;    // gain-normalised
+  std::vector<float> vad;      // per-frame denoiser speech probability
+  uint64_t start_sample = 0;   // position of pcm[0] in the pushed audio
+  float gain_db = 0.f;         // AGC gain applied to pcm
+};
+
+// Frame-level speech endpointer with an adaptive noise floor and AGC.
+//
+// Each frame's level is compared with a running noise-floor estimate, so
+// the same settings work in a quiet office and a loud hall; a fixed RMS
+// threshold would either trigger on the hall or miss soft speech in the
+// office. Completed utterances are gain-normalised for ASR. Audio can be
+// pushed in any chunk size.
+class SpeechEndpointer {
+ public:
+  SpeechEndpointer(int sample_rate, const EndpointerOptions& options = {})
+      : options_(options),
+        sample_rate_(sample_rate),
+        frame_samples_(
+            std::max<size_t>(1, static_cast<size_t>(sample_rate) *
+                                    options.frame_ms / 1000)),
+        fall_(Coefficient(options.floor_fall_ms)),
+        rise_(Coefficient(options.floor_rise_ms)) {
+    Reset();
+  }
+
+  void Reset() {
+    frame_.clear();
+    preroll_.clear();
+    window_.clear();
+    utterance_.clear();
+    vad_trace_.clear();
+    ready_.clear();
+    pushed_ = 0;
+    in_speech_ = false;
+    floor_valid_ = false;
+  }
+
+  // Feeds captured audio with the denoiser's speech probability for it
+  // (negative if there is none). Returns true once an utterance is ready.
+  bool Push(const int16_t* pcm, size_t count, float vad = -1.f) {
+    for (size_t i = 0; i < count; ++i) {
+      frame_.push_back(pcm[i]);
+      if (frame_.size() == frame_samples_) {
+        ProcessFrame(vad);
+        frame_.clear();
+      }
+    }
+    return !ready_.empty();
+  }
+
+  bool has_utterance() const { return !ready_.empty(); }
+
+  // The oldest completed utterance (empty pcm if none). Its vad trace is
+  // empty when no denoiser VAD was supplied.
+  EndpointedUtterance TakeUtterance() {
+    if (ready_.empty()) {
+      return {};
+    }
+    EndpointedUtterance out = std::move(ready_.front());
+    ready_.pop_front();
+    return out;
+  }
+
+  bool in_speech() const { return in_speech_; }
+  float noise_floor_db() const { return floor_db_; }
+  int sample_rate() const { return sample_rate_; }
+
+  EndpointerStats stats() const {
+    EndpointerStats s = stats_;
+    s.noise_floor_db = floor_db_;
+    return s;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const EndpointerStats s = stats();
+    const double hours = s.audio_ms / 3.6e6;
+    out << "[endpointer] audio_s=" << s.audio_ms / 1000
+        << " utterances=" << s.utterances;
+    if (hours > 0) {
+      out << " (" << s.utterances / hours << "/hour)";
+    }
+    out << " rejected_short=" << s.rejected_short
+        << " forced_end=" << s.forced_end
+        << " noise_floor_db=" << s.noise_floor_db
+        << " last_gain_db=" << s.last_gain_db << std::endl;
+  }
+
+ private:
+  float Coefficient(float time_ms) const {
+    return time_ms <= 0.f ? 1.f
+                          : 1.f - std::exp(-options_.frame_ms / time_ms);
+  }
+
+  static float LevelDb(const std::vector<int16_t>& frame) {
+    double sum_sq = 0.0;
+    for (int16_t s : frame) {
+      sum_sq += static_cast<double>(s) * s;
+    }
+    const double ms = sum_sq / frame.size() / (32768.0 * 32768.0);
+    return static_cast<float>(10.0 * std::log10(std::max(ms, 1e-10)));
+  }
+
+  int FramesFor(int ms) const {
+    return std::max(1, ms / options_.frame_ms);
+  }
+
+  void ProcessFrame(float vad) {
+    pushed_ += frame_samples_;
+    stats_.audio_ms += static_cast<uint64_t>(options_.frame_ms);
+    const float level = LevelDb(frame_);
+    if (!floor_valid_) {
+      floor_db_ = level;
+      floor_valid_ = true;
+    }
+    const bool vad_ok = vad < 0.f || vad >= options_.vad_threshold;
+    const bool loud_start = level >= options_.min_level_db &&
+                            level > floor_db_ + options_.start_margin_db &&
+                            vad_ok;
+    const bool loud_continue =
+        level > floor_db_ + options_.continue_margin_db && vad_ok;
+
+    // The floor always follows quieter frames; it only creeps up outside
+    // speech, so talking doesn't raise it.
+    if (level < floor_db_) {
+      floor_db_ += (level - floor_db_) * fall_;
+    } else if (!in_speech_) {
+      floor_db_ += (level - floor_db_) * rise_;
+    }
+
+    if (!in_speech_) {
+      preroll_.insert(preroll_.end(), frame_.begin(), frame_.end());
+      const size_t preroll_max =
+          frame_samples_ * FramesFor(options_.preroll_ms);
+      if (preroll_.size() > preroll_max) {
+        preroll_.erase(preroll_.begin(),
+                       preroll_.begin() + (preroll_.size() - preroll_max));
+      }
+      window_.push_back(loud_start);
+      if (window_.size() >
+          static_cast<size_t>(FramesFor(options_.start_window_ms))) {
+        window_.pop_front();
+      }
+      const int voiced = static_cast<int>(
+          std::count(window_.begin(), window_.end(), true));
+      if (voiced >= FramesFor(options_.start_ms)) {
+        Begin(voiced);
+      }
+      return;
+    }
+
+    utterance_.insert(utterance_.end(), frame_.begin(), frame_.end());
+    utterance_min_db_ = std::min(utterance_min_db_, level);
+    if (vad >= 0.f) {
+      vad_trace_.push_back(vad);
+    }
+    if (loud_continue) {
+      silence_frames_ = 0;
+      ++voiced_frames_;
+      voiced_power_ += std::pow(10.0, level / 10.0);
+    } else {
+      ++silence_frames_;
+    }
+    const bool ended = silence_frames_ >= FramesFor(options_.end_silence_ms);
+    const bool too_long = utterance_.size() >=
+                          frame_samples_ * FramesFor(options_.max_utterance_ms);
+    if (ended || too_long) {
+      if (too_long && !ended) {
+        ++stats_.forced_end;
+      }
+      Finish();
+    }
+  }
+
+  void Begin(int voiced) {
+    in_speech_ = true;
+    utterance_ = std::move(preroll_);
+    utterance_start_ = pushed_ - utterance_.size();
+    preroll_.clear();
+    window_.clear();
+    vad_trace_.clear();
+    silence_frames_ = 0;
+    voiced_frames_ = voiced;
+    utterance_min_db_ = 0.f;
+    // The start window's level isn't kept per frame; count it at the
+    // threshold so AGC has something if the utterance is very short.
+    voiced_power_ =
+        voiced * std::pow(10.0, (floor_db_ + options_.start_margin_db) / 10.0);
+  }
+
+  void Finish() {
+    in_speech_ = false;
+    // Speech has pauses between words; if even the quietest frame was
+    // above the floor, the room got louder (fan, HVAC) while the floor was
+    // frozen. Catch up now instead of retriggering on the new noise.
+    floor_db_ = std::max(floor_db_, utterance_min_db_);
+    if (voiced_frames_ < FramesFor(options_.min_voiced_ms)) {
+      ++stats_.rejected_short;
+      utterance_.clear();
+      return;
+    }
+    // AGC: bring the voiced level to the target, limited so the peak
+    // doesn't clip.
+    const double voiced_db =
+        10.0 * std::log10(std::max(voiced_power_ / voiced_frames_, 1e-10));
+    double gain_db = std::clamp<double>(options_.agc_target_db - voiced_db,
+                                        options_.agc_min_gain_db,
+                                        options_.agc_max_gain_db);
+    int peak = 1;
+    for (int16_t s : utterance_) {
+      peak = std::max(peak, std::abs(static_cast<int>(s)));
+    }
+    gain_db = std::min(gain_db, 20.0 * std::log10(32000.0 / peak));
+    const float gain = static_cast<float>(std::pow(10.0, gain_db / 20.0));
+    for (int16_t& s : utterance_) {
+      s = static_cast<int16_t>(std::clamp(std::lround(s * gain), -32768L,
+                                          32767L));
+    }
+    stats_.last_gain_db = static_cast<float>(gain_db);
+    ++stats_.utterances;
+    EndpointedUtterance ready;
+    ready.pcm = std::move(utterance_);
+    ready.vad = std::move(vad_trace_);
+    ready.start_sample = utterance_start_;
+    ready.gain_db = static_cast<float>(gain_db);
+    ready_.push_back(std::move(ready));
+    utterance_.clear();
+    vad_trace_.clear();
+  }
+
+  EndpointerOptions options_;
+  int sample_rate_;
+  size_t frame_samples_;
+  float fall_;
+  float rise_;
+
+  std::vector<int16_t> frame_;
+  std::vector<int16_t> preroll_;
+  std::deque<bool> window_;
+  std::vector<int16_t> utterance_;
+  std::vector<float> vad_trace_;
+  std::deque<EndpointedUtterance> ready_;
+  uint64_t pushed_ = 0;  // samples through ProcessFrame()
+  uint64_t utterance_start_ = 0;
+
+  bool floor_valid_ = false;
+  float floor_db_ = 0.f;
+  bool in_speech_ = false;
+  int silence_frames_ = 0;
+  int voiced_frames_ = 0;
+  double voiced_power_ = 0.0;
+  float utterance_min_db_ = 0.f;
+  EndpointerStats stats_;
+};
+
+}  // namespace g1_common
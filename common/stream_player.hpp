@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace g1_common {
+
+struct StreamPlayerOptions {
+  int sample_rate = 16000;
+  int frame_ms = 40;           // 20..100 ms per PlayStream call
+  int target_buffer_ms = 240;  // audio kept queued ahead of the speaker
+  // Backoff after a non-zero PlayStream return, doubling up to the max.
+  int backoff_min_ms = 10;
+  int backoff_max_ms = 200;
+  int max_consecutive_failures = 25;
+};
+
+struct StreamPlayerStats {
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t retries = 0;
+  uint64_t underruns = 0;  // the speaker ran dry before the next frame
+  double first_frame_ms = 0.0;
+  double max_call_ms = 0.0;
+  bool aborted = false;
+};
+
+// Streams 16-bit mono PCM through PlayStream in small frames paced by the
+// monotonic clock.
+//
+// The player models the speaker's queue: everything sent minus what has
+// played since the first frame. It sends whenever the queue is below
+// target_buffer_ms (so start-up is one burst of target_buffer_ms), and
+// otherwise sleeps until one frame's worth has drained. Non-zero returns
+// are treated as backpressure: the same frame is retried with exponential
+// backoff. If the queue runs dry the model restarts from the next frame.
+class PacedStreamPlayer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // Sends one frame (e.g. AudioClient::PlayStream); 0 on success.
+  using Writer = std::function<int32_t(const std::vector<uint8_t>&)>;
+  // Called after each accepted frame with the time it will start playing.
+  using OnFrame = std::function<void(const int16_t* samples, size_t count,
+                                     Clock::time_point play_at)>;
+
+  explicit PacedStreamPlayer(Writer writer,
+                             const StreamPlayerOptions& options = {})
+      : writer_(std::move(writer)), options_(options) {
+    frame_bytes_ = static_cast<size_t>(options_.sample_rate) *
+                   options_.frame_ms / 1000 * sizeof(int16_t);
+    // PlayStream takes a vector; reuse one so steady-state sends don't
+    // allocate.
+    frame_.reserve(frame_bytes_);
+  }
+
+  void set_on_frame(OnFrame on_frame) { on_frame_ = std::move(on_frame); }
+
+  // Fills `out` with up to `max` samples; returns 0 at the end.
+  using Source = std::function<size_t(int16_t* out, size_t max)>;
+
+  // Plays `size` bytes starting at `pcm` (borrowed, e.g. an mmapped file;
+  // each frame is copied once into the reused send buffer).
+  StreamPlayerStats Play(const uint8_t* pcm, size_t size,
+                         const std::function<bool()>& stop = nullptr) {
+    size_t offset = 0;
+    return Play(
+        [pcm, size, &offset](int16_t* out, size_t max) {
+          const size_t n =
+              std::min(max, (size - offset) / sizeof(int16_t));
+          std::memcpy(out, pcm + offset, n * sizeof(int16_t));
+          offset += n * sizeof(int16_t);
+          return n;
+        },
+        stop);
+  }
+
+  // Plays whatever `source` produces, one frame at a time, so converted
+  // or generated audio starts immediately with constant memory. `stop` is
+  // polled between frames. Returns once everything is queued; call
+  // WaitDrained() before PlayStop to hear the tail.
+  StreamPlayerStats Play(const Source& source,
+                         const std::function<bool()>& stop = nullptr) {
+    StreamPlayerStats stats;
+    const Clock::time_point begin = Clock::now();
+    const auto target = std::chrono::milliseconds(options_.target_buffer_ms);
+    const size_t frame_samples = frame_bytes_ / sizeof(int16_t);
+    bool have_frame = false;
+    int failures = 0;
+    auto backoff = std::chrono::milliseconds(options_.backoff_min_ms);
+
+    while (true) {
+      if (stop && stop()) {
+        break;
+      }
+      if (!have_frame) {
+        frame_.resize(frame_bytes_);
+        const size_t n =
+            source(reinterpret_cast<int16_t*>(frame_.data()), frame_samples);
+        if (n == 0) {
+          break;
+        }
+        frame_.resize(n * sizeof(int16_t));
+        have_frame = true;
+      }
+
+      const Clock::time_point now = Clock::now();
+      if (started_ && queued_end_ > now) {
+        // Enough queued: sleep until it drops below the target.
+        const Clock::duration queued = queued_end_ - now;
+        if (queued >= target) {
+          std::this_thread::sleep_until(queued_end_ - target +
+                                        FrameDuration(frame_bytes_));
+          continue;
+        }
+      } else if (started_) {
+        ++stats.underruns;
+        started_ = false;
+      }
+
+      const Clock::time_point call_start = Clock::now();
+      const int32_t ret = writer_(frame_);
+      const Clock::time_point call_end = Clock::now();
+      stats.max_call_ms = std::max(
+          stats.max_call_ms,
+          std::chrono::duration<double, std::milli>(call_end - call_start)
+              .count());
+
+      if (ret != 0) {
+        ++stats.retries;
+        if (++failures >= options_.max_consecutive_failures) {
+          std::cout << "PlayStream failed " << failures
+                    << " times in a row (ret " << ret << "), giving up"
+                    << std::endl;
+          stats.aborted = true;
+          break;
+        }
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2,
+                           std::chrono::milliseconds(options_.backoff_max_ms));
+        continue;
+      }
+      failures = 0;
+      backoff = std::chrono::milliseconds(options_.backoff_min_ms);
+      have_frame = false;
+
+      if (!started_) {
+        started_ = true;
+        queued_end_ = call_end;
+      }
+      if (stats.frames == 0) {
+        stats.first_frame_ms =
+            std::chrono::duration<double, std::milli>(call_end - begin)
+                .count();
+      }
+      const Clock::time_point play_at = queued_end_;
+      queued_end_ += FrameDuration(frame_.size());
+      if (on_frame_) {
+        on_frame_(reinterpret_cast<const int16_t*>(frame_.data()),
+                  frame_.size() / sizeof(int16_t), play_at);
+      }
+      ++stats.frames;
+      stats.bytes += frame_.size();
+    }
+    return stats;
+  }
+
+  // Sleeps until the modelled queue is empty (or `stop` returns true).
+  void WaitDrained(const std::function<bool()>& stop = nullptr) {
+    while (started_ && Clock::now() < queued_end_) {
+      if (stop && stop()) {
+        return;
+      }
+      std::this_thread::sleep_for(std::min<Clock::duration>(
+          queued_end_ - Clock::now(), std::chrono::milliseconds(50)));
+    }
+  }
+
+  static void PrintStats(const StreamPlayerStats& s,
+                         std::ostream& out = std::cout) {
+    out << "[player] frames=" << s.frames << " bytes=" << s.bytes
+        << " first_frame_ms=" << s.first_frame_ms
+        << " max_call_ms=" << s.max_call_ms << " retries=" << s.retries
+        << " underruns=" << s.underruns << (s.aborted ? " (aborted)" : "")
+        << std::endl;
+  }
+
+ private:
+  Clock::duration FrameDuration(size_t bytes) const {
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(
+            static_cast<double>(bytes / sizeof(int16_t)) /
+            options_.sample_rate));
+  }
+
+  Writer writer_;
+  StreamPlayerOptions options_;
+  OnFrame on_frame_;
+  size_t frame_bytes_ = 0;
+  std::vector<uint8_t> frame_;
+  bool started_ = false;
+  Clock::time_point queued_end_{};
+};
+
+}  // namespace g1_common
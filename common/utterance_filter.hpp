@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "log_mel.hpp"
+
+namespace g1_common {
+
+struct UtteranceFilterOptions {
+  // A denoiser VAD frame counts as speech at this probability...
+  float vad_speech = 0.5f;
+  // ...and at least this fraction of the utterance's frames must.
+  float min_vad_fraction = 0.1f;
+  // Share of 60 Hz - 8 kHz energy that falls in the 300 - 3400 Hz voice
+  // band (low for thumps, rumble and hiss).
+  float min_band_ratio = 0.35f;
+  // Spectral flatness over the voice-band mel bands: voiced speech has
+  // harmonics and formants (low), coughs, clatter and fan noise are
+  // noise-like (white noise is ~0.7).
+  float max_flatness = 0.5f;
+  // Spread of frame levels: speech rises and falls with syllables, steady
+  // music and machinery don't.
+  float min_modulation_db = 2.0f;
+  // Frames more than this far below the loudest one (hangover, pauses)
+  // are left out of the spectral features.
+  float active_range_db = 15.f;
+  // Speech below either of these is marginal: Whisper's stock subtitle
+  // phrases ("Thank you.") are then taken as filler rather than as what
+  // was said.
+  float confident_vad_fraction = 0.3f;
+  int confident_active_frames = 40;
+};
+
+struct SpeechFeatures {
+  float vad_fraction = -1.f;  // -1 without a VAD trace
+  float band_ratio = 0.f;
+  float flatness = 0.f;
+  float modulation_db = 0.f;
+  int active_frames = 0;
+};
+
+struct SpeechVerdict {
+  bool speech = true;
+  bool marginal = true;  // speech, but weakly; see CheckTranscript()
+  const char* reason = "";
+  SpeechFeatures features;
+};
+
+struct UtteranceFilterStats {
+  uint64_t checked = 0;
+  uint64_t non_speech = 0;      // ASR calls avoided
+  uint64_t hallucinations = 0;  // LLM / command calls avoided
+};
+
+// True if `text` is one of Whisper's stock outputs for non-speech audio:
+// bracketed captions like "[Music]" or "(wind blowing)", or, with
+// `stock_phrases`, phrases from its subtitle training data such as
+// "Thank you." and "Thanks for watching!" (which people also say).
+inline bool IsWhisperHallucination(const std::string& text,
+                                   bool stock_phrases = true) {
+  std::string words;
+  char close = 0;
+  for (unsigned char ch : text) {
+    if (close != 0) {
+      if (ch == close) {
+        close = 0;
+      }
+      continue;
+    }
+    if (ch == '[' || ch == '(' || ch == '*') {
+      close = ch == '[' ? ']' : ch == '(' ? ')' : '*';
+    } else if (std::isalnum(ch) || ch == '\'') {
+      words.push_back(static_cast<char>(std::tolower(ch)));
+    } else if (!words.empty() && words.back() != ' ') {
+      words.push_back(' ');
+    }
+  }
+  while (!words.empty() && words.back() == ' ') {
+    words.pop_back();
+  }
+  if (words.empty()) {
+    return true;  // only captions, music notes or punctuation
+  }
+  if (!stock_phrases) {
+    return false;
+  }
+  static const char* const kPhrases[] = {
+      "thank you",
+      "thank you very much",
+      "thank you so much",
+      "thanks for watching",
+      "thank you for watching",
+      "thank you so much for watching",
+      "please subscribe",
+      "subscribe to my channel",
+      "you",
+      "music",
+      "applause",
+      "laughter",
+      "silence",
+      "blank audio",
+      "foreign",
+  };
+  for (const char* phrase : kPhrases) {
+    if (words == phrase) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Cheap speech / non-speech check on endpointed utterances, run before
+// Whisper, plus the hallucination check on its output. Rules over the
+// denoiser's VAD trace and a few features of the utterance's log-mel
+// frames (the shared MelStream's, so no FFTs of its own); the counters say
+// how many ASR and downstream calls were saved.
+//
+// CheckAudio() and CheckTranscript() may be called from different threads.
+class UtteranceFilter {
+ public:
+  explicit UtteranceFilter(const LogMelOptions& mel = {},
+                           const UtteranceFilterOptions& options = {})
+      : options_(options),
+        n_mels_(mel.n_mels),
+        // Summed band power back to mean square int16: one-sided
+        // Parseval with a Hann window (mean w^2 = 3/8).
+        level_scale_(32768.0 * 32768.0 * 16.0 /
+                     (3.0 * mel.window * mel.window)) {
+    // Slaney bands have unit area, so a band's energy times its half
+    // width approximates the power it covers.
+    const std::vector<double> edges = MelBandEdges(mel);
+    width_.resize(n_mels_);
+    for (size_t m = 0; m < n_mels_; ++m) {
+      const double center = edges[m + 1];
+      width_[m] = (edges[m + 2] - edges[m]) / 2.0;
+      if (center >= 60.0 && center <= 8000.0) {
+        total_hi_ = m + 1;
+        if (total_lo_ > m) {
+          total_lo_ = m;
+        }
+      }
+      if (center >= 300.0 && center <= 3400.0) {
+        voice_hi_ = m + 1;
+        if (voice_lo_ > m) {
+          voice_lo_ = m;
+        }
+      }
+    }
+  }
+
+  // Classifies an utterance from its log10 mel frames (frame-major, as
+  // MelStream::ReadSpan() gives them). `vad` is the denoiser's per-frame
+  // speech probability over it (may be empty).
+  SpeechVerdict CheckAudio(const std::vector<float>& mel,
+                           const std::vector<float>& vad) {
+    SpeechVerdict verdict;
+    verdict.features = Features(mel, vad);
+    const SpeechFeatures& f = verdict.features;
+    if (f.vad_fraction >= 0.f && f.vad_fraction < options_.min_vad_fraction) {
+      verdict.reason = "low VAD";
+    } else if (f.active_frames == 0) {
+      verdict.reason = "silent";
+    } else if (f.band_ratio < options_.min_band_ratio) {
+      verdict.reason = "outside voice band";
+    } else if (f.flatness > options_.max_flatness) {
+      verdict.reason = "noise-like spectrum";
+    } else if (f.modulation_db < options_.min_modulation_db) {
+      verdict.reason = "steady level";
+    }
+    verdict.speech = verdict.reason[0] == '\0';
+    verdict.marginal =
+        (f.vad_fraction >= 0.f &&
+         f.vad_fraction < options_.confident_vad_fraction) ||
+        f.active_frames < options_.confident_active_frames;
+    ++checked_;
+    if (!verdict.speech) {
+      ++non_speech_;
+    }
+    return verdict;
+  }
+
+  // False (and counted) if Whisper's output is a known hallucination.
+  // Stock phrases only count when CheckAudio() found the audio marginal,
+  // so a clearly spoken "Thank you" gets through.
+  bool CheckTranscript(const std::string& text, bool marginal_audio = true) {
+    if (!IsWhisperHallucination(text, marginal_audio)) {
+      return true;
+    }
+    ++hallucinations_;
+    return false;
+  }
+
+  UtteranceFilterStats stats() const {
+    UtteranceFilterStats s;
+    s.checked = checked_.load();
+    s.non_speech = non_speech_.load();
+    s.hallucinations = hallucinations_.load();
+    return s;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const UtteranceFilterStats s = stats();
+    out << "[utterance filter] checked=" << s.checked
+        << " non_speech=" << s.non_speech << " (ASR calls avoided)"
+        << " hallucinations=" << s.hallucinations
+        << " (downstream calls avoided)" << std::endl;
+  }
+
+ private:
+  SpeechFeatures Features(const std::vector<float>& mel,
+                          const std::vector<float>& vad) {
+    SpeechFeatures f;
+    if (!vad.empty()) {
+      const size_t voiced = static_cast<size_t>(
+          std::count_if(vad.begin(), vad.end(), [this](float p) {
+            return p >= options_.vad_speech;
+          }));
+      f.vad_fraction = static_cast<float>(voiced) / vad.size();
+    }
+
+    // Band powers and frame levels first, to find the active frames.
+    // 0 dB is one LSB of int16 audio.
+    const size_t frames = mel.size() / n_mels_;
+    std::vector<float> level_db(frames);
+    power_.resize(mel.size());
+    float max_db = -100.f;
+    for (size_t i = 0; i < frames; ++i) {
+      double total = 0.0;
+      for (size_t m = 0; m < n_mels_; ++m) {
+        const double power = std::pow(10.0, mel[i * n_mels_ + m]);
+        power_[i * n_mels_ + m] = power;
+        total += power * width_[m];
+      }
+      level_db[i] = static_cast<float>(
+          10.0 * std::log10(std::max(total * level_scale_, 1.0)));
+      max_db = std::max(max_db, level_db[i]);
+    }
+
+    double band_sum = 0.0;
+    double flatness_sum = 0.0;
+    double level_sum = 0.0;
+    double level_sq_sum = 0.0;
+    const double voice_bands = static_cast<double>(voice_hi_ - voice_lo_);
+    for (size_t i = 0; i < frames; ++i) {
+      if (level_db[i] < max_db - options_.active_range_db ||
+          level_db[i] <= 0.f) {
+        continue;
+      }
+      ++f.active_frames;
+      level_sum += level_db[i];
+      level_sq_sum += static_cast<double>(level_db[i]) * level_db[i];
+
+      const double* power = &power_[i * n_mels_];
+      double total = 0.0;
+      double voice = 0.0;
+      double density = 0.0;
+      double log_sum = 0.0;
+      for (size_t m = total_lo_; m < total_hi_; ++m) {
+        total += power[m] * width_[m];
+        if (m >= voice_lo_ && m < voice_hi_) {
+          voice += power[m] * width_[m];
+          density += power[m];
+          log_sum += std::log(power[m] + 1e-12);
+        }
+      }
+      band_sum += voice / std::max(total, 1e-12);
+      flatness_sum += std::exp(log_sum / voice_bands) /
+                      std::max(density / voice_bands, 1e-12);
+    }
+    if (f.active_frames > 0) {
+      const double n = f.active_frames;
+      const double mean = level_sum / n;
+      f.band_ratio = static_cast<float>(band_sum / n);
+      f.flatness = static_cast<float>(flatness_sum / n);
+      f.modulation_db = static_cast<float>(
+          std::sqrt(std::max(0.0, level_sq_sum / n - mean * mean)));
+    }
+    return f;
+  }
+
+  UtteranceFilterOptions options_;
+  size_t n_mels_;
+  double level_scale_;
+  std::vector<double> width_;
+  std::vector<double> power_;
+  size_t total_lo_ = SIZE_MAX;
+  size_t total_hi_ = 0;
+  size_t voice_lo_ = SIZE_MAX;
+  size_t voice_hi_ = 0;
+  std::atomic<uint64_t> checked_{0};
+  std::atomic<uint64_t> non_speech_{0};
+  std::atomic<uint64_t> hallucinations_{0};
+};
+
+}  // namespace g1_common
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace g1_common {
+
+constexpr uint16_t kWavFormatPcm = 1;
+constexpr uint16_t kWavFormatFloat = 3;
+constexpr uint16_t kWavFormatExtensible = 0xFFFE;
+
+// A WAV file mapped read-only. Open() walks the RIFF chunks in place and
+// records where the sample data lives; nothing is copied. A data chunk
+// whose size runs past the end of the file (a truncated recording, or a
+// writer that never patched the header) is clamped to what is there.
+class WavFile {
+ public:
+  WavFile() = default;
+  ~WavFile() { Close(); }
+
+  WavFile(const WavFile&) = delete;
+  WavFile& operator=(const WavFile&) = delete;
+
+  bool Open(const std::string& path) {
+    Close();
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cout << "Failed to open wav file: " << path << std::endl;
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+      std::cout << "Invalid WAV file: " << path << std::endl;
+      close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      std::cout << "Failed to mmap wav file: " << path << std::endl;
+      size_ = 0;
+      return false;
+    }
+    base_ = static_cast<const uint8_t*>(map);
+    madvise(map, size_, MADV_SEQUENTIAL);
+    if (!Parse()) {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  void Close() {
+    if (base_ != nullptr) {
+      munmap(const_cast<uint8_t*>(base_), size_);
+    }
+    base_ = nullptr;
+    size_ = 0;
+    data_ = nullptr;
+    data_bytes_ = 0;
+  }
+
+  uint16_t format() const { return format_; }
+  uint16_t channels() const { return channels_; }
+  uint32_t sample_rate() const { return sample_rate_; }
+  uint16_t bits_per_sample() const { return bits_; }
+  size_t frames() const {
+    return block_align_ ? data_bytes_ / block_align_ : 0;
+  }
+  const uint8_t* data() const { return data_; }
+  size_t data_bytes() const { return data_bytes_; }
+  size_t block_align() const { return block_align_; }
+
+  // True when the data is already what the robot plays (16 kHz mono S16),
+  // so it can be sent straight from the mapping.
+  bool IsS16Mono(uint32_t rate) const {
+    return format_ == kWavFormatPcm && channels_ == 1 && bits_ == 16 &&
+           sample_rate_ == rate;
+  }
+
+ private:
+  static uint16_t U16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+  }
+  static uint32_t U32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+  }
+
+  bool Parse() {
+    if (std::memcmp(base_, "RIFF", 4) != 0 ||
+        std::memcmp(base_ + 8, "WAVE", 4) != 0) {
+      std::cout << "Invalid WAV header." << std::endl;
+      return false;
+    }
+    bool fmt_found = false;
+    size_t pos = 12;
+    while (pos + 8 <= size_) {
+      const uint8_t* chunk = base_ + pos;
+      const uint32_t chunk_size = U32(chunk + 4);
+      const size_t body = pos + 8;
+      const size_t available = size_ - body;
+      if (std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 &&
+          available >= 16) {
+        const uint8_t* f = base_ + body;
+        format_ = U16(f);
+        channels_ = U16(f + 2);
+        sample_rate_ = U32(f + 4);
+        block_align_ = U16(f + 12);
+        bits_ = U16(f + 14);
+        if (format_ == kWavFormatExtensible && chunk_size >= 26 &&
+            available >= 26) {
+          // First two bytes of the SubFormat GUID are the real format.
+          format_ = U16(f + 24);
+        }
+        fmt_found = true;
+      } else if (std::memcmp(chunk, "data", 4) == 0) {
+        data_ = base_ + body;
+        data_bytes_ = std::min<size_t>(chunk_size, available);
+        break;
+      }
+      // Chunks are word aligned.
+      pos = body + chunk_size + (chunk_size & 1);
+    }
+    if (!fmt_found || data_ == nullptr) {
+      std::cout << "Missing fmt/data chunks in WAV file." << std::endl;
+      return false;
+    }
+    const bool pcm_ok = format_ == kWavFormatPcm &&
+                        (bits_ == 8 || bits_ == 16 || bits_ == 24 ||
+                         bits_ == 32);
+    const bool float_ok =
+        format_ == kWavFormatFloat && (bits_ == 32 || bits_ == 64);
+    if ((!pcm_ok && !float_ok) || channels_ == 0 || sample_rate_ == 0 ||
+        block_align_ != channels_ * (bits_ / 8)) {
+      std::cout << "Unsupported WAV format: format=" << format_
+                << " channels=" << channels_ << " bits=" << bits_
+                << std::endl;
+      return false;
+    }
+    data_bytes_ -= data_bytes_ % block_align_;
+    return true;
+  }
+
+  const uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+  const uint8_t* data_ = nullptr;
+  size_t data_bytes_ = 0;
+  uint16_t format_ = 0;
+  uint16_t channels_ = 0;
+  uint32_t sample_rate_ = 0;
+  uint16_t block_align_ = 0;
+  uint16_t bits_ = 0;
+};
+
+// Streaming band-limited resampler (windowed sinc, table of 256 phases).
+// Feed input in any block size; output is produced as soon as enough
+// look-ahead is buffered, so memory stays constant.
+class StreamingResampler {
+ public:
+  static constexpr int kHalfTaps = 16;
+  static constexpr int kPhases = 256;
+
+  StreamingResampler(uint32_t in_rate, uint32_t out_rate)
+      : step_(static_cast<double>(in_rate) / out_rate),
+        table_(static_cast<size_t>(kPhases + 1) * 2 * kHalfTaps) {
+    // Cut off a little below the lower Nyquist.
+    const double cutoff = std::min(1.0, 1.0 / step_) * 0.92;
+    for (int p = 0; p <= kPhases; ++p) {
+      const double frac = static_cast<double>(p) / kPhases;
+      double sum = 0.0;
+      float* h = &table_[static_cast<size_t>(p) * 2 * kHalfTaps];
+      for (int k = 0; k < 2 * kHalfTaps; ++k) {
+        const double x = (k - kHalfTaps + 1) - frac;
+        const double sinc =
+            x == 0.0 ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+        // Blackman window over [-kHalfTaps, kHalfTaps].
+        const double w = 0.42 + 0.5 * std::cos(M_PI * x / kHalfTaps) +
+                         0.08 * std::cos(2.0 * M_PI * x / kHalfTaps);
+        h[k] = static_cast<float>(cutoff * sinc * w);
+        sum += h[k];
+      }
+      for (int k = 0; k < 2 * kHalfTaps; ++k) {
+        h[k] = static_cast<float>(h[k] / sum);
+      }
+    }
+    // Prime the history with silence so the first output is at t = 0.
+    buffer_.assign(kHalfTaps - 1, 0.f);
+    position_ = kHalfTaps - 1;
+  }
+
+  void Push(const float* in, size_t count) {
+    buffer_.insert(buffer_.end(), in, in + count);
+  }
+
+  // Writes up to `max` output samples; returns how many.
+  size_t Pull(float* out, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+      const size_t base = static_cast<size_t>(position_);
+      if (base + kHalfTaps >= buffer_.size()) {
+        break;
+      }
+      const double frac = position_ - base;
+      const float* h =
+          &table_[static_cast<size_t>(std::lround(frac * kPhases)) * 2 *
+                  kHalfTaps];
+      const float* x = &buffer_[base + 1 - kHalfTaps];
+      float acc = 0.f;
+      for (int k = 0; k < 2 * kHalfTaps; ++k) {
+        acc += x[k] * h[k];
+      }
+      out[n++] = acc;
+      position_ += step_;
+    }
+    // Drop input no longer needed by the filter.
+    const size_t keep_from = static_cast<size_t>(position_) + 1 - kHalfTaps;
+    if (keep_from > 4096) {
+      buffer_.erase(buffer_.begin(), buffer_.begin() + keep_from);
+      position_ -= keep_from;
+    }
+    return n;
+  }
+
+  // Pads with silence so the last input samples come out.
+  void Flush() { buffer_.insert(buffer_.end(), kHalfTaps, 0.f); }
+
+ private:
+  double step_;
+  std::vector<float> table_;
+  std::vector<float> buffer_;
+  double position_ = 0.0;
+};
+
+// Converts a WavFile to mono S16 at `out_rate` on the fly: decode a block of
+// frames from the mapping, downmix, resample if needed, dither-free round
+// to S16. Constant memory regardless of file length.
+class WavS16Stream {
+ public:
+  static constexpr size_t kBlockFrames = 1024;
+
+  WavS16Stream(const WavFile& wav, uint32_t out_rate)
+      : wav_(wav),
+        resample_(wav.sample_rate() != out_rate),
+        resampler_(wav.sample_rate(), out_rate) {
+    mono_.resize(kBlockFrames);
+    out_.resize(kBlockFrames * 4);
+  }
+
+  // Fills `out` with up to `max` samples; returns 0 at the end.
+  size_t Read(int16_t* out, size_t max) {
+    size_t written = 0;
+    while (written < max) {
+      if (resample_) {
+        const size_t n = resampler_.Pull(out_.data(),
+                                         std::min(max - written, out_.size()));
+        for (size_t i = 0; i < n; ++i) {
+          out[written++] = ToS16(out_[i]);
+        }
+        if (n > 0) {
+          continue;
+        }
+      }
+      const size_t frames = DecodeBlock();
+      if (frames == 0) {
+        if (resample_ && !flushed_) {
+          resampler_.Flush();
+          flushed_ = true;
+          continue;
+        }
+        break;
+      }
+      if (resample_) {
+        resampler_.Push(mono_.data(), frames);
+      } else {
+        // Same rate: convert straight through, carrying any excess.
+        for (size_t i = 0; i < frames; ++i) {
+          if (written < max) {
+            out[written++] = ToS16(mono_[i]);
+          } else {
+            pending_.push_back(mono_[i]);
+          }
+        }
+      }
+    }
+    return written;
+  }
+
+ private:
+  static int16_t ToS16(float v) {
+    const float scaled = std::round(v * 32767.f);
+    return static_cast<int16_t>(std::clamp(scaled, -32768.f, 32767.f));
+  }
+
+  float DecodeSample(const uint8_t* p) const {
+    switch (wav_.bits_per_sample()) {
+      case 8:
+        return (static_cast<int>(p[0]) - 128) / 128.f;
+      case 16:
+        return static_cast<int16_t>(p[0] | (p[1] << 8)) / 32768.f;
+      case 24: {
+        const int32_t v = static_cast<int32_t>(
+            (static_cast<uint32_t>(p[0]) << 8) | (p[1] << 16) |
+            (static_cast<uint32_t>(p[2]) << 24));
+        return (v >> 8) / 8388608.f;
+      }
+      case 32:
+        if (wav_.format() == kWavFormatFloat) {
+          float f;
+          std::memcpy(&f, p, sizeof(f));
+          return f;
+        } else {
+          int32_t v;
+          std::memcpy(&v, p, sizeof(v));
+          return static_cast<float>(v / 2147483648.0);
+        }
+      case 64: {
+        double d;
+        std::memcpy(&d, p, sizeof(d));
+        return static_cast<float>(d);
+      }
+    }
+    return 0.f;
+  }
+
+  // Decodes and downmixes the next block into mono_. Returns frame count.
+  size_t DecodeBlock() {
+    if (!pending_.empty()) {
+      const size_t n = std::min(pending_.size(), mono_.size());
+      std::copy(pending_.begin(), pending_.begin() + n, mono_.begin());
+      pending_.erase(pending_.begin(), pending_.begin() + n);
+      return n;
+    }
+    const size_t frames = std::min(kBlockFrames, wav_.frames() - frame_);
+    const size_t channels = wav_.channels();
+    const size_t bytes_per_sample = wav_.bits_per_sample() / 8;
+    const uint8_t* p = wav_.data() + frame_ * wav_.block_align();
+    const float scale = 1.f / channels;
+    for (size_t f = 0; f < frames; ++f) {
+      float sum = 0.f;
+      for (size_t c = 0; c < channels; ++c) {
+        sum += DecodeSample(p);
+        p += bytes_per_sample;
+      }
+      mono_[f] = sum * scale;
+    }
+    frame_ += frames;
+    return frames;
+  }
+
+  const WavFile& wav_;
+  bool resample_;
+  StreamingResampler resampler_;
+  std::vector<float> mono_;
+  std::vector<float> out_;
+  std::vector<float> pending_;
+  size_t frame_ = 0;
+  bool flushed_ = false;
+};
+
+}  // namespace g1_common
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace g1_common {
+
+struct WavWriterOptions {
+  // Data is written in blocks of this size at block-aligned file offsets.
+  size_t block_bytes = 256 * 1024;
+  // Blocks waiting for the disk; beyond this, Write() drops audio instead
+  // of stalling the capture thread.
+  size_t max_queued_blocks = 8;
+  // A partly filled block is also written once this old (checked on each
+  // Write()), so a crash loses at most about this much audio. 0 disables.
+  int flush_interval_ms = 1000;
+};
+
+struct WavWriterStats {
+  uint64_t bytes = 0;  // sample bytes on disk
+  uint64_t writes = 0;
+  uint64_t dropped_bytes = 0;
+  double max_write_ms = 0.0;
+};
+
+// Streaming 16-bit PCM WAV sink with constant memory.
+//
+// The header is written when the file is opened, padded with a JUNK chunk
+// so the samples start at file offset kHeaderBytes. Write() copies samples
+// into a page-aligned block; full blocks (and, every flush_interval_ms, the
+// partial one) go to a background thread that pwrite()s them at their
+// offset and then patches the RIFF and data sizes. The file on disk is
+// therefore always a valid WAV covering everything written so far, even if
+// the process dies without calling Close().
+class WavWriter {
+ public:
+  static constexpr size_t kHeaderBytes = 4096;
+
+  explicit WavWriter(const WavWriterOptions& options = {})
+      : options_(options) {
+    options_.block_bytes =
+        std::max<size_t>(kHeaderBytes,
+                         options_.block_bytes / kHeaderBytes * kHeaderBytes);
+    options_.max_queued_blocks =
+        std::max<size_t>(1, options_.max_queued_blocks);
+  }
+  ~WavWriter() { Close(); }
+
+  WavWriter(const WavWriter&) = delete;
+  WavWriter& operator=(const WavWriter&) = delete;
+
+  bool Open(const std::string& path, uint32_t sample_rate,
+            uint16_t channels = 1) {
+    Close();
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      std::cout << "Failed to open " << path << " for writing." << std::endl;
+      return false;
+    }
+    std::vector<uint8_t> header(kHeaderBytes, 0);
+    BuildHeader(header.data(), sample_rate, channels);
+    if (!PwriteAll(header.data(), header.size(), 0)) {
+      std::cout << "Failed to write WAV header to " << path << std::endl;
+      close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    path_ = path;
+    stats_ = WavWriterStats{};
+    data_end_ = 0;
+    block_offset_ = 0;
+    filled_ = 0;
+    stopping_ = false;
+    free_.clear();
+    for (size_t i = 0; i < options_.max_queued_blocks + 1; ++i) {
+      free_.push_back(AllocateBlock());
+    }
+    current_ = TakeFree();
+    last_submit_ = std::chrono::steady_clock::now();
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+  const std::string& path() const { return path_; }
+
+  // Appends interleaved samples. Never waits for the disk.
+  void Write(const int16_t* samples, size_t count) {
+    if (fd_ < 0) {
+      return;
+    }
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(samples);
+    size_t bytes = count * sizeof(int16_t);
+    while (bytes > 0) {
+      if (!current_) {
+        // The disk fell behind and every block is queued: drop.
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.dropped_bytes += bytes;
+        current_ = TakeFreeLocked();
+        return;
+      }
+      const size_t n = std::min(bytes, options_.block_bytes - filled_);
+      std::memcpy(current_.get() + filled_, src, n);
+      filled_ += n;
+      src += n;
+      bytes -= n;
+      if (filled_ == options_.block_bytes) {
+        Submit(std::move(current_), filled_);
+        block_offset_ += filled_;
+        filled_ = 0;
+        current_ = TakeFree();
+      }
+    }
+    MaybeFlushPartial();
+  }
+
+  // Writes out what is buffered, patches the header and closes the file.
+  void Close() {
+    if (fd_ < 0) {
+      return;
+    }
+    if (current_ && filled_ > 0) {
+      Submit(std::move(current_), filled_);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    fdatasync(fd_);
+    close(fd_);
+    fd_ = -1;
+    current_.reset();
+    free_.clear();
+  }
+
+  WavWriterStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void PrintStats(std::ostream& out = std::cout) const {
+    const WavWriterStats s = stats();
+    out << "[wav] " << path_ << " bytes=" << s.bytes << " writes=" << s.writes
+        << " dropped_bytes=" << s.dropped_bytes
+        << " max_write_ms=" << s.max_write_ms << std::endl;
+  }
+
+ private:
+  struct FreeDeleter {
+    void operator()(uint8_t* p) const { std::free(p); }
+  };
+  using Block = std::unique_ptr<uint8_t[], FreeDeleter>;
+
+  struct Job {
+    Block block;
+    size_t offset = 0;  // relative to the start of the data
+    size_t bytes = 0;
+  };
+
+  Block AllocateBlock() const {
+    void* p = nullptr;
+    if (posix_memalign(&p, kHeaderBytes, options_.block_bytes) != 0) {
+      return nullptr;
+    }
+    return Block(static_cast<uint8_t*>(p));
+  }
+
+  Block TakeFree() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return TakeFreeLocked();
+  }
+
+  Block TakeFreeLocked() {
+    if (free_.empty()) {
+      return nullptr;
+    }
+    Block b = std::move(free_.back());
+    free_.pop_back();
+    return b;
+  }
+
+  void Submit(Block block, size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(Job{std::move(block), block_offset_, bytes});
+    }
+    cv_.notify_one();
+    last_submit_ = std::chrono::steady_clock::now();
+  }
+
+  // Snapshots the partial block so it reaches the disk; the full block is
+  // later written over the same offset.
+  void MaybeFlushPartial() {
+    if (options_.flush_interval_ms <= 0 || !current_ || filled_ == 0) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_submit_ <
+        std::chrono::milliseconds(options_.flush_interval_ms)) {
+      return;
+    }
+    last_submit_ = now;
+    Block copy = TakeFree();
+    if (!copy) {
+      return;
+    }
+    std::memcpy(copy.get(), current_.get(), filled_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(Job{std::move(copy), block_offset_, filled_});
+    }
+    cv_.notify_one();
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty()) {
+        return;
+      }
+      Job job = std::move(jobs_.front());
+      jobs_.pop_front();
+      lock.unlock();
+
+      const auto start = std::chrono::steady_clock::now();
+      const bool ok =
+          PwriteAll(job.block.get(), job.bytes, kHeaderBytes + job.offset);
+      const size_t end = job.offset + job.bytes;
+      if (ok && end > data_end_) {
+        data_end_ = end;
+        PatchSizes(data_end_);
+      }
+      const double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+      lock.lock();
+      if (ok) {
+        ++stats_.writes;
+        stats_.bytes = data_end_;
+      } else {
+        stats_.dropped_bytes += job.bytes;
+      }
+      stats_.max_write_ms = std::max(stats_.max_write_ms, ms);
+      free_.push_back(std::move(job.block));
+    }
+  }
+
+  bool PwriteAll(const uint8_t* data, size_t bytes, size_t offset) {
+    while (bytes > 0) {
+      const ssize_t n = pwrite(fd_, data, bytes, static_cast<off_t>(offset));
+      if (n <= 0) {
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += n;
+      bytes -= static_cast<size_t>(n);
+      offset += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  static void PutU16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+  }
+  static void PutU32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+      p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+  }
+
+  // RIFF + fmt (16 bytes) + JUNK padding + data header = kHeaderBytes.
+  static void BuildHeader(uint8_t* h, uint32_t sample_rate,
+                          uint16_t channels) {
+    const uint16_t bits = 16;
+    const uint16_t block_align = static_cast<uint16_t>(channels * bits / 8);
+    std::memcpy(h, "RIFF", 4);
+    PutU32(h + 4, kHeaderBytes - 8);
+    std::memcpy(h + 8, "WAVE", 4);
+    std::memcpy(h + 12, "fmt ", 4);
+    PutU32(h + 16, 16);
+    PutU16(h + 20, 1);  // PCM
+    PutU16(h + 22, channels);
+    PutU32(h + 24, sample_rate);
+    PutU32(h + 28, sample_rate * block_align);
+    PutU16(h + 32, block_align);
+    PutU16(h + 34, bits);
+    std::memcpy(h + 36, "JUNK", 4);
+    PutU32(h + 40, kHeaderBytes - 44 - 8);
+    std::memcpy(h + kHeaderBytes - 8, "data", 4);
+    PutU32(h + kHeaderBytes - 4, 0);
+  }
+
+  void PatchSizes(size_t data_bytes) {
+    // WAV sizes are 32-bit; past 4 GB the header stays at the maximum.
+    const uint32_t data_size = static_cast<uint32_t>(
+        std::min<uint64_t>(data_bytes, 0xFFFFFFFFull - kHeaderBytes));
+    uint8_t riff[4];
+    uint8_t data[4];
+    PutU32(riff, data_size + kHeaderBytes - 8);
+    PutU32(data, data_size);
+    PwriteAll(riff, 4, 4);
+    PwriteAll(data, 4, kHeaderBytes - 4);
+  }
+
+  WavWriterOptions options_;
+  std::string path_;
+  int fd_ = -1;
+
+  // Producer side (the thread calling Write()).
+  Block current_;
+  size_t filled_ = 0;
+  size_t block_offset_ = 0;
+  std::chrono::steady_clock::time_point last_submit_{};
+
+  // Writer thread only.
+  size_t data_end_ = 0;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Job> jobs_;
+  std::vector<Block> free_;
+  bool stopping_ = false;
+  WavWriterStats stats_;
+  std::thread thread_;
+};
+
+// Opens a recorder for debugging capture when $G1_CAPTURE_DIR is set:
+// <dir>/<prefix>_<epoch ms>.wav. Returns nullptr otherwise (or if the file
+// can't be created), so callers just test the pointer.
+inline std::unique_ptr<WavWriter> OpenCaptureRecorder(const std::string& prefix,
+                                                      uint32_t sample_rate) {
+  const char* dir = std::getenv("G1_CAPTURE_DIR");
+  if (dir == nullptr || dir[0] == '\0') {
+    return nullptr;
+  }
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now().time_since_epoch())
+                      .count();
+  const std::string path =
+      std::string(dir) + "/" + prefix + "_" + std::to_string(ms) + ".wav";
+  auto writer = std::make_unique<WavWriter>();
+  if (!writer->Open(path, sample_rate)) {
+    return nullptr;
+  }
+  std::cout << "Recording capture to " << path << std::endl;
+  return writer;
+}
+
+}  // namespace g1_common
@@ -1,35 +1,60 @@
 #include <chrono>
 #include <iostream>
 #include <string>
-#include <thread>
+#include <vector>
 
 #include <unitree/robot/channel/channel_factory.hpp>
 #include <unitree/robot/g1/loco/g1_loco_client.hpp>
 
+#include "fsm_sequence.hpp"
+#include "robot_client.hpp"
+
+namespace {
+
+// Damp -> StandUp -> SetFsmId(501), each step starting as soon as the robot
+// reports the previous state.
+template <typename Client>
+bool Activate(Client* client) {
+  using std::chrono::milliseconds;
+  std::vector<g1_loco::FsmStep<Client>> steps;
+  for (const char* name : {"damp", "stand_up", "501"}) {
+    g1_loco::FsmStep<Client> step;
+    g1_loco::MakeFsmStep(name, milliseconds(10000), &step);
+    steps.push_back(step);
+  }
+  g1_loco::FsmSequenceRunner<Client> runner(client);
+  return runner.Run(steps);
+}
+
+}  // namespace
+
 int main(int argc, char **argv) {
   if (argc < 2) {
-    std::cout << "Usage: " << argv[0] << " <network_interface>\n";
+    std::cout << "Usage: " << argv[0] << " <network_interface|robotd|TEST>\n";
     return 1;
   }
 
   const std::string network_interface = argv[1];
+  if (network_interface == "TEST") {
+    g1_loco::SimulatedLocoClient client;
+    return Activate(&client) ? 0 : 1;
+  }
+  if (network_interface == "robotd") {
+    // Through a running g1_robotd, which keeps its clients connected.
+    g1_daemon::RobotDaemonClient client;
+    client.Init();
+    if (!client.connected()) {
+      return 1;
+    }
+    client.SetTimeout(10.f);
+    return Activate(&client) ? 0 : 1;
+  }
+
   unitree::robot::ChannelFactory::Instance()->Init(0, network_interface);
 
   unitree::robot::g1::LocoClient client;
   client.Init();
   client.SetTimeout(10.f);
 
-  int32_t ret = 0;
-  ret = client.Damp();
-  std::cout << "Damp ret: " << ret << "\n";
-  std::this_thread::sleep_for(std::chrono::seconds(2));
-
-  ret = client.StandUp();
-  std::cout << "StandUp ret: " << ret << "\n";
-  std::this_thread::sleep_for(std::chrono::seconds(2));
-
-  ret = client.SetFsmId(501);
-  std::cout << "SetFsmId(501) ret: " << ret << "\n";
-
-  return 0;
+  return Activate(&client) ? 0 : 1;
 }
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+#include <unitree/idl/hg/LowCmd_.hpp>
+
+#include "g1_arm_common.hpp"
+
+namespace g1_arm {
+
+struct JointGains {
+  float kp = 60.f;
+  float kd = 1.5f;
+};
+
+using GainSchedule = std::array<JointGains, kNumArmJoints>;
+
+// 60/1.5 on shoulders, elbows and waist as before; the wrist motors are much
+// smaller and ring at that stiffness, so they get softer gains.
+inline GainSchedule DefaultGainSchedule() {
+  GainSchedule gains;
+  gains.fill(JointGains{60.f, 1.5f});
+  for (size_t i = 0; i < kNumArmJoints; ++i) {
+    switch (kArmJoints[i]) {
+      case kLeftWristRoll:
+      case kLeftWristPitch:
+      case kLeftWristYaw:
+      case kRightWristRoll:
+      case kRightWristPitch:
+      case kRightWristYaw:
+        gains[i] = JointGains{40.f, 1.0f};
+        break;
+      default:
+        break;
+    }
+  }
+  return gains;
+}
+
+inline ArmPose ArmPoseFromCommand(
+    const unitree_hg::msg::dds_::LowCmd_& cmd) {
+  ArmPose pose;
+  for (size_t i = 0; i < kNumArmJoints; ++i) {
+    pose[i] = cmd.motor_cmd().at(kArmJoints[i]).q();
+  }
+  return pose;
+}
+
+// Owns the arm_sdk weight for the lifetime of a control session.
+//
+// The weight is never stepped: acquisition and release are smoothstep ramps
+// advanced once per Step(), and gain changes are rate limited per joint.
+// If the session is destroyed while the weight is still applied (early
+// return, exception, stop signal) the destructor runs a blocking release so
+// the locomotion controller always gets the arms back.
+class ArmSdkSession {
+ public:
+  using CommandWriter =
+      std::function<void(const unitree_hg::msg::dds_::LowCmd_&)>;
+
+  static constexpr float kDefaultGainRampTime = 0.5f;
+  static constexpr float kEmergencyReleaseTime = 1.0f;
+  // Fraction of the target gains re-applied after Resync().
+  static constexpr float kResyncGainScale = 0.3f;
+
+  ArmSdkSession(CommandWriter writer, float control_dt,
+                const GainSchedule& gains = DefaultGainSchedule())
+      : writer_(std::move(writer)),
+        control_dt_(control_dt),
+        target_gains_(gains),
+        gains_(gains) {}
+
+  ~ArmSdkSession() {
+    if (weight_ <= 0.f && weight_to_ <= 0.f) {
+      return;
+    }
+    try {
+      std::cout << "Releasing arm_sdk ..." << std::endl;
+      Release(kEmergencyReleaseTime);
+    } catch (...) {
+      // Nothing more can be done from a destructor.
+    }
+  }
+
+  ArmSdkSession(const ArmSdkSession&) = delete;
+  ArmSdkSession& operator=(const ArmSdkSession&) = delete;
+
+  // Starts ramping the weight to 1 while commanding `measured`, so the
+  // handover from the locomotion controller starts where the arms are.
+  void BeginAcquire(const ArmPose& measured, float ramp_time) {
+    q_des_ = measured;
+    StartWeightRamp(1.f, ramp_time);
+  }
+
+  // Starts ramping the weight back to 0 while holding the last command.
+  void BeginRelease(float ramp_time) { StartWeightRamp(0.f, ramp_time); }
+
+  // Re-seeds the command from `measured` and brings the gains back in
+  // gradually; used after a fault (stale lowstate, large tracking error)
+  // so resuming doesn't snap the arms to a stale target.
+  void Resync(const ArmPose& measured) {
+    q_des_ = measured;
+    for (auto& g : gains_) {
+      g.kp *= kResyncGainScale;
+      g.kd *= kResyncGainScale;
+    }
+  }
+
+  // Changes the gains of one ArmPose slot; applied over the gain ramp time.
+  void SetGains(size_t slot, const JointGains& gains) {
+    target_gains_.at(slot) = gains;
+  }
+
+  void SetGainRampTime(float seconds) {
+    gain_ramp_time_ = std::max(seconds, control_dt_);
+  }
+
+  // Advances the weight and gain ramps by one control period and publishes
+  // `q_des` for every arm joint.
+  void Step(const ArmPose& q_des) {
+    q_des_ = q_des;
+    AdvanceWeight();
+    AdvanceGains();
+
+    msg_.motor_cmd().at(kArmSdkWeightJoint).q(weight_);
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      auto& cmd = msg_.motor_cmd().at(kArmJoints[j]);
+      cmd.q(q_des_[j]);
+      cmd.dq(0.f);
+      cmd.kp(gains_[j].kp);
+      cmd.kd(gains_[j].kd);
+      cmd.tau(0.f);
+    }
+    writer_(msg_);
+  }
+
+  // Publishes the last command again; the weight ramp keeps advancing.
+  void Hold() { Step(q_des_); }
+
+  // Steps at `loop`'s rate, holding the command, until the weight ramp in
+  // progress finishes. Returns false if a stop signal arrived first.
+  bool RunRamp(RateLoop& loop) {
+    while (ramping()) {
+      if (StopRequested()) {
+        return false;
+      }
+      Hold();
+      loop.Sleep();
+    }
+    return true;
+  }
+
+  // Blocking release that ignores stop signals; ends with a weight of 0.
+  void Release(float ramp_time) {
+    RateLoop loop(control_dt_);
+    BeginRelease(ramp_time);
+    while (ramping()) {
+      Hold();
+      loop.Sleep();
+    }
+    weight_ = 0.f;
+    Hold();
+  }
+
+  bool ramping() const { return ramp_step_ < ramp_steps_; }
+  float weight() const { return weight_; }
+  float control_dt() const { return control_dt_; }
+  const ArmPose& commanded() const { return q_des_; }
+
+ private:
+  void StartWeightRamp(float to, float ramp_time) {
+    weight_from_ = weight_;
+    weight_to_ = to;
+    ramp_steps_ =
+        std::max(1, static_cast<int>(std::lround(ramp_time / control_dt_)));
+    ramp_step_ = 0;
+  }
+
+  void AdvanceWeight() {
+    if (!ramping()) {
+      return;
+    }
+    ++ramp_step_;
+    const float x = static_cast<float>(ramp_step_) / ramp_steps_;
+    // Smoothstep: zero slope at both ends, so there is no torque kick when
+    // the ramp starts or stops.
+    const float s = x * x * (3.f - 2.f * x);
+    weight_ = std::clamp(weight_from_ + (weight_to_ - weight_from_) * s, 0.f,
+                         1.f);
+  }
+
+  void AdvanceGains() {
+    const float fraction = control_dt_ / gain_ramp_time_;
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      const float max_dkp =
+          std::max(target_gains_[j].kp, gains_[j].kp) * fraction;
+      const float max_dkd =
+          std::max(target_gains_[j].kd, gains_[j].kd) * fraction;
+      gains_[j].kp += std::clamp(target_gains_[j].kp - gains_[j].kp, -max_dkp,
+                                 max_dkp);
+      gains_[j].kd += std::clamp(target_gains_[j].kd - gains_[j].kd, -max_dkd,
+                                 max_dkd);
+    }
+  }
+
+  CommandWriter writer_;
+  float control_dt_;
+  float gain_ramp_time_ = kDefaultGainRampTime;
+  GainSchedule target_gains_;
+  GainSchedule gains_;
+  ArmPose q_des_{};
+  unitree_hg::msg::dds_::LowCmd_ msg_;
+
+  float weight_ = 0.f;
+  float weight_from_ = 0.f;
+  float weight_to_ = 0.f;
+  int ramp_steps_ = 0;
+  int ramp_step_ = 0;
+};
+
+constexpr auto kStateTimeout = std::chrono::milliseconds(100);
+
+// Returns false while rt/lowstate is stale. On the first fresh sample after a
+// stale period the session and `jpos_des` are re-seeded from the measured
+// pose, so the trajectory resumes from where the arms are instead of jumping
+// to wherever the command had drifted.
+inline bool StateHealthy(const ArmStateBuffer& state, ArmSdkSession* session,
+                         ArmPose* jpos_des, bool* faulted) {
+  if (state.Age() > kStateTimeout) {
+    if (!*faulted) {
+      std::cout << "lowstate stale, holding arms" << std::endl;
+    }
+    *faulted = true;
+    return false;
+  }
+  if (*faulted) {
+    ArmPose measured{};
+    state.Latest(&measured);
+    session->Resync(measured);
+    *jpos_des = measured;
+    *faulted = false;
+    std::cout << "lowstate back, resynced arms" << std::endl;
+  }
+  return true;
+}
+
+}  // namespace g1_arm
@@ -0,0 +1,111 @@
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "g1_arm_common.hpp"
+#include "setpoint_stream.hpp"
+
+using namespace g1_arm;
+
+// Local setpoint source for g1_arm_teleop: swings both shoulders with a slow
+// sine. Useful to exercise the UDP and shared-memory input paths without a
+// teleop rig.
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0]
+              << " <udp:host:port|shm:name> [seconds] [rate_hz]" << std::endl;
+    return 1;
+  }
+
+  SetpointEndpoint endpoint;
+  if (!ParseSetpointEndpoint(argv[1], &endpoint)) {
+    std::cout << "Invalid setpoint endpoint: " << argv[1] << std::endl;
+    return 1;
+  }
+  const float seconds = argc >= 3 ? std::stof(argv[2]) : 10.f;
+  const float rate_hz = argc >= 4 ? std::stof(argv[3]) : 100.f;
+
+  int sock = -1;
+  sockaddr_in dest{};
+  SetpointShm* shm = nullptr;
+  if (endpoint.kind == SetpointEndpoint::kUdp) {
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(static_cast<uint16_t>(endpoint.port));
+    const std::string host =
+        endpoint.host.empty() ? "127.0.0.1" : endpoint.host;
+    if (sock < 0 || inet_pton(AF_INET, host.c_str(), &dest.sin_addr) != 1) {
+      std::cout << "Failed to set up UDP destination " << host << std::endl;
+      return 1;
+    }
+  } else {
+    int fd = shm_open(endpoint.shm_name.c_str(), O_CREAT | O_RDWR, 0660);
+    if (fd < 0 || ftruncate(fd, sizeof(SetpointShm)) < 0) {
+      std::cout << "Failed to open shared memory " << endpoint.shm_name
+                << std::endl;
+      return 1;
+    }
+    void* mem = mmap(nullptr, sizeof(SetpointShm), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+      std::cout << "Failed to map shared memory." << std::endl;
+      return 1;
+    }
+    shm = static_cast<SetpointShm*>(mem);
+  }
+
+  InstallStopSignalHandlers();
+  RateLoop loop(1.f / rate_hz);
+  const auto start = std::chrono::steady_clock::now();
+  SetpointPacket packet;
+  uint32_t sent = 0;
+  while (!StopRequested()) {
+    const auto now = std::chrono::steady_clock::now();
+    const float t = std::chrono::duration<float>(now - start).count();
+    if (t >= seconds) {
+      break;
+    }
+    const float swing = 0.4f * std::sin(2.f * 3.14159265f * 0.25f * t);
+    packet.seq = sent++;
+    packet.stamp_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now.time_since_epoch())
+            .count());
+    packet.q[0] = swing;   // left shoulder pitch
+    packet.q[7] = swing;   // right shoulder pitch
+    packet.q[3] = 0.5f;    // left elbow
+    packet.q[10] = 0.5f;   // right elbow
+
+    if (sock >= 0) {
+      sendto(sock, &packet, sizeof(packet), 0,
+             reinterpret_cast<sockaddr*>(&dest), sizeof(dest));
+    } else {
+      const uint32_t seq = shm->sequence.load(std::memory_order_relaxed);
+      shm->sequence.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      std::memcpy(&shm->packet, &packet, sizeof(packet));
+      shm->sequence.store(seq + 2, std::memory_order_release);
+    }
+    loop.Sleep();
+  }
+
+  std::cout << "Sent " << sent << " setpoints." << std::endl;
+  if (sock >= 0) {
+    close(sock);
+  }
+  if (shm != nullptr) {
+    munmap(shm, sizeof(SetpointShm));
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace g1_loco {
+
+constexpr int kNoFsmWait = -1;
+
+// One step of a bring-up sequence: an RPC, then (optionally) a wait until
+// GetFsmId reports `target_fsm`. `settle` is an extra dwell after the target
+// is reached, for transitions whose FSM id flips before the motion is over.
+template <typename Client>
+struct FsmStep {
+  std::string name;
+  std::function<int32_t(Client&)> action;
+  int target_fsm = kNoFsmWait;
+  std::chrono::milliseconds timeout{5000};
+  std::chrono::milliseconds settle{0};
+};
+
+// Runs FsmSteps back to back. Instead of sleeping a worst-case interval
+// after each RPC it polls GetFsmId and issues the next step as soon as the
+// robot reports the target state, so bring-up takes as long as the robot
+// needs. Templated on the client so it runs against LocoClient or a mock.
+template <typename Client>
+class FsmSequenceRunner {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit FsmSequenceRunner(
+      Client* client,
+      std::chrono::milliseconds poll_interval = std::chrono::milliseconds(50))
+      : client_(client), poll_interval_(poll_interval) {}
+
+  // Returns false at the first step whose RPC fails or whose target state is
+  // not reached within its timeout.
+  bool Run(const std::vector<FsmStep<Client>>& steps) {
+    const Clock::time_point sequence_start = Clock::now();
+    for (const auto& step : steps) {
+      const Clock::time_point step_start = Clock::now();
+      int32_t ret = step.action(*client_);
+      std::cout << step.name << " ret: " << ret;
+      if (ret != 0) {
+        std::cout << " (failed)" << std::endl;
+        return false;
+      }
+      if (step.target_fsm != kNoFsmWait) {
+        if (!WaitForFsm(step.target_fsm, step_start + step.timeout)) {
+          std::cout << " timed out waiting for FSM " << step.target_fsm
+                    << " (last " << last_fsm_ << ")" << std::endl;
+          return false;
+        }
+        std::this_thread::sleep_for(step.settle);
+      }
+      std::cout << " done in " << MillisSince(step_start) << " ms"
+                << std::endl;
+    }
+    std::cout << "Sequence done in " << MillisSince(sequence_start) << " ms"
+              << std::endl;
+    return true;
+  }
+
+ private:
+  bool WaitForFsm(int target, Clock::time_point deadline) {
+    while (true) {
+      int fsm_id = -1;
+      if (client_->GetFsmId(fsm_id) == 0) {
+        last_fsm_ = fsm_id;
+        if (fsm_id == target) {
+          return true;
+        }
+      }
+      if (Clock::now() + poll_interval_ > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(poll_interval_);
+    }
+  }
+
+  static long long MillisSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                                 start)
+        .count();
+  }
+
+  Client* client_;
+  std::chrono::milliseconds poll_interval_;
+  int last_fsm_ = -1;
+};
+
+// Builds a step from a set_mode-style name: damp, zero_torque, squat, sit,
+// stand_up, start, stop_move, balance_stand, high_stand, low_stand, or a
+// bare FSM id. Steps that change the FSM wait for it; the others don't.
+template <typename Client>
+bool MakeFsmStep(const std::string& name, std::chrono::milliseconds timeout,
+                 FsmStep<Client>* step) {
+  step->name = name;
+  step->timeout = timeout;
+  step->target_fsm = kNoFsmWait;
+  if (name == "damp") {
+    step->action = [](Client& c) { return c.Damp(); };
+    step->target_fsm = 1;
+  } else if (name == "zero_torque") {
+    step->action = [](Client& c) { return c.ZeroTorque(); };
+    step->target_fsm = 0;
+  } else if (name == "squat") {
+    step->action = [](Client& c) { return c.Squat(); };
+    step->target_fsm = 2;
+  } else if (name == "sit") {
+    step->action = [](Client& c) { return c.Sit(); };
+    step->target_fsm = 3;
+  } else if (name == "stand_up") {
+    step->action = [](Client& c) { return c.StandUp(); };
+    step->target_fsm = 4;
+    // The id switches to 4 as the stand-up motion starts, and there is no
+    // signal for its end; allow the 2 s it takes.
+    step->settle = std::chrono::milliseconds(2000);
+  } else if (name == "start") {
+    step->action = [](Client& c) { return c.Start(); };
+    step->target_fsm = 500;
+  } else if (name == "stop_move") {
+    step->action = [](Client& c) { return c.StopMove(); };
+  } else if (name == "balance_stand") {
+    step->action = [](Client& c) { return c.BalanceStand(); };
+  } else if (name == "high_stand") {
+    step->action = [](Client& c) { return c.HighStand(); };
+  } else if (name == "low_stand") {
+    step->action = [](Client& c) { return c.LowStand(); };
+  } else if (!name.empty() &&
+             name.find_first_not_of("0123456789") == std::string::npos) {
+    const int fsm_id = std::atoi(name.c_str());
+    step->name = "SetFsmId(" + name + ")";
+    step->action = [fsm_id](Client& c) { return c.SetFsmId(fsm_id); };
+    step->target_fsm = fsm_id;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Parses a comma separated list of step names (see MakeFsmStep).
+template <typename Client>
+bool ParseFsmSequence(const std::string& spec,
+                      std::chrono::milliseconds timeout,
+                      std::vector<FsmStep<Client>>* steps) {
+  size_t start = 0;
+  while (start <= spec.size()) {
+    size_t comma = spec.find(',', start);
+    if (comma == std::string::npos) {
+      comma = spec.size();
+    }
+    FsmStep<Client> step;
+    if (!MakeFsmStep(spec.substr(start, comma - start), timeout, &step)) {
+      std::cerr << "Error: Unknown sequence step '"
+                << spec.substr(start, comma - start) << "'\n";
+      return false;
+    }
+    steps->push_back(std::move(step));
+    start = comma + 1;
+  }
+  return !steps->empty();
+}
+
+// Stand-in for LocoClient that moves to the requested FSM after a fixed
+// transition time; lets sequences run without a robot.
+class SimulatedLocoClient {
+ public:
+  explicit SimulatedLocoClient(
+      std::chrono::milliseconds transition = std::chrono::milliseconds(800))
+      : transition_(transition) {}
+
+  int32_t Damp() { return Request(1); }
+  int32_t ZeroTorque() { return Request(0); }
+  int32_t Squat() { return Request(2); }
+  int32_t Sit() { return Request(3); }
+  int32_t StandUp() { return Request(4); }
+  int32_t Start() { return Request(500); }
+  int32_t SetFsmId(int fsm_id) { return Request(fsm_id); }
+  int32_t StopMove() {
+    vx_ = vy_ = omega_ = 0.f;
+    return 0;
+  }
+  int32_t SetVelocity(float vx, float vy, float omega, float duration = 1.f) {
+    (void)duration;
+    vx_ = vx;
+    vy_ = vy;
+    omega_ = omega;
+    return 0;
+  }
+  int32_t BalanceStand() { return 0; }
+  int32_t HighStand() { return 0; }
+  int32_t LowStand() { return 0; }
+
+  int32_t GetFsmId(int& fsm_id) {
+    if (pending_ >= 0 && std::chrono::steady_clock::now() >= ready_at_) {
+      current_ = pending_;
+      pending_ = -1;
+    }
+    fsm_id = current_;
+    return 0;
+  }
+
+ private:
+  int32_t Request(int fsm_id) {
+    pending_ = fsm_id;
+    ready_at_ = std::chrono::steady_clock::now() + transition_;
+    return 0;
+  }
+
+  std::chrono::milliseconds transition_;
+  float vx_ = 0.f;
+  float vy_ = 0.f;
+  float omega_ = 0.f;
+  int current_ = 1;
+  int pending_ = -1;
+  std::chrono::steady_clock::time_point ready_at_{};
+};
+
+}  // namespace g1_loco
@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdlib>
+#include <cmath>
 #include <iostream>
 #include <thread>
 
@@ -8,68 +11,73 @@
 #include <unitree/robot/channel/channel_publisher.hpp>
 #include <unitree/robot/channel/channel_subscriber.hpp>
 
+#include "arm_sdk_session.hpp"
+#include "g1_arm_common.hpp"
+#include "telemetry_recorder.hpp"
+#include "tracking_monitor.hpp"
+
+using namespace g1_arm;
+
 static const std::string kTopicArmSDK = "rt/arm_sdk";
 static const std::string kTopicState = "rt/lowstate";
 constexpr float kPi = 3.141592654;
 constexpr float kPi_2 = 1.57079632;
+constexpr auto kStatsPeriod = std::chrono::seconds(5);
+
+// Moves `jpos_des` toward `target` by at most `max_delta[j]` per tick for
+// `steps` ticks. Returns false if a stop signal arrived.
+bool MoveToward(ArmSdkSession& session, RateLoop& loop,
+                const ArmStateBuffer& state, const ArmPose& target,
+                const ArmPose& max_delta, int steps, ArmPose* jpos_des) {
+  bool faulted = false;
+  for (int i = 0; i < steps; ++i) {
+    if (StopRequested()) {
+      return false;
+    }
+    if (!StateHealthy(state, &session, jpos_des, &faulted)) {
+      session.Hold();
+      loop.Sleep();
+      continue;
+    }
+
+    // update jpos des
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      jpos_des->at(j) += std::clamp(target.at(j) - jpos_des->at(j),
+                                    -max_delta.at(j), max_delta.at(j));
+    }
 
-enum JointIndex {
-    // Left leg
-    kLeftHipPitch,
-    kLeftHipRoll,
-    kLeftHipYaw,
-    kLeftKnee,
-    kLeftAnkle,
-    kLeftAnkleRoll,
-
-    // Right leg
-    kRightHipPitch,
-    kRightHipRoll,
-    kRightHipYaw,
-    kRightKnee,
-    kRightAnkle,
-    kRightAnkleRoll,
-
-    kWaistYaw,
-    kWaistRoll,
-    kWaistPitch,
-
-    // Left arm
-    kLeftShoulderPitch,
-    kLeftShoulderRoll,
-    kLeftShoulderYaw,
-    kLeftElbow,
-    kLeftWristRoll,
-    kLeftWristPitch,
-    kLeftWristYaw,
-    // Right arm
-    kRightShoulderPitch,
-    kRightShoulderRoll,
-    kRightShoulderYaw,
-    kRightElbow,
-    kRightWristRoll,
-    kRightWristPitch,
-    kRightWristYaw,
-
-    kNotUsedJoint,
-    kNotUsedJoint1,
-    kNotUsedJoint2,
-    kNotUsedJoint3,
-    kNotUsedJoint4,
-    kNotUsedJoint5
-};
+    // set control joints and send dds msg
+    session.Step(*jpos_des);
+
+    // sleep
+    loop.Sleep();
+  }
+  return true;
+}
 
 int main(int argc, char const *argv[]) {
   if (argc < 2) {
-    std::cout << "Usage: " << argv[0] << " networkInterface" << std::endl;
+    std::cout << "Usage: " << argv[0] << " networkInterface [telemetry_file]"
+              << "\n  ARM_STATS_FILE=<path> writes tracking/latency stats as JSON."
+              << std::endl;
+    exit(-1);
+  }
+
+  // Declared first so it outlives the subscriber callback and the session.
+  TelemetryRecorder recorder;
+  if (argc >= 3 && !recorder.Open(argv[2])) {
     exit(-1);
   }
+  float control_dt = 0.005f;
+  const char* stats_env = std::getenv("ARM_STATS_FILE");
+  TrackingMonitor monitor(control_dt, kStatsPeriod,
+                          stats_env != nullptr ? stats_env : "");
+  monitor.Start();
 
   unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
 
   unitree::robot::ChannelPublisherPtr<unitree_hg::msg::dds_::LowCmd_>
       arm_sdk_publisher;
-  unitree_hg::msg::dds_::LowCmd_ msg;
 
   arm_sdk_publisher.reset(
       new unitree::robot::ChannelPublisher<unitree_hg::msg::dds_::LowCmd_>(
@@ -80,100 +88,87 @@ int main(int argc, char const *argv[]) {
       low_state_subscriber;
 
   // create subscriber
-  unitree_hg::msg::dds_::LowState_ state_msg;
+  ArmStateBuffer state_buffer;
   low_state_subscriber.reset(
       new unitree::robot::ChannelSubscriber<unitree_hg::msg::dds_::LowState_>(
           kTopicState));
   low_state_subscriber->InitChannel([&](const void *msg) {
         auto s = ( const unitree_hg::msg::dds_::LowState_* )msg;
-        memcpy( &state_msg, s, sizeof( unitree_hg::msg::dds_::LowState_ ) );
+        const ArmPose pose = ArmPoseFromState(*s);
+        state_buffer.Update(pose, s->tick());
+        monitor.OnState(pose);
+        recorder.RecordState(*s);
   }, 1);
 
-  // Include waist joints to maintain balance, even if we don't move them
-  std::array<JointIndex, 17> arm_joints = {
-      JointIndex::kLeftShoulderPitch,  JointIndex::kLeftShoulderRoll,
-      JointIndex::kLeftShoulderYaw,    JointIndex::kLeftElbow,
-      JointIndex::kLeftWristRoll,       JointIndex::kLeftWristPitch,
-      JointIndex::kLeftWristYaw,
-      JointIndex::kRightShoulderPitch, JointIndex::kRightShoulderRoll,
-      JointIndex::kRightShoulderYaw,   JointIndex::kRightElbow,
-      JointIndex::kRightWristRoll,      JointIndex::kRightWristPitch,
-      JointIndex::kRightWristYaw,
-      JointIndex::kWaistYaw,
-      JointIndex::kWaistRoll,
-      JointIndex::kWaistPitch};
-
-  float weight = 0.f;
-  float weight_rate = 0.2f;
-
-  float kp = 60.f;
-  float kd = 1.5f;
-  float dq = 0.f;
-  float tau_ff = 0.f;
-
-  float control_dt = 0.02f;
+  InstallStopSignalHandlers();
+
+  float acquire_time = 1.0f;
+  float release_time = 2.0f;
+
   float max_joint_velocity = 0.5f;
 
-  float delta_weight = weight_rate * control_dt;
   float max_joint_delta = max_joint_velocity * control_dt;
-  auto sleep_time =
-      std::chrono::milliseconds(static_cast<int>(control_dt / 0.001f));
+  RateLoop loop(control_dt);
+
+  uint32_t command_tick = 0;
+  ArmSdkSession session(
+      [&](const unitree_hg::msg::dds_::LowCmd_ &msg) {
+        recorder.RecordCommand(msg, ++command_tick);
+        arm_sdk_publisher->Write(msg);
+        monitor.OnCommand(ArmPoseFromCommand(msg));
+      },
+      control_dt);
 
-  std::array<float, 17> init_pos{0, 0, 0, 0, 0, 0, 0,
-                                 0, 0, 0, 0, 0, 0, 0,
-                                 0, 0, 0};  // waist: yaw, roll, pitch = 0
+  ArmPose init_pos{0, 0, 0, 0, 0, 0, 0,
+                   0, 0, 0, 0, 0, 0, 0,
+                   0, 0, 0};  // waist: yaw, roll, pitch = 0
 
-  std::array<float, 17> target_pos = {0.f, kPi_2,  0.f, kPi_2, 0.f, 0.f, 0.f,
-                                      0.f, -kPi_2, 0.f, kPi_2, 0.f, 0.f, 0.f,
-                                      0.f, 0.f, 0.f};  // waist stays at 0
+  ArmPose target_pos = {0.f, kPi_2,  0.f, kPi_2, 0.f, 0.f, 0.f,
+                        0.f, -kPi_2, 0.f, kPi_2, 0.f, 0.f, 0.f,
+                        0.f, 0.f, 0.f};  // waist stays at 0
 
   // wait for init
   std::cout << "Press ENTER to init arms ...";
   std::cin.get();
 
   // get current joint position
-  std::array<float, 17> current_jpos{};
+  ArmPose current_jpos{};
+  if (!state_buffer.Latest(&current_jpos)) {
+    std::cout << "No " << kTopicState << " received, aborting." << std::endl;
+    return 1;
+  }
   std::cout << "Current joint position: ";
-  for (int i = 0; i < arm_joints.size(); ++i) {
-    current_jpos.at(i) = state_msg.motor_state().at(arm_joints.at(i)).q();
+  for (size_t i = 0; i < kNumArmJoints; ++i) {
     std::cout << current_jpos.at(i) << " ";
   }
   std::cout << std::endl;
 
   // Keep waist at current position for stability
-  init_pos.at(14) = current_jpos.at(14);   // waist yaw
-  init_pos.at(15) = current_jpos.at(15);   // waist roll
-  init_pos.at(16) = current_jpos.at(16);   // waist pitch
-  target_pos.at(14) = current_jpos.at(14);
-  target_pos.at(15) = current_jpos.at(15);
-  target_pos.at(16) = current_jpos.at(16);
-
-  // set init pos
-  std::cout << "Initailizing arms ...";
+  init_pos.at(kWaistYawSlot) = current_jpos.at(kWaistYawSlot);
+  init_pos.at(kWaistRollSlot) = current_jpos.at(kWaistRollSlot);
+  init_pos.at(kWaistPitchSlot) = current_jpos.at(kWaistPitchSlot);
+  target_pos.at(kWaistYawSlot) = current_jpos.at(kWaistYawSlot);
+  target_pos.at(kWaistRollSlot) = current_jpos.at(kWaistRollSlot);
+  target_pos.at(kWaistPitchSlot) = current_jpos.at(kWaistPitchSlot);
+
+  // take over the arms where they are, then move them to the init pos
+  std::cout << "Initailizing arms ..." << std::endl;
+  session.BeginAcquire(current_jpos, acquire_time);
+  if (!session.RunRamp(loop)) {
+    return 0;  // session destructor releases the arms
+  }
+
   float init_time = 2.0f;
   int init_time_steps = static_cast<int>(init_time / control_dt);
-
-  for (int i = 0; i < init_time_steps; ++i) {
-    // increase weight
-    weight = 1.0;
-    msg.motor_cmd().at(JointIndex::kNotUsedJoint).q(weight);
-    float phase = 1.0 * i / init_time_steps;
-    std::cout << "Phase: " << phase << std::endl;
-
-    // set control joints
-    for (int j = 0; j < init_pos.size(); ++j) {
-      msg.motor_cmd().at(arm_joints.at(j)).q(init_pos.at(j) * phase + current_jpos.at(j) * (1 - phase));
-      msg.motor_cmd().at(arm_joints.at(j)).dq(dq);
-      msg.motor_cmd().at(arm_joints.at(j)).kp(kp);
-      msg.motor_cmd().at(arm_joints.at(j)).kd(kd);
-      msg.motor_cmd().at(arm_joints.at(j)).tau(tau_ff);
-    }
-
-    // send dds msg
-    arm_sdk_publisher->Write(msg);
-
-    // sleep
-    std::this_thread::sleep_for(sleep_time);
+  ArmPose init_delta{};
+  for (size_t j = 0; j < kNumArmJoints; ++j) {
+    init_delta.at(j) =
+        std::abs(init_pos.at(j) - current_jpos.at(j)) / init_time_steps;
+  }
+  ArmPose current_jpos_des = current_jpos;
+  if (!MoveToward(session, loop, state_buffer, init_pos, init_delta,
+                  init_time_steps, &current_jpos_des)) {
+    return 0;
   }
 
   std::cout << "Done!" << std::endl;
@@ -186,83 +181,20 @@ int main(int argc, char const *argv[]) {
   std::cout << "Start arm ctrl!" << std::endl;
   float period = 5.f;
   int num_time_steps = static_cast<int>(period / control_dt);
-
-  std::array<float, 17> current_jpos_des{};
-
-  // lift arms up
-  for (int i = 0; i < num_time_steps; ++i) {
-    // update jpos des
-    for (int j = 0; j < init_pos.size(); ++j) {
-      current_jpos_des.at(j) +=
-          std::clamp(target_pos.at(j) - current_jpos_des.at(j),
-                     -max_joint_delta, max_joint_delta);
-    }
-
-    // set control joints
-    for (int j = 0; j < init_pos.size(); ++j) {
-      msg.motor_cmd().at(arm_joints.at(j)).q(current_jpos_des.at(j));
-      msg.motor_cmd().at(arm_joints.at(j)).dq(dq);
-      msg.motor_cmd().at(arm_joints.at(j)).kp(kp);
-      msg.motor_cmd().at(arm_joints.at(j)).kd(kd);
-      msg.motor_cmd().at(arm_joints.at(j)).tau(tau_ff);
-    }
-
-    // send dds msg
-    arm_sdk_publisher->Write(msg);
-
-    // sleep
-    std::this_thread::sleep_for(sleep_time);
-  }
-
-  // put arms down
-  for (int i = 0; i < num_time_steps; ++i) {
-    // update jpos des
-    for (int j = 0; j < init_pos.size(); ++j) {
-      current_jpos_des.at(j) +=
-          std::clamp(init_pos.at(j) - current_jpos_des.at(j), -max_joint_delta,
-                     max_joint_delta);
-    }
-
-    // set control joints
-    for (int j = 0; j < init_pos.size(); ++j) {
-      msg.motor_cmd().at(arm_joints.at(j)).q(current_jpos_des.at(j));
-      msg.motor_cmd().at(arm_joints.at(j)).dq(dq);
-      msg.motor_cmd().at(arm_joints.at(j)).kp(kp);
-      msg.motor_cmd().at(arm_joints.at(j)).kd(kd);
-      msg.motor_cmd().at(arm_joints.at(j)).tau(tau_ff);
-    }
-
-    // send dds msg
-    arm_sdk_publisher->Write(msg);
-
-    // sleep
-    std::this_thread::sleep_for(sleep_time);
+  ArmPose max_delta;
+  max_delta.fill(max_joint_delta);
+
+  // lift arms up, then put them down
+  if (!MoveToward(session, loop, state_buffer, target_pos, max_delta,
+                  num_time_steps, &current_jpos_des) ||
+      !MoveToward(session, loop, state_buffer, init_pos, max_delta,
+                  num_time_steps, &current_jpos_des)) {
+    return 0;
   }
 
   // stop control
   std::cout << "Stoping arm ctrl ...";
-  float stop_time = 2.0f;
-  int stop_time_steps = static_cast<int>(stop_time / control_dt);
-
-  for (int i = 0; i < stop_time_steps; ++i) {
-    // increase weight
-    weight -= delta_weight;
-    weight = std::clamp(weight, 0.f, 1.f);
-
-    // set weight
-    msg.motor_cmd().at(JointIndex::kNotUsedJoint).q(weight);
-
-    // send dds msg
-    arm_sdk_publisher->Write(msg);
-
-    // sleep
-    std::this_thread::sleep_for(sleep_time);
-  }
-
-  // set weight
-  msg.motor_cmd().at(JointIndex::kNotUsedJoint).q(0);
-  // send dds msg
-  arm_sdk_publisher->Write(msg);
+  session.Release(release_time);
 
   std::cout << "Done!" << std::endl;
 
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <unitree/idl/hg/LowState_.hpp>
+
+namespace g1_arm {
+
+enum JointIndex {
+    // Left leg
+    kLeftHipPitch,
+    kLeftHipRoll,
+    kLeftHipYaw,
+    kLeftKnee,
+    kLeftAnkle,
+    kLeftAnkleRoll,
+
+    // Right leg
+    kRightHipPitch,
+    kRightHipRoll,
+    kRightHipYaw,
+    kRightKnee,
+    kRightAnkle,
+    kRightAnkleRoll,
+
+    kWaistYaw,
+    kWaistRoll,
+    kWaistPitch,
+
+    // Left arm
+    kLeftShoulderPitch,
+    kLeftShoulderRoll,
+    kLeftShoulderYaw,
+    kLeftElbow,
+    kLeftWristRoll,
+    kLeftWristPitch,
+    kLeftWristYaw,
+    // Right arm
+    kRightShoulderPitch,
+    kRightShoulderRoll,
+    kRightShoulderYaw,
+    kRightElbow,
+    kRightWristRoll,
+    kRightWristPitch,
+    kRightWristYaw,
+
+    kNotUsedJoint,
+    kNotUsedJoint1,
+    kNotUsedJoint2,
+    kNotUsedJoint3,
+    kNotUsedJoint4,
+    kNotUsedJoint5
+};
+
+// arm_sdk reads the blend weight from the q of the first unused motor slot.
+constexpr JointIndex kArmSdkWeightJoint = kNotUsedJoint;
+
+constexpr size_t kNumArmJoints = 17;
+
+// Include waist joints to maintain balance, even if we don't move them
+constexpr std::array<JointIndex, kNumArmJoints> kArmJoints = {
+    kLeftShoulderPitch,  kLeftShoulderRoll,
+    kLeftShoulderYaw,    kLeftElbow,
+    kLeftWristRoll,      kLeftWristPitch,
+    kLeftWristYaw,
+    kRightShoulderPitch, kRightShoulderRoll,
+    kRightShoulderYaw,   kRightElbow,
+    kRightWristRoll,     kRightWristPitch,
+    kRightWristYaw,
+    kWaistYaw,
+    kWaistRoll,
+    kWaistPitch};
+
+// Slots of the waist joints inside an ArmPose.
+constexpr size_t kWaistYawSlot = 14;
+constexpr size_t kWaistRollSlot = 15;
+constexpr size_t kWaistPitchSlot = 16;
+
+using ArmPose = std::array<float, kNumArmJoints>;
+
+inline volatile std::sig_atomic_t g_stop_requested = 0;
+
+inline void HandleStopSignal(int) {
+  g_stop_requested = 1;
+}
+
+// Routes SIGINT/SIGTERM to g_stop_requested so control loops can leave
+// through their release path instead of dying with the weight still applied.
+inline void InstallStopSignalHandlers() {
+  std::signal(SIGINT, HandleStopSignal);
+  std::signal(SIGTERM, HandleStopSignal);
+}
+
+inline bool StopRequested() {
+  return g_stop_requested != 0;
+}
+
+inline ArmPose ArmPoseFromState(
+    const unitree_hg::msg::dds_::LowState_& state) {
+  ArmPose pose;
+  for (size_t i = 0; i < kNumArmJoints; ++i) {
+    pose[i] = state.motor_state().at(kArmJoints[i]).q();
+  }
+  return pose;
+}
+
+// Latest arm joint positions from rt/lowstate. Written from the DDS callback,
+// read from the control loop; the copy under the lock is 17 floats.
+class ArmStateBuffer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void Update(const unitree_hg::msg::dds_::LowState_& state) {
+    Update(ArmPoseFromState(state), state.tick());
+  }
+
+  void Update(const ArmPose& pose, uint32_t tick) {
+    const Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    pose_ = pose;
+    tick_ = tick;
+    stamp_ = now;
+    valid_ = true;
+  }
+
+  // Returns false until the first lowstate message has arrived.
+  bool Latest(ArmPose* pose, Clock::time_point* stamp = nullptr,
+              uint32_t* tick = nullptr) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!valid_) {
+      return false;
+    }
+    *pose = pose_;
+    if (stamp != nullptr) {
+      *stamp = stamp_;
+    }
+    if (tick != nullptr) {
+      *tick = tick_;
+    }
+    return true;
+  }
+
+  // Time since the last lowstate message, or max() if none arrived yet.
+  Clock::duration Age() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!valid_) {
+      return Clock::duration::max();
+    }
+    return Clock::now() - stamp_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  ArmPose pose_{};
+  uint32_t tick_ = 0;
+  Clock::time_point stamp_{};
+  bool valid_ = false;
+};
+
+// Fixed-rate loop pacing on an absolute schedule, so time spent building and
+// publishing a command doesn't stretch the period the way sleep_for does.
+class RateLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit RateLoop(float period_s)
+      : period_(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<float>(period_s))),
+        next_(Clock::now() + period_) {}
+
+  void Sleep() {
+    std::this_thread::sleep_until(next_);
+    next_ += period_;
+    // After a long stall (debugger, overloaded host) resynchronize instead
+    // of firing a burst of back-to-back iterations.
+    const Clock::time_point now = Clock::now();
+    if (next_ < now) {
+      next_ = now + period_;
+    }
+  }
+
+  Clock::duration period() const { return period_; }
+
+ private:
+  Clock::duration period_;
+  Clock::time_point next_;
+};
+
+}  // namespace g1_arm
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <unitree/idl/hg/LowCmd_.hpp>
+#include <unitree/idl/hg/LowState_.hpp>
+#include <unitree/robot/channel/channel_publisher.hpp>
+#include <unitree/robot/channel/channel_subscriber.hpp>
+
+#include "arm_sdk_session.hpp"
+#include "g1_arm_common.hpp"
+#include "setpoint_stream.hpp"
+#include "telemetry_recorder.hpp"
+#include "tracking_monitor.hpp"
+
+using namespace g1_arm;
+
+static const std::string kTopicArmSDK = "rt/arm_sdk";
+static const std::string kTopicState = "rt/lowstate";
+
+namespace {
+constexpr float kControlDt = 0.005f;
+constexpr float kMaxJointVelocity = 1.5f;
+constexpr float kAcquireTime = 1.0f;
+constexpr float kReleaseTime = 2.0f;
+constexpr auto kPlayoutDelay = std::chrono::milliseconds(30);
+constexpr auto kSetpointWatchdog = std::chrono::milliseconds(200);
+constexpr int kStatusPeriodTicks = 200;
+constexpr auto kStatsPeriod = std::chrono::seconds(5);
+
+void PrintUsage(const char* program) {
+  std::cout << "Usage: " << program
+            << " <networkInterface|TEST> [udp:[host:]port|shm:name]"
+               " [telemetry_file]\n"
+            << "  default endpoint: udp:" << kDefaultSetpointPort << "\n"
+            << "  TEST publishes to a mock that echoes commands back as "
+               "lowstate.\n"
+            << "  ARM_STATS_FILE=<path> writes tracking/latency stats as "
+               "JSON.\n"
+            << "  Feed it with: g1_arm_setpoint_sender udp:127.0.0.1:"
+            << kDefaultSetpointPort << std::endl;
+}
+}  // namespace
+
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  SetpointEndpoint endpoint;
+  if (argc >= 3 && !ParseSetpointEndpoint(argv[2], &endpoint)) {
+    std::cout << "Invalid setpoint endpoint: " << argv[2] << std::endl;
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // Declared first so it outlives the subscriber callback and the session.
+  TelemetryRecorder recorder;
+  if (argc >= 4 && !recorder.Open(argv[3])) {
+    return 1;
+  }
+  const char* stats_env = std::getenv("ARM_STATS_FILE");
+  TrackingMonitor monitor(kControlDt, kStatsPeriod,
+                          stats_env != nullptr ? stats_env : "");
+  monitor.Start();
+
+  const bool is_test = (std::string(argv[1]) == "TEST");
+  ArmStateBuffer state_buffer;
+  unitree::robot::ChannelPublisherPtr<unitree_hg::msg::dds_::LowCmd_>
+      arm_sdk_publisher;
+  unitree::robot::ChannelSubscriberPtr<unitree_hg::msg::dds_::LowState_>
+      low_state_subscriber;
+  ArmSdkSession::CommandWriter writer;
+  uint32_t mock_tick = 0;
+  uint32_t command_tick = 0;
+
+  if (is_test) {
+    // Mock publisher: the "robot" follows the command perfectly.
+    state_buffer.Update(ArmPose{}, mock_tick);
+    writer = [&](const unitree_hg::msg::dds_::LowCmd_ &msg) {
+      recorder.RecordCommand(msg, ++command_tick);
+      monitor.OnCommand(ArmPoseFromCommand(msg));
+      ArmPose echoed;
+      for (size_t j = 0; j < kNumArmJoints; ++j) {
+        echoed[j] = msg.motor_cmd().at(kArmJoints[j]).q();
+      }
+      state_buffer.Update(echoed, ++mock_tick);
+      monitor.OnState(echoed);
+    };
+  } else {
+    unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
+
+    arm_sdk_publisher.reset(
+        new unitree::robot::ChannelPublisher<unitree_hg::msg::dds_::LowCmd_>(
+            kTopicArmSDK));
+    arm_sdk_publisher->InitChannel();
+
+    low_state_subscriber.reset(
+        new unitree::robot::ChannelSubscriber<
+            unitree_hg::msg::dds_::LowState_>(kTopicState));
+    low_state_subscriber->InitChannel([&](const void *msg) {
+          auto s = ( const unitree_hg::msg::dds_::LowState_* )msg;
+          const ArmPose pose = ArmPoseFromState(*s);
+          state_buffer.Update(pose, s->tick());
+          monitor.OnState(pose);
+          recorder.RecordState(*s);
+    }, 1);
+
+    writer = [&](const unitree_hg::msg::dds_::LowCmd_ &msg) {
+      recorder.RecordCommand(msg, ++command_tick);
+      arm_sdk_publisher->Write(msg);
+      monitor.OnCommand(ArmPoseFromCommand(msg));
+    };
+  }
+
+  SetpointReceiver receiver(kPlayoutDelay, kSetpointWatchdog);
+  if (!receiver.Start(endpoint)) {
+    return 1;
+  }
+  std::cout << "Listening for setpoints on "
+            << (endpoint.kind == SetpointEndpoint::kUdp
+                    ? "udp port " + std::to_string(endpoint.port)
+                    : "shm " + endpoint.shm_name)
+            << std::endl;
+
+  InstallStopSignalHandlers();
+
+  // wait for lowstate
+  ArmPose current_jpos{};
+  for (int i = 0; i < 100 && !state_buffer.Latest(&current_jpos); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  if (!state_buffer.Latest(&current_jpos)) {
+    std::cout << "No " << kTopicState << " received, aborting." << std::endl;
+    return 1;
+  }
+
+  RateLoop loop(kControlDt);
+  ArmSdkSession session(writer, kControlDt);
+  std::cout << "Acquiring arms ..." << std::endl;
+  session.BeginAcquire(current_jpos, kAcquireTime);
+  if (!session.RunRamp(loop)) {
+    return 0;  // session destructor releases the arms
+  }
+  std::cout << "Teleop active, Ctrl+C to release." << std::endl;
+
+  // The waist is held where it was; setpoints only drive the arms.
+  const float max_joint_delta = kMaxJointVelocity * kControlDt;
+  ArmPose jpos_des = current_jpos;
+  bool state_faulted = false;
+  bool input_stale = true;
+  int tick = 0;
+  while (!StopRequested()) {
+    if (!StateHealthy(state_buffer, &session, &jpos_des, &state_faulted)) {
+      session.Hold();
+      loop.Sleep();
+      continue;
+    }
+
+    SetpointSample sample = receiver.Sample(SetpointReceiver::Clock::now());
+    const bool stale = !sample.valid || sample.stale;
+    if (stale != input_stale) {
+      std::cout << (stale ? "Setpoint watchdog: holding arms"
+                          : "Setpoints resumed")
+                << std::endl;
+      input_stale = stale;
+    }
+    if (!stale) {
+      // Velocity limit also makes the transition out of a hold smooth.
+      for (size_t j = 0; j < kWaistYawSlot; ++j) {
+        jpos_des[j] += std::clamp(sample.q[j] - jpos_des[j], -max_joint_delta,
+                                  max_joint_delta);
+      }
+    }
+    session.Step(jpos_des);
+
+    if (++tick % kStatusPeriodTicks == 0 && is_test) {
+      std::cout << "received=" << receiver.received()
+                << " dropped=" << receiver.dropped()
+                << " q[0]=" << jpos_des[0] << " q[7]=" << jpos_des[7]
+                << std::endl;
+    }
+    loop.Sleep();
+  }
+
+  std::cout << "Releasing arms ..." << std::endl;
+  session.Release(kReleaseTime);
+  receiver.Stop();
+  if (recorder.is_open()) {
+    recorder.Close();
+    std::cout << "Telemetry dropped samples: " << recorder.dropped()
+              << std::endl;
+  }
+  std::cout << "Done!" << std::endl;
+  return 0;
+}
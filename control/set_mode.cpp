@@ -1,10 +1,16 @@
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <vector>
 
 #include <unitree/robot/channel/channel_factory.hpp>
 #include <unitree/robot/g1/loco/g1_loco_client.hpp>
 
+#include "fsm_sequence.hpp"
+#include "robot_client.hpp"
+#include "velocity_stream.hpp"
+
 const char* get_fsm_description(int fsm_id) {
   switch (fsm_id) {
     case 0:   return "ZeroTorque - motors free (CAUTION: robot will fall!)";
@@ -19,11 +25,72 @@ const char* get_fsm_description(int fsm_id) {
   }
 }
 
+// Runs a --sequence spec; false if it doesn't parse or a step fails.
+template <typename Client>
+bool run_sequence(Client* client, const std::string& spec,
+                  std::chrono::milliseconds step_timeout) {
+  std::vector<g1_loco::FsmStep<Client>> steps;
+  if (!g1_loco::ParseFsmSequence(spec, step_timeout, &steps)) {
+    return false;
+  }
+  g1_loco::FsmSequenceRunner<Client> runner(client);
+  return runner.Run(steps);
+}
+
+// Streams --stream_velocity setpoints from `source` until Ctrl-C; false
+// if the source can't be opened.
+template <typename Client>
+bool stream_velocity(Client* client, const std::string& source,
+                     const g1_loco::VelocityStreamOptions& options,
+                     int32_t* ret) {
+  g1_loco::VelocityInput input;
+  if (!input.Start(source, options.max_speed)) {
+    return false;
+  }
+  g1_loco::VelocityStreamer<Client> streamer(client, options);
+  *ret = streamer.Run(&input);
+  return true;
+}
+
+// Runs the --sequence and --stream_velocity commands against `client`,
+// for the TEST and robotd modes.
+template <typename Client>
+int run_sequence_commands(Client* client, int argc, char** argv,
+                          std::chrono::milliseconds step_timeout,
+                          const g1_loco::VelocityStreamOptions& stream_options,
+                          const char* mode) {
+  int32_t ret = 0;
+  for (int i = 2; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--sequence=", 0) == 0) {
+      if (!run_sequence(client, arg.substr(11), step_timeout)) {
+        return 1;
+      }
+    }
+    else if (arg.rfind("--stream_velocity=", 0) == 0) {
+      if (!stream_velocity(client, arg.substr(18), stream_options, &ret)) {
+        return 1;
+      }
+    }
+    else if (arg.rfind("--step_timeout=", 0) != 0 &&
+             arg.rfind("--stream_rate=", 0) != 0 &&
+             arg.rfind("--deadman=", 0) != 0) {
+      std::cerr << "Error: Only --sequence and --stream_velocity run in "
+                << mode << " mode, not '" << arg << "'\n";
+      return 1;
+    }
+  }
+  return 0;
+}
+
 void print_help(const char* program_name) {
   std::cout << "Usage: " << program_name << " <network_interface> [options]\n\n";
   std::cout << "Control G1 robot FSM states and movement.\n\n";
   std::cout << "Arguments:\n";
-  std::cout << "  <network_interface>    Network interface (e.g., eth0, lo)\n\n";
+  std::cout << "  <network_interface>    Network interface (e.g., eth0, lo), or TEST\n";
+  std::cout << "                         to run --sequence and --stream_velocity\n";
+  std::cout << "                         against a simulated robot, or robotd\n";
+  std::cout << "                         to run them through g1_robotd\n\n";
   std::cout << "Options:\n";
   std::cout << "  --help                 Show this help message\n";
   std::cout << "  --get_fsm_id           Get current FSM ID\n";
@@ -43,6 +110,19 @@ void print_help(const char* program_name) {
   std::cout << "  --velocity=<vx,vy,w>   Set velocity (e.g., --velocity=0.3,0,0)\n";
   std::cout << "  --stand_height=<h>     Set stand height\n";
   std::cout << "  --swing_height=<h>     Set swing height\n";
+  std::cout << "  --sequence=<s1,s2,..>  Run steps back to back, each waiting for\n";
+  std::cout << "                         its FSM state (damp, stand_up, start, sit,\n";
+  std::cout << "                         squat, zero_torque, stop_move, <fsm_id>...)\n";
+  std::cout << "  --step_timeout=<s>     Per-step timeout for --sequence (default 10)\n";
+  std::cout << "  --stream_velocity=<src>\n";
+  std::cout << "                         Stream setpoints until Ctrl-C from stdin,\n";
+  std::cout << "                         udp:<port> (lines \"vx,vy,w\") or\n";
+  std::cout << "                         js:/dev/input/js0; stops the robot when\n";
+  std::cout << "                         input goes quiet\n";
+  std::cout << "  --stream_rate=<hz>     SetVelocity rate for --stream_velocity (default 20)\n";
+  std::cout << "  --deadman=<s>          Input timeout for --stream_velocity (default\n";
+  std::cout << "                         3 for stdin, 0.5 for udp and js; a held\n";
+  std::cout << "                         joystick counts as input)\n";
   std::cout << "\nFSM IDs:\n";
   std::cout << "  0   - " << get_fsm_description(0) << "\n";
   std::cout << "  1   - " << get_fsm_description(1) << "\n";
@@ -57,6 +137,9 @@ void print_help(const char* program_name) {
   std::cout << "  " << program_name << " eth0 --fsm_id=501\n";
   std::cout << "  " << program_name << " eth0 --velocity=0.3,0,0\n";
   std::cout << "  " << program_name << " eth0 --stop_move --damp\n";
+  std::cout << "  " << program_name << " eth0 --sequence=damp,stand_up,501\n";
+  std::cout << "  " << program_name << " eth0 --stream_velocity=js:/dev/input/js0\n";
+  std::cout << "  " << program_name << " TEST --sequence=damp,stand_up,start\n";
 }
 
 int main(int argc, char **argv) {
@@ -81,6 +164,41 @@ int main(int argc, char **argv) {
 
   const std::string network_interface = argv[1];
 
+  std::chrono::milliseconds step_timeout(10000);
+  g1_loco::VelocityStreamOptions stream_options;
+
+  // Settings for other commands apply wherever they appear, so read them
+  // before running anything.
+  for (int i = 2; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--step_timeout=", 0) == 0) {
+      step_timeout = std::chrono::milliseconds(
+          static_cast<int>(std::stof(arg.substr(15)) * 1000));
+    }
+    else if (arg.rfind("--stream_rate=", 0) == 0) {
+      stream_options.rate_hz = std::stof(arg.substr(14));
+    }
+    else if (arg.rfind("--deadman=", 0) == 0) {
+      stream_options.deadman_s = std::stof(arg.substr(10));
+    }
+  }
+
+  if (network_interface == "TEST") {
+    g1_loco::SimulatedLocoClient client;
+    return run_sequence_commands(&client, argc, argv, step_timeout,
+                                 stream_options, "TEST");
+  }
+  if (network_interface == "robotd") {
+    g1_daemon::RobotDaemonClient client;
+    client.Init();
+    if (!client.connected()) {
+      return 1;
+    }
+    client.SetTimeout(10.f);
+    return run_sequence_commands(&client, argc, argv, step_timeout,
+                                 stream_options, "robotd");
+  }
+
   // Initialize channel factory
   unitree::robot::ChannelFactory::Instance()->Init(0, network_interface);
 
@@ -186,6 +304,25 @@ int main(int argc, char **argv) {
       std::cout << "SetStandHeight(" << height << ") ret: " << ret << "\n";
       command_executed = true;
     }
+    else if (arg.rfind("--step_timeout=", 0) == 0) {
+      // Read above.
+    }
+    else if (arg.rfind("--sequence=", 0) == 0) {
+      if (!run_sequence(&client, arg.substr(11), step_timeout)) {
+        return 1;
+      }
+      command_executed = true;
+    }
+    else if (arg.rfind("--stream_rate=", 0) == 0 ||
+             arg.rfind("--deadman=", 0) == 0) {
+      // Read above.
+    }
+    else if (arg.rfind("--stream_velocity=", 0) == 0) {
+      if (!stream_velocity(&client, arg.substr(18), stream_options, &ret)) {
+        return 1;
+      }
+      command_executed = true;
+    }
     else if (arg.rfind("--swing_height=", 0) == 0) {
       float height = std::stof(arg.substr(15));
       ret = client.SetSwingHeight(height);
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "g1_arm_common.hpp"
+
+namespace g1_arm {
+
+constexpr uint32_t kSetpointMagic = 0x50533147;  // "G1SP"
+constexpr int kDefaultSetpointPort = 9870;
+constexpr const char* kDefaultSetpointShm = "/g1_arm_setpoint";
+
+// Wire format of one joint setpoint, in host byte order (the stream is meant
+// for the robot's own PC or a teleop host on the same LAN).
+struct SetpointPacket {
+  uint32_t magic = kSetpointMagic;
+  uint32_t seq = 0;
+  // Sender's steady clock; only differences between packets matter.
+  uint64_t stamp_ns = 0;
+  float q[kNumArmJoints] = {};
+};
+
+// Layout of the shared-memory endpoint: a single-slot seqlock. The writer
+// makes `sequence` odd while it copies the packet and even when done.
+struct SetpointShm {
+  std::atomic<uint32_t> sequence;
+  SetpointPacket packet;
+};
+
+struct SetpointEndpoint {
+  enum Kind { kUdp, kShm } kind = kUdp;
+  std::string host;
+  int port = kDefaultSetpointPort;
+  std::string shm_name = kDefaultSetpointShm;
+};
+
+// Parses "udp:<port>", "udp:<host>:<port>" or "shm:<name>".
+inline bool ParseSetpointEndpoint(const std::string& spec,
+                                  SetpointEndpoint* endpoint) {
+  if (spec.rfind("udp:", 0) == 0) {
+    endpoint->kind = SetpointEndpoint::kUdp;
+    std::string rest = spec.substr(4);
+    size_t colon = rest.rfind(':');
+    if (colon != std::string::npos) {
+      endpoint->host = rest.substr(0, colon);
+      rest = rest.substr(colon + 1);
+    }
+    endpoint->port = std::atoi(rest.c_str());
+    return endpoint->port > 0 && endpoint->port < 65536;
+  }
+  if (spec.rfind("shm:", 0) == 0) {
+    endpoint->kind = SetpointEndpoint::kShm;
+    endpoint->shm_name = spec.substr(4);
+    if (endpoint->shm_name.empty() || endpoint->shm_name[0] != '/') {
+      endpoint->shm_name = "/" + endpoint->shm_name;
+    }
+    return endpoint->shm_name.size() > 1;
+  }
+  return false;
+}
+
+struct SetpointSample {
+  ArmPose q{};
+  bool valid = false;  // at least one setpoint has arrived
+  bool stale = false;  // watchdog expired; hold instead of using `q`
+};
+
+// Turns irregularly arriving setpoints into a smooth signal sampled at the
+// control rate.
+//
+// Sender timestamps are mapped onto the local clock with the smallest
+// observed (arrival - send) offset, i.e. the fastest path through the
+// network. Output is played `playout_delay` behind that mapping and linearly
+// interpolated between the two bracketing setpoints, so early packets wait
+// for their slot and a late one is bridged by interpolation rather than
+// producing a step. Past the newest setpoint the output holds it; once no
+// packet arrived for `watchdog` the sample is marked stale.
+class SetpointInterpolator {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  SetpointInterpolator(Clock::duration playout_delay, Clock::duration watchdog)
+      : playout_delay_(playout_delay), watchdog_(watchdog) {}
+
+  void Push(const SetpointPacket& packet, Clock::time_point arrival) {
+    if (count_ > 0) {
+      const Entry& newest = history_[(head_ + count_ - 1) % kHistory];
+      const int32_t seq_delta = static_cast<int32_t>(packet.seq - newest.seq);
+      const bool newer_stamp = packet.stamp_ns > newest.stamp_ns;
+      if (seq_delta <= 0 && !newer_stamp) {
+        ++dropped_;  // duplicate or reordered
+        return;
+      }
+      if (seq_delta <= 0 || !newer_stamp) {
+        // Sender restarted (new sequence or new clock); start over.
+        count_ = 0;
+        offset_valid_ = false;
+      }
+    }
+
+    const int64_t arrival_ns = ToNs(arrival);
+    const int64_t offset = arrival_ns - static_cast<int64_t>(packet.stamp_ns);
+    if (!offset_valid_ || offset < offset_ns_) {
+      offset_ns_ = offset;
+      offset_valid_ = true;
+    } else {
+      // Let the minimum creep up slowly so clock drift between the two hosts
+      // doesn't accumulate into extra latency.
+      offset_ns_ += (offset - offset_ns_) / 1024;
+    }
+
+    Entry entry;
+    entry.seq = packet.seq;
+    entry.stamp_ns = packet.stamp_ns;
+    std::copy(std::begin(packet.q), std::end(packet.q), entry.q.begin());
+    if (count_ == kHistory) {
+      head_ = (head_ + 1) % kHistory;
+      --count_;
+    }
+    history_[(head_ + count_) % kHistory] = entry;
+    ++count_;
+    last_arrival_ = arrival;
+    ++received_;
+  }
+
+  SetpointSample Sample(Clock::time_point now) const {
+    SetpointSample sample;
+    if (count_ == 0) {
+      return sample;
+    }
+    sample.valid = true;
+    sample.stale = now - last_arrival_ > watchdog_;
+
+    // Position on the sender's timeline that should be output now.
+    const int64_t play_ns = ToNs(now) - offset_ns_ - ToNs(playout_delay_);
+    const Entry& oldest = history_[head_];
+    const Entry& newest = history_[(head_ + count_ - 1) % kHistory];
+    if (play_ns <= static_cast<int64_t>(oldest.stamp_ns)) {
+      sample.q = oldest.q;
+      return sample;
+    }
+    if (play_ns >= static_cast<int64_t>(newest.stamp_ns)) {
+      sample.q = newest.q;
+      return sample;
+    }
+    for (size_t i = 1; i < count_; ++i) {
+      const Entry& b = history_[(head_ + i) % kHistory];
+      if (static_cast<int64_t>(b.stamp_ns) < play_ns) {
+        continue;
+      }
+      const Entry& a = history_[(head_ + i - 1) % kHistory];
+      const float t =
+          static_cast<float>(play_ns - static_cast<int64_t>(a.stamp_ns)) /
+          static_cast<float>(b.stamp_ns - a.stamp_ns);
+      for (size_t j = 0; j < kNumArmJoints; ++j) {
+        sample.q[j] = a.q[j] + (b.q[j] - a.q[j]) * t;
+      }
+      break;
+    }
+    return sample;
+  }
+
+  uint64_t received() const { return received_; }
+  uint64_t dropped() const { return dropped_; }
+
+ private:
+  static constexpr size_t kHistory = 16;
+
+  struct Entry {
+    uint32_t seq = 0;
+    uint64_t stamp_ns = 0;
+    ArmPose q{};
+  };
+
+  template <typename D>
+  static int64_t ToNs(D d) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  }
+  static int64_t ToNs(Clock::time_point t) {
+    return ToNs(t.time_since_epoch());
+  }
+
+  Clock::duration playout_delay_;
+  Clock::duration watchdog_;
+  std::array<Entry, kHistory> history_{};
+  size_t head_ = 0;
+  size_t count_ = 0;
+  int64_t offset_ns_ = 0;
+  bool offset_valid_ = false;
+  Clock::time_point last_arrival_{};
+  uint64_t received_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+// Background thread that ingests setpoints from a UDP socket or a POSIX
+// shared-memory slot and feeds a SetpointInterpolator.
+class SetpointReceiver {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  SetpointReceiver(Clock::duration playout_delay, Clock::duration watchdog)
+      : interpolator_(playout_delay, watchdog) {}
+
+  ~SetpointReceiver() { Stop(); }
+
+  SetpointReceiver(const SetpointReceiver&) = delete;
+  SetpointReceiver& operator=(const SetpointReceiver&) = delete;
+
+  bool Start(const SetpointEndpoint& endpoint) {
+    if (endpoint.kind == SetpointEndpoint::kUdp) {
+      if (!OpenUdp(endpoint)) {
+        return false;
+      }
+      running_.store(true);
+      thread_ = std::thread(&SetpointReceiver::UdpLoop, this);
+    } else {
+      if (!OpenShm(endpoint)) {
+        return false;
+      }
+      running_.store(true);
+      thread_ = std::thread(&SetpointReceiver::ShmLoop, this);
+    }
+    return true;
+  }
+
+  void Stop() {
+    running_.store(false);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (sock_ >= 0) {
+      close(sock_);
+      sock_ = -1;
+    }
+    if (shm_ != nullptr) {
+      munmap(shm_, sizeof(SetpointShm));
+      shm_ = nullptr;
+    }
+  }
+
+  SetpointSample Sample(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interpolator_.Sample(now);
+  }
+
+  uint64_t received() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interpolator_.received();
+  }
+
+  uint64_t dropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interpolator_.dropped();
+  }
+
+ private:
+  bool OpenUdp(const SetpointEndpoint& endpoint) {
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_ < 0) {
+      std::cout << "Failed to create setpoint UDP socket." << std::endl;
+      return false;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(endpoint.port));
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (!endpoint.host.empty() &&
+        inet_pton(AF_INET, endpoint.host.c_str(), &addr.sin_addr) != 1) {
+      std::cout << "Invalid setpoint bind address: " << endpoint.host
+                << std::endl;
+      return false;
+    }
+    if (bind(sock_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      std::cout << "Failed to bind setpoint UDP port " << endpoint.port
+                << ": errno=" << errno << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool OpenShm(const SetpointEndpoint& endpoint) {
+    int fd = shm_open(endpoint.shm_name.c_str(), O_CREAT | O_RDWR, 0660);
+    if (fd < 0) {
+      std::cout << "Failed to open shared memory " << endpoint.shm_name
+                << ": errno=" << errno << std::endl;
+      return false;
+    }
+    if (ftruncate(fd, sizeof(SetpointShm)) < 0) {
+      std::cout << "Failed to size shared memory: errno=" << errno
+                << std::endl;
+      close(fd);
+      return false;
+    }
+    void* mem = mmap(nullptr, sizeof(SetpointShm), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+      std::cout << "Failed to map shared memory: errno=" << errno
+                << std::endl;
+      return false;
+    }
+    shm_ = static_cast<SetpointShm*>(mem);
+    return true;
+  }
+
+  void UdpLoop() {
+    pollfd pfd{sock_, POLLIN, 0};
+    while (running_.load()) {
+      if (poll(&pfd, 1, 100) <= 0) {
+        continue;
+      }
+      SetpointPacket packet;
+      ssize_t len = recv(sock_, &packet, sizeof(packet), 0);
+      const Clock::time_point arrival = Clock::now();
+      if (len != static_cast<ssize_t>(sizeof(packet)) ||
+          packet.magic != kSetpointMagic) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      interpolator_.Push(packet, arrival);
+    }
+  }
+
+  void ShmLoop() {
+    uint32_t last_sequence = shm_->sequence.load(std::memory_order_acquire);
+    while (running_.load()) {
+      const uint32_t begin = shm_->sequence.load(std::memory_order_acquire);
+      if (begin == last_sequence || (begin & 1u) != 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+      SetpointPacket packet;
+      std::memcpy(&packet, &shm_->packet, sizeof(packet));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (shm_->sequence.load(std::memory_order_relaxed) != begin) {
+        continue;  // torn read, retry
+      }
+      const Clock::time_point arrival = Clock::now();
+      last_sequence = begin;
+      if (packet.magic != kSetpointMagic) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      interpolator_.Push(packet, arrival);
+    }
+  }
+
+  mutable std::mutex mutex_;
+  SetpointInterpolator interpolator_;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+  int sock_ = -1;
+  SetpointShm* shm_ = nullptr;
+};
+
+}  // namespace g1_arm
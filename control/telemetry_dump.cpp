@@ -0,0 +1,147 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "telemetry_recorder.hpp"
+
+using namespace g1_arm;
+
+namespace {
+
+bool GetVarint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+  uint64_t v = 0;
+  int shift = 0;
+  while (*p < end && shift < 64) {
+    const uint8_t byte = *(*p)++;
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = v;
+      return true;
+    }
+    shift += 7;
+  }
+  return false;
+}
+
+}  // namespace
+
+// Converts a telemetry file written by TelemetryRecorder into CSV on stdout,
+// one row per sample of the selected stream.
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <telemetry_file> [state|cmd]"
+              << std::endl;
+    return 1;
+  }
+  const std::string which = argc >= 3 ? argv[2] : "state";
+  if (which != "state" && which != "cmd") {
+    std::cerr << "Stream must be 'state' or 'cmd'." << std::endl;
+    return 1;
+  }
+  const uint8_t wanted = which == "state" ? kTelemetryState : kTelemetryCommand;
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    std::cerr << "Failed to open " << argv[1] << std::endl;
+    return 1;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+
+  const size_t header_size = sizeof(kTelemetryMagic) + 3 * sizeof(uint16_t);
+  if (data.size() < header_size ||
+      std::memcmp(data.data(), kTelemetryMagic, sizeof(kTelemetryMagic)) != 0) {
+    std::cerr << "Not a telemetry file." << std::endl;
+    return 1;
+  }
+  uint16_t header[3];
+  std::memcpy(header, data.data() + sizeof(kTelemetryMagic), sizeof(header));
+  const size_t motors = header[1];
+  const size_t fields = header[2];
+  if (header[0] != kTelemetryVersion || fields != kTelemetryFields) {
+    std::cerr << "Unsupported telemetry version " << header[0] << std::endl;
+    return 1;
+  }
+
+  const char* const* names = TelemetryFieldNames(wanted);
+  std::cout << "time_s,tick";
+  for (size_t f = 0; f < fields; ++f) {
+    for (size_t m = 0; m < motors; ++m) {
+      std::cout << ',' << names[f] << m;
+    }
+  }
+  std::cout << '\n';
+
+  size_t pos = header_size;
+  bool have_t0 = false;
+  int64_t t0 = 0;
+  std::vector<int64_t> times;
+  std::vector<uint32_t> ticks;
+  std::vector<float> values;
+  while (pos + 9 <= data.size()) {
+    const uint8_t stream = data[pos];
+    uint32_t count = 0;
+    uint32_t bytes = 0;
+    std::memcpy(&count, data.data() + pos + 1, sizeof(count));
+    std::memcpy(&bytes, data.data() + pos + 5, sizeof(bytes));
+    pos += 9;
+    if (pos + bytes > data.size()) {
+      std::cerr << "Truncated block, stopping." << std::endl;
+      break;
+    }
+    const uint8_t* p = data.data() + pos;
+    const uint8_t* end = p + bytes;
+    pos += bytes;
+
+    times.resize(count);
+    ticks.resize(count);
+    values.resize(static_cast<size_t>(count) * fields * motors);
+    bool ok = true;
+    uint64_t v = 0;
+    int64_t prev_time = 0;
+    for (uint32_t i = 0; i < count && ok; ++i) {
+      ok = GetVarint(&p, end, &v);
+      prev_time += UnZigZag(v);
+      times[i] = prev_time;
+    }
+    uint32_t prev_tick = 0;
+    for (uint32_t i = 0; i < count && ok; ++i) {
+      ok = GetVarint(&p, end, &v);
+      prev_tick += static_cast<uint32_t>(UnZigZag(v));
+      ticks[i] = prev_tick;
+    }
+    for (size_t c = 0; c < fields * motors && ok; ++c) {
+      uint32_t prev = 0;
+      for (uint32_t i = 0; i < count && ok; ++i) {
+        ok = GetVarint(&p, end, &v);
+        prev += static_cast<uint32_t>(UnZigZag(v));
+        values[i * fields * motors + c] = BitsFloat(prev);
+      }
+    }
+    if (!ok) {
+      std::cerr << "Corrupt block, stopping." << std::endl;
+      break;
+    }
+    if (!have_t0 && count > 0) {
+      t0 = times[0];
+      have_t0 = true;
+    }
+    if (stream != wanted) {
+      continue;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      std::printf("%.6f,%u", (times[i] - t0) * 1e-9, ticks[i]);
+      const float* row = &values[i * fields * motors];
+      for (size_t c = 0; c < fields * motors; ++c) {
+        std::printf(",%.6g", row[c]);
+      }
+      std::printf("\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unitree/idl/hg/LowCmd_.hpp>
+#include <unitree/idl/hg/LowState_.hpp>
+
+#include "g1_arm_common.hpp"
+
+namespace g1_arm {
+
+// Telemetry file layout (little endian, as written by the host):
+//
+//   file   := "G1TL" u16 version u16 motors u16 fields block*
+//   block  := u8 stream u32 count u32 payload_bytes payload
+//   payload:= column(time_ns) column(tick) column(field 0, motor 0) ...
+//             column(field fields-1, motor motors-1)
+//
+// Every column holds `count` values, each stored as the zigzag varint of
+// its difference to the previous value in the same column (the first value
+// is relative to 0). Float columns are differenced on their IEEE bit
+// patterns, which is lossless and stays small for slowly changing signals.
+constexpr char kTelemetryMagic[4] = {'G', '1', 'T', 'L'};
+constexpr uint16_t kTelemetryVersion = 1;
+// The 29 body motors plus the arm_sdk weight slot.
+constexpr size_t kTelemetryMotors = kNotUsedJoint + 1;
+constexpr size_t kTelemetryFields = 5;
+
+enum TelemetryStream : uint8_t {
+  kTelemetryState = 0,
+  kTelemetryCommand = 1,
+};
+
+// Column names per stream, in field order.
+inline const char* const* TelemetryFieldNames(uint8_t stream) {
+  static const char* const kState[kTelemetryFields] = {"q", "dq", "tau_est",
+                                                       "temp0", "temp1"};
+  static const char* const kCommand[kTelemetryFields] = {"q", "dq", "tau",
+                                                         "kp", "kd"};
+  return stream == kTelemetryState ? kState : kCommand;
+}
+
+struct TelemetrySample {
+  int64_t time_ns = 0;
+  uint32_t tick = 0;
+  float field[kTelemetryFields][kTelemetryMotors] = {};
+};
+
+// Fixed-capacity single-producer/single-consumer ring. The producer never
+// waits: when the consumer falls behind, new samples are dropped and
+// counted.
+class TelemetryRing {
+ public:
+  explicit TelemetryRing(size_t capacity) : slots_(capacity) {}
+
+  // Returns a slot to fill, or nullptr if the ring is full.
+  TelemetrySample* BeginPush() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == slots_.size()) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &slots_[head % slots_.size()];
+  }
+
+  void CommitPush() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Consumer side: samples in [tail, head) are readable.
+  size_t Available() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_relaxed);
+  }
+  const TelemetrySample& Peek(size_t i) const {
+    return slots_[(tail_.load(std::memory_order_relaxed) + i) % slots_.size()];
+  }
+  void Pop(size_t n) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + n,
+                std::memory_order_release);
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  std::vector<TelemetrySample> slots_;
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+inline void PutVarint(std::vector<uint8_t>* out, uint64_t v) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(v));
+}
+
+inline uint64_t ZigZag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline uint32_t FloatBits(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+inline float BitsFloat(uint32_t bits) {
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Records rt/lowstate and rt/arm_sdk at full rate.
+//
+// RecordState()/RecordCommand() only copy into a preallocated ring and are
+// safe to call from the DDS callback and the control loop; a background
+// thread transposes whatever accumulated into columns, encodes it and writes
+// one block per stream.
+class TelemetryRecorder {
+ public:
+  static constexpr size_t kDefaultRingCapacity = 8192;
+  static constexpr auto kFlushPeriod = std::chrono::milliseconds(200);
+
+  explicit TelemetryRecorder(size_t ring_capacity = kDefaultRingCapacity)
+      : state_ring_(ring_capacity), command_ring_(ring_capacity) {}
+
+  ~TelemetryRecorder() { Close(); }
+
+  TelemetryRecorder(const TelemetryRecorder&) = delete;
+  TelemetryRecorder& operator=(const TelemetryRecorder&) = delete;
+
+  bool Open(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      std::cout << "Failed to open telemetry file " << path << std::endl;
+      return false;
+    }
+    const uint16_t header[3] = {kTelemetryVersion,
+                                static_cast<uint16_t>(kTelemetryMotors),
+                                static_cast<uint16_t>(kTelemetryFields)};
+    std::fwrite(kTelemetryMagic, 1, sizeof(kTelemetryMagic), file_);
+    std::fwrite(header, sizeof(header), 1, file_);
+    running_.store(true);
+    thread_ = std::thread(&TelemetryRecorder::FlushLoop, this);
+    return true;
+  }
+
+  // Stops the flush thread after writing out everything still queued.
+  void Close() {
+    if (!running_.exchange(false)) {
+      return;
+    }
+    thread_.join();
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+
+  bool is_open() const { return running_.load(); }
+
+  void RecordState(const unitree_hg::msg::dds_::LowState_& state) {
+    if (!running_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    TelemetrySample* s = state_ring_.BeginPush();
+    if (s == nullptr) {
+      return;
+    }
+    s->time_ns = NowNs();
+    s->tick = state.tick();
+    for (size_t m = 0; m < kTelemetryMotors; ++m) {
+      const auto& ms = state.motor_state().at(m);
+      s->field[0][m] = ms.q();
+      s->field[1][m] = ms.dq();
+      s->field[2][m] = ms.tau_est();
+      s->field[3][m] = ms.temperature().at(0);
+      s->field[4][m] = ms.temperature().at(1);
+    }
+    state_ring_.CommitPush();
+  }
+
+  // `tick` is the control loop's own counter (LowCmd_ carries none).
+  void RecordCommand(const unitree_hg::msg::dds_::LowCmd_& cmd,
+                     uint32_t tick) {
+    if (!running_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    TelemetrySample* s = command_ring_.BeginPush();
+    if (s == nullptr) {
+      return;
+    }
+    s->time_ns = NowNs();
+    s->tick = tick;
+    for (size_t m = 0; m < kTelemetryMotors; ++m) {
+      const auto& mc = cmd.motor_cmd().at(m);
+      s->field[0][m] = mc.q();
+      s->field[1][m] = mc.dq();
+      s->field[2][m] = mc.tau();
+      s->field[3][m] = mc.kp();
+      s->field[4][m] = mc.kd();
+    }
+    command_ring_.CommitPush();
+  }
+
+  uint64_t dropped() const {
+    return state_ring_.dropped() + command_ring_.dropped();
+  }
+
+ private:
+  static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void FlushLoop() {
+    while (running_.load()) {
+      std::this_thread::sleep_for(kFlushPeriod);
+      Drain(kTelemetryState, &state_ring_);
+      Drain(kTelemetryCommand, &command_ring_);
+    }
+    Drain(kTelemetryState, &state_ring_);
+    Drain(kTelemetryCommand, &command_ring_);
+    std::fflush(file_);
+  }
+
+  void Drain(uint8_t stream, TelemetryRing* ring) {
+    const size_t count = ring->Available();
+    if (count == 0) {
+      return;
+    }
+    payload_.clear();
+    int64_t prev_time = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const int64_t t = ring->Peek(i).time_ns;
+      PutVarint(&payload_, ZigZag(t - prev_time));
+      prev_time = t;
+    }
+    uint32_t prev_tick = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const uint32_t tick = ring->Peek(i).tick;
+      PutVarint(&payload_, ZigZag(static_cast<int32_t>(tick - prev_tick)));
+      prev_tick = tick;
+    }
+    for (size_t f = 0; f < kTelemetryFields; ++f) {
+      for (size_t m = 0; m < kTelemetryMotors; ++m) {
+        uint32_t prev = 0;
+        for (size_t i = 0; i < count; ++i) {
+          const uint32_t bits = FloatBits(ring->Peek(i).field[f][m]);
+          PutVarint(&payload_, ZigZag(static_cast<int32_t>(bits - prev)));
+          prev = bits;
+        }
+      }
+    }
+    ring->Pop(count);
+
+    const uint32_t count32 = static_cast<uint32_t>(count);
+    const uint32_t bytes = static_cast<uint32_t>(payload_.size());
+    std::fwrite(&stream, sizeof(stream), 1, file_);
+    std::fwrite(&count32, sizeof(count32), 1, file_);
+    std::fwrite(&bytes, sizeof(bytes), 1, file_);
+    std::fwrite(payload_.data(), 1, payload_.size(), file_);
+  }
+
+  TelemetryRing state_ring_;
+  TelemetryRing command_ring_;
+  std::vector<uint8_t> payload_;
+  std::FILE* file_ = nullptr;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
+
+}  // namespace g1_arm
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "g1_arm_common.hpp"
+
+namespace g1_arm {
+
+constexpr const char* kArmJointNames[kNumArmJoints] = {
+    "LeftShoulderPitch",  "LeftShoulderRoll",  "LeftShoulderYaw",
+    "LeftElbow",          "LeftWristRoll",     "LeftWristPitch",
+    "LeftWristYaw",       "RightShoulderPitch", "RightShoulderRoll",
+    "RightShoulderYaw",   "RightElbow",        "RightWristRoll",
+    "RightWristPitch",    "RightWristYaw",     "WaistYaw",
+    "WaistRoll",          "WaistPitch"};
+
+struct TrackingStats {
+  double window_s = 0.0;
+  uint64_t commands = 0;
+  uint64_t states = 0;
+  // RMS of (measured - commanded) over the window, radians.
+  std::array<double, kNumArmJoints> rms_error{};
+  // Command->state delay from velocity cross-correlation; negative when the
+  // arms did not move enough in the window to tell.
+  double latency_ms = -1.0;
+  double latency_confidence = 0.0;
+  double period_p50_ms = 0.0;
+  double period_p99_ms = 0.0;
+  double period_max_ms = 0.0;
+  uint64_t overruns = 0;  // periods longer than 1.5x nominal
+};
+
+// Correlates the arm_sdk command stream with rt/lowstate.
+//
+// OnCommand() (control loop) and OnState() (DDS callback) only append to
+// fixed-size histories and accumulate error sums under a short lock. A
+// reporter thread computes the expensive parts every `report_period`: the
+// command->state latency as the lag maximizing the correlation between
+// commanded and measured joint velocities, and loop-period percentiles from
+// a 10 us histogram. Each report is printed and, if a path was given,
+// written as JSON (replaced atomically) for other tools to poll.
+class TrackingMonitor {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TrackingMonitor(float control_dt, Clock::duration report_period,
+                  std::string stats_path = "")
+      : control_dt_(control_dt),
+        report_period_(report_period),
+        stats_path_(std::move(stats_path)),
+        period_histogram_(kHistogramBuckets, 0) {}
+
+  ~TrackingMonitor() { Stop(); }
+
+  TrackingMonitor(const TrackingMonitor&) = delete;
+  TrackingMonitor& operator=(const TrackingMonitor&) = delete;
+
+  void Start() {
+    running_.store(true);
+    window_start_ = Clock::now();
+    thread_ = std::thread(&TrackingMonitor::ReportLoop, this);
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      if (!running_.exchange(false)) {
+        return;
+      }
+    }
+    wake_cv_.notify_all();
+    thread_.join();
+  }
+
+  // Call once per control tick with the command that was published.
+  void OnCommand(const ArmPose& q_des) {
+    const int64_t now = NowNs();
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int64_t period_us = (now - last_command_ns_) / 1000;
+    // Gaps over a second are pauses between phases, not slow ticks.
+    if (last_command_ns_ != 0 && period_us < kMaxPeriodUs) {
+      const size_t bucket = std::min<size_t>(
+          static_cast<size_t>(std::max<int64_t>(period_us, 0)) /
+              kHistogramBucketUs,
+          kHistogramBuckets - 1);
+      ++period_histogram_[bucket];
+      period_max_us_ = std::max(period_max_us_, period_us);
+      if (period_us * 1e-6 > 1.5 * control_dt_) {
+        ++overruns_;
+      }
+    }
+    last_command_ns_ = now;
+    last_command_ = q_des;
+    have_command_ = true;
+    Push(&commands_, now, q_des);
+    ++command_count_;
+  }
+
+  void OnState(const ArmPose& q) {
+    const int64_t now = NowNs();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!have_command_) {
+      return;
+    }
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      const double e = q[j] - last_command_[j];
+      error_sq_[j] += e * e;
+    }
+    Push(&states_, now, q);
+    ++state_count_;
+  }
+
+  // Computes the stats for the window since the previous call and starts a
+  // new one.
+  TrackingStats Collect() {
+    History commands;
+    History states;
+    std::vector<uint32_t> histogram;
+    TrackingStats stats;
+    std::array<double, kNumArmJoints> error_sq{};
+    const Clock::time_point now = Clock::now();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      commands = commands_;
+      states = states_;
+      histogram.swap(period_histogram_);
+      period_histogram_.assign(kHistogramBuckets, 0);
+      error_sq = error_sq_;
+      error_sq_.fill(0.0);
+      stats.commands = command_count_;
+      stats.states = state_count_;
+      stats.period_max_ms = period_max_us_ / 1000.0;
+      stats.overruns = overruns_;
+      command_count_ = 0;
+      state_count_ = 0;
+      period_max_us_ = 0;
+      overruns_ = 0;
+    }
+    stats.window_s =
+        std::chrono::duration<double>(now - window_start_).count();
+    window_start_ = now;
+
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      stats.rms_error[j] =
+          stats.states > 0 ? std::sqrt(error_sq[j] / stats.states) : 0.0;
+    }
+    stats.period_p50_ms = Percentile(histogram, 0.50);
+    stats.period_p99_ms = Percentile(histogram, 0.99);
+    EstimateLatency(commands, states, &stats);
+    return stats;
+  }
+
+  static void Print(const TrackingStats& stats) {
+    size_t worst = 0;
+    for (size_t j = 1; j < kNumArmJoints; ++j) {
+      if (stats.rms_error[j] > stats.rms_error[worst]) {
+        worst = j;
+      }
+    }
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "[arm stats] rms max=%.4f rad (%s) latency=%s%.1f ms "
+                  "period p50=%.2f p99=%.2f max=%.2f ms overruns=%llu",
+                  stats.rms_error[worst], kArmJointNames[worst],
+                  stats.latency_ms < 0 ? "n/a " : "",
+                  std::max(stats.latency_ms, 0.0), stats.period_p50_ms,
+                  stats.period_p99_ms, stats.period_max_ms,
+                  static_cast<unsigned long long>(stats.overruns));
+    std::cout << line << std::endl;
+  }
+
+  static bool WriteJson(const TrackingStats& stats, const std::string& path) {
+    const std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "w");
+    if (f == nullptr) {
+      return false;
+    }
+    std::fprintf(f,
+                 "{\"window_s\":%.3f,\"commands\":%llu,\"states\":%llu,"
+                 "\"latency_ms\":%.3f,\"latency_confidence\":%.3f,"
+                 "\"period_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+                 "\"overruns\":%llu,\"rms_error_rad\":{",
+                 stats.window_s,
+                 static_cast<unsigned long long>(stats.commands),
+                 static_cast<unsigned long long>(stats.states),
+                 stats.latency_ms, stats.latency_confidence,
+                 stats.period_p50_ms, stats.period_p99_ms,
+                 stats.period_max_ms,
+                 static_cast<unsigned long long>(stats.overruns));
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      std::fprintf(f, "%s\"%s\":%.6f", j > 0 ? "," : "", kArmJointNames[j],
+                   stats.rms_error[j]);
+    }
+    std::fprintf(f, "}}\n");
+    std::fclose(f);
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+  }
+
+ private:
+  static constexpr size_t kHistory = 512;
+  static constexpr size_t kHistogramBucketUs = 10;
+  static constexpr size_t kHistogramBuckets = 10000;  // up to 100 ms
+  static constexpr int64_t kMaxPeriodUs = 1000000;
+  static constexpr int64_t kMaxLagNs = 200 * 1000000LL;
+  static constexpr int64_t kLagStepNs = 1000000LL;
+  // Below this much commanded motion the correlation is just noise.
+  static constexpr double kMinCommandSpeedSq = 1e-4;
+
+  struct History {
+    std::array<int64_t, kHistory> t{};
+    std::array<ArmPose, kHistory> q{};
+    size_t next = 0;
+    size_t size = 0;
+
+    size_t Index(size_t i) const {
+      return (next + kHistory - size + i) % kHistory;
+    }
+  };
+
+  static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+  }
+
+  static void Push(History* h, int64_t t, const ArmPose& q) {
+    h->t[h->next] = t;
+    h->q[h->next] = q;
+    h->next = (h->next + 1) % kHistory;
+    h->size = std::min(h->size + 1, kHistory);
+  }
+
+  // Linearly interpolated command at time t; false outside the history.
+  static bool CommandAt(const History& h, int64_t t, ArmPose* q) {
+    if (h.size < 2 || t < h.t[h.Index(0)] || t > h.t[h.Index(h.size - 1)]) {
+      return false;
+    }
+    size_t lo = 0;
+    size_t hi = h.size - 1;
+    while (hi - lo > 1) {
+      const size_t mid = (lo + hi) / 2;
+      if (h.t[h.Index(mid)] <= t) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    const size_t a = h.Index(lo);
+    const size_t b = h.Index(hi);
+    const double span = static_cast<double>(h.t[b] - h.t[a]);
+    const double x = span > 0 ? (t - h.t[a]) / span : 0.0;
+    for (size_t j = 0; j < kNumArmJoints; ++j) {
+      (*q)[j] = static_cast<float>(h.q[a][j] + (h.q[b][j] - h.q[a][j]) * x);
+    }
+    return true;
+  }
+
+  void EstimateLatency(const History& commands, const History& states,
+                       TrackingStats* stats) const {
+    if (states.size < 3 || commands.size < 3) {
+      return;
+    }
+    double best_corr = 0.0;
+    int64_t best_lag = -1;
+    double best_command_energy = 0.0;
+    for (int64_t lag = 0; lag <= kMaxLagNs; lag += kLagStepNs) {
+      double cross = 0.0;
+      double state_energy = 0.0;
+      double command_energy = 0.0;
+      size_t n = 0;
+      ArmPose c0;
+      ArmPose c1;
+      for (size_t i = 1; i < states.size; ++i) {
+        const size_t a = states.Index(i - 1);
+        const size_t b = states.Index(i);
+        const double dt = (states.t[b] - states.t[a]) * 1e-9;
+        if (dt <= 0.0 || !CommandAt(commands, states.t[a] - lag, &c0) ||
+            !CommandAt(commands, states.t[b] - lag, &c1)) {
+          continue;
+        }
+        for (size_t j = 0; j < kNumArmJoints; ++j) {
+          const double vs = (states.q[b][j] - states.q[a][j]) / dt;
+          const double vc = (c1[j] - c0[j]) / dt;
+          cross += vs * vc;
+          state_energy += vs * vs;
+          command_energy += vc * vc;
+        }
+        ++n;
+      }
+      if (n < 10 || state_energy <= 0.0 || command_energy <= 0.0) {
+        continue;
+      }
+      const double corr = cross / std::sqrt(state_energy * command_energy);
+      if (corr > best_corr) {
+        best_corr = corr;
+        best_lag = lag;
+        best_command_energy = command_energy / n;
+      }
+    }
+    if (best_lag >= 0 && best_command_energy >= kMinCommandSpeedSq) {
+      stats->latency_ms = best_lag * 1e-6;
+      stats->latency_confidence = best_corr;
+    }
+  }
+
+  static double Percentile(const std::vector<uint32_t>& histogram,
+                           double fraction) {
+    uint64_t total = 0;
+    for (uint32_t c : histogram) {
+      total += c;
+    }
+    if (total == 0) {
+      return 0.0;
+    }
+    const uint64_t rank =
+        static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+      seen += histogram[i];
+      if (seen >= rank) {
+        return (i + 0.5) * kHistogramBucketUs / 1000.0;
+      }
+    }
+    return histogram.size() * kHistogramBucketUs / 1000.0;
+  }
+
+  void ReportLoop() {
+    std::unique_lock<std::mutex> wake_lock(wake_mutex_);
+    while (running_.load()) {
+      wake_cv_.wait_for(wake_lock, report_period_,
+                        [this] { return !running_.load(); });
+      if (!running_.load()) {
+        break;
+      }
+      const TrackingStats stats = Collect();
+      if (stats.commands == 0) {
+        continue;  // not controlling right now (e.g. waiting for ENTER)
+      }
+      Print(stats);
+      if (!stats_path_.empty()) {
+        WriteJson(stats, stats_path_);
+      }
+    }
+  }
+
+  const float control_dt_;
+  const Clock::duration report_period_;
+  const std::string stats_path_;
+
+  std::mutex mutex_;
+  History commands_;
+  History states_;
+  ArmPose last_command_{};
+  bool have_command_ = false;
+  int64_t last_command_ns_ = 0;
+  std::array<double, kNumArmJoints> error_sq_{};
+  std::vector<uint32_t> period_histogram_;
+  int64_t period_max_us_ = 0;
+  uint64_t overruns_ = 0;
+  uint64_t command_count_ = 0;
+  uint64_t state_count_ = 0;
+
+  Clock::time_point window_start_{};
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
+
+}  // namespace g1_arm
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/joystick.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace g1_loco {
+
+struct Velocity {
+  float vx = 0.f;
+  float vy = 0.f;
+  float omega = 0.f;
+};
+
+struct VelocityStreamOptions {
+  float rate_hz = 20.f;
+  // Input older than this stops the robot (and is the SetVelocity duration,
+  // so the locomotion controller also stops by itself if we die). 0 uses
+  // the input's default: 0.5 s for UDP and joysticks, which stream, and
+  // 3 s for stdin, where setpoints are often typed by hand.
+  float deadman_s = 0.f;
+  Velocity max_speed{0.6f, 0.4f, 1.0f};
+  // Per-axis acceleration limit applied to the command, units/s^2.
+  Velocity max_accel{1.0f, 1.0f, 2.0f};
+  // First-order smoothing time constant on top of the rate limit.
+  float smoothing_s = 0.1f;
+};
+
+inline volatile std::sig_atomic_t g_velocity_stream_stop = 0;
+
+inline void HandleVelocityStreamSignal(int) {
+  g_velocity_stream_stop = 1;
+}
+
+// Reads velocity setpoints from stdin ("vx vy omega" or "vx,vy,omega" per
+// line), a UDP port (same text format, one setpoint per datagram) or a
+// Linux joystick device (/dev/input/jsN: left stick translates, right stick
+// turns). Keeps only the newest setpoint and when it arrived.
+class VelocityInput {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  ~VelocityInput() { Stop(); }
+
+  // `source` is "stdin", "udp:<port>" or "js:<device>".
+  bool Start(const std::string& source, const Velocity& max_speed) {
+    max_speed_ = max_speed;
+    if (source == "stdin") {
+      fd_ = STDIN_FILENO;
+      kind_ = kText;
+    } else if (source.rfind("udp:", 0) == 0) {
+      fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(static_cast<uint16_t>(std::atoi(source.c_str() + 4)));
+      addr.sin_addr.s_addr = INADDR_ANY;
+      if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr*>(&addr),
+                          sizeof(addr)) < 0) {
+        std::cerr << "Error: Failed to bind " << source << " (errno=" << errno
+                  << ")\n";
+        return false;
+      }
+      kind_ = kDatagram;
+      owns_fd_ = true;
+    } else if (source.rfind("js:", 0) == 0) {
+      fd_ = open(source.c_str() + 3, O_RDONLY);
+      if (fd_ < 0) {
+        std::cerr << "Error: Failed to open " << source.substr(3)
+                  << " (errno=" << errno << ")\n";
+        return false;
+      }
+      kind_ = kJoystick;
+      owns_fd_ = true;
+    } else {
+      std::cerr << "Error: Unknown velocity source '" << source << "'\n";
+      return false;
+    }
+    running_.store(true);
+    thread_ = std::thread(&VelocityInput::ReadLoop, this);
+    return true;
+  }
+
+  void Stop() {
+    running_.store(false);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (owns_fd_ && fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = -1;
+    owns_fd_ = false;
+  }
+
+  // False until the first setpoint arrives.
+  bool Latest(Velocity* v, Clock::time_point* stamp) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *v = latest_;
+    *stamp = stamp_;
+    return have_input_;
+  }
+
+  // True once stdin hit EOF or the joystick went away.
+  bool closed() const { return closed_.load(); }
+
+  float default_deadman_s() const { return kind_ == kText ? 3.f : 0.5f; }
+
+ private:
+  enum Kind { kText, kDatagram, kJoystick };
+
+  void Publish(const Velocity& v) {
+    Velocity clamped;
+    clamped.vx = std::clamp(v.vx, -max_speed_.vx, max_speed_.vx);
+    clamped.vy = std::clamp(v.vy, -max_speed_.vy, max_speed_.vy);
+    clamped.omega = std::clamp(v.omega, -max_speed_.omega, max_speed_.omega);
+    std::lock_guard<std::mutex> lock(mutex_);
+    latest_ = clamped;
+    stamp_ = Clock::now();
+    have_input_ = true;
+  }
+
+  void ParseLine(const std::string& line) {
+    Velocity v;
+    if (std::sscanf(line.c_str(), "%f%*[ ,]%f%*[ ,]%f", &v.vx, &v.vy,
+                    &v.omega) >= 1) {
+      Publish(v);
+    }
+  }
+
+  void ReadLoop() {
+    pollfd pfd{fd_, POLLIN, 0};
+    std::string pending;
+    float axes[4] = {0.f, 0.f, 0.f, 0.f};
+    bool have_axes = false;
+    while (running_.load()) {
+      const int ready = poll(&pfd, 1, 100);
+      if (kind_ == kJoystick) {
+        if (ready > 0) {
+          js_event event;
+          if (read(fd_, &event, sizeof(event)) != sizeof(event)) {
+            closed_.store(true);
+            return;
+          }
+          if ((event.type & ~JS_EVENT_INIT) == JS_EVENT_AXIS &&
+              event.number < 4) {
+            axes[event.number] = event.value / 32767.f;
+            have_axes = true;
+          }
+        }
+        // A stick held still sends no events, so the held axes are
+        // republished every tick; only losing the device stops the robot.
+        if (have_axes) {
+          // Stick up is negative on most pads.
+          Publish(Velocity{-axes[1] * max_speed_.vx, -axes[0] * max_speed_.vy,
+                           -axes[3] * max_speed_.omega});
+        }
+        continue;
+      }
+      if (ready <= 0) {
+        continue;
+      }
+      char buffer[512];
+      const ssize_t len = read(fd_, buffer, sizeof(buffer));
+      if (len <= 0) {
+        if (kind_ == kText) {
+          closed_.store(true);
+          return;
+        }
+        continue;
+      }
+      if (kind_ == kDatagram) {
+        ParseLine(std::string(buffer, static_cast<size_t>(len)));
+        continue;
+      }
+      pending.append(buffer, static_cast<size_t>(len));
+      size_t newline;
+      while ((newline = pending.find('\n')) != std::string::npos) {
+        ParseLine(pending.substr(0, newline));
+        pending.erase(0, newline + 1);
+      }
+    }
+  }
+
+  Velocity max_speed_;
+  int fd_ = -1;
+  bool owns_fd_ = false;
+  Kind kind_ = kText;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> closed_{false};
+  std::thread thread_;
+  mutable std::mutex mutex_;
+  Velocity latest_;
+  Clock::time_point stamp_{};
+  bool have_input_ = false;
+};
+
+// Streams SetVelocity at a fixed rate from a VelocityInput through one
+// long-lived client. Commands are acceleration limited and smoothed; if the
+// input goes quiet for `deadman_s` the robot is stopped with StopMove.
+template <typename Client>
+class VelocityStreamer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  VelocityStreamer(Client* client, const VelocityStreamOptions& options)
+      : client_(client), options_(options) {}
+
+  // Runs until SIGINT/SIGTERM or EOF on stdin. Returns the last RPC error.
+  int32_t Run(VelocityInput* input) {
+    std::signal(SIGINT, HandleVelocityStreamSignal);
+    std::signal(SIGTERM, HandleVelocityStreamSignal);
+
+    const float dt = 1.f / options_.rate_hz;
+    const float deadman_s = options_.deadman_s > 0.f
+                                ? options_.deadman_s
+                                : input->default_deadman_s();
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(dt));
+    const auto deadman = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(deadman_s));
+    const float alpha =
+        options_.smoothing_s > 0.f ? dt / (options_.smoothing_s + dt) : 1.f;
+
+    int32_t ret = 0;
+    bool stopped = true;
+    Velocity command;
+    Velocity smoothed;
+    Clock::time_point last_sent{};
+    Clock::time_point next = Clock::now();
+    while (g_velocity_stream_stop == 0 && !input->closed()) {
+      next += period;
+      Velocity target;
+      Clock::time_point stamp;
+      const Clock::time_point now = Clock::now();
+      const bool fresh =
+          input->Latest(&target, &stamp) && now - stamp <= deadman;
+      if (!fresh) {
+        if (!stopped) {
+          ret = client_->StopMove();
+          std::cout << "Deadman: no input for " << deadman_s
+                    << " s, StopMove ret: " << ret << std::endl;
+          stopped = true;
+        }
+        command = Velocity{};
+        smoothed = Velocity{};
+        std::this_thread::sleep_until(next);
+        continue;
+      }
+
+      smoothed.vx += alpha * (target.vx - smoothed.vx);
+      smoothed.vy += alpha * (target.vy - smoothed.vy);
+      smoothed.omega += alpha * (target.omega - smoothed.omega);
+      command.vx += Limit(smoothed.vx - command.vx, options_.max_accel.vx * dt);
+      command.vy += Limit(smoothed.vy - command.vy, options_.max_accel.vy * dt);
+      command.omega +=
+          Limit(smoothed.omega - command.omega, options_.max_accel.omega * dt);
+
+      // Refresh at least twice per SetVelocity duration even if unchanged.
+      const bool changed = std::abs(command.vx - sent_.vx) > 1e-3f ||
+                           std::abs(command.vy - sent_.vy) > 1e-3f ||
+                           std::abs(command.omega - sent_.omega) > 1e-3f;
+      if (changed || stopped || now - last_sent >= deadman / 2) {
+        ret = client_->SetVelocity(command.vx, command.vy, command.omega,
+                                   deadman_s);
+        if (ret != 0) {
+          std::cout << "SetVelocity ret: " << ret << std::endl;
+        }
+        sent_ = command;
+        last_sent = now;
+        stopped = false;
+      }
+      std::this_thread::sleep_until(next);
+    }
+
+    const int32_t stop_ret = client_->StopMove();
+    std::cout << "StopMove ret: " << stop_ret << std::endl;
+    return ret != 0 ? ret : stop_ret;
+  }
+
+ private:
+  static float Limit(float delta, float max_step) {
+    return std::clamp(delta, -max_step, max_step);
+  }
+
+  Client* client_;
+  VelocityStreamOptions options_;
+  Velocity sent_;
+};
+
+}  // namespace g1_loco
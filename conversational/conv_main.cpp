@@ -1,12 +1,14 @@
+#include <algorithm>
 #include <atomic>
 #include <cctype>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
 #include <condition_variable>
 #include <deque>
-#include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -21,108 +23,141 @@
 #include <rnnoise.h>
 #include <whisper.h>
 
+#include "audio_envelope.hpp"
+#include "conversation_context.hpp"
+#include "keyword_spotter.hpp"
+#include "led_animation.hpp"
+#include "led_scheduler.hpp"
+#include "llm_backend.hpp"
+#include "log_mel.hpp"
+#include "mic_capture.hpp"
+#include "spectral_denoiser.hpp"
+#include "speech_endpointer.hpp"
+#include "utterance_filter.hpp"
+#include "response_cache.hpp"
+#include "rpc_executor.hpp"
+#include "speaker_tracker.hpp"
+#include "wav_writer.hpp"
+
 namespace {
 
-constexpr int kMicCaptureRate = 48000;
 constexpr int kMicWhisperRate = 16000;
+// The robot's speaker (TtsMaker, PlayStream).
+constexpr int kTtsPlaybackRate = 16000;
 constexpr int kMicChannels = 1;
 constexpr int kMicBitsPerSample = 16;
-constexpr int kMicChunkSeconds = 1;
+// The mic is read in short chunks so the endpointer reacts within one.
+constexpr int kMicChunkMs = 100;
 constexpr int kMicMaxRecordSeconds = 5;
 constexpr int kMicSilenceStopMs = 500;
-constexpr float kMicVadThresholdStart = 0.0f;
-constexpr float kMicVadThresholdContinue = 0.0f;
-constexpr int kMicRmsThreshold = 1200;
-constexpr int kMaxContextMessages = 10;
+// Minimum denoiser speech probability for a frame to count as speech
+// (0 = level only).
+constexpr float kMicVadThreshold = 0.0f;
+// With a KWS model, utterances are only transcribed within this long of
+// the wake word or of the last accepted utterance.
+constexpr int kWakeFollowUpMs = 15000;
+// Shared log-mel frames kept for the KWS, the utterance filter and
+// Whisper; more than the longest utterance plus preroll.
+constexpr size_t kMelRingFrames = 1000;
+// Conversation turns are folded into a summary once a context passes
+// this many (estimated) tokens; see ConversationContextOptions.
+constexpr size_t kContextSummarizeTokens = 900;
+constexpr size_t kContextMaxTokens = 1500;
+constexpr int kSummaryMaxTokens = 200;
+// LLM backends: replies wait at most kLlmBudgetMs (LLM_BUDGET_MS) and
+// the local model joins after kLlmHedgeMs (LLM_HEDGE_MS). Summaries run
+// in the background on Groq only and may take longer.
+constexpr int kLlmBudgetMs = 10000;
+constexpr int kLlmHedgeMs = 2500;
+constexpr int kSummaryBudgetMs = 60000;
+constexpr const char* kGroqUrl =
+    "https://api.groq.com/openai/v1/chat/completions";
+// Response cache defaults (CONV_CACHE*). Search results go stale sooner
+// than answers to "what is your name".
+constexpr const char* kDefaultCachePath = "conv_cache.bin";
+constexpr int64_t kCacheReplyTtlS = 7 * 24 * 3600;
+constexpr int64_t kCacheSearchTtlS = 24 * 3600;
+constexpr size_t kCacheMaxMb = 4;
+// Context-dependent questions are keyed on this many recent messages.
+constexpr size_t kCacheContextMessages = 2;
 
 #ifndef WHISPER_MODEL_PATH
 #define WHISPER_MODEL_PATH "thirdparty/whisper.cpp/models/ggml-tiny.en.bin"
 #endif
 constexpr const char* kDefaultModelPath = WHISPER_MODEL_PATH;
-constexpr const char* kLocalMicChunkPcm = "/tmp/conv_mic_chunk.pcm";
 constexpr const char* kDefaultAlsaDevice = "default";
 
 std::string g_alsa_device = kDefaultAlsaDevice;
 
+// Mic backend and denoiser chosen by MIC_SOURCE / MIC_DENOISE.
+g1_common::MicPipeline g_mic_pipeline;
+g1_common::CaptureSource* g_mic = nullptr;
+g1_common::SpectralDenoiser* g_spectral_denoiser = nullptr;
+g1_common::SpeechEndpointer* g_endpointer = nullptr;
+// Log-mel frames of the denoised 16 kHz stream; capture thread only.
+g1_common::MelStream* g_mel = nullptr;
+g1_common::UtteranceFilter* g_utterance_filter = nullptr;
+// Wake-word gate (KWS_MODEL); null when disabled.
+g1_common::KeywordSpotter* g_kws = nullptr;
+// Routes each utterance to a per-speaker conversation history.
+g1_common::SpeakerTracker* g_speakers = nullptr;
+std::atomic<int64_t> g_awake_until_ms(0);
+std::atomic<uint64_t> g_kws_skipped(0);
 unitree::robot::g1::AudioClient* g_audio_client = nullptr;
 unitree::robot::g1::G1ArmActionClient* g_arm_client = nullptr;
+// Arm actions run here so a slow ExecuteAction doesn't hold up listening.
+g1_common::RpcExecutor* g_arm_rpc = nullptr;
+// Background work between turns: folding old turns into conversation
+// summaries and compacting the response cache.
+g1_common::RpcExecutor* g_summary_rpc = nullptr;
+// LLM replies and search results by normalized question; null when
+// CONV_CACHE=off.
+g1_common::ResponseCache* g_response_cache = nullptr;
+// Head LED: a listening layer following the mic envelope and a speaking
+// layer following a synthetic envelope of the TTS text.
+g1_common::LedAnimationEngine* g_led_engine = nullptr;
+g1_common::PlaybackEnvelope* g_mic_envelope = nullptr;
+g1_common::PlaybackEnvelope* g_speech_envelope = nullptr;
 whisper_context* g_whisper_ctx = nullptr;
 DenoiseState* g_rnnoise_state = nullptr;
 std::mutex g_queue_mutex;
 std::condition_variable g_queue_cv;
-std::deque<std::vector<int16_t>> g_pcm_queue;
-std::atomic<bool> g_capture_running(true);
-
-struct ChatMessage {
-  std::string role;
-  std::string content;
+// An utterance at 16 kHz with its log-mel frames (empty if the ring
+// had already dropped them) and the speaker's voiceprint from them.
+struct QueuedUtterance {
+  std::vector<int16_t> pcm;
+  std::vector<float> mel;
+  g1_common::SpeakerEmbedding voiceprint;
+  bool marginal = true;  // SpeechVerdict::marginal
 };
+std::deque<QueuedUtterance> g_utterance_queue;
+std::atomic<bool> g_capture_running(true);
 
-std::vector<ChatMessage> g_conversation_history;
+// One context per SpeakerTracker id (0 when the speaker is unknown), so
+// people talking to the robot in turn don't share one and "clear history"
+// only clears the current speaker's. At most max_speakers + 1 contexts of
+// kContextMaxTokens exist. Shared so a summary in flight outlives an
+// evicted or cleared context.
+std::map<int, std::shared_ptr<g1_common::ConversationContext>>
+    g_conversation_histories;
+int g_current_speaker = 0;
 std::mutex g_history_mutex;
 
 std::string g_groq_api_key;
 std::string g_groq_model = "llama-3.3-70b-versatile";
+// OpenAI-compatible local server (llama.cpp's llama-server); empty when
+// not configured.
+std::string g_local_llm_url;
+std::string g_local_llm_model = "local";
+// Replies and summaries each have a router, as each serves one thread.
+g1_common::LlmRouter* g_llm = nullptr;
+g1_common::LlmRouter* g_summary_llm = nullptr;
 std::string g_system_prompt =
     "You are a friendly robot assistant named G1. You are helpful, concise, "
     "and speak naturally. Keep responses brief (1-2 sentences) since they "
     "will be spoken aloud. Be conversational and engaging. "
     "When web search results are provided, use them to give accurate answers.";
 
-std::string EscapeJson(const std::string& input) {
-  std::string output;
-  output.reserve(input.size() * 2);
-  for (char ch : input) {
-    switch (ch) {
-      case '"':
-        output += "\\\"";
-        break;
-      case '\\':
-        output += "\\\\";
-        break;
-      case '\b':
-        output += "\\b";
-        break;
-      case '\f':
-        output += "\\f";
-        break;
-      case '\n':
-        output += "\\n";
-        break;
-      case '\r':
-        output += "\\r";
-        break;
-      case '\t':
-        output += "\\t";
-        break;
-      default:
-        if (static_cast<unsigned char>(ch) < 0x20) {
-          char buf[8];
-          snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(ch));
-          output += buf;
-        } else {
-          output += ch;
-        }
-        break;
-    }
-  }
-  return output;
-}
-
-std::string BuildMessagesJson(const std::vector<ChatMessage>& messages) {
-  std::ostringstream oss;
-  oss << "[";
-  for (size_t i = 0; i < messages.size(); ++i) {
-    if (i > 0) {
-      oss << ",";
-    }
-    oss << "{\"role\":\"" << messages[i].role << "\",\"content\":\""
-        << EscapeJson(messages[i].content) << "\"}";
-  }
-  oss << "]";
-  return oss.str();
-}
-
 std::string ExtractContentFromResponse(const std::string& json_response) {
   const std::string marker = "\"content\":";
   size_t pos = json_response.find(marker);
@@ -447,10 +482,12 @@ int DetectAction(const std::string& text) {
   return best_score >= 2 ? best_id : -1;
 }
 
-bool ExecuteAction(int action_id) {
+// Queues the action on the arm executor; a failure is logged when it
+// returns.
+void ExecuteAction(int action_id) {
   if (g_arm_client == nullptr) {
     std::cout << "[Would execute action " << action_id << "]" << std::endl;
-    return false;
+    return;
   }
 
   const auto actions = GetActionList();
@@ -463,107 +500,367 @@ bool ExecuteAction(int action_id) {
   }
 
   std::cout << "[Executing action: " << action_name << " (id=" << action_id << ")]" << std::endl;
-  int32_t ret = g_arm_client->ExecuteAction(action_id);
-  return ret == 0;
+  // A newer action replaces one that hasn't started yet.
+  g_arm_rpc->Post(
+      "ExecuteAction",
+      [action_id] { return g_arm_client->ExecuteAction(action_id); },
+      "arm_action", [action_name](int32_t ret) {
+        if (ret != 0) {
+          std::cout << "[Action " << action_name << " ret: " << ret << "]"
+                    << std::endl;
+        }
+      });
 }
 
-bool ExecuteCustomAction(const std::string& action_name) {
+void ExecuteCustomAction(const std::string& action_name) {
   if (g_arm_client == nullptr) {
     std::cout << "[Would execute custom action: " << action_name << "]" << std::endl;
-    return false;
+    return;
   }
 
   std::cout << "[Executing custom action: " << action_name << "]" << std::endl;
-  int32_t ret = g_arm_client->ExecuteAction(action_name);
-  return ret == 0;
+  g_arm_rpc->Post(
+      "ExecuteAction",
+      [action_name] { return g_arm_client->ExecuteAction(action_name); },
+      "arm_action", [action_name](int32_t ret) {
+        if (ret != 0) {
+          std::cout << "[Custom action " << action_name << " ret: " << ret
+                    << "]" << std::endl;
+        }
+      });
 }
 
-std::string CallOpenAI(const std::string& user_message) {
-  if (g_groq_api_key.empty()) {
-    return "Error: Groq API key not set.";
+// The current speaker's context, created on first use.
+std::shared_ptr<g1_common::ConversationContext> CurrentContext() {
+  std::lock_guard<std::mutex> lock(g_history_mutex);
+  std::shared_ptr<g1_common::ConversationContext>& context =
+      g_conversation_histories[g_current_speaker];
+  if (!context) {
+    g1_common::ConversationContextOptions options;
+    options.summarize_above_tokens = kContextSummarizeTokens;
+    options.max_tokens = kContextMaxTokens;
+    context = std::make_shared<g1_common::ConversationContext>(
+        g_system_prompt, options);
   }
+  return context;
+}
 
-  // Check if we should search the web
-  std::string search_context;
-  if (ShouldSearch(user_message)) {
-    std::cout << "[Searching the web...]" << std::endl;
-    search_context = SearchDuckDuckGo(user_message);
-  }
+int CurlCancelCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t,
+                       curl_off_t) {
+  return static_cast<const std::atomic<bool>*>(clientp)->load() ? 1 : 0;
+}
+
+// Chat completions over an OpenAI-compatible HTTP API: Groq, or a local
+// llama.cpp server.
+class OpenAiChatBackend : public g1_common::LlmBackend {
+ public:
+  OpenAiChatBackend(std::string label, std::string url, std::string api_key,
+                    std::string model, long connect_timeout_s,
+                    long timeout_s)
+      : label_(std::move(label)),
+        url_(std::move(url)),
+        api_key_(std::move(api_key)),
+        model_(std::move(model)),
+        connect_timeout_s_(connect_timeout_s),
+        timeout_s_(timeout_s) {}
+
+  std::string name() const override { return label_ + ":" + model_; }
+
+  bool Complete(const g1_common::LlmRequest& request,
+                const std::atomic<bool>& cancel,
+                std::string* reply) override {
+    std::ostringstream body;
+    body << "{\"model\":\"" << model_ << "\",\"messages\":"
+         << request.messages_json << ",\"max_tokens\":" << request.max_tokens
+         << ",\"temperature\":" << request.temperature << "}";
+    std::string request_body = body.str();
+
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+      *reply = "Error: Failed to initialize curl.";
+      return false;
+    }
 
-  std::vector<ChatMessage> messages;
-  messages.push_back({"system", g_system_prompt});
+    std::string response;
+    struct curl_slist* headers = nullptr;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    std::string auth_header = "Authorization: Bearer " + api_key_;
+    if (!api_key_.empty()) {
+      headers = curl_slist_append(headers, auth_header.c_str());
+    }
 
-  {
-    std::lock_guard<std::mutex> lock(g_history_mutex);
-    for (const auto& msg : g_conversation_history) {
-      messages.push_back(msg);
+    curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_body.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, connect_timeout_s_);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_s_);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CurlCancelCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA,
+                     const_cast<std::atomic<bool>*>(&cancel));
+
+    CURLcode res = curl_easy_perform(curl);
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    if (res != CURLE_OK) {
+      *reply =
+          std::string("Error: curl request failed: ") + curl_easy_strerror(res);
+      return false;
     }
+
+    std::string content = ExtractContentFromResponse(response);
+    if (content.empty()) {
+      std::cout << name() << " raw response: " << response << std::endl;
+      // Try to extract error message from API response
+      size_t err_pos = response.find("\"message\":");
+      if (err_pos != std::string::npos) {
+        std::string err_content = ExtractContentFromResponse(
+            response.substr(err_pos - 1));
+        if (!err_content.empty()) {
+          *reply = "API error: " + err_content;
+          return false;
+        }
+      }
+      *reply = "API returned empty response.";
+      return false;
+    }
+
+    *reply = content;
+    return true;
   }
 
-  // Add search results to user message if available
-  std::string augmented_message = user_message;
-  if (!search_context.empty()) {
-    augmented_message = user_message + "\n\n[Web search results]: " + search_context;
+ private:
+  std::string label_;
+  std::string url_;
+  std::string api_key_;
+  std::string model_;
+  long connect_timeout_s_;
+  long timeout_s_;
+};
+
+// Groq first when there is a key, then the local server. A down uplink
+// fails Groq's connect within seconds, handing over to the local model.
+// The local server works through one request at a time, so only one
+// router may use it.
+std::unique_ptr<g1_common::LlmRouter> MakeLlmRouter(const std::string& name,
+                                                    int budget_ms,
+                                                    int hedge_after_ms,
+                                                    bool with_local) {
+  g1_common::LlmRouterOptions options;
+  options.name = name;
+  options.budget_ms = budget_ms;
+  options.hedge_after_ms = hedge_after_ms;
+  auto router = std::make_unique<g1_common::LlmRouter>(options);
+  if (!g_groq_api_key.empty()) {
+    router->Add(std::make_unique<OpenAiChatBackend>(
+        "groq", kGroqUrl, g_groq_api_key, g_groq_model, 3L, 30L));
+  }
+  if (with_local && !g_local_llm_url.empty()) {
+    router->Add(std::make_unique<OpenAiChatBackend>(
+        "local", g_local_llm_url, "", g_local_llm_model, 1L, 120L));
   }
-  messages.push_back({"user", augmented_message});
+  return router;
+}
 
-  std::string messages_json = BuildMessagesJson(messages);
-  std::ostringstream body;
-  body << "{\"model\":\"" << g_groq_model << "\",\"messages\":"
-       << messages_json << ",\"max_tokens\":150,\"temperature\":0.7}";
-  std::string request_body = body.str();
+// ConversationContext::Summarizer over the chat model.
+std::string SummarizeTurns(const std::string& summary,
+                           const std::vector<g1_common::ChatMessage>& turns) {
+  std::string transcript;
+  if (!summary.empty()) {
+    transcript = "Earlier summary: " + summary + "\n\n";
+  }
+  for (const g1_common::ChatMessage& turn : turns) {
+    transcript += turn.role + ": " + turn.content + "\n";
+  }
+  const std::string messages_json = g1_common::BuildMessagesJson(
+      {{"system",
+        "Summarize this conversation between a user and a robot assistant "
+        "in at most three sentences. Keep names, facts about the user and "
+        "anything still unanswered. Reply with the summary only."},
+       {"user", transcript}});
+  std::string reply;
+  if (!g_summary_llm->Complete({messages_json, kSummaryMaxTokens, 0.2f},
+                               &reply)) {
+    std::cout << "[Summary failed]: " << reply << std::endl;
+    return "";
+  }
+  return reply;
+}
 
-  CURL* curl = curl_easy_init();
-  if (!curl) {
-    return "Error: Failed to initialize curl.";
+// Queues a fold of the context's older turns if it's over budget. Runs
+// between turns, so it normally finishes before the next request.
+void MaybeSummarize(std::shared_ptr<g1_common::ConversationContext> context) {
+  if (g_summary_rpc == nullptr || g_summary_llm == nullptr ||
+      !context->NeedsSummary()) {
+    return;
   }
+  g_summary_rpc->Post("summarize", [context]() -> int32_t {
+    return context->Summarize(SummarizeTurns) ? 0 : -1;
+  });
+}
 
-  std::string response;
-  struct curl_slist* headers = nullptr;
-  headers = curl_slist_append(headers, "Content-Type: application/json");
-  std::string auth_header = "Authorization: Bearer " + g_groq_api_key;
-  headers = curl_slist_append(headers, auth_header.c_str());
-
-  curl_easy_setopt(curl, CURLOPT_URL,
-                   "https://api.groq.com/openai/v1/chat/completions");
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_body.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+// Queues a compaction once puts have taken the response cache past its
+// limit, so no reply waits for one.
+void MaybeCompactCache() {
+  if (g_summary_rpc == nullptr || g_response_cache == nullptr ||
+      !g_response_cache->NeedsCompaction()) {
+    return;
+  }
+  g_summary_rpc->Post(
+      "compact_cache",
+      []() -> int32_t { return g_response_cache->Compact() ? 0 : -1; },
+      "compact_cache");
+}
 
-  CURLcode res = curl_easy_perform(curl);
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
+// Lowercase words with punctuation dropped, so Whisper's "What's your
+// name?" and "what's your name" share a cache entry.
+std::string CacheQuery(const std::string& text) {
+  std::string out;
+  for (unsigned char ch : text) {
+    if (std::isalnum(ch) || ch == '\'') {
+      out.push_back(static_cast<char>(std::tolower(ch)));
+    } else if (std::isspace(ch) && !out.empty() && out.back() != ' ') {
+      out.push_back(' ');
+    }
+  }
+  if (!out.empty() && out.back() == ' ') {
+    out.pop_back();
+  }
+  return out;
+}
 
-  if (res != CURLE_OK) {
-    return std::string("Error: curl request failed: ") + curl_easy_strerror(res);
-  }
-
-  std::string content = ExtractContentFromResponse(response);
-  if (content.empty()) {
-    std::cout << "Groq raw response: " << response << std::endl;
-    // Try to extract error message from API response
-    size_t err_pos = response.find("\"message\":");
-    if (err_pos != std::string::npos) {
-      std::string err_content = ExtractContentFromResponse(
-          response.substr(err_pos - 1));
-      if (!err_content.empty()) {
-        return "API error: " + err_content;
-      }
+bool HasAnyWord(const std::string& query,
+                const std::vector<std::string>& words) {
+  for (const std::string& word : SplitWords(query)) {
+    if (std::find(words.begin(), words.end(), word) != words.end()) {
+      return true;
     }
-    return "API returned empty response.";
   }
+  return false;
+}
 
-  return content;
+// Answers that change with the clock are never cached.
+bool IsTimeSensitive(const std::string& query) {
+  return HasAnyWord(query, {"time", "date", "today", "tonight", "tomorrow",
+                            "yesterday", "now", "weather", "news",
+                            "latest", "current"});
+}
+
+// Questions referring back to the conversation ("why is that", "tell me
+// more", "what's my name") are only reused within the same context.
+bool IsContextDependent(const std::string& query) {
+  return HasAnyWord(query, {"it", "its", "it's", "that", "that's", "this",
+                            "these", "those", "they", "them", "he", "she",
+                            "him", "her", "his", "there", "more", "again",
+                            "another", "else", "i", "i'm", "my", "we",
+                            "our", "us"});
+}
+
+std::string ReplyCacheKey(const std::string& query) {
+  char hex[17];
+  uint64_t hash =
+      g1_common::Fnv1a64(g_llm->backend(0).name() + "\n" + g_system_prompt);
+  std::string key = "reply|";
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  key += hex;
+  if (IsContextDependent(query)) {
+    hash = 14695981039346656037ull;
+    for (const g1_common::ChatMessage& message :
+         CurrentContext()->Recent(kCacheContextMessages)) {
+      hash = g1_common::Fnv1a64(message.role + "\n" + message.content + "\n",
+                                hash);
+    }
+    snprintf(hex, sizeof(hex), "%016llx",
+             static_cast<unsigned long long>(hash));
+    key += "|";
+    key += hex;
+  }
+  return key + "|" + query;
+}
+
+std::string CachedSearch(const std::string& query) {
+  const std::string key = "search|" + CacheQuery(query);
+  std::string result;
+  if (g_response_cache != nullptr && g_response_cache->Lookup(key, &result)) {
+    std::cout << "[Search result (cached)]: " << result.substr(0, 100)
+              << "..." << std::endl;
+    return result;
+  }
+  result = SearchDuckDuckGo(query);
+  if (g_response_cache != nullptr && !result.empty()) {
+    g_response_cache->Put(key, result, kCacheSearchTtlS);
+  }
+  return result;
+}
+
+std::string CallOpenAI(const std::string& user_message) {
+  const std::string query = CacheQuery(user_message);
+  const bool cacheable = g_response_cache != nullptr && !query.empty() &&
+                         !IsTimeSensitive(query);
+  std::string cache_key;
+  std::string reply;
+  if (cacheable) {
+    cache_key = ReplyCacheKey(query);
+    if (g_response_cache->Lookup(cache_key, &reply)) {
+      std::cout << "[Cached reply]" << std::endl;
+      return reply;
+    }
+  }
+
+  // Check if we should search the web
+  std::string search_context;
+  if (ShouldSearch(user_message)) {
+    std::cout << "[Searching the web...]" << std::endl;
+    search_context = CachedSearch(user_message);
+  }
+
+  // Add search results to user message if available
+  std::string augmented_message = user_message;
+  if (!search_context.empty()) {
+    augmented_message = user_message + "\n\n[Web search results]: " + search_context;
+  }
+
+  int winner = -1;
+  if (g_llm->Complete({CurrentContext()->MessagesJson(augmented_message), 150,
+                       0.7f},
+                      &reply, &winner) &&
+      winner > 0) {
+    std::cout << "[Answered by " << g_llm->backend(winner).name() << "]"
+              << std::endl;
+  }
+  // Only the preferred backend's replies are cached, so a fallback's
+  // answer doesn't outlive the outage.
+  if (winner == 0 && cacheable) {
+    g_response_cache->Put(cache_key, reply);
+  }
+  return reply;
 }
 
 void AddToHistory(const std::string& role, const std::string& content) {
+  CurrentContext()->Add(role, content);
+}
+
+// Identifies who said `utterance` and makes their history the current
+// one; a speaker the tracker dropped loses theirs.
+void SelectSpeaker(const QueuedUtterance& utterance) {
+  int evicted = 0;
+  const size_t known = g_speakers->speaker_count();
+  const uint64_t created = g_speakers->stats().speakers;
+  const int speaker = g_speakers->Identify(utterance.voiceprint, &evicted);
   std::lock_guard<std::mutex> lock(g_history_mutex);
-  g_conversation_history.push_back({role, content});
-  while (g_conversation_history.size() > kMaxContextMessages) {
-    g_conversation_history.erase(g_conversation_history.begin());
+  if (evicted != 0) {
+    g_conversation_histories.erase(evicted);
+  }
+  if (speaker != g_current_speaker || known == 0) {
+    std::cout << "[Speaker " << speaker
+              << (g_speakers->stats().speakers != created ? ", new" : "")
+              << "]" << std::endl;
   }
+  g_current_speaker = speaker;
 }
 
 std::string Normalize(const std::string& input) {
@@ -587,16 +884,14 @@ std::string Normalize(const std::string& input) {
   return out;
 }
 
-std::string TranscribeWithWhisper(const std::vector<int16_t>& pcm_data) {
-  if (g_whisper_ctx == nullptr || pcm_data.empty()) {
+// Transcribes from the capture thread's log-mel frames when there are
+// some and the model takes that many bands, so Whisper doesn't redo the
+// STFT (plus 30 s of padding) per call; otherwise from the audio.
+std::string TranscribeWithWhisper(const QueuedUtterance& utterance) {
+  if (g_whisper_ctx == nullptr || utterance.pcm.empty()) {
     return "";
   }
 
-  std::vector<float> samples(pcm_data.size());
-  for (size_t i = 0; i < pcm_data.size(); ++i) {
-    samples[i] = static_cast<float>(pcm_data[i]) / 32768.0f;
-  }
-
   whisper_full_params params =
       whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
   params.print_progress = false;
@@ -605,8 +900,28 @@ std::string TranscribeWithWhisper(const std::vector<int16_t>& pcm_data) {
   params.translate = false;
   params.language = "en";
 
-  int ret = whisper_full(g_whisper_ctx, params, samples.data(),
-                         static_cast<int>(samples.size()));
+  const int n_mels = whisper_model_n_mels(g_whisper_ctx);
+  int ret = 0;
+  if (!utterance.mel.empty() && n_mels > 0 &&
+      utterance.mel.size() % n_mels == 0 &&
+      static_cast<size_t>(n_mels) == g1_common::LogMelOptions().n_mels) {
+    const size_t frames = utterance.mel.size() / n_mels;
+    int n_len = 0;
+    const std::vector<float> mel =
+        g1_common::ToWhisperMel(utterance.mel, n_mels, &n_len);
+    params.duration_ms = static_cast<int>(frames * 10);
+    ret = whisper_set_mel(g_whisper_ctx, mel.data(), n_len, n_mels);
+    if (ret == 0) {
+      ret = whisper_full(g_whisper_ctx, params, nullptr, 0);
+    }
+  } else {
+    std::vector<float> samples(utterance.pcm.size());
+    for (size_t i = 0; i < utterance.pcm.size(); ++i) {
+      samples[i] = static_cast<float>(utterance.pcm[i]) / 32768.0f;
+    }
+    ret = whisper_full(g_whisper_ctx, params, samples.data(),
+                       static_cast<int>(samples.size()));
+  }
   if (ret != 0) {
     std::cout << "Whisper transcribe error: " << ret << std::endl;
     return "";
@@ -647,19 +962,21 @@ RnnoiseChunkResult DenoiseChunk48k(const std::vector<int16_t>& pcm_data) {
     size_t frame_count =
         remaining < static_cast<size_t>(kFrameSize) ? remaining : kFrameSize;
     for (size_t i = 0; i < frame_count; ++i) {
-      in_frame[i] = static_cast<float>(pcm_data[offset + i]) / 32768.0f;
+      // RNNoise works on int16-range floats; at +-1 it hears silence and
+      // its VAD stays near 0.
+      in_frame[i] = static_cast<float>(pcm_data[offset + i]);
     }
     float vad = rnnoise_process_frame(g_rnnoise_state, out_frame, in_frame);
     vad_sum += vad;
     vad_frames++;
     for (size_t i = 0; i < frame_count; ++i) {
       float v = out_frame[i];
-      if (v > 1.0f) {
-        v = 1.0f;
-      } else if (v < -1.0f) {
-        v = -1.0f;
+      if (v > 32767.0f) {
+        v = 32767.0f;
+      } else if (v < -32768.0f) {
+        v = -32768.0f;
       }
-      result.denoised.push_back(static_cast<int16_t>(v * 32767.0f));
+      result.denoised.push_back(static_cast<int16_t>(v));
     }
     offset += frame_count;
   }
@@ -670,6 +987,26 @@ RnnoiseChunkResult DenoiseChunk48k(const std::vector<int16_t>& pcm_data) {
   return result;
 }
 
+// Denoises a captured chunk with the configured stage. Without one there
+// is no VAD (avg_vad < 0), so the endpointer goes on level alone.
+RnnoiseChunkResult PrepareChunk(std::vector<int16_t> chunk) {
+  RnnoiseChunkResult result;
+  switch (g_mic_pipeline.denoise) {
+    case g1_common::MicDenoise::kRnnoise:
+      return DenoiseChunk48k(chunk);
+    case g1_common::MicDenoise::kSpectral:
+      result.denoised.reserve(chunk.size());
+      result.avg_vad = g_spectral_denoiser->Process(
+          chunk.data(), chunk.size(), &result.denoised);
+      return result;
+    case g1_common::MicDenoise::kOff:
+      break;
+  }
+  result.denoised = std::move(chunk);
+  result.avg_vad = -1.0f;
+  return result;
+}
+
 std::vector<int16_t> DownsampleTo16k(const std::vector<int16_t>& pcm_data) {
   if (pcm_data.empty()) {
     return {};
@@ -682,108 +1019,140 @@ std::vector<int16_t> DownsampleTo16k(const std::vector<int16_t>& pcm_data) {
   return out;
 }
 
-std::vector<int16_t> ReadRawPcm(const std::string& path) {
-  std::ifstream in(path, std::ios::binary);
-  if (!in) {
-    return {};
-  }
-  in.seekg(0, std::ios::end);
-  std::streamsize size = in.tellg();
-  in.seekg(0, std::ios::beg);
-  if (size <= 0 || size % static_cast<std::streamsize>(sizeof(int16_t)) != 0) {
-    return {};
-  }
-  std::vector<int16_t> data(static_cast<size_t>(size / sizeof(int16_t)));
-  if (!in.read(reinterpret_cast<char*>(data.data()), size)) {
-    return {};
-  }
-  return data;
+int64_t SteadyNowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
 }
 
-int ComputeRms(const std::vector<int16_t>& pcm) {
-  if (pcm.empty()) {
-    return 0;
-  }
-  double sum_sq = 0.0;
-  for (int16_t sample : pcm) {
-    double v = static_cast<double>(sample);
-    sum_sq += v * v;
+void KeepAwake() {
+  g_awake_until_ms.store(SteadyNowMs() + kWakeFollowUpMs);
+}
+
+bool IsAwake() {
+  return g_kws == nullptr || SteadyNowMs() <= g_awake_until_ms.load();
+}
+
+// Removes a leading "Hey G1" (in the spellings Whisper uses) from a
+// transcript. Returns "" if that was all of it.
+std::string StripWakePhrase(const std::string& transcript) {
+  static const char* const kPhrases[] = {"hey g1", "hey g 1", "hey g one",
+                                         "hey gee one", "hey ji one"};
+  std::string words;
+  for (size_t i = 0; i <= transcript.size(); ++i) {
+    const unsigned char ch =
+        i < transcript.size() ? static_cast<unsigned char>(transcript[i]) : 0;
+    if (std::isalnum(ch)) {
+      words.push_back(static_cast<char>(std::tolower(ch)));
+      continue;
+    }
+    // End of a word: does the text so far spell the wake phrase?
+    for (const char* phrase : kPhrases) {
+      if (words == phrase) {
+        const size_t rest = transcript.find_first_not_of(" ,.!?", i);
+        return rest == std::string::npos ? "" : transcript.substr(rest);
+      }
+    }
+    if (words.size() > 12) {
+      break;
+    }
+    if (!words.empty() && words.back() != ' ') {
+      words.push_back(' ');
+    }
   }
-  double rms = std::sqrt(sum_sq / pcm.size());
-  return static_cast<int>(rms);
+  return transcript;
 }
 
-std::vector<int16_t> RecordLocalMicPcmDynamic() {
+// Reads the mic in short chunks and feeds them, denoised, to the shared
+// log-mel stream (and from it the KWS) and the endpointer until the
+// latter completes an utterance.
+g1_common::EndpointedUtterance RecordMicPcmDynamic() {
   std::cout << "\n[Listening...] Speak now." << std::endl;
   std::cout.flush();
-  std::vector<int16_t> result;
+  const size_t chunk_samples =
+      static_cast<size_t>(g_mic->sample_rate()) * kMicChunkMs / 1000;
+  std::vector<int16_t> chunk(chunk_samples);
   bool started = false;
-  int silence_ms = 0;
-  int captured_ms = 0;
-
-  while (captured_ms < kMicMaxRecordSeconds * 1000) {
-    std::string cmd =
-        std::string("arecord -q -D ") + g_alsa_device + " -f S16_LE -r " +
-        std::to_string(kMicCaptureRate) + " -c 1 -d " +
-        std::to_string(kMicChunkSeconds) + " -t raw " + kLocalMicChunkPcm;
-    int ret = std::system(cmd.c_str());
-    if (ret != 0) {
-      std::cout << "arecord failed, ret=" << ret << std::endl;
+  while (g_capture_running.load()) {
+    const size_t read =
+        g_mic->Read(chunk.data(), chunk.size(),
+                    std::chrono::milliseconds(kMicChunkMs + 1000));
+    if (read == 0) {
+      if (g_capture_running.load()) {
+        std::cout << "Mic stream stalled (" << g_mic->name() << ")."
+                  << std::endl;
+      }
       break;
     }
-    std::vector<int16_t> chunk = ReadRawPcm(kLocalMicChunkPcm);
-    std::remove(kLocalMicChunkPcm);
-    if (chunk.empty()) {
-      break;
+    if (g_mic_envelope != nullptr) {
+      // The mic is read a chunk at a time, so the LED replays each one's
+      // envelope while the next is being captured (one chunk behind).
+      g_mic_envelope->Schedule(chunk.data(), read,
+                               std::chrono::steady_clock::now());
     }
 
-    RnnoiseChunkResult denoised = DenoiseChunk48k(chunk);
-    if (denoised.denoised.empty()) {
-      break;
+    RnnoiseChunkResult denoised = PrepareChunk(
+        std::vector<int16_t>(chunk.begin(), chunk.begin() + read));
+    const std::vector<int16_t> pcm16 =
+        g_mic->sample_rate() == kMicWhisperRate
+            ? denoised.denoised
+            : DownsampleTo16k(denoised.denoised);
+    g_mel->Push(pcm16.data(), pcm16.size());
+    if (g_kws != nullptr && g_kws->Update(*g_mel)) {
+      std::cout << "[Wake word] score=" << g_kws->last_score() << std::endl;
+      KeepAwake();
     }
-    int rms = ComputeRms(denoised.denoised);
-    if (!started) {
-      if (denoised.avg_vad >= kMicVadThresholdStart &&
-          rms >= kMicRmsThreshold) {
-        started = true;
-        std::cout << "[Speech detected]" << std::endl;
-        result.insert(result.end(), denoised.denoised.begin(),
-                      denoised.denoised.end());
-      }
-    } else {
-      result.insert(result.end(), denoised.denoised.begin(),
-                    denoised.denoised.end());
-      if (denoised.avg_vad < kMicVadThresholdContinue ||
-          rms < kMicRmsThreshold) {
-        silence_ms += kMicChunkSeconds * 1000;
-      } else {
-        silence_ms = 0;
-      }
-      if (silence_ms >= kMicSilenceStopMs) {
-        std::cout << "[End of speech]" << std::endl;
-        break;
-      }
+    if (g_endpointer->Push(denoised.denoised.data(), denoised.denoised.size(),
+                           denoised.avg_vad)) {
+      std::cout << "[End of speech]" << std::endl;
+      return g_endpointer->TakeUtterance();
+    }
+    if (g_endpointer->in_speech() != started) {
+      started = g_endpointer->in_speech();
+      std::cout << (started ? "[Speech detected]" : "[Too short, ignored]")
+                << std::endl;
     }
-    captured_ms += kMicChunkSeconds * 1000;
-  }
-
-  if (!started) {
-    return {};
   }
-
-  return result;
+  return {};
 }
 
 void CaptureThread() {
   while (g_capture_running.load()) {
-    std::vector<int16_t> pcm_data = RecordLocalMicPcmDynamic();
-    if (pcm_data.empty()) {
-      unitree::common::Sleep(1);
+    g1_common::EndpointedUtterance endpointed = RecordMicPcmDynamic();
+    if (endpointed.pcm.empty()) {
+      if (g_capture_running.load()) {
+        unitree::common::Sleep(1);
+      }
+      continue;
+    }
+    if (!IsAwake()) {
+      // The endpointer's utterance ends after the wake word's, so a
+      // "Hey G1, ..." utterance is already awake here.
+      g_kws_skipped.fetch_add(1);
+      std::cout << "[No wake word, ignored]" << std::endl;
       continue;
     }
+    QueuedUtterance utterance;
+    utterance.pcm = g_mic->sample_rate() == kMicWhisperRate
+                        ? std::move(endpointed.pcm)
+                        : DownsampleTo16k(endpointed.pcm);
+    // The frames were computed before the AGC gain; apply it in the log
+    // domain.
+    g_mel->ReadSpan(endpointed.start_sample * kMicWhisperRate /
+                        g_mic->sample_rate(),
+                    utterance.pcm.size(), endpointed.gain_db / 10.f,
+                    &utterance.mel);
+    const g1_common::SpeechVerdict verdict =
+        g_utterance_filter->CheckAudio(utterance.mel, endpointed.vad);
+    if (!verdict.speech) {
+      std::cout << "[Not speech: " << verdict.reason << "]" << std::endl;
+      continue;
+    }
+    utterance.marginal = verdict.marginal;
+    utterance.voiceprint = g_speakers->Embed(utterance.mel, utterance.pcm);
     {
       std::lock_guard<std::mutex> lock(g_queue_mutex);
-      g_pcm_queue.push_back(std::move(pcm_data));
+      g_utterance_queue.push_back(std::move(utterance));
     }
     g_queue_cv.notify_one();
   }
@@ -796,6 +1165,19 @@ void SpeakResponse(const std::string& text) {
   }
 
   std::cout << "[Speaking]: " << text << std::endl;
+  if (g_led_engine != nullptr) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = g_speech_envelope->ScheduleLevels(
+        g1_common::SyntheticSpeechEnvelope(text), start);
+    const uint32_t ms = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+            .count());
+    g_led_engine->Play(g1_common::kLedLayerSpeaking,
+                       g1_common::LedTimeline(g1_common::LedColor{0, 200, 255})
+                           .Hold(ms)
+                           .FollowEnvelope(0.1f)
+                           .Compile());
+  }
   g_audio_client->TtsMaker(text, 1);
 }
 
@@ -806,21 +1188,72 @@ int main(int argc, char const* argv[]) {
     std::cout << "Usage: conv_main [NetworkInterface(eth0)|TEST] [model_path]"
               << std::endl;
     std::cout << "Environment: GROQ_API_KEY must be set (free at https://console.groq.com/keys)" << std::endl;
+    std::cout << "  unless LLM_LOCAL_URL is" << std::endl;
     std::cout << "Optional: GROQ_MODEL (default: llama-3.3-70b-versatile)" << std::endl;
+    std::cout << "Optional: LLM_LOCAL_URL (OpenAI-compatible server such as "
+                 "llama.cpp's llama-server, e.g. http://127.0.0.1:8080; "
+                 "fallback when Groq is slow or unreachable)"
+              << std::endl;
+    std::cout << "Optional: LLM_LOCAL_MODEL (default: local), LLM_BUDGET_MS "
+                 "(default: "
+              << kLlmBudgetMs << "), LLM_HEDGE_MS (default: " << kLlmHedgeMs
+              << ")" << std::endl;
     std::cout << "Optional: CONV_SYSTEM_PROMPT (custom system prompt)"
               << std::endl;
     std::cout << "Optional: ALSA_DEVICE (default: default)" << std::endl;
+    std::cout << "Optional: MIC_SOURCE=alsa|multicast (default: alsa)"
+              << std::endl;
+    std::cout << "Optional: MIC_DENOISE=rnnoise|spectral|off (default: "
+                 "rnnoise for alsa, off for multicast)"
+              << std::endl;
+    std::cout << "Optional: G1_CAPTURE_DIR (record utterances to WAV files)"
+              << std::endl;
+    std::cout << "Optional: KWS_MODEL (DS-CNN wake word model; only talk "
+                 "after \"Hey G1\")"
+              << std::endl;
+    std::cout << "Optional: CONV_CACHE=<file>|off (default: "
+              << kDefaultCachePath << "), CONV_CACHE_TTL_S, CONV_CACHE_MAX_MB"
+              << std::endl;
     return 1;
   }
 
+  const char* local_url_env = std::getenv("LLM_LOCAL_URL");
+  if (local_url_env != nullptr && std::string(local_url_env).length() > 0) {
+    g_local_llm_url = local_url_env;
+    if (g_local_llm_url.find("/chat/completions") == std::string::npos) {
+      while (!g_local_llm_url.empty() && g_local_llm_url.back() == '/') {
+        g_local_llm_url.pop_back();
+      }
+      g_local_llm_url += "/v1/chat/completions";
+    }
+  }
+  const char* local_model_env = std::getenv("LLM_LOCAL_MODEL");
+  if (local_model_env != nullptr &&
+      std::string(local_model_env).length() > 0) {
+    g_local_llm_model = local_model_env;
+  }
+
   const char* api_key_env = std::getenv("GROQ_API_KEY");
-  if (api_key_env == nullptr || std::string(api_key_env).empty()) {
+  if (api_key_env != nullptr && std::string(api_key_env).length() > 0) {
+    g_groq_api_key = api_key_env;
+  } else if (g_local_llm_url.empty()) {
     std::cout << "Error: GROQ_API_KEY environment variable not set."
               << std::endl;
     std::cout << "Get free API key at: https://console.groq.com/keys" << std::endl;
+    std::cout << "Or set LLM_LOCAL_URL to use a local model." << std::endl;
     return 1;
   }
-  g_groq_api_key = api_key_env;
+
+  int llm_budget_ms = kLlmBudgetMs;
+  const char* budget_env = std::getenv("LLM_BUDGET_MS");
+  if (budget_env != nullptr && std::atoi(budget_env) > 0) {
+    llm_budget_ms = std::atoi(budget_env);
+  }
+  int llm_hedge_ms = kLlmHedgeMs;
+  const char* hedge_env = std::getenv("LLM_HEDGE_MS");
+  if (hedge_env != nullptr && std::string(hedge_env).length() > 0) {
+    llm_hedge_ms = std::max(0, std::atoi(hedge_env));
+  }
 
   const char* model_env = std::getenv("GROQ_MODEL");
   if (model_env != nullptr && std::string(model_env).length() > 0) {
@@ -866,8 +1299,100 @@ int main(int argc, char const* argv[]) {
 
   const bool is_test = (std::string(argv[1]) == "TEST");
 
+  std::unique_ptr<g1_common::CaptureSource> mic;
+  if (g1_common::MicPipelineFromEnv(&g_mic_pipeline)) {
+    mic = g1_common::MakeCaptureSource(g_mic_pipeline, g_alsa_device,
+                                       is_test ? "" : argv[1]);
+  }
+  g1_common::SpectralDenoiser spectral_denoiser;
+  g_spectral_denoiser = &spectral_denoiser;
+  if (!mic || !mic->Start()) {
+    std::cout << "Failed to start microphone capture." << std::endl;
+    rnnoise_destroy(g_rnnoise_state);
+    whisper_free(g_whisper_ctx);
+    curl_global_cleanup();
+    return 1;
+  }
+  g_mic = mic.get();
+  g1_common::EndpointerOptions endpoint_options;
+  endpoint_options.end_silence_ms = kMicSilenceStopMs;
+  endpoint_options.max_utterance_ms = kMicMaxRecordSeconds * 1000;
+  endpoint_options.vad_threshold = kMicVadThreshold;
+  g1_common::SpeechEndpointer endpointer(mic->sample_rate(), endpoint_options);
+  g_endpointer = &endpointer;
+  g1_common::MelStream mel_stream(kMelRingFrames);
+  g_mel = &mel_stream;
+  g1_common::UtteranceFilterOptions filter_options;
+  if (g_mic_pipeline.denoise == g1_common::MicDenoise::kSpectral) {
+    // SpectralDenoiser's probability is a mean Wiener gain and runs lower
+    // than RNNoise's VAD on the same speech.
+    filter_options.vad_speech = 0.3f;
+  }
+  g1_common::UtteranceFilter utterance_filter(mel_stream.frontend().options(),
+                                              filter_options);
+  g_utterance_filter = &utterance_filter;
+  g1_common::SpeakerTracker speakers(mel_stream.n_mels());
+  g_speakers = &speakers;
+
+  // KWS_MODEL=<file> gates transcription on the "Hey G1" wake word.
+  g1_common::KeywordSpotter kws;
+  const char* kws_env = std::getenv("KWS_MODEL");
+  if (kws_env != nullptr && std::string(kws_env).length() > 0) {
+    if (!kws.Load(kws_env)) {
+      std::cout << "Failed to load KWS model." << std::endl;
+      mic->Stop();
+      rnnoise_destroy(g_rnnoise_state);
+      whisper_free(g_whisper_ctx);
+      curl_global_cleanup();
+      return 1;
+    }
+    g_kws = &kws;
+  }
+
+  // Declared before led_engine, whose thread reads them until it is
+  // destroyed.
+  g1_common::PlaybackEnvelope mic_envelope(mic->sample_rate());
+  g1_common::PlaybackEnvelope speech_envelope(kTtsPlaybackRate);
   std::unique_ptr<unitree::robot::g1::AudioClient> audio_client;
   std::unique_ptr<unitree::robot::g1::G1ArmActionClient> arm_client;
+  std::unique_ptr<g1_common::RpcExecutor> arm_rpc;
+  std::unique_ptr<g1_common::LedScheduler> leds;
+  std::unique_ptr<g1_common::SchedulerLedSink> led_sink;
+  std::unique_ptr<g1_common::LedAnimationEngine> led_engine;
+  std::unique_ptr<g1_common::LlmRouter> llm =
+      MakeLlmRouter("llm", llm_budget_ms, llm_hedge_ms, true);
+  g_llm = llm.get();
+  // A summary on the local server would hold it while a reply waits, so
+  // without Groq old turns are dropped instead of summarised.
+  std::unique_ptr<g1_common::LlmRouter> summary_llm =
+      MakeLlmRouter("summary_llm", kSummaryBudgetMs, llm_hedge_ms, false);
+  g_summary_llm = summary_llm->size() > 0 ? summary_llm.get() : nullptr;
+  auto summary_rpc = std::make_unique<g1_common::RpcExecutor>("summary");
+  g_summary_rpc = summary_rpc.get();
+
+  // CONV_CACHE=<file> keeps replies and search results across restarts;
+  // "off" disables it.
+  g1_common::ResponseCacheOptions cache_options;
+  cache_options.ttl_s = kCacheReplyTtlS;
+  cache_options.max_bytes = kCacheMaxMb << 20;
+  const char* cache_ttl_env = std::getenv("CONV_CACHE_TTL_S");
+  if (cache_ttl_env != nullptr && std::atoll(cache_ttl_env) > 0) {
+    cache_options.ttl_s = std::atoll(cache_ttl_env);
+  }
+  const char* cache_mb_env = std::getenv("CONV_CACHE_MAX_MB");
+  if (cache_mb_env != nullptr && std::atoll(cache_mb_env) > 0) {
+    cache_options.max_bytes = static_cast<size_t>(std::atoll(cache_mb_env))
+                              << 20;
+  }
+  std::string cache_path = kDefaultCachePath;
+  const char* cache_env = std::getenv("CONV_CACHE");
+  if (cache_env != nullptr && std::string(cache_env).length() > 0) {
+    cache_path = cache_env;
+  }
+  g1_common::ResponseCache response_cache(cache_options);
+  if (cache_path != "off" && response_cache.Open(cache_path)) {
+    g_response_cache = &response_cache;
+  }
   if (!is_test) {
     unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
     audio_client = std::make_unique<unitree::robot::g1::AudioClient>();
@@ -879,39 +1404,100 @@ int main(int argc, char const* argv[]) {
     arm_client->Init();
     arm_client->SetTimeout(10.0f);
     g_arm_client = arm_client.get();
+    arm_rpc = std::make_unique<g1_common::RpcExecutor>("arm");
+    g_arm_rpc = arm_rpc.get();
+
+    auto* audio = audio_client.get();
+    leds = std::make_unique<g1_common::LedScheduler>(
+        [audio](uint8_t r, uint8_t g, uint8_t b) {
+          return audio->LedControl(r, g, b);
+        });
+    led_sink = std::make_unique<g1_common::SchedulerLedSink>(leds.get());
+    g1_common::LedEnvelopeOptions passthrough;
+    passthrough.attack_ms = 0.f;
+    passthrough.release_ms = 0.f;
+    led_engine = std::make_unique<g1_common::LedAnimationEngine>(
+        led_sink.get(), 20, passthrough);
+    g_mic_envelope = &mic_envelope;
+    g_speech_envelope = &speech_envelope;
+    led_engine->SetEnvelopeSource([&mic_envelope, &speech_envelope] {
+      const auto now = std::chrono::steady_clock::now();
+      return speech_envelope.end() > now ? speech_envelope.LevelAt(now)
+                                         : mic_envelope.LevelAt(now);
+    });
+    led_engine->Play(g1_common::kLedLayerListening,
+                     g1_common::LedTimeline(g1_common::LedColor{0, 0, 255})
+                         .Hold(1000)
+                         .Loop()
+                         .FollowEnvelope(0.15f)
+                         .Compile());
+    led_engine->Start();
+    g_led_engine = led_engine.get();
   }
 
   std::cout << "\n========================================" << std::endl;
   std::cout << "G1 Conversational Mode" << std::endl;
   std::cout << "========================================" << std::endl;
-  std::cout << "Model: " << g_groq_model << std::endl;
-  std::cout << "Audio: " << g_alsa_device << std::endl;
+  std::cout << "LLM: ";
+  for (size_t i = 0; i < llm->size(); ++i) {
+    std::cout << (i > 0 ? ", then " : "") << llm->backend(i).name();
+  }
+  std::cout << " (budget " << llm_budget_ms << " ms)" << std::endl;
+  std::cout << "Audio: " << mic->name()
+            << " (denoise: " << g_mic_pipeline.denoise_name() << ")"
+            << std::endl;
+  std::cout << "Wake word: "
+            << (g_kws != nullptr ? "Hey G1 (" + std::string(kws_env) + ")"
+                                 : std::string("off"))
+            << std::endl;
+  std::cout << "Cache: "
+            << (g_response_cache != nullptr ? cache_path : std::string("off"))
+            << std::endl;
   std::cout << "Mode: " << (is_test ? "TEST (no robot)" : "LIVE") << std::endl;
   std::cout << "Press Ctrl+C to exit." << std::endl;
   std::cout << "========================================\n" << std::endl;
 
+  // G1_CAPTURE_DIR=<dir> records every utterance Whisper sees, for ASR
+  // debugging.
+  std::unique_ptr<g1_common::WavWriter> capture_wav =
+      g1_common::OpenCaptureRecorder("conv", kMicWhisperRate);
+
   std::thread capture_thread(CaptureThread);
-  capture_thread.detach();
 
   while (true) {
-    std::vector<int16_t> pcm_data;
+    QueuedUtterance utterance;
     {
       std::unique_lock<std::mutex> lock(g_queue_mutex);
-      g_queue_cv.wait(lock, [] { return !g_pcm_queue.empty(); });
-      pcm_data = std::move(g_pcm_queue.front());
-      g_pcm_queue.pop_front();
+      g_queue_cv.wait(lock, [] { return !g_utterance_queue.empty(); });
+      utterance = std::move(g_utterance_queue.front());
+      g_utterance_queue.pop_front();
     }
-
-    std::vector<int16_t> whisper_pcm = DownsampleTo16k(pcm_data);
-    if (whisper_pcm.empty()) {
+    if (utterance.pcm.empty()) {
       continue;
     }
 
-    std::string transcript = TranscribeWithWhisper(whisper_pcm);
+    if (capture_wav) {
+      capture_wav->Write(utterance.pcm.data(), utterance.pcm.size());
+    }
+
+    std::string transcript = TranscribeWithWhisper(utterance);
     if (transcript.empty()) {
       std::cout << "[No speech detected]" << std::endl;
       continue;
     }
+    if (!g_utterance_filter->CheckTranscript(transcript,
+                                             utterance.marginal)) {
+      std::cout << "[Ignoring Whisper filler]: " << transcript << std::endl;
+      continue;
+    }
+    if (g_kws != nullptr) {
+      KeepAwake();
+      transcript = StripWakePhrase(transcript);
+      if (transcript.empty()) {
+        std::cout << "[Wake word only, listening]" << std::endl;
+        continue;
+      }
+    }
 
     std::string normalized = Normalize(transcript);
     if (normalized.length() < 2) {
@@ -919,6 +1505,7 @@ int main(int argc, char const* argv[]) {
       continue;
     }
 
+    SelectSpeaker(utterance);
     std::cout << "\n[You said]: " << transcript << std::endl;
 
     if (normalized == "goodbye" || normalized == "bye" ||
@@ -939,7 +1526,7 @@ int main(int argc, char const* argv[]) {
     if (normalized == "clear history" || normalized == "reset conversation" ||
         normalized == "start over") {
       std::lock_guard<std::mutex> lock(g_history_mutex);
-      g_conversation_history.clear();
+      g_conversation_histories.erase(g_current_speaker);
       SpeakResponse("Conversation history cleared. Let's start fresh!");
       continue;
     }
@@ -973,12 +1560,69 @@ int main(int argc, char const* argv[]) {
 
     AddToHistory("user", transcript);
     AddToHistory("assistant", ai_response);
+    MaybeSummarize(CurrentContext());
+    MaybeCompactCache();
 
     std::cout << "[G1]: " << ai_response << std::endl;
     SpeakResponse(ai_response);
   }
 
+  // The capture thread reaches main's mic, endpointer, mel stream and
+  // friends through the globals; stopping the mic ends its Read().
   g_capture_running.store(false);
+  mic->Stop();
+  capture_thread.join();
+  mic->PrintStats();
+  endpointer.PrintStats();
+  mel_stream.PrintStats();
+  utterance_filter.PrintStats();
+  speakers.PrintStats();
+  if (g_kws != nullptr) {
+    kws.PrintStats();
+    std::cout << "[kws] utterances ignored without wake word: "
+              << g_kws_skipped.load() << " (ASR and LLM calls avoided)"
+              << std::endl;
+  }
+  if (led_engine) {
+    g_led_engine = nullptr;
+    g_mic_envelope = nullptr;
+    led_engine->Stop();
+    leds->SetTarget(g1_common::LedColor{});
+    leds->Flush();
+    leds->PrintStats();
+  }
+  if (arm_rpc) {
+    arm_rpc->Drain();
+    arm_rpc->PrintStats();
+  }
+  if (capture_wav) {
+    capture_wav->Close();
+    capture_wav->PrintStats();
+  }
+  // Waits for a summary in flight, then cancels and waits for requests
+  // still running on a backend; curl must outlive them.
+  g_summary_rpc = nullptr;
+  summary_rpc.reset();
+  llm->PrintStats();
+  summary_llm->PrintStats();
+  g_llm = nullptr;
+  g_summary_llm = nullptr;
+  llm.reset();
+  summary_llm.reset();
+  for (const auto& entry : g_conversation_histories) {
+    const g1_common::ConversationContextStats stats = entry.second->stats();
+    std::cout << "[context] speaker=" << entry.first
+              << " tokens=" << entry.second->tokens()
+              << " messages=" << stats.messages
+              << " summaries=" << stats.summaries
+              << " summarised=" << stats.summarised
+              << " dropped=" << stats.dropped
+              << " requests=" << stats.requests
+              << " prefix_rebuilds=" << stats.prefix_rebuilds << std::endl;
+  }
+  if (g_response_cache != nullptr) {
+    g_response_cache->PrintStats();
+  }
   rnnoise_destroy(g_rnnoise_state);
   whisper_free(g_whisper_ctx);
   curl_global_cleanup();
@@ -0,0 +1,179 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "llm_backend.hpp"
+
+// Checks LlmRouter against scripted backends: the preferred backend
+// answering alone, fail-over, hedging, the budget and late counting.
+// Runs in a few seconds; exits non-zero if any check fails.
+
+namespace {
+
+// Answers (or fails) after `delay_ms`, returning early once cancelled.
+class FakeBackend : public g1_common::LlmBackend {
+ public:
+  FakeBackend(std::string name, int delay_ms, bool ok)
+      : name_(std::move(name)), delay_ms_(delay_ms), ok_(ok) {}
+
+  std::string name() const override { return name_; }
+
+  bool Complete(const g1_common::LlmRequest& request,
+                const std::atomic<bool>& cancel,
+                std::string* reply) override {
+    const auto until = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(delay_ms_);
+    while (std::chrono::steady_clock::now() < until) {
+      if (cancel.load()) {
+        *reply = "Error: " + name_ + " cancelled.";
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    *reply = ok_ ? name_ + ":" + request.messages_json
+                 : "Error: " + name_ + " is down.";
+    return ok_;
+  }
+
+ private:
+  std::string name_;
+  int delay_ms_;
+  bool ok_;
+};
+
+struct Outcome {
+  bool ok = false;
+  int winner = -1;
+  std::string reply;
+  double elapsed_ms = 0.0;
+};
+
+// A cloud backend and a local one, hedged after 200 ms within 600 ms.
+std::unique_ptr<g1_common::LlmRouter> MakeRouter(int cloud_ms, bool cloud_ok,
+                                                 int local_ms, bool local_ok) {
+  g1_common::LlmRouterOptions options;
+  options.budget_ms = 600;
+  options.hedge_after_ms = 200;
+  auto router = std::make_unique<g1_common::LlmRouter>(options);
+  router->Add(std::make_unique<FakeBackend>("cloud", cloud_ms, cloud_ok));
+  router->Add(std::make_unique<FakeBackend>("local", local_ms, local_ok));
+  return router;
+}
+
+Outcome Ask(g1_common::LlmRouter* router, const std::string& question) {
+  Outcome out;
+  const auto start = std::chrono::steady_clock::now();
+  out.ok = router->Complete({question}, &out.reply, &out.winner);
+  out.elapsed_ms = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return out;
+}
+
+// Waits for cancelled losers to report back.
+g1_common::LlmRouterStats SettledStats(const g1_common::LlmRouter& router,
+                                       uint64_t expected_late) {
+  for (int i = 0; i < 100; ++i) {
+    const g1_common::LlmRouterStats stats = router.stats();
+    uint64_t late = 0;
+    for (const auto& backend : stats.backends) {
+      late += backend.late;
+    }
+    if (late >= expected_late) {
+      return stats;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return router.stats();
+}
+
+int failures = 0;
+
+void Check(bool condition, const std::string& what) {
+  std::cout << (condition ? "  ok   " : "  FAIL ") << what << std::endl;
+  if (!condition) {
+    ++failures;
+  }
+}
+
+}  // namespace
+
+int main() {
+  {
+    std::cout << "preferred backend answers before the hedge" << std::endl;
+    auto router = MakeRouter(50, true, 50, true);
+    const Outcome out = Ask(router.get(), "q");
+    Check(out.ok && out.winner == 0 && out.reply == "cloud:q",
+          "cloud's reply");
+    Check(out.elapsed_ms < 150, "no hedge wait");
+    const auto stats = SettledStats(*router, 0);
+    Check(stats.backends[0].wins == 1, "cloud win counted");
+    Check(stats.backends[1].wins + stats.backends[1].failures +
+                  stats.backends[1].late ==
+              0,
+          "local never started");
+  }
+  {
+    std::cout << "fail-over starts the fallback at once" << std::endl;
+    auto router = MakeRouter(20, false, 50, true);
+    const Outcome out = Ask(router.get(), "q");
+    Check(out.ok && out.winner == 1 && out.reply == "local:q",
+          "local's reply");
+    Check(out.elapsed_ms < 150, "before the hedge delay");
+    const auto stats = router->stats();
+    Check(stats.backends[0].failures == 1 && stats.backends[1].wins == 1,
+          "cloud failure and local win counted");
+  }
+  {
+    std::cout << "slow preferred backend is hedged" << std::endl;
+    auto router = MakeRouter(2000, true, 100, true);
+    const Outcome out = Ask(router.get(), "q");
+    Check(out.ok && out.winner == 1, "local wins");
+    Check(out.elapsed_ms >= 250 && out.elapsed_ms < 450,
+          "answered hedge + local delay in (" +
+              std::to_string(static_cast<int>(out.elapsed_ms)) + " ms)");
+    const auto stats = SettledStats(*router, 1);
+    Check(stats.backends[0].late == 1 && stats.backends[0].failures == 0,
+          "cancelled cloud counted late, not failed");
+  }
+  {
+    std::cout << "budget expires" << std::endl;
+    auto router = MakeRouter(2000, true, 2000, true);
+    const Outcome out = Ask(router.get(), "q");
+    Check(!out.ok && out.winner == -1, "no reply");
+    Check(out.reply.find("no reply within 600 ms") != std::string::npos,
+          "timeout message");
+    Check(out.elapsed_ms >= 590 && out.elapsed_ms < 800, "within budget");
+    const auto stats = SettledStats(*router, 2);
+    Check(stats.timeouts == 1 && stats.failures == 0, "timeout counted");
+    Check(stats.backends[0].late == 1 && stats.backends[1].late == 1,
+          "both backends counted late");
+    const Outcome next = Ask(router.get(), "q2");
+    Check(!next.ok && next.elapsed_ms < 800,
+          "next request isn't stuck behind the last");
+  }
+  {
+    std::cout << "every backend fails" << std::endl;
+    auto router = MakeRouter(20, false, 20, false);
+    const Outcome out = Ask(router.get(), "q");
+    Check(!out.ok && out.reply == "Error: cloud is down.",
+          "preferred backend's error");
+    const auto stats = router->stats();
+    Check(stats.failures == 1 && stats.timeouts == 0, "failure counted");
+    Check(stats.backends[0].failures == 1 && stats.backends[1].failures == 1,
+          "both backend failures counted");
+  }
+  {
+    std::cout << "no backends" << std::endl;
+    g1_common::LlmRouter router;
+    std::string reply;
+    Check(!router.Complete({"q"}, &reply) && !reply.empty(), "error reply");
+  }
+
+  std::cout << (failures == 0 ? "PASS" : "FAIL") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "response_cache.hpp"
+
+// Checks ResponseCache against a scratch file: compaction keeping the
+// newest entries (also when run twice), puts during compaction, reopening
+// and a torn tail. Exits non-zero if any check fails.
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const std::string& what) {
+  std::cout << (condition ? "  ok   " : "  FAIL ") << what << std::endl;
+  if (!condition) {
+    ++failures;
+  }
+}
+
+std::string Value(int i) { return std::string(200, 'v') + std::to_string(i); }
+
+// Puts keys `prefix`0, 1, ... until the file needs compaction; returns
+// how many.
+int Fill(g1_common::ResponseCache* cache, const std::string& prefix) {
+  int count = 0;
+  while (!cache->NeedsCompaction() &&
+         cache->Put(prefix + std::to_string(count), Value(count))) {
+    ++count;
+  }
+  return count;
+}
+
+// True if the keys still cached are a non-empty suffix of `keys` (in put
+// order) with their values intact.
+bool KeepsNewest(g1_common::ResponseCache* cache,
+                 const std::vector<std::string>& keys) {
+  std::string value;
+  bool kept = false;
+  for (const std::string& key : keys) {
+    const bool hit = cache->Lookup(key, &value);
+    if (kept && !hit) {
+      std::cout << "  " << key << " dropped after an older key was kept"
+                << std::endl;
+      return false;
+    }
+    kept = kept || hit;
+  }
+  return kept;
+}
+
+}  // namespace
+
+int main() {
+  const std::string path =
+      "/tmp/g1_response_cache_test." + std::to_string(getpid());
+  g1_common::ResponseCacheOptions options;
+  options.max_bytes = 64 * 1024;
+  std::string value;
+  std::vector<std::string> keys;
+
+  unlink(path.c_str());
+  {
+    std::cout << "compaction keeps the newest entries" << std::endl;
+    g1_common::ResponseCache cache(options);
+    Check(cache.Open(path), "opened");
+    const int filled = Fill(&cache, "a");
+    for (int i = 0; i < filled; ++i) {
+      keys.push_back("a" + std::to_string(i));
+    }
+    Check(cache.NeedsCompaction(), "over max_bytes after " +
+                                       std::to_string(filled) + " puts");
+    Check(cache.Lookup("a0", &value), "nothing dropped before compaction");
+    Check(cache.Compact() && !cache.NeedsCompaction(), "compacted");
+    Check(!cache.Lookup("a0", &value), "oldest entry dropped");
+    Check(KeepsNewest(&cache, keys), "newest entries kept");
+
+    std::cout << "compacting again keeps the newest entries" << std::endl;
+    for (int i = 0; i < 5; ++i) {
+      keys.push_back("b" + std::to_string(i));
+      Check(cache.Put(keys.back(), Value(i)), "put " + keys.back());
+    }
+    Check(cache.Compact(), "compacted twice");
+    Check(KeepsNewest(&cache, keys), "newest entries kept");
+    const int refilled = Fill(&cache, "c");
+    for (int i = 0; i < refilled; ++i) {
+      keys.push_back("c" + std::to_string(i));
+    }
+    Check(cache.Compact(), "compacted three times");
+    Check(KeepsNewest(&cache, keys), "newest entries kept");
+    Check(cache.Lookup("c" + std::to_string(refilled - 1), &value) &&
+              value == Value(refilled - 1),
+          "last put kept");
+
+    std::cout << "puts during compaction are carried over" << std::endl;
+    Fill(&cache, "d");
+    std::thread compactor([&cache] { cache.Compact(); });
+    for (int i = 0; i < 20; ++i) {
+      cache.Put("e" + std::to_string(i), Value(i));
+      cache.Lookup("d0", &value);
+    }
+    compactor.join();
+    bool all = true;
+    for (int i = 0; i < 20; ++i) {
+      all = all && cache.Lookup("e" + std::to_string(i), &value) &&
+            value == Value(i);
+    }
+    Check(all, "every concurrent put kept");
+    Check(cache.stats().compactions == 4, "four compactions counted");
+    cache.PrintStats();
+  }
+  {
+    std::cout << "reopening keeps the entries" << std::endl;
+    g1_common::ResponseCache cache(options);
+    Check(cache.Open(path), "reopened");
+    Check(cache.Lookup("e19", &value) && value == Value(19), "entry read back");
+  }
+  {
+    std::cout << "a torn tail is dropped" << std::endl;
+    FILE* file = fopen(path.c_str(), "ab");
+    fwrite("\x31\x47\x31\x52torn", 1, 8, file);
+    fclose(file);
+    g1_common::ResponseCache cache(options);
+    Check(cache.Open(path), "reopened");
+    Check(cache.stats().torn_bytes == 8, "8 bytes dropped");
+    Check(cache.Lookup("e19", &value) && value == Value(19), "entries intact");
+  }
+  unlink(path.c_str());
+
+  std::cout << (failures == 0 ? "PASS" : "FAIL") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
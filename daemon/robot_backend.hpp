@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unitree/robot/channel/channel_factory.hpp>
+#include <unitree/robot/g1/arm/g1_arm_action_client.hpp>
+#include <unitree/robot/g1/audio/g1_audio_client.hpp>
+#include <unitree/robot/g1/loco/g1_loco_client.hpp>
+
+#include "robot_protocol.hpp"
+
+namespace g1_daemon {
+
+// What the daemon drives. Calls for one subsystem (audio, loco, arm) are
+// serialised by the daemon; calls for different subsystems may overlap.
+class RobotBackend {
+ public:
+  virtual ~RobotBackend() = default;
+
+  virtual int32_t TtsMaker(const std::string& text, int32_t speaker_id) = 0;
+  virtual int32_t LedControl(uint8_t r, uint8_t g, uint8_t b) = 0;
+  virtual int32_t GetVolume(uint8_t& volume) = 0;
+  virtual int32_t SetVolume(uint8_t volume) = 0;
+  virtual int32_t PlayStream(const std::string& app,
+                             const std::string& stream_id,
+                             const std::vector<uint8_t>& pcm) = 0;
+  virtual int32_t PlayStop(const std::string& app) = 0;
+
+  virtual int32_t Loco(LocoCommand command) = 0;
+  virtual int32_t SetFsmId(int fsm_id) = 0;
+  virtual int32_t GetFsmId(int& fsm_id) = 0;
+  virtual int32_t SetVelocity(float vx, float vy, float omega,
+                              float duration) = 0;
+
+  virtual int32_t ExecuteAction(int32_t action_id) = 0;
+  virtual int32_t ExecuteAction(const std::string& action_name) = 0;
+  virtual int32_t StopCustomAction() = 0;
+};
+
+// Owns the real SDK clients. The channel factory and all three clients are
+// initialised once, when the daemon starts.
+class UnitreeRobotBackend : public RobotBackend {
+ public:
+  explicit UnitreeRobotBackend(const std::string& network_interface) {
+    unitree::robot::ChannelFactory::Instance()->Init(0, network_interface);
+    audio_.Init();
+    audio_.SetTimeout(10.0f);
+    loco_.Init();
+    loco_.SetTimeout(10.f);
+    arm_.Init();
+    arm_.SetTimeout(10.f);
+  }
+
+  int32_t TtsMaker(const std::string& text, int32_t speaker_id) override {
+    return audio_.TtsMaker(text, speaker_id);
+  }
+  int32_t LedControl(uint8_t r, uint8_t g, uint8_t b) override {
+    return audio_.LedControl(r, g, b);
+  }
+  int32_t GetVolume(uint8_t& volume) override {
+    return audio_.GetVolume(volume);
+  }
+  int32_t SetVolume(uint8_t volume) override {
+    return audio_.SetVolume(volume);
+  }
+  int32_t PlayStream(const std::string& app, const std::string& stream_id,
+                     const std::vector<uint8_t>& pcm) override {
+    return audio_.PlayStream(app, stream_id, pcm);
+  }
+  int32_t PlayStop(const std::string& app) override {
+    return audio_.PlayStop(app);
+  }
+
+  int32_t Loco(LocoCommand command) override {
+    switch (command) {
+      case kLocoDamp:         return loco_.Damp();
+      case kLocoStart:        return loco_.Start();
+      case kLocoSquat:        return loco_.Squat();
+      case kLocoSit:          return loco_.Sit();
+      case kLocoStandUp:      return loco_.StandUp();
+      case kLocoZeroTorque:   return loco_.ZeroTorque();
+      case kLocoStopMove:     return loco_.StopMove();
+      case kLocoHighStand:    return loco_.HighStand();
+      case kLocoLowStand:     return loco_.LowStand();
+      case kLocoBalanceStand: return loco_.BalanceStand();
+      case kLocoWaveHand:     return loco_.WaveHand();
+      case kLocoShakeHand:    return loco_.ShakeHand();
+    }
+    return kErrBadPayload;
+  }
+  int32_t SetFsmId(int fsm_id) override { return loco_.SetFsmId(fsm_id); }
+  int32_t GetFsmId(int& fsm_id) override { return loco_.GetFsmId(fsm_id); }
+  int32_t SetVelocity(float vx, float vy, float omega,
+                      float duration) override {
+    return loco_.SetVelocity(vx, vy, omega, duration);
+  }
+
+  int32_t ExecuteAction(int32_t action_id) override {
+    return arm_.ExecuteAction(action_id);
+  }
+  int32_t ExecuteAction(const std::string& action_name) override {
+    return arm_.ExecuteAction(action_name);
+  }
+  int32_t StopCustomAction() override { return arm_.StopCustomAction(); }
+
+ private:
+  unitree::robot::g1::AudioClient audio_;
+  unitree::robot::g1::LocoClient loco_;
+  unitree::robot::g1::G1ArmActionClient arm_;
+};
+
+// Stand-in used with TEST: logs every call and keeps just enough state
+// (volume, FSM id) for reads to reflect earlier writes.
+class MockRobotBackend : public RobotBackend {
+ public:
+  int32_t TtsMaker(const std::string& text, int32_t speaker_id) override {
+    return Log("TtsMaker(\"" + text + "\", " + std::to_string(speaker_id) +
+               ")");
+  }
+  int32_t LedControl(uint8_t r, uint8_t g, uint8_t b) override {
+    return Log("LedControl(" + std::to_string(r) + ", " + std::to_string(g) +
+               ", " + std::to_string(b) + ")");
+  }
+  int32_t GetVolume(uint8_t& volume) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    volume = volume_;
+    return 0;
+  }
+  int32_t SetVolume(uint8_t volume) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      volume_ = volume;
+    }
+    return Log("SetVolume(" + std::to_string(volume) + ")");
+  }
+  int32_t PlayStream(const std::string& app, const std::string& stream_id,
+                     const std::vector<uint8_t>& pcm) override {
+    return Log("PlayStream(" + app + ", " + stream_id + ", " +
+               std::to_string(pcm.size()) + " bytes)");
+  }
+  int32_t PlayStop(const std::string& app) override {
+    return Log("PlayStop(" + app + ")");
+  }
+
+  int32_t Loco(LocoCommand command) override {
+    static const int kFsmFor[] = {1, 500, 2, 3, 4, 0};
+    if (command <= kLocoZeroTorque) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fsm_id_ = kFsmFor[command];
+    }
+    return Log("Loco(" + std::to_string(command) + ")");
+  }
+  int32_t SetFsmId(int fsm_id) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fsm_id_ = fsm_id;
+    }
+    return Log("SetFsmId(" + std::to_string(fsm_id) + ")");
+  }
+  int32_t GetFsmId(int& fsm_id) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fsm_id = fsm_id_;
+    return 0;
+  }
+  int32_t SetVelocity(float vx, float vy, float omega,
+                      float duration) override {
+    return Log("SetVelocity(" + std::to_string(vx) + ", " +
+               std::to_string(vy) + ", " + std::to_string(omega) + ", " +
+               std::to_string(duration) + ")");
+  }
+
+  int32_t ExecuteAction(int32_t action_id) override {
+    return Log("ExecuteAction(" + std::to_string(action_id) + ")");
+  }
+  int32_t ExecuteAction(const std::string& action_name) override {
+    return Log("ExecuteAction(\"" + action_name + "\")");
+  }
+  int32_t StopCustomAction() override { return Log("StopCustomAction()"); }
+
+ private:
+  int32_t Log(const std::string& call) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "[mock] " << call << std::endl;
+    return 0;
+  }
+
+  std::mutex mutex_;
+  uint8_t volume_ = 80;
+  int fsm_id_ = 1;
+};
+
+}  // namespace g1_daemon
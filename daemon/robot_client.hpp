@@ -0,0 +1,262 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "robot_protocol.hpp"
+
+namespace g1_daemon {
+
+// Socket path: $G1_ROBOTD_SOCKET, or kDefaultSocketPath.
+inline std::string DaemonSocketPath() {
+  const char* env = std::getenv("G1_ROBOTD_SOCKET");
+  return env != nullptr && env[0] != '\0' ? env : kDefaultSocketPath;
+}
+
+// Blocking client for the robot daemon. Its methods mirror AudioClient,
+// LocoClient and G1ArmActionClient, so code templated on those clients
+// (e.g. the FSM sequence runner) can run through the daemon unchanged.
+// Every call returns the SDK's return code, or kErrDisconnected.
+class RobotDaemonClient {
+ public:
+  RobotDaemonClient() = default;
+  ~RobotDaemonClient() { Disconnect(); }
+
+  RobotDaemonClient(const RobotDaemonClient&) = delete;
+  RobotDaemonClient& operator=(const RobotDaemonClient&) = delete;
+
+  // SDK-style Init(): connect to the default socket.
+  void Init() { Connect(DaemonSocketPath()); }
+
+  bool Connect(const std::string& path) {
+    Disconnect();
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (fd_ < 0 ||
+        connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+      std::cerr << "Failed to connect to robot daemon at " << path
+                << " (errno=" << errno << ")" << std::endl;
+      Disconnect();
+      return false;
+    }
+    ApplyTimeout();
+    return true;
+  }
+
+  void Disconnect() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  bool connected() const { return fd_ >= 0; }
+
+  // Receive timeout per call, like the SDK clients' SetTimeout.
+  void SetTimeout(float seconds) {
+    timeout_s_ = seconds;
+    ApplyTimeout();
+  }
+
+  // Sends one request and waits for its response. `*response` receives the
+  // payload after the return code.
+  int32_t Call(uint16_t opcode, const std::vector<uint8_t>& payload,
+               std::vector<uint8_t>* response = nullptr) {
+    if (fd_ < 0) {
+      return kErrDisconnected;
+    }
+    const uint32_t id = ++next_id_;
+    send_buffer_.clear();
+    EncodeMessage(opcode, 0, id, payload, &send_buffer_);
+    if (!WriteAll(send_buffer_.data(), send_buffer_.size())) {
+      Disconnect();
+      return kErrDisconnected;
+    }
+    while (true) {
+      MessageHeader header;
+      if (!ReadAll(&header, sizeof(header)) ||
+          header.magic != kProtocolMagic || header.length > kMaxPayload) {
+        Disconnect();
+        return kErrDisconnected;
+      }
+      receive_buffer_.resize(header.length);
+      if (!ReadAll(receive_buffer_.data(), header.length)) {
+        Disconnect();
+        return kErrDisconnected;
+      }
+      // Only one call is ever in flight; skip anything that isn't its answer.
+      if (header.request_id != id) {
+        continue;
+      }
+      PayloadReader reader(receive_buffer_.data(), receive_buffer_.size());
+      const int32_t ret = reader.I32();
+      if (!reader.ok()) {
+        return kErrBadPayload;
+      }
+      if (response != nullptr) {
+        response->assign(receive_buffer_.begin() + sizeof(int32_t),
+                         receive_buffer_.end());
+      }
+      return ret;
+    }
+  }
+
+  int32_t Ping() { return Call(kPing, {}); }
+
+  // AudioClient
+  int32_t TtsMaker(const std::string& text, int32_t speaker_id) {
+    std::vector<uint8_t> p;
+    PayloadWriter w(&p);
+    w.Str(text);
+    w.I32(speaker_id);
+    return Call(kTts, p);
+  }
+  int32_t LedControl(uint8_t r, uint8_t g, uint8_t b) {
+    return Call(kLed, {r, g, b});
+  }
+  int32_t GetVolume(uint8_t& volume) {
+    std::vector<uint8_t> out;
+    const int32_t ret = Call(kGetVolume, {}, &out);
+    PayloadReader reader(out.data(), out.size());
+    const uint8_t v = reader.U8();
+    if (ret == 0 && reader.ok()) {
+      volume = v;
+    }
+    return ret;
+  }
+  int32_t SetVolume(uint8_t volume) { return Call(kSetVolume, {volume}); }
+  int32_t PlayStream(const std::string& app, const std::string& stream_id,
+                     const std::vector<uint8_t>& pcm) {
+    std::vector<uint8_t> p;
+    p.reserve(pcm.size() + app.size() + stream_id.size() + 12);
+    PayloadWriter w(&p);
+    w.Str(app);
+    w.Str(stream_id);
+    w.Bytes(pcm.data(), pcm.size());
+    return Call(kPlayStream, p);
+  }
+  int32_t PlayStop(const std::string& app) {
+    std::vector<uint8_t> p;
+    PayloadWriter(&p).Str(app);
+    return Call(kPlayStop, p);
+  }
+
+  // LocoClient
+  int32_t Damp() { return Loco(kLocoDamp); }
+  int32_t Start() { return Loco(kLocoStart); }
+  int32_t Squat() { return Loco(kLocoSquat); }
+  int32_t Sit() { return Loco(kLocoSit); }
+  int32_t StandUp() { return Loco(kLocoStandUp); }
+  int32_t ZeroTorque() { return Loco(kLocoZeroTorque); }
+  int32_t StopMove() { return Loco(kLocoStopMove); }
+  int32_t HighStand() { return Loco(kLocoHighStand); }
+  int32_t LowStand() { return Loco(kLocoLowStand); }
+  int32_t BalanceStand() { return Loco(kLocoBalanceStand); }
+  int32_t WaveHand() { return Loco(kLocoWaveHand); }
+  int32_t ShakeHand() { return Loco(kLocoShakeHand); }
+  int32_t SetFsmId(int fsm_id) {
+    std::vector<uint8_t> p;
+    PayloadWriter(&p).I32(fsm_id);
+    return Call(kSetFsmId, p);
+  }
+  int32_t GetFsmId(int& fsm_id) {
+    std::vector<uint8_t> out;
+    const int32_t ret = Call(kGetFsmId, {}, &out);
+    PayloadReader reader(out.data(), out.size());
+    const int32_t v = reader.I32();
+    if (ret == 0 && reader.ok()) {
+      fsm_id = v;
+    }
+    return ret;
+  }
+  int32_t SetVelocity(float vx, float vy, float omega, float duration = 1.f) {
+    std::vector<uint8_t> p;
+    PayloadWriter w(&p);
+    w.F32(vx);
+    w.F32(vy);
+    w.F32(omega);
+    w.F32(duration);
+    return Call(kSetVelocity, p);
+  }
+
+  // G1ArmActionClient
+  int32_t ExecuteAction(int32_t action_id) {
+    std::vector<uint8_t> p;
+    PayloadWriter(&p).I32(action_id);
+    return Call(kArmAction, p);
+  }
+  int32_t ExecuteAction(const std::string& action_name) {
+    std::vector<uint8_t> p;
+    PayloadWriter(&p).Str(action_name);
+    return Call(kArmActionName, p);
+  }
+  int32_t StopCustomAction() { return Call(kArmStop, {}); }
+
+ private:
+  int32_t Loco(LocoCommand command) {
+    return Call(kLocoCommand, {static_cast<uint8_t>(command)});
+  }
+
+  void ApplyTimeout() {
+    if (fd_ < 0) {
+      return;
+    }
+    timeval tv{};
+    tv.tv_sec = static_cast<time_t>(timeout_s_);
+    tv.tv_usec =
+        static_cast<suseconds_t>((timeout_s_ - static_cast<float>(tv.tv_sec)) *
+                                 1e6f);
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+
+  bool WriteAll(const uint8_t* data, size_t size) {
+    while (size > 0) {
+      const ssize_t n = send(fd_, data, size, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  bool ReadAll(void* out, size_t size) {
+    uint8_t* p = static_cast<uint8_t*>(out);
+    while (size > 0) {
+      const ssize_t n = recv(fd_, p, size, 0);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      p += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+  float timeout_s_ = 10.f;
+  uint32_t next_id_ = 0;
+  std::vector<uint8_t> send_buffer_;
+  std::vector<uint8_t> receive_buffer_;
+};
+
+}  // namespace g1_daemon
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "robot_client.hpp"
+
+namespace {
+
+void PrintHelp(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [--socket=<path>] <command> [args]\n\n";
+  std::cout << "Sends one command to the robot daemon (g1_robotd).\n\n";
+  std::cout << "Commands:\n";
+  std::cout << "  ping [count]               Round trip to the daemon, prints latency\n";
+  std::cout << "  tts <text> [speaker_id]    TtsMaker\n";
+  std::cout << "  led <r> <g> <b>            LedControl\n";
+  std::cout << "  volume [0-100]             Get or set the volume\n";
+  std::cout << "  loco <name>                damp, start, squat, sit, stand_up,\n";
+  std::cout << "                             zero_torque, stop_move, high_stand,\n";
+  std::cout << "                             low_stand, balance_stand, wave_hand,\n";
+  std::cout << "                             shake_hand\n";
+  std::cout << "  fsm [id]                   Get or set the FSM id\n";
+  std::cout << "  velocity <vx> <vy> <w> [duration]\n";
+  std::cout << "  action <id|name>           Arm action\n";
+  std::cout << "  action_stop                Stop the current arm action\n";
+  std::cout << "\nThe socket defaults to $G1_ROBOTD_SOCKET or "
+            << g1_daemon::kDefaultSocketPath << ".\n";
+}
+
+bool ParseLoco(const std::string& name, g1_daemon::LocoCommand* command) {
+  static const char* const kNames[] = {
+      "damp",      "start",      "squat",     "sit",
+      "stand_up",  "zero_torque", "stop_move", "high_stand",
+      "low_stand", "balance_stand", "wave_hand", "shake_hand"};
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); ++i) {
+    if (name == kNames[i]) {
+      *command = static_cast<g1_daemon::LocoCommand>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string socket_path = g1_daemon::DaemonSocketPath();
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      PrintHelp(argv[0]);
+      return 0;
+    }
+    if (arg.rfind("--socket=", 0) == 0) {
+      socket_path = arg.substr(9);
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.empty()) {
+    PrintHelp(argv[0]);
+    return 1;
+  }
+
+  g1_daemon::RobotDaemonClient client;
+  if (!client.Connect(socket_path)) {
+    return 1;
+  }
+
+  const std::string& command = args[0];
+  const size_t nargs = args.size() - 1;
+  int32_t ret = 0;
+
+  if (command == "ping") {
+    const int count = nargs >= 1 ? std::atoi(args[1].c_str()) : 1;
+    if (count < 1) {
+      std::cerr << "Error: ping count must be at least 1\n";
+      return 1;
+    }
+    double total_us = 0, worst_us = 0;
+    int completed = 0;
+    for (int i = 0; i < count && ret == 0; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      ret = client.Ping();
+      const double us = std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      if (ret != 0) {
+        break;
+      }
+      ++completed;
+      total_us += us;
+      worst_us = std::max(worst_us, us);
+    }
+    std::cout << "Ping ret: " << ret;
+    if (completed > 0) {
+      std::cout << " avg " << total_us / completed << " us, max " << worst_us
+                << " us";
+    }
+    std::cout << " over " << completed << " of " << count << "\n";
+  } else if (command == "tts" && nargs >= 1) {
+    const int32_t speaker = nargs >= 2 ? std::atoi(args[2].c_str()) : 1;
+    ret = client.TtsMaker(args[1], speaker);
+    std::cout << "TtsMaker ret: " << ret << "\n";
+  } else if (command == "led" && nargs >= 3) {
+    ret = client.LedControl(static_cast<uint8_t>(std::atoi(args[1].c_str())),
+                            static_cast<uint8_t>(std::atoi(args[2].c_str())),
+                            static_cast<uint8_t>(std::atoi(args[3].c_str())));
+    std::cout << "LedControl ret: " << ret << "\n";
+  } else if (command == "volume") {
+    if (nargs >= 1) {
+      ret = client.SetVolume(static_cast<uint8_t>(std::atoi(args[1].c_str())));
+      std::cout << "SetVolume ret: " << ret << "\n";
+    } else {
+      uint8_t volume = 0;
+      ret = client.GetVolume(volume);
+      std::cout << "Volume: " << static_cast<int>(volume) << " ret: " << ret
+                << "\n";
+    }
+  } else if (command == "loco" && nargs >= 1) {
+    g1_daemon::LocoCommand loco;
+    if (!ParseLoco(args[1], &loco)) {
+      std::cerr << "Error: Unknown loco command '" << args[1] << "'\n";
+      return 1;
+    }
+    ret = client.Call(g1_daemon::kLocoCommand, {static_cast<uint8_t>(loco)});
+    std::cout << args[1] << " ret: " << ret << "\n";
+  } else if (command == "fsm") {
+    if (nargs >= 1) {
+      ret = client.SetFsmId(std::atoi(args[1].c_str()));
+      std::cout << "SetFsmId(" << args[1] << ") ret: " << ret << "\n";
+    } else {
+      int fsm_id = -1;
+      ret = client.GetFsmId(fsm_id);
+      std::cout << "Current FSM ID: " << fsm_id << " ret: " << ret << "\n";
+    }
+  } else if (command == "velocity" && nargs >= 3) {
+    const float vx = std::strtof(args[1].c_str(), nullptr);
+    const float vy = std::strtof(args[2].c_str(), nullptr);
+    const float omega = std::strtof(args[3].c_str(), nullptr);
+    const float duration =
+        nargs >= 4 ? std::strtof(args[4].c_str(), nullptr) : 1.f;
+    ret = client.SetVelocity(vx, vy, omega, duration);
+    std::cout << "SetVelocity(" << vx << ", " << vy << ", " << omega
+              << ") ret: " << ret << "\n";
+  } else if (command == "action" && nargs >= 1) {
+    const std::string& target = args[1];
+    if (target.find_first_not_of("0123456789") == std::string::npos) {
+      ret = client.ExecuteAction(std::atoi(target.c_str()));
+    } else {
+      ret = client.ExecuteAction(target);
+    }
+    std::cout << "ExecuteAction(" << target << ") ret: " << ret << "\n";
+  } else if (command == "action_stop") {
+    ret = client.StopCustomAction();
+    std::cout << "StopCustomAction ret: " << ret << "\n";
+  } else {
+    std::cerr << "Error: Unknown command or missing arguments: " << command
+              << "\n";
+    std::cerr << "Use --help for usage information.\n";
+    return 1;
+  }
+
+  return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,545 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "robot_backend.hpp"
+#include "robot_client.hpp"
+#include "robot_protocol.hpp"
+
+namespace {
+
+using g1_daemon::MessageHeader;
+using g1_daemon::PayloadReader;
+using g1_daemon::PayloadWriter;
+using g1_daemon::RobotBackend;
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void HandleSignal(int) { g_stop = 1; }
+
+struct Request {
+  uint64_t connection = 0;
+  MessageHeader header;
+  std::vector<uint8_t> payload;
+};
+
+struct Reply {
+  uint64_t connection = 0;
+  std::vector<uint8_t> bytes;
+};
+
+// Runs one request against the backend and builds the response payload.
+std::vector<uint8_t> Dispatch(RobotBackend* backend, const Request& request) {
+  PayloadReader in(request.payload.data(), request.payload.size());
+  std::vector<uint8_t> extra;
+  PayloadWriter out(&extra);
+  int32_t ret = g1_daemon::kErrUnknownOpcode;
+
+  switch (request.header.opcode) {
+    case g1_daemon::kPing:
+      ret = 0;
+      break;
+    case g1_daemon::kTts: {
+      const std::string text = in.Str();
+      const int32_t speaker = in.I32();
+      if (in.ok()) ret = backend->TtsMaker(text, speaker);
+      break;
+    }
+    case g1_daemon::kLed: {
+      const uint8_t r = in.U8(), g = in.U8(), b = in.U8();
+      if (in.ok()) ret = backend->LedControl(r, g, b);
+      break;
+    }
+    case g1_daemon::kGetVolume: {
+      uint8_t volume = 0;
+      ret = backend->GetVolume(volume);
+      out.U8(volume);
+      break;
+    }
+    case g1_daemon::kSetVolume: {
+      const uint8_t volume = in.U8();
+      if (in.ok()) ret = backend->SetVolume(volume);
+      break;
+    }
+    case g1_daemon::kPlayStream: {
+      const std::string app = in.Str();
+      const std::string stream_id = in.Str();
+      const uint8_t* pcm = nullptr;
+      const size_t size = in.Bytes(&pcm);
+      if (in.ok()) {
+        ret = backend->PlayStream(app, stream_id,
+                                  std::vector<uint8_t>(pcm, pcm + size));
+      }
+      break;
+    }
+    case g1_daemon::kPlayStop: {
+      const std::string app = in.Str();
+      if (in.ok()) ret = backend->PlayStop(app);
+      break;
+    }
+    case g1_daemon::kLocoCommand: {
+      const uint8_t command = in.U8();
+      if (in.ok() && command <= g1_daemon::kLocoShakeHand) {
+        ret = backend->Loco(static_cast<g1_daemon::LocoCommand>(command));
+      } else {
+        ret = g1_daemon::kErrBadPayload;
+      }
+      break;
+    }
+    case g1_daemon::kSetFsmId: {
+      const int32_t fsm_id = in.I32();
+      if (in.ok()) ret = backend->SetFsmId(fsm_id);
+      break;
+    }
+    case g1_daemon::kGetFsmId: {
+      int fsm_id = -1;
+      ret = backend->GetFsmId(fsm_id);
+      out.I32(fsm_id);
+      break;
+    }
+    case g1_daemon::kSetVelocity: {
+      const float vx = in.F32(), vy = in.F32(), omega = in.F32();
+      const float duration = in.F32();
+      if (in.ok()) ret = backend->SetVelocity(vx, vy, omega, duration);
+      break;
+    }
+    case g1_daemon::kArmAction: {
+      const int32_t action_id = in.I32();
+      if (in.ok()) ret = backend->ExecuteAction(action_id);
+      break;
+    }
+    case g1_daemon::kArmActionName: {
+      const std::string name = in.Str();
+      if (in.ok()) ret = backend->ExecuteAction(name);
+      break;
+    }
+    case g1_daemon::kArmStop:
+      ret = backend->StopCustomAction();
+      break;
+  }
+  if (!in.ok()) {
+    ret = g1_daemon::kErrBadPayload;
+  }
+
+  std::vector<uint8_t> payload;
+  PayloadWriter(&payload).I32(ret);
+  payload.insert(payload.end(), extra.begin(), extra.end());
+  return payload;
+}
+
+// Queue of replies finished by the workers, plus a pipe that wakes the
+// poll loop when one is added.
+class ReplyQueue {
+ public:
+  ReplyQueue() {
+    if (pipe(wake_) == 0) {
+      fcntl(wake_[0], F_SETFL, O_NONBLOCK);
+      fcntl(wake_[1], F_SETFL, O_NONBLOCK);
+    }
+  }
+  ~ReplyQueue() {
+    close(wake_[0]);
+    close(wake_[1]);
+  }
+
+  void Push(Reply reply) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      replies_.push_back(std::move(reply));
+    }
+    const char byte = 1;
+    (void)!write(wake_[1], &byte, 1);
+  }
+
+  std::deque<Reply> TakeAll() {
+    char drain[64];
+    while (read(wake_[0], drain, sizeof(drain)) > 0) {
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::deque<Reply> out;
+    out.swap(replies_);
+    return out;
+  }
+
+  int wake_fd() const { return wake_[0]; }
+
+ private:
+  int wake_[2] = {-1, -1};
+  std::mutex mutex_;
+  std::deque<Reply> replies_;
+};
+
+// One thread per subsystem: requests to the same SDK client run in order,
+// while a long arm action or TTS call doesn't hold up LED or loco commands.
+class SubsystemWorker {
+ public:
+  SubsystemWorker(RobotBackend* backend, ReplyQueue* replies)
+      : backend_(backend), replies_(replies) {
+    thread_ = std::thread(&SubsystemWorker::Loop, this);
+  }
+
+  // Queued requests are cancelled, not run: on Ctrl+C the robot must not
+  // keep executing loco or arm commands nobody is waiting for. A request
+  // already running is waited for.
+  ~SubsystemWorker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      if (!queue_.empty()) {
+        std::cout << "Cancelled " << queue_.size() << " queued requests"
+                  << std::endl;
+      }
+      queue_.clear();
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  void Submit(Request request) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(request));
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  void Loop() {
+    while (true) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        request = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      Reply reply;
+      reply.connection = request.connection;
+      g1_daemon::EncodeMessage(request.header.opcode, g1_daemon::kFlagResponse,
+                               request.header.request_id,
+                               Dispatch(backend_, request), &reply.bytes);
+      replies_->Push(std::move(reply));
+    }
+  }
+
+  RobotBackend* backend_;
+  ReplyQueue* replies_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> queue_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+struct Connection {
+  int fd = -1;
+  std::vector<uint8_t> in;
+  std::vector<uint8_t> out;
+  // Requests with a subsystem, whose replies are still to come.
+  size_t pending = 0;
+  // The client shut down its side; close once everything is answered.
+  bool read_closed = false;
+};
+
+class RobotDaemon {
+ public:
+  explicit RobotDaemon(RobotBackend* backend)
+      : audio_(backend, &replies_),
+        loco_(backend, &replies_),
+        arm_(backend, &replies_) {}
+
+  ~RobotDaemon() {
+    for (auto& entry : connections_) {
+      close(entry.second.fd);
+    }
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      unlink(path_.c_str());
+    }
+  }
+
+  bool Listen(const std::string& path) {
+    path_ = path;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    // Only a socket nobody answers on is left over from a dead daemon.
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    const bool answered =
+        probe >= 0 &&
+        connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    const bool stale = !answered && errno == ECONNREFUSED;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (answered) {
+      std::cout << "Another robot daemon is listening on " << path
+                << std::endl;
+      return false;
+    }
+    if (stale) {
+      unlink(path.c_str());
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) <
+            0 ||
+        listen(listen_fd_, 16) < 0) {
+      std::cout << "Failed to listen on " << path << " (errno=" << errno
+                << ")" << std::endl;
+      if (listen_fd_ >= 0) {
+        close(listen_fd_);  // not ours to unlink
+        listen_fd_ = -1;
+      }
+      return false;
+    }
+    fcntl(listen_fd_, F_SETFL, O_NONBLOCK);
+    std::cout << "Robot daemon listening on " << path << std::endl;
+    return true;
+  }
+
+  void Run() {
+    std::vector<pollfd> fds;
+    std::vector<uint64_t> ids;
+    while (g_stop == 0) {
+      fds.clear();
+      ids.clear();
+      fds.push_back({listen_fd_, POLLIN, 0});
+      fds.push_back({replies_.wake_fd(), POLLIN, 0});
+      for (const auto& entry : connections_) {
+        const short events =
+            (entry.second.read_closed ? 0 : POLLIN) |
+            (entry.second.out.empty() ? 0 : POLLOUT);
+        if (events == 0) {
+          continue;  // half-closed, waiting for replies
+        }
+        fds.push_back({entry.second.fd, events, 0});
+        ids.push_back(entry.first);
+      }
+      if (poll(fds.data(), fds.size(), 200) <= 0) {
+        continue;
+      }
+      if (fds[0].revents & POLLIN) {
+        Accept();
+      }
+      if (fds[1].revents & POLLIN) {
+        for (Reply& reply : replies_.TakeAll()) {
+          auto it = connections_.find(reply.connection);
+          if (it != connections_.end()) {
+            auto& out = it->second.out;
+            out.insert(out.end(), reply.bytes.begin(), reply.bytes.end());
+            --it->second.pending;
+            Flush(reply.connection);
+            MaybeClose(reply.connection);
+          }
+        }
+      }
+      for (size_t i = 2; i < fds.size(); ++i) {
+        const uint64_t id = ids[i - 2];
+        if (fds[i].revents & POLLOUT) {
+          Flush(id);
+          MaybeClose(id);
+        }
+        auto it = connections_.find(id);
+        if (it != connections_.end() && !it->second.read_closed &&
+            (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+          Receive(id);
+        }
+      }
+    }
+    std::cout << "Robot daemon served " << served_ << " requests" << std::endl;
+  }
+
+ private:
+  void Accept() {
+    while (true) {
+      const int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) {
+        return;
+      }
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      Connection& connection = connections_[++next_connection_];
+      connection.fd = fd;
+    }
+  }
+
+  void Drop(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it != connections_.end()) {
+      close(it->second.fd);
+      connections_.erase(it);
+    }
+  }
+
+  // Closes a half-closed connection once its last reply is sent.
+  void MaybeClose(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it != connections_.end() && it->second.read_closed &&
+        it->second.pending == 0 && it->second.out.empty()) {
+      Drop(id);
+    }
+  }
+
+  void Flush(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) {
+      return;
+    }
+    auto& out = it->second.out;
+    while (!out.empty()) {
+      const ssize_t n = send(it->second.fd, out.data(), out.size(),
+                             MSG_NOSIGNAL);
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+      }
+      if (n <= 0) {
+        Drop(id);
+        return;
+      }
+      out.erase(out.begin(), out.begin() + n);
+    }
+  }
+
+  void Receive(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) {
+      return;
+    }
+    auto& in = it->second.in;
+    uint8_t buffer[64 * 1024];
+    while (true) {
+      const ssize_t n = recv(it->second.fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        in.insert(in.end(), buffer, buffer + n);
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (n == 0) {
+        // EOF after shutdown(SHUT_WR): still answer what was sent.
+        it->second.read_closed = true;
+        break;
+      }
+      Drop(id);
+      return;
+    }
+
+    size_t pos = 0;
+    while (in.size() - pos >= sizeof(MessageHeader)) {
+      MessageHeader header;
+      std::memcpy(&header, in.data() + pos, sizeof(header));
+      if (header.magic != g1_daemon::kProtocolMagic ||
+          header.length > g1_daemon::kMaxPayload) {
+        std::cout << "Dropping client: bad message header" << std::endl;
+        Drop(id);
+        return;
+      }
+      if (in.size() - pos - sizeof(header) < header.length) {
+        break;
+      }
+      Request request;
+      request.connection = id;
+      request.header = header;
+      const uint8_t* body = in.data() + pos + sizeof(header);
+      request.payload.assign(body, body + header.length);
+      pos += sizeof(header) + header.length;
+      Route(std::move(request));
+    }
+    in.erase(in.begin(), in.begin() + pos);
+    if (it->second.read_closed) {
+      in.clear();  // a partial request can't complete now
+      Flush(id);
+      MaybeClose(id);
+    }
+  }
+
+  // Ping is answered inline; everything else goes to its subsystem.
+  void Route(Request request) {
+    ++served_;
+    const uint16_t group = request.header.opcode / 10;
+    if (group >= 1 && group <= 3) {
+      ++connections_[request.connection].pending;
+    }
+    if (group == 1) {
+      audio_.Submit(std::move(request));
+    } else if (group == 2) {
+      loco_.Submit(std::move(request));
+    } else if (group == 3) {
+      arm_.Submit(std::move(request));
+    } else {
+      Reply reply;
+      reply.connection = request.connection;
+      g1_daemon::EncodeMessage(request.header.opcode, g1_daemon::kFlagResponse,
+                               request.header.request_id,
+                               Dispatch(nullptr, request), &reply.bytes);
+      // Sent by the poll loop once the socket is writable; flushing here
+      // could drop the connection under Receive().
+      auto& out = connections_[request.connection].out;
+      out.insert(out.end(), reply.bytes.begin(), reply.bytes.end());
+    }
+  }
+
+  ReplyQueue replies_;
+  SubsystemWorker audio_;
+  SubsystemWorker loco_;
+  SubsystemWorker arm_;
+  std::string path_;
+  int listen_fd_ = -1;
+  std::map<uint64_t, Connection> connections_;
+  uint64_t next_connection_ = 0;
+  uint64_t served_ = 0;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0]
+              << " <network_interface|TEST> [socket_path]\n"
+              << "  socket_path defaults to $G1_ROBOTD_SOCKET or "
+              << g1_daemon::kDefaultSocketPath << "\n";
+    return 1;
+  }
+
+  const std::string network_interface = argv[1];
+  const std::string socket_path =
+      argc > 2 ? argv[2] : g1_daemon::DaemonSocketPath();
+
+  std::signal(SIGINT, HandleSignal);
+  std::signal(SIGTERM, HandleSignal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::unique_ptr<RobotBackend> backend;
+  if (network_interface == "TEST") {
+    backend = std::make_unique<g1_daemon::MockRobotBackend>();
+  } else {
+    backend = std::make_unique<g1_daemon::UnitreeRobotBackend>(network_interface);
+  }
+
+  RobotDaemon daemon(backend.get());
+  if (!daemon.Listen(socket_path)) {
+    return 1;
+  }
+  daemon.Run();
+  return 0;
+}
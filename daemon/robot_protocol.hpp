@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace g1_daemon {
+
+// Wire format spoken over the daemon's Unix stream socket. Every message,
+// in both directions, is a fixed 16 byte header followed by `length` bytes
+// of payload. Integers and floats are host byte order (both ends run on the
+// same machine).
+//
+//   u32 magic | u16 opcode | u16 flags | u32 request_id | u32 length
+//
+// A response echoes the request's opcode and id with kFlagResponse set; its
+// payload starts with the i32 SDK return code, followed by any results.
+// Requests on one connection may be answered out of order.
+constexpr uint32_t kProtocolMagic = 0x44523147;  // "G1RD"
+constexpr uint32_t kMaxPayload = 4u << 20;
+constexpr uint16_t kFlagResponse = 0x1;
+
+constexpr const char* kDefaultSocketPath = "/tmp/g1_robotd.sock";
+
+// Daemon-side error codes, kept clear of the SDK's own return values.
+constexpr int32_t kErrUnknownOpcode = -9001;
+constexpr int32_t kErrBadPayload = -9002;
+constexpr int32_t kErrDisconnected = -9003;
+
+#pragma pack(push, 1)
+struct MessageHeader {
+  uint32_t magic = kProtocolMagic;
+  uint16_t opcode = 0;
+  uint16_t flags = 0;
+  uint32_t request_id = 0;
+  uint32_t length = 0;
+};
+#pragma pack(pop)
+static_assert(sizeof(MessageHeader) == 16, "header must stay 16 bytes");
+
+enum Opcode : uint16_t {
+  kPing = 1,
+
+  // AudioClient
+  kTts = 10,          // str text, i32 speaker_id
+  kLed = 11,          // u8 r, u8 g, u8 b
+  kGetVolume = 12,    // -> u8 volume
+  kSetVolume = 13,    // u8 volume
+  kPlayStream = 14,   // str app, str stream_id, bytes pcm
+  kPlayStop = 15,     // str app
+
+  // LocoClient
+  kLocoCommand = 20,  // u8 LocoCommand
+  kSetFsmId = 21,     // i32 fsm_id
+  kGetFsmId = 22,     // -> i32 fsm_id
+  kSetVelocity = 23,  // f32 vx, f32 vy, f32 omega, f32 duration
+
+  // G1ArmActionClient
+  kArmAction = 30,      // i32 action_id
+  kArmActionName = 31,  // str action_name
+  kArmStop = 32,
+};
+
+// Argument-less LocoClient calls, multiplexed on kLocoCommand.
+enum LocoCommand : uint8_t {
+  kLocoDamp = 0,
+  kLocoStart,
+  kLocoSquat,
+  kLocoSit,
+  kLocoStandUp,
+  kLocoZeroTorque,
+  kLocoStopMove,
+  kLocoHighStand,
+  kLocoLowStand,
+  kLocoBalanceStand,
+  kLocoWaveHand,
+  kLocoShakeHand,
+};
+
+// Appends fields to a payload.
+class PayloadWriter {
+ public:
+  explicit PayloadWriter(std::vector<uint8_t>* out) : out_(out) {}
+
+  void U8(uint8_t v) { Raw(&v, sizeof(v)); }
+  void I32(int32_t v) { Raw(&v, sizeof(v)); }
+  void F32(float v) { Raw(&v, sizeof(v)); }
+  void Str(const std::string& s) { Bytes(s.data(), s.size()); }
+  void Bytes(const void* data, size_t size) {
+    const uint32_t n = static_cast<uint32_t>(size);
+    Raw(&n, sizeof(n));
+    Raw(data, size);
+  }
+
+ private:
+  void Raw(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    out_->insert(out_->end(), p, p + size);
+  }
+
+  std::vector<uint8_t>* out_;
+};
+
+// Reads fields back; any read past the end latches ok() to false.
+class PayloadReader {
+ public:
+  PayloadReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint8_t U8() { return Pod<uint8_t>(); }
+  int32_t I32() { return Pod<int32_t>(); }
+  float F32() { return Pod<float>(); }
+  std::string Str() {
+    const uint8_t* p = nullptr;
+    const size_t n = Bytes(&p);
+    return std::string(reinterpret_cast<const char*>(p), n);
+  }
+  // Points `*data` into the payload (no copy) and returns the length.
+  size_t Bytes(const uint8_t** data) {
+    const uint32_t n = Pod<uint32_t>();
+    if (!ok_ || size_ - pos_ < n) {
+      ok_ = false;
+      *data = data_;
+      return 0;
+    }
+    *data = data_ + pos_;
+    pos_ += n;
+    return n;
+  }
+
+  bool ok() const { return ok_; }
+
+ private:
+  template <typename T>
+  T Pod() {
+    T v{};
+    if (!ok_ || size_ - pos_ < sizeof(T)) {
+      ok_ = false;
+      return v;
+    }
+    std::memcpy(&v, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return v;
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+// Serialises header + payload into one buffer ready for send().
+inline void EncodeMessage(uint16_t opcode, uint16_t flags, uint32_t request_id,
+                          const std::vector<uint8_t>& payload,
+                          std::vector<uint8_t>* out) {
+  MessageHeader header;
+  header.opcode = opcode;
+  header.flags = flags;
+  header.request_id = request_id;
+  header.length = static_cast<uint32_t>(payload.size());
+  const uint8_t* h = reinterpret_cast<const uint8_t*>(&header);
+  out->insert(out->end(), h, h + sizeof(header));
+  out->insert(out->end(), payload.begin(), payload.end());
+}
+
+}  // namespace g1_daemon
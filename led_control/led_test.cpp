@@ -1,63 +1,146 @@
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include <unitree/common/time/time_tool.hpp>
 #include <unitree/robot/channel/channel_factory.hpp>
 #include <unitree/robot/g1/audio/g1_audio_client.hpp>
 
-int main(int argc, char const* argv[]) {
-  if (argc < 2) {
-    std::cout << "Usage: g1_audio_led_test [NetWorkInterface(eth0)]"
-              << std::endl;
-    return 1;
-  }
+#include "led_animation.hpp"
+#include "led_scheduler.hpp"
+#include "robot_client.hpp"
 
-  unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
+namespace {
 
-  unitree::robot::g1::AudioClient client;
-  client.Init();
-  client.SetTimeout(10.0f);
+using g1_common::LedColor;
+
+const LedColor kOff{0, 0, 0};
+const LedColor kRed{255, 0, 0};
+const LedColor kGreen{0, 255, 0};
+const LedColor kBlue{0, 0, 255};
+const LedColor kWhite{255, 255, 255};
 
-  std::cout << "LED test: red -> green -> blue -> white -> off" << std::endl;
+// red -> green -> blue -> white -> off (1 s each), then ~6.4 s fade-ins of
+// blue, green and red from black.
+g1_common::CompiledLedAnimation DemoAnimation() {
+  return g1_common::LedTimeline(kOff)
+      .Set(kRed, 1000)
+      .Set(kGreen, 1000)
+      .Set(kBlue, 1000)
+      .Set(kWhite, 1000)
+      .Set(kOff, 200)
+      .FadeTo(kBlue, 6400)
+      .Set(kOff, 0)
+      .FadeTo(kGreen, 6400)
+      .Set(kOff, 0)
+      .FadeTo(kRed, 6400)
+      .Set(kOff, 200)
+      .Compile();
+}
 
-  int32_t ret = client.LedControl(255, 0, 0);
-  std::cout << "LedControl red ret: " << ret << std::endl;
-  unitree::common::Sleep(1);
+// Runs the demo plus a layering check on simulated time and prints what
+// would have been sent.
+int RunTest() {
+  g1_common::RecordingLedSink sink;
+  g1_common::LedAnimationEngine engine(&sink);
+  const auto demo = DemoAnimation();
+  engine.Play(g1_common::kLedLayerIdle, demo);
 
-  ret = client.LedControl(0, 255, 0);
-  std::cout << "LedControl green ret: " << ret << std::endl;
-  unitree::common::Sleep(1);
+  uint32_t t = 0;
+  for (; t <= demo.duration_ms(); t += engine.tick_ms()) {
+    engine.Tick(t);
+  }
+  const size_t demo_frames = sink.frames().size();
+  std::cout << "Demo: " << demo.frames() << " table frames over "
+            << demo.duration_ms() << " ms -> " << demo_frames
+            << " distinct frames" << std::endl;
+
+  // Listening pulse, interrupted by an error blink, then speaking with a
+  // synthetic envelope.
+  engine.Play(g1_common::kLedLayerListening,
+              g1_common::LedPulse(kBlue, 1000));
+  engine.Play(g1_common::kLedLayerError,
+              g1_common::LedBlink(kRed, 100, 100, 3));
+  const uint32_t phase_start = t;
+  for (; t < phase_start + 3000; t += engine.tick_ms()) {
+    if (t == phase_start + 1500) {
+      engine.Play(g1_common::kLedLayerSpeaking,
+                  g1_common::LedPaletteCycle({kRed, kGreen, kBlue}, 500, 0.2f));
+    }
+    engine.SetEnvelope((t / 100) % 2 == 0 ? 1.f : 0.f);
+    engine.Tick(t);
+  }
+  const auto frames = sink.frames();
+  for (size_t i = demo_frames; i < frames.size(); i += 10) {
+    const auto& f = frames[i];
+    std::cout << "  t=" << f.time_ms << " [" << static_cast<int>(f.color.r)
+              << "," << static_cast<int>(f.color.g) << ","
+              << static_cast<int>(f.color.b) << "]" << std::endl;
+  }
+  const bool error_done = !engine.active(g1_common::kLedLayerError);
+  std::cout << "Total frames: " << frames.size()
+            << ", error layer finished: " << (error_done ? "yes" : "no")
+            << std::endl;
+  return error_done ? 0 : 1;
+}
 
-  ret = client.LedControl(0, 0, 255);
-  std::cout << "LedControl blue ret: " << ret << std::endl;
-  unitree::common::Sleep(1);
+// Plays the demo on the robot's LED. Templated so it runs on AudioClient
+// or through g1_robotd.
+template <typename Client>
+int RunDemo(Client* client) {
+  // Frames are rendered from a precomputed table; the scheduler sends at
+  // a capped rate and drops frames that wouldn't visibly change the LED.
+  g1_common::LedScheduler leds([client](uint8_t r, uint8_t g, uint8_t b) {
+    return client->LedControl(r, g, b);
+  });
+  g1_common::SchedulerLedSink sink(&leds);
+  g1_common::LedAnimationEngine engine(&sink);
 
-  ret = client.LedControl(255, 255, 255);
-  std::cout << "LedControl white ret: " << ret << std::endl;
-  unitree::common::Sleep(1);
+  const auto demo = DemoAnimation();
+  std::cout << "LED test: red -> green -> blue -> white -> off, then fades"
+            << std::endl;
+  engine.Play(g1_common::kLedLayerIdle, demo);
+  engine.Start();
+  unitree::common::MilliSleep(demo.duration_ms() + 100);
+  engine.Stop();
 
-  ret = client.LedControl(0, 0, 0);
+  leds.SetTarget(kOff);
+  leds.Flush();
+  const int32_t ret = leds.last_ret();
   std::cout << "LedControl off ret: " << ret << std::endl;
+  leds.PrintStats();
+  return ret == 0 ? 0 : 1;
+}
 
-  int R = 0, G = 0, B = 0;
+}  // namespace
 
-  for (;B<255;B+=2) {
-      std::cout << "LedControl Fade In Blue[" << R << "," << G << "," << B << "] " << ret << std::endl;
-      ret = client.LedControl(R, G, B);
-      unitree::common::MilliSleep(50);
+int main(int argc, char const* argv[]) {
+  if (argc < 2) {
+    std::cout
+        << "Usage: g1_audio_led_test [NetWorkInterface(eth0)|robotd|TEST]"
+        << std::endl;
+    return 1;
   }
-  B = 0;
-  for (;G<255;G+=2) {
-      std::cout << "LedControl Fade In Green[" << R << "," << G << "," << B << "] " << ret << std::endl;
-      ret = client.LedControl(R, G, B);
-      unitree::common::MilliSleep(50);
+
+  if (std::string(argv[1]) == "TEST") {
+    return RunTest();
   }
-  G = 0;
-  for (;R<255;R+=2) {
-      std::cout << "LedControl Fade In Red[" << R << "," << G << "," << B << "] " << ret << std::endl;
-      ret = client.LedControl(R, G, B);
-      unitree::common::MilliSleep(50);
+
+  if (std::string(argv[1]) == "robotd") {
+    g1_daemon::RobotDaemonClient client;
+    client.Init();
+    if (!client.connected()) {
+      return 1;
+    }
+    client.SetTimeout(10.0f);
+    return RunDemo(&client);
   }
 
-  ret = client.LedControl(0, 0, 0);
-  return ret == 0 ? 0 : 1;
+  unitree::robot::ChannelFactory::Instance()->Init(0, argv[1]);
+
+  unitree::robot::g1::AudioClient client;
+  client.Init();
+  client.SetTimeout(10.0f);
+  return RunDemo(&client);
 }